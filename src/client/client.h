@@ -1,6 +1,8 @@
 #include <filesystem>
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <functional>
 
 #define SUCCESS 0
 #define INTERNAL_ERROR 1
@@ -14,21 +16,91 @@ std::string interactive_commands();
 // DAEMON API
 #define SESSION_DIR(session_id) (std::filesystem::path("daemons") / std::to_string(session_id))
 #define LOGS_FILE(session_id) (SESSION_DIR(session_id) / "logs")
-#define CMD_FILE(session_id) (SESSION_DIR(session_id) / "cmd")
-#define ERR_FILE(session_id) (SESSION_DIR(session_id) / "err")
+#define SOCKET_FILE(session_id) (SESSION_DIR(session_id) / "sock")
+#define CLIENT_DIR (std::filesystem::path(get_home_dir()) / ".distft")
+#define JOURNAL_DIR (CLIENT_DIR / "journals")
+#define CACHE_DIR (CLIENT_DIR / "cache")
+
+// max number of messages queued for the daemon's (asynchronous) log file writer
+#define DAEMON_LOG_QUEUE_SIZE 8192
+
+
+// clients talk to a daemon over its unix domain socket with length-prefixed binary frames
+// (see daemon.cpp for the layout); results and progress events carry the id of their request
+#define FRAME_HEADER_SIZE 9
+#define FRAME_MAX_SIZE (64 << 20)
+#define DAEMON_CONNECT_TIMEOUT 60
+#define PROGRESS_INTERVAL_MS 1000
+#define PROGRESS_PAYLOAD_SIZE 52
+#define DAEMON_MAX_FDS 64
+enum FRAME {
+  REQUEST_FRAME = 0,
+  RESULT_FRAME = 1,
+  PROGRESS_FRAME = 2,
+};
+struct daemon_progress {
+  uint32_t id;
+  uint64_t chunks_done;
+  uint64_t chunks_total;
+  uint64_t bytes_done;
+  uint64_t bytes_total;
+  uint64_t bytes_per_second;
+  uint32_t in_flight;
+  uint64_t retries;
+};
+struct daemon_request {
+  uint32_t id;
+  char cmd;
+  std::vector<std::string> args;
+
+  // sends a progress event for the request to the client (set by the daemon while the request is handled)
+  std::function<void(daemon_progress&)> progress;
+
+  // open files of the client passed along with the request (closed once the request was answered)
+  std::vector<int> fds;
+};
+struct daemon_result {
+  uint32_t id;
+  char err;
+  std::string err_msg;
+  std::string succ_msg;
+};
+
+// leading client flags of list/store/load commands (--detach, --progress, and --json)
+struct client_flags {
+  bool detach;
+  bool progress;
+  bool json;
+};
+
+// options of commands sent to a daemon (the client flags and the open files passed along with the request)
+struct send_options {
+  client_flags flags = {false, false, false};
+  std::vector<int> fds;
+};
 
 void setup_daemon();
-void run_founder_session_daemon(int startup_client_id, std::vector<std::string> endpoints);
-void run_transient_session_daemon(int startup_client_id, std::string remote_endpoint, std::string local_endpoint);
-bool read_cmd(int& client_id, char& cmd, char& argc, std::vector<std::string>& args);
-bool write_err(int client_id, char err, std::string err_msg, std::string succ_msg);
-bool write_cmd(int session_id, char cmd, char argc, std::vector<std::string> args);
-bool read_err(int session_id, char& err, std::string& err_msg, std::string& succ_msg);
+void run_founder_session_daemon(std::vector<std::string> endpoints);
+void run_transient_session_daemon(std::vector<std::string> remote_endpoints, std::string local_endpoint);
+int listen_daemon_socket(std::string path);
+void serve_daemon_socket(int listen_fd, std::function<bool(daemon_request&, daemon_result&)> handler);
+int connect_daemon_socket(std::string path, int timeout_seconds);
+bool serve_metrics_socket(std::string path);
+bool write_request(int fd, daemon_request& request);
+bool read_result(int fd, daemon_result& result, std::function<void(daemon_progress&)> on_progress = NULL);
+bool send_cmd(int session_id, char cmd, std::vector<std::string> args, char& err, std::string& err_msg, std::string& succ_msg, send_options options = {});
+bool open_cmd_files(char cmd, std::vector<std::string>& args, std::vector<int>& fds_buffer, std::string& err_buffer);
+void print_json_result(char err, std::string err_msg, std::string succ_msg);
 bool setup_client();
 bool add_daemon_files(int session_id);
 void remove_daemon_files(int session_id);
 std::string get_home_dir();
 std::string daemon_commands();
+bool parse_erasure_arg(std::string arg, unsigned int& k, unsigned int& m);
+bool parse_range_arg(std::string arg, uint64_t& offset, uint64_t& length);
+bool parse_sample_rate_arg(std::string arg, double& rate);
+std::string caller_path(std::string path);
+bool parse_client_flags(std::vector<std::string>& args, client_flags& flags);
 
 // CMD API
 enum CMD {
@@ -38,6 +110,25 @@ enum CMD {
   LIST = 3,
   STORE = 4,
   LOAD = 5,
+  JOBS = 6,
+  JOB = 7,
+  CANCEL = 8,
+  STATS = 9,
+  TRACE = 10,
+};
+
+class Transfer;
+
+// options of store commands (erasure_k > 0 stores erasure coded stripes, and fds are the open files to store, if given)
+struct store_options {
+  unsigned int erasure_k = 0;
+  unsigned int erasure_m = 0;
+  std::vector<int> fds;
+};
+
+// options of load commands (output_fd is the open output file, if given)
+struct load_options {
+  int output_fd = -1;
 };
 
 class CommandControl {
@@ -52,16 +143,25 @@ public:
 
   // command result management
   std::string get_cmd_err();
+  void set_cmd_err(std::string err);
   std::string get_cmd_out();
   void clear_cmd();
 
+  // transfer that store/load commands on the calling thread run as (for cancellation and fair sharing)
+  void set_cmd_transfer(Transfer* transfer);
+
   // command execution
   bool bootstrap_cmd(std::vector<std::string> endpoints);
-  bool start_background_strain_reliever_cmd();
-  bool join_cmd(std::string my_endpoint, std::string ext_endpoint);
+  bool join_cmd(std::string my_endpoint, std::vector<std::string> seed_endpoints);
   void exit_cmd();
   bool list_cmd();
-  bool store_cmd(std::vector<std::string> files);
-  bool load_cmd(std::vector<std::string> input_files, std::string output_file);
+  bool list_page_cmd(std::string cursor);
+  bool store_cmd(std::vector<std::string> files, store_options options = {});
+  bool load_cmd(std::vector<std::string> input_files, std::string output_file, load_options options = {});
+  bool load_split_cmd(std::vector<std::string> input_files, std::string output_dir);
+  bool load_range_cmd(std::string input_file, uint64_t offset, uint64_t length, std::string output_file, load_options options = {});
+  bool stats_cmd(bool prometheus);
+  bool trace_cmd();
+  bool trace_cmd(double sample_rate);
 
 };
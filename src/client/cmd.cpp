@@ -2,36 +2,70 @@
 #include "src/client/file.h"
 
 #include "src/dht/session.h"
+#include "src/dht/trace.h"
 #include "src/utils/utils.h"
+#include "src/utils/metrics.h"
+#include "src/utils/executor.h"
 
 #include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
 
 // client state: defines the internal data for the current running client
+// commands may run concurrently (e.g., as daemon jobs), so every thread has its own command result
 struct CommandControl::client_state_data {
+  struct cmd_output {
+    std::string err;
+    std::string out;
+    Transfer* transfer;
+  };
+
   bool dying;
   std::vector<std::string> endpoints;
   std::vector<Session*> sessions;
-  std::vector<std::thread*> background_threads;
-  std::string cmd_err;
-  std::string cmd_out;
+  std::mutex outputs_lock;
+  std::unordered_map<std::thread::id, cmd_output> outputs;
+  std::mutex index_lock;
   session_metadata* meta;
+  IndexCache* index_cache;
+  ChunkCache* chunk_cache;
+
+  // the calling thread's command result (references stay valid until the entry is cleared)
+  cmd_output& output() {
+    std::lock_guard<std::mutex> guard(this->outputs_lock);
+    auto it = this->outputs.find(std::this_thread::get_id());
+    if (it == this->outputs.end()) {
+      it = this->outputs.insert({std::this_thread::get_id(), cmd_output{"", "", NULL}}).first;
+    }
+    return it->second;
+  }
 };
 
 CommandControl::CommandControl() {
   this->data = new CommandControl::client_state_data;
+  this->data->index_cache = new IndexCache(std::chrono::seconds(INDEX_CACHE_TTL));
+  this->data->chunk_cache = new ChunkCache(CACHE_DIR.string(), CHUNK_CACHE_CAPACITY);
 }
 CommandControl::~CommandControl() {
+  delete this->data->index_cache;
+  delete this->data->chunk_cache;
   delete this->data;
 }
 std::string CommandControl::get_cmd_err() {
-  return this->data->cmd_err;
+  return this->data->output().err;
+}
+void CommandControl::set_cmd_err(std::string err) {
+  this->data->output().err = err;
 }
 std::string CommandControl::get_cmd_out() {
-  return this->data->cmd_out;
+  return this->data->output().out;
 }
 void CommandControl::clear_cmd() {
-  this->data->cmd_err.clear();
-  this->data->cmd_out.clear();
+  std::lock_guard<std::mutex> guard(this->data->outputs_lock);
+  this->data->outputs.erase(std::this_thread::get_id());
+}
+void CommandControl::set_cmd_transfer(Transfer* transfer) {
+  this->data->output().transfer = transfer;
 }
 
 // bootstrap a new cluster of sessions from at least 2 endpoints
@@ -39,65 +73,53 @@ bool CommandControl::bootstrap_cmd(std::vector<std::string> endpoints) {
   this->data->dying = false;
   this->data->endpoints = endpoints;
   this->data->meta = new session_metadata;
-  std::vector<std::thread> threads;
 
-  // startup sessions
+  // startup sessions in parallel with their routers seeded with every other session (the founder knows all keys,
+  // so no session needs to ping or look up its peers)
+  std::vector<Peer> peers;
+  for (std::string& endpoint : endpoints) {
+    peers.push_back(Peer(random_key(), endpoint));
+  }
+  TaskGroup startups;
   for (int i = 0; i < this->data->endpoints.size(); i++) {
     Session* s = new Session;
     this->data->sessions.push_back(s);
-    threads.push_back(std::thread([this](Session* s, std::string my_ep, std::string other_ep) {
-      s->startup(this->data->meta, my_ep, other_ep);
-    }, s, endpoints[i], endpoints[(i + 1) % endpoints.size()]));
-  }
-  while (threads.size() > 0) {
-    threads.back().join();
-    threads.pop_back();
+    startups.run([this, &peers, s, i]() {
+      std::vector<Peer> seed_peers(peers);
+      seed_peers.erase(seed_peers.begin() + i);
+      startup_options options;
+      options.seed_peers = seed_peers;
+      options.self_key = peers[i].key;
+      s->startup(this->data->meta, peers[i].endpoint, options);
+      s->set_cache(this->data->chunk_cache);
+    });
   }
+  startups.wait();
 
   // init index file
   if (!init_index_file(this->data->sessions[std::rand() % this->data->sessions.size()])) {
     this->exit_cmd();
-    this->data->cmd_err = "Failed to initialize session index file";
+    this->data->output().err = "Failed to initialize session index file";
     return false;
   }
-  this->data->cmd_out = "Initialized sessions and index file for new cluster.";
+  this->data->output().out = "Initialized sessions and index file for new cluster.";
   return true;
 }
 
-// add a session strain reliever background thread
-bool CommandControl::start_background_strain_reliever_cmd() {
-  this->data->meta->dead_peers_thresh = 15;
-  const unsigned int max_dummy_chunks = 10;
-  auto strain_checker = [this]() {
-    while (true) {
-      std::unique_lock<std::mutex> uq_meta_lock(this->data->meta->meta_lock);
-      while (!this->data->dying && this->data->meta->dead_peers >= this->data->meta->dead_peers_thresh) {
-        this->data->meta->dead_cv.wait(uq_meta_lock);
-      }
-      this->data->meta->dead_peers = 0;
-      uq_meta_lock.unlock();
-      if (this->data->dying) {
-        return;
-      }
-      for (int i = 0; i < std::rand() % max_dummy_chunks; i++) {
-        this->data->sessions[std::rand() % this->data->sessions.size()]->set(random_key(), new std::vector<char>(), false);
-      }
-    }
-  };
-
-  // start background strain management thread
-  this->data->background_threads.push_back(new std::thread(strain_checker));
-  return true;
-}
-
-// join an existing session cluster
-bool CommandControl::join_cmd(std::string my_endpoint, std::string ext_endpoint) {
-  this->data->endpoints.push_back(my_endpoint);
+// join an existing session cluster (through the first of the seed endpoints that answers)
+bool CommandControl::join_cmd(std::string my_endpoint, std::vector<std::string> seed_endpoints) {
   this->data->meta = new session_metadata;
   Session* s = new Session;
+  if (!s->startup(this->data->meta, my_endpoint, startup_options{seed_endpoints})) {
+    s->teardown(false);
+    delete s;
+    this->data->output().err = "Failed to reach any of the seed endpoints";
+    return false;
+  }
+  this->data->endpoints.push_back(my_endpoint);
   this->data->sessions.push_back(s);
-  s->startup(this->data->meta, my_endpoint, ext_endpoint);
-  this->data->cmd_out = "Joined external session successfully.";
+  s->set_cache(this->data->chunk_cache);
+  this->data->output().out = "Joined external session successfully.";
   return true;
 }
 
@@ -105,85 +127,282 @@ bool CommandControl::join_cmd(std::string my_endpoint, std::string ext_endpoint)
 bool CommandControl::list_cmd() {
   std::vector<std::string> index_files;
   if (!get_index_files(this->data->sessions[std::rand() % this->data->sessions.size()], index_files)) {
-    this->data->cmd_err = "Failed to access index file";
+    this->data->output().err = "Failed to access index file";
     return false;
   }
-  this->data->cmd_out.append(std::string("INDEX\n"));
+  this->data->output().out.append(std::string("INDEX\n"));
   for (std::string file : index_files) {
-    this->data->cmd_out.append(file);
-    this->data->cmd_out.push_back('\n');
+    this->data->output().out.append(file);
+    this->data->output().out.push_back('\n');
   }
   return true;
 }
 
+// add a single page of files in the session (starting at the cursor) to the state's cmd output
+bool CommandControl::list_page_cmd(std::string cursor) {
+  std::vector<std::string> index_files;
+  std::string next_cursor;
+  if (!get_index_page(this->data->sessions[std::rand() % this->data->sessions.size()], cursor, index_files, next_cursor)) {
+    this->data->output().err = "Failed to access index file page " + cursor;
+    return false;
+  }
+  this->data->output().out.append(std::string("INDEX\n"));
+  for (std::string file : index_files) {
+    this->data->output().out.append(file);
+    this->data->output().out.push_back('\n');
+  }
+  if (!next_cursor.empty()) {
+    this->data->output().out.append("NEXT PAGE: " + next_cursor + "\n");
+  }
+  return true;
+}
+
+// local journal of a (resumable) store/load operation
+// journals live outside of the daemon directories so that a restarted daemon picks them up again
+static std::string journal_path(std::string operation) {
+  return (JOURNAL_DIR / full_hex_string(key_from_string(operation))).string();
+}
+
 // store all files in the session
-bool CommandControl::store_cmd(std::vector<std::string> files) {
-  std::vector<std::string> added_files;
+// files are fully replicated unless erasure_k > 0, in which case they are stored as k + m erasure coded stripes
+// files[i] is read from fds[i] if given (e.g., files opened by the client), and opened by path otherwise
+bool CommandControl::store_cmd(std::vector<std::string> files, store_options options) {
+  std::vector<int>& fds = options.fds;
+  unsigned int erasure_k = options.erasure_k;
+  unsigned int erasure_m = options.erasure_m;
+  if (!fds.empty() && fds.size() != files.size()) {
+    this->data->output().err = "Expected one open file per stored file";
+    return false;
+  }
+  // check all of the files against the (cached) index at once
+  std::vector<std::string> dht_filenames;
   for (std::string file : files) {
-    std::filesystem::path file_path(file);
-    std::string dht_filename = file_path.filename().string();
+    dht_filenames.push_back(std::filesystem::path(file).filename().string());
+  }
+  std::unordered_set<std::string> existing_files;
+  if (!files_exist(this->data->sessions[std::rand() % this->data->sessions.size()], dht_filenames, existing_files, this->data->index_cache)) {
+    this->data->output().err = "Failed to access index file";
+    return false;
+  }
+
+  Transfer* transfer = this->data->output().transfer;
+  std::vector<std::string> added_files;
+  std::vector<Journal*> journals;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (transfer != NULL && transfer->cancelled()) {
+      this->data->output().err += "Store cancelled before file " + files[i] + ". ";
+      break;
+    }
+    std::string file = files[i];
+    std::string dht_filename = dht_filenames[i];
     if (std::find(added_files.begin(), added_files.end(), dht_filename) != added_files.end()
-        || file_exists(this->data->sessions[std::rand() % this->data->sessions.size()], dht_filename)) {
-      this->data->cmd_err += "File" + file + " already exists in the current session. Skipping.";
+        || existing_files.count(dht_filename) > 0) {
+      this->data->output().err += "File" + file + " already exists in the current session. Skipping.";
       continue;
     }
-    if (!write_from_file(this->data->sessions[std::rand() % this->data->sessions.size()], file, dht_filename)) {
-      this->data->cmd_err += "File " +  file + " does not exist or read failed. Skipping.";
+    Session* s = this->data->sessions[std::rand() % this->data->sessions.size()];
+    std::error_code ec;
+    Journal* journal = new Journal(journal_path("store:" + std::filesystem::absolute(file, ec).string() + ":" + dht_filename
+                                                + ":" + std::to_string(erasure_k) + ":" + std::to_string(erasure_m)));
+    transfer_options file_options{journal, transfer, fds.empty() ? -1 : fds[i]};
+    bool written = erasure_k > 0 ? write_from_file_erasure(s, file, dht_filename, erasure_k, erasure_m, file_options)
+                                 : write_from_file(s, file, dht_filename, file_options);
+    if (!written) {
+      delete journal;
+      this->data->output().err += "File " +  file + " does not exist or could not be stored. Skipping.";
       continue;
     }
     added_files.push_back(dht_filename);
+    journals.push_back(journal);
   }
-  if (!add_files_to_index_file(this->data->sessions[std::rand() % this->data->sessions.size()], added_files)) {
-    this->data->cmd_err += "Failed to write to index file.";
+
+  // the journals are kept (and the stores can be resumed) until the files are in the index
+  // (concurrent stores update the index one at a time)
+  std::unique_lock<std::mutex> uq_index_lock(this->data->index_lock);
+  bool indexed = add_files_to_index_file(this->data->sessions[std::rand() % this->data->sessions.size()], added_files, this->data->index_cache);
+  uq_index_lock.unlock();
+  for (Journal* journal : journals) {
+    if (indexed) {
+      journal->finish();
+    }
+    delete journal;
+  }
+  if (!indexed) {
+    this->data->output().err += "Failed to write to index file.";
     return false;
   }
-  this->data->cmd_out = "Successfully stored the following files\n";
+  this->data->output().out = "Successfully stored the following files\n";
   for (std::string file : added_files) {
-    this->data->cmd_out += file;
-    this->data->cmd_out.push_back('\n');
+    this->data->output().out += file;
+    this->data->output().out.push_back('\n');
   }
   return true;
 }
 
 // load (and concatenate) all files to a local output file
-bool CommandControl::load_cmd(std::vector<std::string> input_files, std::string output_file) {
-  std::vector<char>* buffer;
-  if (!read_in_files(this->data->sessions[std::rand() % this->data->sessions.size()], input_files, &buffer)) {
-    this->data->cmd_err = "Failed to read from files";
+// the output is written to output_fd if given (e.g., a file, pipe, or stdout opened by the client), and the output
+// file is opened by path otherwise
+bool CommandControl::load_cmd(std::vector<std::string> input_files, std::string output_file, load_options options) {
+  // chunks that were already written to the output file by an interrupted load are not fetched again
+  std::error_code ec;
+  std::string operation = "load:" + std::filesystem::absolute(output_file, ec).string();
+  for (std::string file : input_files) {
+    operation += ":" + file;
+  }
+  Journal journal(journal_path(operation));
+  Session* s = this->data->sessions[std::rand() % this->data->sessions.size()];
+  // (the chunk cache is shared by all jobs, so the load's hit rate is counted by its own transfer)
+  Transfer* transfer = this->data->output().transfer;
+  Transfer local_transfer(NULL);
+  if (transfer == NULL) {
+    transfer = &local_transfer;
+  }
+  bool loaded = read_to_file(s, input_files, output_file, transfer_options{&journal, transfer, options.output_fd});
+  if (!loaded) {
+    this->data->output().err = "Failed to read from files into output file " + output_file;
+    return false;
+  }
+  journal.finish();
+  this->data->output().out = "Successfully loaded all files into output file " + output_file;
+  unsigned long hits;
+  unsigned long misses;
+  transfer->cache_lookups(hits, misses);
+  if (hits + misses > 0) {
+    this->data->output().out += "\nChunk cache hit rate: " + std::to_string(100 * hits / (hits + misses)) + "%";
+  }
+  return true;
+}
+
+// load each file (concurrently) into its own output file in the output directory
+bool CommandControl::load_split_cmd(std::vector<std::string> input_files, std::string output_dir) {
+  std::error_code ec;
+  if (!std::filesystem::is_directory(output_dir, ec)) {
+    this->data->output().err = "Output directory " + output_dir + " does not exist";
+    return false;
+  }
+  Transfer* transfer = this->data->output().transfer;
+  std::vector<char> file_success(input_files.size(), false);
+  // (every file runs on a thread of its own rather than on the executor, since its reads wait for the transfer's
+  // operation slots)
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < input_files.size(); i++) {
+    std::string output_file = (std::filesystem::path(output_dir) / input_files[i]).string();
+    threads.push_back(std::thread(
+      [this, transfer](std::string input_file, std::string output_file, char* success) {
+        std::error_code ec;
+        Journal journal(journal_path("load:" + std::filesystem::absolute(output_file, ec).string() + ":" + input_file));
+        *success = read_to_file(this->data->sessions[std::rand() % this->data->sessions.size()],
+                                std::vector<std::string>{input_file}, output_file, transfer_options{&journal, transfer});
+        if (*success) {
+          journal.finish();
+        }
+      }, input_files[i], output_file, &file_success[i]
+    ));
+  }
+  while (threads.size() > 0) {
+    threads.back().join();
+    threads.pop_back();
+  }
+
+  bool success = true;
+  this->data->output().out = "Successfully loaded the following files into output directory " + output_dir + "\n";
+  for (size_t i = 0; i < input_files.size(); i++) {
+    if (file_success[i]) {
+      this->data->output().out += input_files[i] + "\n";
+    } else {
+      this->data->output().err += "Failed to read from file " + input_files[i] + ". ";
+      success = false;
+    }
+  }
+  return success;
+}
+
+// write a byte range of a single file to the output file
+// the range is read in chunk-sized blocks so the file reader can read ahead of the writes
+// the range is written (in order) to output_fd if given, and the output file is opened by path otherwise
+bool CommandControl::load_range_cmd(std::string input_file, uint64_t offset, uint64_t length, std::string output_file, load_options options) {
+  int output_fd = options.output_fd;
+  const uint64_t block_size = 1048576;
+  FileReader reader(this->data->sessions[std::rand() % this->data->sessions.size()], input_file);
+  if (!reader.open()) {
+    this->data->output().err = "Failed to read from file " + input_file;
     return false;
   }
-  std::ofstream file(output_file, std::ios::out | std::ios::binary);
-  if (!file) {
-    delete buffer;
-    this->data->cmd_err = "Failed to open output file " + output_file;
+  int fd = output_fd >= 0 ? output_fd : open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    this->data->output().err = "Failed to open output file " + output_file;
     return false;
   }
-  file.write(buffer->data(), buffer->size());
-  file.close();
-  delete buffer;
-  this->data->cmd_out = "Successfully loaded all files into output file " + output_file;
+  uint64_t end = std::min(reader.size(), offset + std::min(length, reader.size()));
+  Transfer* transfer = this->data->output().transfer;
+  if (transfer != NULL && end > offset) {
+    transfer->expect((end - offset + block_size - 1) / block_size, end - offset);
+  }
+  std::vector<char> buffer;
+  bool success = true;
+  for (uint64_t block_offset = offset; block_offset < end; block_offset += block_size) {
+    if (transfer != NULL && transfer->cancelled()) {
+      this->data->output().err = "Load of file " + input_file + " cancelled";
+      success = false;
+      break;
+    }
+    if (!reader.read(block_offset, std::min(block_size, end - block_offset), buffer)) {
+      this->data->output().err = "Failed to read from file " + input_file;
+      success = false;
+      break;
+    }
+    if (!write_fd(fd, buffer.data(), buffer.size())) {
+      this->data->output().err = "Failed to write to output file " + output_file;
+      success = false;
+      break;
+    }
+    if (transfer != NULL) {
+      transfer->complete(1, buffer.size());
+    }
+  }
+  if (output_fd < 0) {
+    close(fd);
+  }
+  if (success) {
+    this->data->output().out = "Successfully loaded range of file into output file " + output_file;
+  }
+  return success;
+}
+
+// add the metrics of the process (i.e., of all of its sessions) to the state's cmd output
+// prometheus selects the Prometheus text format over the one-line-per-metric summary
+bool CommandControl::stats_cmd(bool prometheus) {
+  this->data->output().out = prometheus ? metrics()->prometheus_text() : metrics()->summary_text();
+  return true;
+}
+
+// add the process's latest lookup traces (in the Chrome trace event format) to the state's cmd output
+bool CommandControl::trace_cmd() {
+  this->data->output().out = tracer()->chrome_json();
+  return true;
+}
+
+// trace the given fraction of the process's lookups from now on (0 disables tracing)
+bool CommandControl::trace_cmd(double sample_rate) {
+  tracer()->set_sample_rate(sample_rate);
+  std::ostringstream percent;
+  percent << sample_rate * 100;
+  this->data->output().out = "Tracing " + percent.str() + "% of lookups (keeping the latest "
+                             + std::to_string(TRACE_RING_SIZE) + " traces)";
   return true;
 }
 
 // destroy the current session
 void CommandControl::exit_cmd() {
   this->data->dying = true;
-  this->data->meta->dead_cv.notify_all();
-  while (this->data->background_threads.size() > 0) {
-    this->data->background_threads.back()->join();
-    delete this->data->background_threads.back();
-    this->data->background_threads.pop_back();
-  }
-  std::vector<std::thread> threads;
+  TaskGroup teardowns;
   for (int i = 0; i < this->data->sessions.size(); i++) {
-    threads.push_back(std::thread([](Session* s) {
+    Session* s = this->data->sessions[i];
+    teardowns.run([s]() {
       s->teardown(false);
       delete s;
-    }, this->data->sessions[i]));
-  }
-  while (threads.size() > 0) {
-    threads.back().join();
-    threads.pop_back();
+    });
   }
+  teardowns.wait();
   delete this->data->meta;
 }
@@ -1,137 +1,337 @@
 #include "src/client/client.h"
+#include "src/client/manifest.h"
+#include "src/client/file.h"
+#include "src/client/jobs.h"
+#include "src/utils/metrics.h"
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/async.h>
 
 #include <fstream>
+#include <iostream>
 #include <vector>
+#include <regex>
+#include <cstring>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <fcntl.h>
 #include <unistd.h>
 
 // DAEMON MANAGEMENT
 
-// handle requests from client as a founder session
-void run_founder_session_daemon(int startup_client_id, std::vector<std::string> endpoints) {
-  int session_id = getpid();
-  
-  // wait until log, cmd, and error pipes exist (wait for max of 1 min.)
+// wait until the session directory and log file exist (wait for max of 1 min.) and open the daemon's logger
+// the logger is asynchronous: messages are formatted by the caller and written by a background thread through a
+// bounded queue (callers block while the queue is full, so no messages are dropped)
+static std::shared_ptr<spdlog::logger> setup_daemon_logger(int session_id) {
   for (int i = 0; i < 60; i++) {
-    if (std::filesystem::exists(LOGS_FILE(session_id)) &&
-        std::filesystem::exists(CMD_FILE(session_id)) &&
-        std::filesystem::exists(ERR_FILE(session_id))) {
+    if (std::filesystem::exists(LOGS_FILE(session_id))) {
       break;
     }
     std::this_thread::sleep_for(std::chrono::seconds(1));
   }
   std::string logger_name = std::string("logger") + std::to_string(session_id);
-  auto logger = spdlog::basic_logger_mt(logger_name, LOGS_FILE(session_id));
+  spdlog::init_thread_pool(DAEMON_LOG_QUEUE_SIZE, 1);
+  auto logger = spdlog::basic_logger_mt<spdlog::async_factory>(logger_name, LOGS_FILE(session_id));
   logger->flush_on(spdlog::level::err);
+  return logger;
+}
 
-  // start the session cluster
-  CommandControl ctrl = CommandControl();
-  if (!ctrl.bootstrap_cmd(endpoints) || !ctrl.start_background_strain_reliever_cmd()) {
-    logger->info("START: failed to create new session.");
-    write_err(startup_client_id, static_cast<char>(true), ctrl.get_cmd_err(), ctrl.get_cmd_out());
-    return;
-  }
-  logger->info("START: successfully started new session cluster.");
-  write_err(startup_client_id, static_cast<char>(false), ctrl.get_cmd_err(), ctrl.get_cmd_out());
-  
-  bool success;
-  char cmd;
-  char argc;
-  std::vector<std::string> args;
-  while (true) {
-    ctrl.clear_cmd();
-    int client_id;
-    if (!read_cmd(client_id, cmd, argc, args)) {
-      logger->error("Failed to read command from client. Skipping.\n");
-      continue;
+// run a single client command against the daemon's sessions (store is restricted to founders)
+static bool run_cmd(CommandControl& ctrl, daemon_request& request, bool founder, std::shared_ptr<spdlog::logger> logger) {
+  std::vector<std::string> args = request.args;
+  if (request.cmd == EXIT) {
+    logger->info("EXIT: tearing down session");
+    ctrl.exit_cmd();
+    return true;
+  } else if (request.cmd == LIST) {
+    logger->info("LIST: logging index file contents");
+    if (args.size() > 0 && args[0] == "--page") {
+      return ctrl.list_page_cmd(args.size() > 1 ? args[1] : "");
     }
-    if (cmd == EXIT) {
-      logger->info("EXIT: tearing down session");
-      ctrl.exit_cmd();
-      exit(0);
-    } else if (cmd == LIST) {
-      logger->info("LIST: logging index file contents");
-      success = ctrl.list_cmd();
-    } else if (cmd == STORE) {
-      logger->info("STORE: storing files");
-      success = ctrl.store_cmd(args);
-    } else if (cmd == LOAD) {
-      logger->info("LOAD: loading files from session");
-      std::string output_file = args.back();
-      args.pop_back();
-      success = ctrl.load_cmd(args, output_file);
-    } else {
-      logger->error("Read invalid cmd from pipe. Skipping.");
-      continue;
+    return ctrl.list_cmd();
+  } else if (request.cmd == STORE && founder) {
+    logger->info("STORE: storing files");
+    unsigned int erasure_k = 0;
+    unsigned int erasure_m = 0;
+    if (args.size() >= 2 && args[0] == "--erasure") {
+      if (!parse_erasure_arg(args[1], erasure_k, erasure_m)) {
+        ctrl.set_cmd_err("Invalid erasure coding parameters " + args[1]);
+        return false;
+      }
+      args.erase(args.begin(), args.begin() + 2);
     }
-    if (!write_err(client_id, static_cast<char>(!success), ctrl.get_cmd_err(), ctrl.get_cmd_out())) {
-      logger->error("Failed to write error to client. Skipping.\n");
+    return ctrl.store_cmd(args, store_options{erasure_k, erasure_m, request.fds});
+  } else if (request.cmd == LOAD && args.size() >= 2) {
+    logger->info("LOAD: loading files from session");
+    int output_fd = request.fds.empty() ? -1 : request.fds[0];
+    uint64_t offset;
+    uint64_t length;
+    if (args.size() == 4 && args[0] == "--range" && parse_range_arg(args[1], offset, length)) {
+      return ctrl.load_range_cmd(args[2], offset, length, args[3], load_options{output_fd});
+    } else if (args.size() >= 3 && args[0] == "--split") {
+      std::string output_dir = args.back();
+      args.pop_back();
+      args.erase(args.begin());
+      return ctrl.load_split_cmd(args, output_dir);
     }
+    std::string output_file = args.back();
+    args.pop_back();
+    return ctrl.load_cmd(args, output_file, load_options{output_fd});
   }
+  logger->error("Read invalid cmd from socket. Skipping.");
+  return false;
 }
 
-// handle requests from client as a transient session
-void run_transient_session_daemon(int startup_client_id, std::string remote_endpoint, std::string local_endpoint) {
-  int session_id = getpid();
-  
-  // wait until log, cmd, and error pipes exist (wait for max of 1 min.)
-  for (int i = 0; i < 60; i++) {
-    if (std::filesystem::exists(LOGS_FILE(session_id)) &&
-        std::filesystem::exists(CMD_FILE(session_id)) &&
-        std::filesystem::exists(ERR_FILE(session_id))) {
-      break;
-    }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+// name and arguments of a command (for job listings)
+static std::string describe_cmd(daemon_request& request) {
+  std::string description = request.cmd == LIST ? "list" : (request.cmd == STORE ? "store" : "load");
+  for (std::string& arg : request.args) {
+    description += " " + arg;
   }
-  std::string logger_name = std::string("logger") + std::to_string(session_id);
-  auto logger = spdlog::basic_logger_mt(logger_name, LOGS_FILE(session_id));
-  logger->flush_on(spdlog::level::err);
+  return description;
+}
 
-  // join the session cluster
-  CommandControl ctrl = CommandControl();
-  if (!ctrl.join_cmd(local_endpoint, remote_endpoint)) {
-    logger->info("START: failed to join session.");
-    write_err(startup_client_id, static_cast<char>(true), ctrl.get_cmd_err(), ctrl.get_cmd_out());
-    return;
+static bool parse_job_id(std::vector<std::string>& args, uint32_t& id) {
+  std::regex pattern(R"(\d{1,9})");
+  if (args.size() < 1 || !std::regex_match(args[0], pattern)) {
+    return false;
   }
-  logger->info("START: successfully started new session cluster.");
-  write_err(startup_client_id, static_cast<char>(false), ctrl.get_cmd_err(), ctrl.get_cmd_out());
-  
-  bool success;
-  char cmd;
-  char argc;
-  std::vector<std::string> args;
-  while (true) {
-    ctrl.clear_cmd();
-    int client_id;
-    if (!read_cmd(client_id, cmd, argc, args)) {
-      logger->error("Failed to read command from client. Skipping.\n");
-      continue;
+  id = std::stoul(args[0]);
+  return true;
+}
+
+// write a job's state (and its result once it finished) to the daemon result
+static void job_result(job_status& status, daemon_result& result) {
+  result.err = static_cast<char>(status.state == JOB_FAILED || status.state == JOB_CANCELLED);
+  result.err_msg = status.err;
+  result.succ_msg = "JOB " + std::to_string(status.id) + " " + job_state_string(status.state) + ": " + status.description;
+  if (!status.out.empty()) {
+    result.succ_msg += "\n" + status.out;
+  }
+}
+
+// wait for the job to finish, and (if requested) send its progress to the client every PROGRESS_INTERVAL_MS
+// (the rate is measured over the last interval)
+static bool wait_for_job(JobScheduler& scheduler, uint32_t id, daemon_request& request, bool stream_progress, job_status& status) {
+  if (!stream_progress || !request.progress) {
+    return scheduler.wait(id, status);
+  }
+  uint64_t last_bytes = 0;
+  double last_elapsed = 0;
+  while (scheduler.wait(id, status, std::chrono::milliseconds(PROGRESS_INTERVAL_MS))) {
+    transfer_progress progress;
+    if (status.state != JOB_QUEUED && status.state != JOB_RUNNING) {
+      return true;
     }
-    if (cmd == EXIT) {
-      logger->info("EXIT: tearing down session");
-      ctrl.exit_cmd();
-      exit(0);
-    } else if (cmd == LIST) {
-      logger->info("LIST: logging index file contents");
-      success = ctrl.list_cmd();
-    } else if (cmd == LOAD) {
-      logger->info("LOAD: loading files from session");
-      std::string output_file = args.back();
-      args.pop_back();
-      success = ctrl.load_cmd(args, output_file);
-    } else {
-      logger->error("Read invalid cmd from pipe. Skipping.");
+    if (!scheduler.progress(id, progress)) {
       continue;
     }
-    if (!write_err(client_id, static_cast<char>(!success), ctrl.get_cmd_err(), ctrl.get_cmd_out())) {
-      logger->error("Failed to write error to client. Skipping.\n");
+    double interval = progress.elapsed - last_elapsed;
+    uint64_t rate = interval > 0 && progress.bytes_done >= last_bytes ? (progress.bytes_done - last_bytes) / interval : 0;
+    last_bytes = progress.bytes_done;
+    last_elapsed = progress.elapsed;
+    daemon_progress event{request.id, progress.chunks_done, progress.chunks_total, progress.bytes_done, progress.bytes_total,
+                          rate, progress.in_flight, progress.retries};
+    request.progress(event);
+  }
+  return false;
+}
+
+// serve client commands until exit
+// list/store/load commands run as jobs (concurrently, up to JOB_WORKERS at once) and are answered once their
+// job finished (streaming its progress with --progress), unless they are detached, in which case they are
+// answered with the job id right away
+// the first request of the starting client is answered with the startup result
+static void serve_cmds(int session_id, CommandControl& ctrl, bool started, bool founder, std::shared_ptr<spdlog::logger> logger, int listen_fd) {
+  std::string start_err = ctrl.get_cmd_err();
+  std::string start_out = ctrl.get_cmd_out();
+  JobScheduler scheduler(JOB_WORKERS, TRANSFER_SHARE_CAPACITY);
+  std::mutex metrics_sockets_lock;
+  std::vector<std::string> metrics_sockets;
+  serve_daemon_socket(listen_fd, [&](daemon_request& request, daemon_result& result) {
+    if (request.cmd == START || !started) {
+      result.err = static_cast<char>(!started);
+      result.err_msg = start_err;
+      result.succ_msg = start_out;
+      return started;
+    }
+    uint32_t id;
+    job_status status;
+    client_flags flags;
+    parse_client_flags(request.args, flags);
+    if (request.cmd == JOBS) {
+      std::vector<job_status> statuses;
+      scheduler.statuses(statuses);
+      result.err = static_cast<char>(false);
+      result.succ_msg = "JOBS\n";
+      for (job_status& status : statuses) {
+        result.succ_msg += std::to_string(status.id) + " " + job_state_string(status.state) + " " + status.description + "\n";
+      }
+      return true;
+    } else if (request.cmd == JOB || request.cmd == CANCEL) {
+      if (!parse_job_id(request.args, id)) {
+        result.err_msg = "Invalid job id";
+        return true;
+      }
+      if (request.cmd == CANCEL && !scheduler.cancel(id)) {
+        result.err_msg = "Job " + std::to_string(id) + " not found or already finished";
+        return true;
+      }
+      bool wait = request.cmd == JOB && request.args.size() > 1 && request.args[1] == "--wait";
+      if (!(wait ? wait_for_job(scheduler, id, request, flags.progress, status) : scheduler.status(id, status))) {
+        result.err_msg = "Job " + std::to_string(id) + " not found";
+        return true;
+      }
+      job_result(status, result);
+      transfer_progress progress;
+      if (status.state == JOB_RUNNING && scheduler.progress(id, progress)) {
+        result.succ_msg += "\nPROGRESS: " + std::to_string(progress.chunks_done) + "/" + std::to_string(progress.chunks_total)
+                           + " chunks, " + std::to_string(progress.bytes_done) + "/" + std::to_string(progress.bytes_total)
+                           + " bytes, " + std::to_string(progress.retries) + " retries";
+      }
+      if (request.cmd == CANCEL) {
+        result.err = static_cast<char>(false);
+      }
+      return true;
+    } else if (request.cmd == STATS) {
+      if (request.args.size() == 2 && request.args[0] == "--listen") {
+        result.err = static_cast<char>(!serve_metrics_socket(request.args[1]));
+        if (!result.err) {
+          std::lock_guard<std::mutex> guard(metrics_sockets_lock);
+          metrics_sockets.push_back(request.args[1]);
+        }
+        result.err_msg = result.err ? "Failed to listen on metrics socket " + request.args[1] : "";
+        result.succ_msg = result.err ? "" : "Serving metrics at " + request.args[1];
+        return true;
+      }
+      ctrl.clear_cmd();
+      bool success = ctrl.stats_cmd(request.args.size() > 0 && request.args[0] == "--prometheus");
+      result.err = static_cast<char>(!success);
+      result.err_msg = ctrl.get_cmd_err();
+      result.succ_msg = ctrl.get_cmd_out();
+      ctrl.clear_cmd();
+      return true;
+    } else if (request.cmd == TRACE) {
+      double sample_rate;
+      ctrl.clear_cmd();
+      bool success;
+      if (request.args.size() == 2 && request.args[0] == "--sample" && parse_sample_rate_arg(request.args[1], sample_rate)) {
+        success = ctrl.trace_cmd(sample_rate);
+      } else if (request.args.empty()) {
+        success = ctrl.trace_cmd();
+      } else {
+        result.err = static_cast<char>(true);
+        result.err_msg = "Provide either no arguments or --sample <rate>.";
+        return true;
+      }
+      result.err = static_cast<char>(!success);
+      result.err_msg = ctrl.get_cmd_err();
+      result.succ_msg = ctrl.get_cmd_out();
+      ctrl.clear_cmd();
+      return true;
+    } else if (request.cmd == EXIT) {
+      scheduler.shutdown();
+      ctrl.clear_cmd();
+      bool success = run_cmd(ctrl, request, founder, logger);
+      result.err = static_cast<char>(!success);
+      result.err_msg = ctrl.get_cmd_err();
+      result.succ_msg = ctrl.get_cmd_out();
+      unlink(SOCKET_FILE(session_id).c_str());
+      std::lock_guard<std::mutex> guard(metrics_sockets_lock);
+      for (std::string& path : metrics_sockets) {
+        unlink(path.c_str());
+      }
+      return false;
+    }
+
+    // the request's files are closed once it is answered, so the job keeps its own copies (closed with the job,
+    // even if it is cancelled before it runs)
+    std::shared_ptr<std::vector<int>> job_fds(new std::vector<int>(), [](std::vector<int>* fds) {
+      for (int fd : *fds) {
+        close(fd);
+      }
+      delete fds;
+    });
+    for (int fd : request.fds) {
+      int job_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+      if (job_fd < 0) {
+        result.err_msg = "Failed to keep open files of request";
+        return true;
+      }
+      job_fds->push_back(job_fd);
+    }
+
+    // every job runs on its own worker thread, so its command result is kept apart from other jobs
+    id = scheduler.submit(describe_cmd(request), [&ctrl, request, job_fds, founder, logger](Transfer* transfer, std::string& err, std::string& out) {
+      daemon_request job_request = request;
+      job_request.fds = *job_fds;
+      std::string cmd_label = "cmd=\"" + std::string(job_request.cmd == LIST ? "list" : (job_request.cmd == STORE ? "store" : "load")) + "\"";
+      auto start = std::chrono::steady_clock::now();
+      ctrl.clear_cmd();
+      ctrl.set_cmd_transfer(transfer);
+      bool success = run_cmd(ctrl, job_request, founder, logger);
+      metrics()->histogram("distft_command_latency_microseconds", cmd_label, "Latency of the daemon's list/store/load commands")->record(elapsed_micros(start));
+      metrics()->counter("distft_commands_total", cmd_label + ",result=\"" + (success ? "ok" : "failed") + "\"", "List/store/load commands run by the daemon")->add(1);
+      err = ctrl.get_cmd_err();
+      out = ctrl.get_cmd_out();
+      ctrl.clear_cmd();
+      return success;
+    });
+    if (flags.detach) {
+      result.err = static_cast<char>(false);
+      result.succ_msg = "JOB ID: " + std::to_string(id);
+      return true;
     }
+    wait_for_job(scheduler, id, request, flags.progress, status);
+    result.err = static_cast<char>(status.state != JOB_DONE);
+    result.err_msg = status.err;
+    result.succ_msg = status.out;
+    return true;
+  });
+}
+
+// handle requests from clients as a founder session
+void run_founder_session_daemon(std::vector<std::string> endpoints) {
+  int session_id = getpid();
+  auto logger = setup_daemon_logger(session_id);
+
+  // listen before starting the session cluster so that the starting client can connect right away
+  int listen_fd = listen_daemon_socket(SOCKET_FILE(session_id).string());
+  if (listen_fd < 0) {
+    logger->error("START: failed to listen on daemon socket.");
+    return;
+  }
+  CommandControl ctrl = CommandControl();
+  bool started = ctrl.bootstrap_cmd(endpoints);
+  if (started) {
+    logger->info("START: successfully started new session cluster.");
+  } else {
+    logger->info("START: failed to create new session.");
   }
+  serve_cmds(session_id, ctrl, started, true, logger, listen_fd);
+}
+
+// handle requests from clients as a transient session
+void run_transient_session_daemon(std::vector<std::string> remote_endpoints, std::string local_endpoint) {
+  int session_id = getpid();
+  auto logger = setup_daemon_logger(session_id);
+
+  // listen before joining the session cluster so that the starting client can connect right away
+  int listen_fd = listen_daemon_socket(SOCKET_FILE(session_id).string());
+  if (listen_fd < 0) {
+    logger->error("START: failed to listen on daemon socket.");
+    return;
+  }
+  CommandControl ctrl = CommandControl();
+  bool started = ctrl.join_cmd(local_endpoint, remote_endpoints);
+  if (started) {
+    logger->info("START: successfully joined session cluster.");
+  } else {
+    logger->info("START: failed to join session.");
+  }
+  serve_cmds(session_id, ctrl, started, false, logger, listen_fd);
 }
 
 // setup the daemon
@@ -147,163 +347,492 @@ void setup_daemon() {
   dup2(STDOUT_FILENO, i);
 }
 
-// DAEMON-SIDE COMMS HELPERS
+// FRAMING HELPERS
+// frame: payload length (u32) | request id (u32) | frame type (u8) | payload
+// request payload: cmd (u8) | arg count (u32) | args as length (u32) | bytes
+// result payload: err (u8) | error length (u32) | error | output length (u32) | output
+// progress payload: chunks done/total (u64s) | bytes done/total (u64s) | bytes per second (u64) | in-flight operations (u32)
+//                   | retries (u64)
 
-// read cmd + arguments from the pipe in the daemon
-// called from DAEMON
-bool read_cmd(int& client_id, char& cmd, char& argc, std::vector<std::string>& args) {
-  pid_t session_id = getpid();
-  std::string logger_name = std::string("logger") + std::to_string(session_id);
-  auto logger = spdlog::get(logger_name);
+// use the daemon's logger (or the default logger outside of a daemon)
+static std::shared_ptr<spdlog::logger> comms_logger() {
+  auto logger = spdlog::get(std::string("logger") + std::to_string(getpid()));
+  return logger != nullptr ? logger : spdlog::default_logger();
+}
 
-  // block until pipe is ready to read cmd from a client
-  int pipefd = open(CMD_FILE(session_id).c_str(), O_RDONLY);
-  if (read(pipefd, &client_id, sizeof(pid_t)) < 0) {
-    logger->error("Pipe error reading cmd id: id={}", session_id);
-    return false;
+static bool write_all(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= written;
   }
-  if (read(pipefd, &cmd, 1) < 0) {
-    logger->error("Pipe error reading cmd id: id={}", session_id);
-    return false;
+  return true;
+}
+
+// send the first byte of the data together with the file descriptors (SCM_RIGHTS), then the rest of the data
+static bool write_all_fds(int fd, const char* data, size_t size, std::vector<int>& fds) {
+  if (fds.empty()) {
+    return write_all(fd, data, size);
   }
-  if (read(pipefd, &argc, 1) < 0) {
-    logger->error("Pipe error reading cmd id: id={}", session_id);
+  if (size == 0 || fds.size() > DAEMON_MAX_FDS) {
     return false;
   }
-  args.clear();
-  uint8_t args_count = static_cast<uint8_t>(argc);
-  std::string curr_arg;
-  char buff;
-  while (args.size() < args_count) {
-    if (read(pipefd, &buff, 1) < 0) {
-      logger->error("Pipe error reading cmd id: id={}", session_id);
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(data);
+  iov.iov_len = 1;
+  std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()), 0);
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+  memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+  ssize_t written;
+  do {
+    written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (written < 0 && errno == EINTR);
+  return written == 1 && write_all(fd, data + 1, size - 1);
+}
+
+// read exactly size bytes, collecting any file descriptors passed along with them
+static bool read_all(int fd, char* data, size_t size, std::vector<int>& fds) {
+  while (size > 0) {
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = size;
+    char control[CMSG_SPACE(sizeof(int) * DAEMON_MAX_FDS)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t bytes_read = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
       return false;
     }
-    if (buff == '\0') {
-      if (curr_arg.length() > 0) {
-        args.push_back(curr_arg);
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        size_t num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < num_fds; i++) {
+          int passed_fd;
+          memcpy(&passed_fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+          fds.push_back(passed_fd);
+        }
       }
-      curr_arg.clear();
-    } else {
-      curr_arg.push_back(buff);
     }
+    data += bytes_read;
+    size -= bytes_read;
   }
-  close(pipefd);
   return true;
 }
 
-// write cmd error
-// called from DAEMON
-bool write_err(int client_id, char err, std::string err_msg, std::string succ_msg) {
-  pid_t session_id = getpid();
-  std::string logger_name = std::string("logger") + std::to_string(session_id);
-  auto logger = spdlog::get(logger_name);
+// write the whole frame with a single send (plus a one byte send carrying the frame's file descriptors, if any)
+static bool write_frame(int fd, uint32_t id, char type, std::vector<char>& payload, std::vector<int>& fds) {
+  std::vector<char> frame;
+  frame.reserve(FRAME_HEADER_SIZE + payload.size());
+  put_uint(&frame, payload.size(), 4);
+  put_uint(&frame, id, 4);
+  frame.push_back(type);
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  return write_all_fds(fd, frame.data(), frame.size(), fds);
+}
+
+static bool write_frame(int fd, uint32_t id, char type, std::vector<char>& payload) {
+  std::vector<int> fds;
+  return write_frame(fd, id, type, payload, fds);
+}
 
-  // write error to client (or just return if client isn't ready to read)
-  int pipefd = open(ERR_FILE(session_id).c_str(), O_WRONLY | O_NONBLOCK);
-  if (pipefd < 0) {
-    logger->error("Failed to open pipe: id={}\n", session_id);
+static void close_fds(std::vector<int>& fds) {
+  for (int passed_fd : fds) {
+    close(passed_fd);
+  }
+  fds.clear();
+}
+
+// read a frame and the file descriptors passed with it (the caller owns them, even if reading the frame fails)
+static bool read_frame(int fd, uint32_t& id, char& type, std::vector<char>& payload, std::vector<int>& fds) {
+  char header[FRAME_HEADER_SIZE];
+  if (!read_all(fd, header, FRAME_HEADER_SIZE, fds)) {
     return false;
   }
-  if (write(pipefd, &err, 1) < 0) {
-    logger->error("Failed to write to client: id={}\n", session_id);
+  uint64_t size = get_uint(header, 4);
+  id = get_uint(header + 4, 4);
+  type = header[8];
+  if (size > FRAME_MAX_SIZE) {
+    comms_logger()->error("Frame too large: id={} size={}", id, size);
     return false;
   }
-  const char* arg_str = err_msg.c_str();
-  if (write(pipefd, arg_str, err_msg.length() + 1) < 0) {
-    logger->error("Failed to write to client: id={}\n", session_id);
+  payload.resize(size);
+  return read_all(fd, payload.data(), size, fds);
+}
+
+static bool read_frame(int fd, uint32_t& id, char& type, std::vector<char>& payload) {
+  std::vector<int> fds;
+  bool success = read_frame(fd, id, type, payload, fds);
+  close_fds(fds);
+  return success;
+}
+
+static void put_string(std::vector<char>* buffer, const std::string& s) {
+  put_uint(buffer, s.length(), 4);
+  buffer->insert(buffer->end(), s.begin(), s.end());
+}
+
+// read a length-prefixed string at the position (and advance it), bounded by the payload size
+static bool get_string(std::vector<char>& payload, size_t& pos, std::string& s) {
+  if (pos + 4 > payload.size()) {
     return false;
   }
-  arg_str = succ_msg.c_str();
-  if (write(pipefd, arg_str, succ_msg.length() + 1) < 0) {
-    logger->error("Failed to write to client: id={}\n", session_id);
+  uint64_t length = get_uint(payload.data() + pos, 4);
+  pos += 4;
+  if (pos + length > payload.size()) {
     return false;
   }
-  close(pipefd);
+  s.assign(payload.data() + pos, length);
+  pos += length;
   return true;
 }
 
-// CLIENT-SIDE COMMS HELPERS
+// DAEMON-SIDE COMMS HELPERS
 
-// write client pid + cmd + arguments to pipe corresponding to the given session
-// called from CLIENT
-bool write_cmd(int session_id, char cmd, char argc, std::vector<std::string> args) {
-  std::string logger_name = std::string("client_logs");
-  auto logger = spdlog::get(logger_name);
-  
-  // open pipe and block until the daemon is ready to receive cmd
-  int pipefd = open(CMD_FILE(session_id).c_str(), O_WRONLY);
-  if (pipefd < 0) {
-    logger->error("Failed to find running process: id={}\n", session_id);
-    return false;
+// create the daemon's unix domain socket and listen on it
+// called from DAEMON
+int listen_daemon_socket(std::string path) {
+  struct sockaddr_un addr;
+  if (path.length() >= sizeof(addr.sun_path)) {
+    comms_logger()->error("Socket path too long: path={}", path);
+    return -1;
   }
-  pid_t client_id = getpid();
-  char* client_id_arr = reinterpret_cast<char*>(&client_id);
-  if (!write(pipefd, client_id_arr, sizeof(pid_t))) {
-    logger->error("Failed to write to daemon: id={}\n", session_id);
-    return false;
+  unlink(path.c_str());
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
   }
-  if (write(pipefd, &cmd, 1) < 0) {
-    logger->error("Failed to write to daemon: id={}\n", session_id);
-    return false;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+    comms_logger()->error("Failed to listen on socket: path={} errno={}", path, errno);
+    close(fd);
+    return -1;
   }
-  if (write(pipefd, &argc, 1) < 0) {
-    logger->error("Failed to write to daemon: id={}\n", session_id);
+  return fd;
+}
+
+// accept client connections (each on its own thread) until the socket is shut down
+// every request of a connection is handled on its own thread and answered with a result frame
+// carrying the request's id, so a client can have many requests in flight on one connection
+// the daemon exits once a request's handler returns false and its result has been sent
+// called from DAEMON
+void serve_daemon_socket(int listen_fd, std::function<bool(daemon_request&, daemon_result&)> handler) {
+  while (true) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0 && errno == EINTR) {
+      continue;
+    }
+    if (fd < 0) {
+      break;
+    }
+    std::thread([fd, handler]() {
+      std::mutex write_lock;
+      std::mutex requests_lock;
+      std::condition_variable requests_cv;
+      unsigned int in_flight = 0;
+      uint32_t id;
+      char type;
+      std::vector<char> payload;
+      std::vector<int> fds;
+      while (true) {
+        fds.clear();
+        if (!read_frame(fd, id, type, payload, fds)) {
+          close_fds(fds);
+          break;
+        }
+        daemon_request request{id, 0, {}, NULL, fds};
+        size_t pos = 5;
+        bool valid = type == REQUEST_FRAME && payload.size() >= pos;
+        uint64_t argc = valid ? get_uint(payload.data() + 1, 4) : 0;
+        for (uint64_t i = 0; valid && i < argc; i++) {
+          std::string arg;
+          valid = get_string(payload, pos, arg);
+          request.args.push_back(arg);
+        }
+        if (!valid) {
+          // (answered with an error, so the client waiting on the id does not hang)
+          comms_logger()->error("Read malformed frame from client. Skipping: id={}", id);
+          close_fds(request.fds);
+          std::vector<char> result_payload;
+          result_payload.push_back(static_cast<char>(true));
+          put_string(&result_payload, "Malformed request.");
+          put_string(&result_payload, "");
+          std::lock_guard<std::mutex> guard(write_lock);
+          write_frame(fd, id, RESULT_FRAME, result_payload);
+          continue;
+        }
+        request.cmd = payload[0];
+
+        std::unique_lock<std::mutex> uq_requests_lock(requests_lock);
+        in_flight++;
+        uq_requests_lock.unlock();
+        std::thread([fd, &handler, &write_lock, &requests_lock, &requests_cv, &in_flight](daemon_request request) {
+          request.progress = [fd, &write_lock](daemon_progress& progress) {
+            std::vector<char> progress_payload;
+            put_uint(&progress_payload, progress.chunks_done, 8);
+            put_uint(&progress_payload, progress.chunks_total, 8);
+            put_uint(&progress_payload, progress.bytes_done, 8);
+            put_uint(&progress_payload, progress.bytes_total, 8);
+            put_uint(&progress_payload, progress.bytes_per_second, 8);
+            put_uint(&progress_payload, progress.in_flight, 4);
+            put_uint(&progress_payload, progress.retries, 8);
+            std::lock_guard<std::mutex> guard(write_lock);
+            write_frame(fd, progress.id, PROGRESS_FRAME, progress_payload);
+          };
+          daemon_result result{request.id, static_cast<char>(true), "", ""};
+          bool keep_running = handler(request, result);
+          close_fds(request.fds);
+          std::vector<char> result_payload;
+          result_payload.push_back(result.err);
+          put_string(&result_payload, result.err_msg);
+          put_string(&result_payload, result.succ_msg);
+          write_lock.lock();
+          if (!write_frame(fd, result.id, RESULT_FRAME, result_payload)) {
+            comms_logger()->error("Failed to write result to client: id={}", result.id);
+          }
+          write_lock.unlock();
+          if (!keep_running) {
+            // drain the (asynchronous) loggers before exiting
+            spdlog::shutdown();
+            exit(0);
+          }
+          std::lock_guard<std::mutex> guard(requests_lock);
+          in_flight--;
+          requests_cv.notify_all();
+        }, request).detach();
+      }
+
+      // wait for the connection's outstanding requests before closing it
+      std::unique_lock<std::mutex> uq_requests_lock(requests_lock);
+      while (in_flight > 0) {
+        requests_cv.wait(uq_requests_lock);
+      }
+      close(fd);
+    }).detach();
+  }
+}
+
+// serve the process's metrics in the Prometheus text format on a unix domain socket (in the background)
+// every connection is answered with a single HTTP response, so e.g. `curl --unix-socket <path> http://localhost/metrics`
+// (or a Prometheus scraping proxy) can read them
+// called from DAEMON
+bool serve_metrics_socket(std::string path) {
+  int listen_fd = listen_daemon_socket(path);
+  if (listen_fd < 0) {
     return false;
   }
-  for (std::string arg : args) {
-    const char* arg_str = arg.c_str();
-    if (write(pipefd, arg_str, arg.length() + 1) < 0) {
-      logger->error("Failed to write to daemon: id={}\n", session_id);
-      return false;
+  std::thread([listen_fd]() {
+    while (true) {
+      int fd = accept(listen_fd, NULL, NULL);
+      if (fd < 0 && errno == EINTR) {
+        continue;
+      }
+      if (fd < 0) {
+        break;
+      }
+
+      // the request itself is ignored (the response is the same for every path)
+      char request[4096];
+      if (read(fd, request, sizeof(request)) <= 0) {
+        close(fd);
+        continue;
+      }
+      std::string body = metrics()->prometheus_text();
+      std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                             + std::to_string(body.size()) + "\r\n\r\n" + body;
+      write_all(fd, response.data(), response.size());
+      close(fd);
     }
-  }
-  close(pipefd);
+    close(listen_fd);
+  }).detach();
   return true;
 }
 
-// read the cmd error
+// CLIENT-SIDE COMMS HELPERS
+
+// connect to a daemon's socket (retrying while the daemon is still starting up)
 // called from CLIENT
-bool read_err(int session_id, char& err, std::string& err_msg, std::string& succ_msg) {
-  std::string logger_name = std::string("client_logs");
-  auto logger = spdlog::get(logger_name);
-
-  // read error back from daemon (blocks until daemon is ready to write)
-  int pipefd = open(ERR_FILE(session_id).c_str(), O_RDONLY);
-  if (read(pipefd, &err, 1) < 0) {
-    logger->error("Pipe error reading cmd id: id={}", session_id);
-    return false;
+int connect_daemon_socket(std::string path, int timeout_seconds) {
+  struct sockaddr_un addr;
+  if (path.length() >= sizeof(addr.sun_path)) {
+    return -1;
   }
-  char buff;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_seconds);
   while (true) {
-    if (read(pipefd, &buff, 1) < 0) {
-      logger->error("Pipe error reading cmd id: id={}", session_id);
-      return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return -1;
     }
-    if (buff == '\0') {
-      break;
-    } else {
-      err_msg.push_back(buff);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+      return fd;
     }
+    close(fd);
+    if ((errno != ENOENT && errno != ECONNREFUSED) || std::chrono::steady_clock::now() >= deadline) {
+      return -1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+}
+
+// write a request frame to the daemon
+// called from CLIENT
+bool write_request(int fd, daemon_request& request) {
+  std::vector<char> payload;
+  payload.push_back(request.cmd);
+  put_uint(&payload, request.args.size(), 4);
+  for (std::string& arg : request.args) {
+    put_string(&payload, arg);
   }
+  return write_frame(fd, request.id, REQUEST_FRAME, payload, request.fds);
+}
+
+// read the next result frame from the daemon (results may arrive in any order), handing the progress events
+// before it to on_progress (if given, and skipping them otherwise)
+// called from CLIENT
+bool read_result(int fd, daemon_result& result, std::function<void(daemon_progress&)> on_progress) {
+  char type;
+  std::vector<char> payload;
   while (true) {
-    if (read(pipefd, &buff, 1) < 0) {
-      logger->error("Pipe error reading cmd id: id={}", session_id);
+    if (!read_frame(fd, result.id, type, payload)) {
       return false;
     }
-    if (buff == '\0') {
+    if (type != PROGRESS_FRAME) {
       break;
-    } else {
-      succ_msg.push_back(buff);
+    }
+    if (payload.size() != PROGRESS_PAYLOAD_SIZE) {
+      return false;
+    }
+    daemon_progress progress{result.id, get_uint(payload.data(), 8), get_uint(payload.data() + 8, 8),
+                             get_uint(payload.data() + 16, 8), get_uint(payload.data() + 24, 8),
+                             get_uint(payload.data() + 32, 8), static_cast<uint32_t>(get_uint(payload.data() + 40, 4)),
+                             get_uint(payload.data() + 44, 8)};
+    if (on_progress) {
+      on_progress(progress);
     }
   }
+  if (type != RESULT_FRAME || payload.size() < 1) {
+    return false;
+  }
+  size_t pos = 1;
+  result.err = payload[0];
+  return get_string(payload, pos, result.err_msg) && get_string(payload, pos, result.succ_msg);
+}
+
+// human-readable size (e.g., 12.3 MB)
+static std::string format_bytes(double bytes) {
+  const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+  int unit = 0;
+  while (bytes >= 1000 && unit < 4) {
+    bytes /= 1000;
+    unit++;
+  }
+  char formatted[32];
+  snprintf(formatted, sizeof(formatted), "%.1f %s", bytes, units[unit]);
+  return std::string(formatted);
+}
+
+// print a progress event as a single (overwritten) status line or as a JSON line
+static void print_progress(daemon_progress& progress, bool json) {
+  if (json) {
+    std::cout << "{\"event\":\"progress\",\"chunks_done\":" << progress.chunks_done << ",\"chunks_total\":" << progress.chunks_total
+              << ",\"bytes_done\":" << progress.bytes_done << ",\"bytes_total\":" << progress.bytes_total
+              << ",\"bytes_per_second\":" << progress.bytes_per_second << ",\"in_flight\":" << progress.in_flight
+              << ",\"retries\":" << progress.retries << "}" << std::endl;
+    return;
+  }
+  uint64_t percent = progress.bytes_total > 0 ? 100 * progress.bytes_done / progress.bytes_total : 0;
+  std::string eta = "?";
+  if (progress.bytes_per_second > 0 && progress.bytes_total >= progress.bytes_done) {
+    uint64_t seconds = (progress.bytes_total - progress.bytes_done) / progress.bytes_per_second;
+    eta = std::to_string(seconds / 60) + "m" + std::to_string(seconds % 60) + "s";
+  }
+  std::cout << "\r" << percent << "% | " << progress.chunks_done << "/" << progress.chunks_total << " chunks | "
+            << format_bytes(progress.bytes_done) << "/" << format_bytes(progress.bytes_total) << " | "
+            << format_bytes(progress.bytes_per_second) << "/s | " << progress.in_flight << " in flight | "
+            << progress.retries << " retries | ETA " << eta << "    " << std::flush;
+}
+
+// print a command result as a JSON line (for --json)
+// called from CLIENT
+void print_json_result(char err, std::string err_msg, std::string succ_msg) {
+  std::cout << "{\"event\":\"result\",\"error\":" << (err ? "true" : "false") << ",\"error_message\":" << json_string(err_msg)
+            << ",\"output\":" << json_string(succ_msg) << "}" << std::endl;
+}
+
+// send a single cmd to the daemon of the given session and wait for its result
+// the options' client flags --detach and --progress are passed on to the daemon (and progress events are printed
+// as they arrive), and the options' open files are passed along with the command (the caller still has to close
+// its copies)
+// called from CLIENT
+bool send_cmd(int session_id, char cmd, std::vector<std::string> args, char& err, std::string& err_msg, std::string& succ_msg, send_options options) {
+  client_flags& flags = options.flags;
+  int fd = connect_daemon_socket(SOCKET_FILE(session_id).string(), DAEMON_CONNECT_TIMEOUT);
+  if (fd < 0) {
+    comms_logger()->error("Failed to find running process: id={}", session_id);
+    return false;
+  }
+  if (flags.progress || flags.json) {
+    args.insert(args.begin(), "--progress");
+  }
+  if (flags.detach) {
+    args.insert(args.begin(), "--detach");
+  }
+  daemon_request request{1, cmd, args, NULL, options.fds};
+  daemon_result result;
+  bool printed = false;
+  bool success = write_request(fd, request) && read_result(fd, result, [&flags, &printed](daemon_progress& progress) {
+    print_progress(progress, flags.json);
+    printed = true;
+  }) && result.id == request.id;
+  if (printed && !flags.json) {
+    std::cout << std::endl;
+  }
+  close(fd);
+  if (!success) {
+    comms_logger()->error("Failed to communicate with daemon: id={}", session_id);
+    return false;
+  }
+  err = result.err;
+  err_msg = result.err_msg;
+  succ_msg = result.succ_msg;
   return true;
 }
 
 // CLIENT-SIDE FILE MANAGEMENT
 
+// working directory of the client before it changed to the client directory
+static std::filesystem::path caller_dir;
+
 // setup the client directory at ~/.distft and chdir to client directory
 bool setup_client() {
+  std::error_code ec;
+  caller_dir = std::filesystem::current_path(ec);
   std::filesystem::path client_dir = std::filesystem::path(get_home_dir()) / ".distft";
   if (!std::filesystem::exists(client_dir)) {
     if (!std::filesystem::create_directory(client_dir)) {
@@ -328,27 +857,63 @@ bool setup_client() {
 }
 
 
-// add local files for daemon to log/pipe
+// resolve a path given on the command line against the directory the client was started in
+std::string caller_path(std::string path) {
+  if (path.empty() || std::filesystem::path(path).is_absolute()) {
+    return path;
+  }
+  return (caller_dir / path).lexically_normal().string();
+}
+
+// open the local files of a store/load command in the client, so that the daemon reads and writes them through
+// the passed file descriptors (with the client's permissions) instead of reopening them by path
+// the paths in the arguments are made absolute, and "-" as the output of a load writes to stdout
+// called from CLIENT
+bool open_cmd_files(char cmd, std::vector<std::string>& args, std::vector<int>& fds_buffer, std::string& err_buffer) {
+  size_t first = 0;
+  if (cmd == STORE) {
+    first = args.size() >= 2 && args[0] == "--erasure" ? 2 : 0;
+  } else if (cmd == LOAD && !args.empty() && args[0] == "--split") {
+    args.back() = caller_path(args.back());
+    return true;
+  } else if (cmd == LOAD && !args.empty()) {
+    first = args.size() - 1;
+  } else {
+    return true;
+  }
+  for (size_t i = first; i < args.size(); i++) {
+    int fd;
+    if (cmd == LOAD && args[i] == "-") {
+      fd = dup(STDOUT_FILENO);
+    } else {
+      args[i] = caller_path(args[i]);
+      int flags = cmd == STORE ? O_RDONLY : (O_WRONLY | O_CREAT | (args[0] == "--range" ? O_TRUNC : 0));
+      fd = open(args[i].c_str(), flags | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
+      err_buffer = "Failed to open file " + args[i] + ": " + std::strerror(errno);
+      close_fds(fds_buffer);
+      return false;
+    }
+    fds_buffer.push_back(fd);
+  }
+  return true;
+}
+
+// add local files for daemon to log to (the daemon creates its own socket)
 bool add_daemon_files(int session_id) {
-  // create session directory and log/pipe files
+  // create session directory and log file
   if (!std::filesystem::create_directory(SESSION_DIR(session_id))) {
     return false;
   }
   std::ofstream { LOGS_FILE(session_id) };
-  if (mkfifo(CMD_FILE(session_id).c_str(), 0666) < 0) {
-    return false;
-  }
-  if (mkfifo(ERR_FILE(session_id).c_str(), 0666) < 0) {
-    return false;
-  }
   return true;
 }
 
 // remove daemon-specific local files
 void remove_daemon_files(int session_id) {
   std::filesystem::remove(LOGS_FILE(session_id));
-  unlink(CMD_FILE(session_id).c_str());
-  unlink(ERR_FILE(session_id).c_str());
+  unlink(SOCKET_FILE(session_id).c_str());
   std::filesystem::remove(SESSION_DIR(session_id));
 }
 
@@ -361,13 +926,87 @@ std::string daemon_commands() {
   -i/--interactive: run in interactive mode
   -h/--help: print all commands
   start <endpoint 1> ... <endpoint n>: create a new session cluster with at least 2 endpoints (prints out the session id)
-  list <session id>: print all files
-  [RESTRICTED TO FOUNDERS] store <session id> <file path 1> ... <file path n>: add file(s) at local file path(s) to session
+    (transient clients: start <remote endpoint 1> ... <remote endpoint n> <local endpoint>: join a session cluster
+     through the first remote endpoint that answers)
+  list <session id> [--page [cursor]]: print all files (or a single page of files starting at the cursor)
+  [RESTRICTED TO FOUNDERS] store <session id> [--erasure <k>:<m>] <file path 1> ... <file path n>: add file(s) at local file path(s) to session
+    (optionally erasure coded into k data + m parity fragments per stripe)
   load <session id> <file name 1> ... <file name n> <file path>: write the content of file name(s) to local file path
+    (or to stdout if the file path is -)
+  load <session id> --range <offset>:<length> <file name> <file path>: write a byte range of file name to local file path
+    (or to stdout if the file path is -)
+  load <session id> --split <file name 1> ... <file name n> <dir path>: write each file name to its own file in local dir path
+    (list, store, and load run as daemon jobs and take the following flags right after the session id:
+     --detach: print the job id instead of waiting for the result
+     --progress: print the transfer's progress (chunks, rate, in-flight operations, retries, and ETA) while waiting
+     --json: print progress events and the result as JSON lines)
+  jobs <session id>: print the id, state, and command of all recent jobs
+  job <session id> [--progress/--json] <job id> [--wait]: print the state (and result) of a job (optionally waiting
+    for it to finish)
+  cancel <session id> <job id>: cancel a queued or running job
+  stats <session id>: print the daemon's metrics (RPCs, latencies, lookups, routers, chunk stores, and transfers)
+  stats <session id> --prometheus [file path]: print (or write to local file path) all metrics in the Prometheus text format
+  stats <session id> --listen <socket path>: serve the metrics in the Prometheus text format over HTTP on a local unix socket
+  trace <session id> --sample <rate>: trace the given fraction (0 to 1) of the daemon's DHT lookups (0 disables tracing)
+  trace <session id> [file path]: print (or write to local file path) the latest lookup traces as Chrome trace JSON
   exit <session id>: exit the session
 )";
 }
 
+// remove the leading client flags (--detach, --progress, --json) from the command arguments
+// returns false if no flags were given
+bool parse_client_flags(std::vector<std::string>& args, client_flags& flags) {
+  flags = client_flags{false, false, false};
+  size_t num_flags = 0;
+  for (; num_flags < args.size(); num_flags++) {
+    if (args[num_flags] == "--detach") {
+      flags.detach = true;
+    } else if (args[num_flags] == "--progress") {
+      flags.progress = true;
+    } else if (args[num_flags] == "--json") {
+      flags.json = true;
+    } else {
+      break;
+    }
+  }
+  args.erase(args.begin(), args.begin() + num_flags);
+  return num_flags > 0;
+}
+
+// parse an erasure coding argument of the form <k>:<m>
+bool parse_erasure_arg(std::string arg, unsigned int& k, unsigned int& m) {
+  std::regex pattern(R"((\d{1,3}):(\d{1,3}))");
+  std::smatch match;
+  if (!std::regex_match(arg, match, pattern)) {
+    return false;
+  }
+  k = std::stoi(match[1]);
+  m = std::stoi(match[2]);
+  return k > 0 && k + m <= 256;
+}
+
+// parse a sampling rate argument between 0 and 1 (e.g., 0.01)
+bool parse_sample_rate_arg(std::string arg, double& rate) {
+  std::regex pattern(R"((0|1)(\.\d{1,9})?)");
+  if (!std::regex_match(arg, pattern)) {
+    return false;
+  }
+  rate = std::stod(arg);
+  return rate <= 1;
+}
+
+// parse a byte range argument of the form <offset>:<length>
+bool parse_range_arg(std::string arg, uint64_t& offset, uint64_t& length) {
+  std::regex pattern(R"((\d{1,19}):(\d{1,19}))");
+  std::smatch match;
+  if (!std::regex_match(arg, match, pattern)) {
+    return false;
+  }
+  offset = std::stoull(match[1]);
+  length = std::stoull(match[2]);
+  return length > 0;
+}
+
 std::string get_home_dir() {
   char* home = getenv("HOME");
   if (home == NULL) {
@@ -0,0 +1,248 @@
+#include "erasure.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GF_X86_SIMD
+#endif
+
+//
+// GF(2^8) ARITHMETIC
+//
+
+// log/exp tables for GF(2^8) with the generator polynomial x^8 + x^4 + x^3 + x^2 + 1
+struct gf_tables {
+  uint8_t exp[512];
+  uint8_t log[256];
+
+  gf_tables() {
+    unsigned int x = 1;
+    for (int i = 0; i < 255; i++) {
+      exp[i] = static_cast<uint8_t>(x);
+      log[x] = static_cast<uint8_t>(i);
+      x <<= 1;
+      if (x & 0x100) {
+        x ^= 0x11d;
+      }
+    }
+    for (int i = 255; i < 512; i++) {
+      exp[i] = exp[i - 255];
+    }
+    log[0] = 0;
+  }
+};
+
+static const gf_tables& tables() {
+  static gf_tables t;
+  return t;
+}
+
+uint8_t gf_mul(uint8_t a, uint8_t b) {
+  if (a == 0 || b == 0) {
+    return 0;
+  }
+  const gf_tables& t = tables();
+  return t.exp[t.log[a] + t.log[b]];
+}
+
+uint8_t gf_inv(uint8_t a) {
+  const gf_tables& t = tables();
+  return t.exp[255 - t.log[a]];
+}
+
+// region kernels use split nibble tables: c * x = low[x & 0xf] ^ high[x >> 4]
+static void gf_mul_region_xor_scalar(uint8_t* dst, const uint8_t* src, const uint8_t* low, const uint8_t* high, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    dst[i] ^= low[src[i] & 0x0f] ^ high[src[i] >> 4];
+  }
+}
+
+#ifdef GF_X86_SIMD
+__attribute__((target("ssse3")))
+static void gf_mul_region_xor_ssse3(uint8_t* dst, const uint8_t* src, const uint8_t* low, const uint8_t* high, size_t size) {
+  __m128i low_tbl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low));
+  __m128i high_tbl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high));
+  __m128i mask = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i s_low = _mm_and_si128(s, mask);
+    __m128i s_high = _mm_and_si128(_mm_srli_epi64(s, 4), mask);
+    __m128i p = _mm_xor_si128(_mm_shuffle_epi8(low_tbl, s_low), _mm_shuffle_epi8(high_tbl, s_high));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, p));
+  }
+  gf_mul_region_xor_scalar(dst + i, src + i, low, high, size - i);
+}
+
+__attribute__((target("avx2")))
+static void gf_mul_region_xor_avx2(uint8_t* dst, const uint8_t* src, const uint8_t* low, const uint8_t* high, size_t size) {
+  __m256i low_tbl = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(low)));
+  __m256i high_tbl = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(high)));
+  __m256i mask = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i s_low = _mm256_and_si256(s, mask);
+    __m256i s_high = _mm256_and_si256(_mm256_srli_epi64(s, 4), mask);
+    __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(low_tbl, s_low), _mm256_shuffle_epi8(high_tbl, s_high));
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(d, p));
+  }
+  gf_mul_region_xor_scalar(dst + i, src + i, low, high, size - i);
+}
+#endif
+
+// select the widest kernel supported by the running CPU (once per process)
+typedef void (*gf_region_kernel)(uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*, size_t);
+static gf_region_kernel select_kernel() {
+#ifdef GF_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return gf_mul_region_xor_avx2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return gf_mul_region_xor_ssse3;
+  }
+#endif
+  return gf_mul_region_xor_scalar;
+}
+
+void gf_mul_region_xor(uint8_t* dst, const uint8_t* src, uint8_t c, size_t size) {
+  static const gf_region_kernel kernel = select_kernel();
+  if (c == 0) {
+    return;
+  }
+  uint8_t low[16];
+  uint8_t high[16];
+  for (int i = 0; i < 16; i++) {
+    low[i] = gf_mul(c, static_cast<uint8_t>(i));
+    high[i] = gf_mul(c, static_cast<uint8_t>(i << 4));
+  }
+  kernel(dst, src, low, high, size);
+}
+
+//
+// REED-SOLOMON CODEC
+//
+
+ErasureCoder::ErasureCoder(unsigned int k, unsigned int m) {
+  this->k = k;
+  this->m = m;
+
+  // identity rows reproduce the data fragments, Cauchy rows 1 / (x_i + y_j) produce parity
+  // (x_i = k + i and y_j = j are distinct, so every k x k submatrix is invertible)
+  this->matrix.assign((k + m) * k, 0);
+  for (unsigned int i = 0; i < k; i++) {
+    this->matrix[i * k + i] = 1;
+  }
+  for (unsigned int i = 0; i < m; i++) {
+    for (unsigned int j = 0; j < k; j++) {
+      uint8_t x = static_cast<uint8_t>(k + i);
+      uint8_t y = static_cast<uint8_t>(j);
+      this->matrix[(k + i) * k + j] = gf_inv(x ^ y);
+    }
+  }
+}
+
+void ErasureCoder::encode(std::vector<std::vector<char>*>& data_fragments, std::vector<std::vector<char>*>& parity_buffer) {
+  size_t fragment_size = data_fragments.at(0)->size();
+  for (unsigned int i = 0; i < this->m; i++) {
+    std::vector<char>* parity = new std::vector<char>(fragment_size, 0);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(parity->data());
+    for (unsigned int j = 0; j < this->k; j++) {
+      const uint8_t* src = reinterpret_cast<const uint8_t*>(data_fragments[j]->data());
+      gf_mul_region_xor(dst, src, this->matrix[(this->k + i) * this->k + j], fragment_size);
+    }
+    parity_buffer.push_back(parity);
+  }
+}
+
+bool ErasureCoder::decode(std::vector<std::vector<char>*>& fragments) {
+  // nothing to do if all data fragments are present
+  std::vector<unsigned int> missing;
+  for (unsigned int i = 0; i < this->k; i++) {
+    if (fragments[i] == NULL) {
+      missing.push_back(i);
+    }
+  }
+  if (missing.empty()) {
+    return true;
+  }
+
+  // select the first k present fragments and the matching rows of the encoding matrix
+  std::vector<unsigned int> present;
+  for (unsigned int i = 0; i < this->k + this->m && present.size() < this->k; i++) {
+    if (fragments[i] != NULL) {
+      present.push_back(i);
+    }
+  }
+  if (present.size() < this->k) {
+    return false;
+  }
+  std::vector<uint8_t> square(this->k * this->k);
+  for (unsigned int r = 0; r < this->k; r++) {
+    std::memcpy(&square[r * this->k], &this->matrix[present[r] * this->k], this->k);
+  }
+  std::vector<uint8_t> inverse;
+  if (!this->invert_matrix(square, inverse)) {
+    return false;
+  }
+
+  // data fragment i = sum_j inverse[i][j] * present fragment j
+  size_t fragment_size = fragments[present[0]]->size();
+  for (unsigned int i : missing) {
+    std::vector<char>* recovered = new std::vector<char>(fragment_size, 0);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(recovered->data());
+    for (unsigned int j = 0; j < this->k; j++) {
+      const uint8_t* src = reinterpret_cast<const uint8_t*>(fragments[present[j]]->data());
+      gf_mul_region_xor(dst, src, inverse[i * this->k + j], fragment_size);
+    }
+    fragments[i] = recovered;
+  }
+  return true;
+}
+
+// Gauss-Jordan elimination over GF(2^8)
+bool ErasureCoder::invert_matrix(std::vector<uint8_t>& square, std::vector<uint8_t>& inverse_buffer) {
+  unsigned int n = this->k;
+  inverse_buffer.assign(n * n, 0);
+  for (unsigned int i = 0; i < n; i++) {
+    inverse_buffer[i * n + i] = 1;
+  }
+  for (unsigned int col = 0; col < n; col++) {
+    // find a pivot row and swap it into place
+    unsigned int pivot = col;
+    while (pivot < n && square[pivot * n + col] == 0) {
+      pivot++;
+    }
+    if (pivot == n) {
+      return false;
+    }
+    if (pivot != col) {
+      for (unsigned int j = 0; j < n; j++) {
+        std::swap(square[pivot * n + j], square[col * n + j]);
+        std::swap(inverse_buffer[pivot * n + j], inverse_buffer[col * n + j]);
+      }
+    }
+
+    // normalize the pivot row and eliminate the column from all other rows
+    uint8_t scale = gf_inv(square[col * n + col]);
+    for (unsigned int j = 0; j < n; j++) {
+      square[col * n + j] = gf_mul(square[col * n + j], scale);
+      inverse_buffer[col * n + j] = gf_mul(inverse_buffer[col * n + j], scale);
+    }
+    for (unsigned int row = 0; row < n; row++) {
+      uint8_t factor = square[row * n + col];
+      if (row == col || factor == 0) {
+        continue;
+      }
+      for (unsigned int j = 0; j < n; j++) {
+        square[row * n + j] ^= gf_mul(factor, square[col * n + j]);
+        inverse_buffer[row * n + j] ^= gf_mul(factor, inverse_buffer[col * n + j]);
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// max number of (data + parity) fragments in a stripe (bounded by the size of GF(2^8))
+#define ERASURE_MAX_FRAGMENTS 256
+
+//
+// GF(2^8) ARITHMETIC
+//
+
+uint8_t gf_mul(uint8_t a, uint8_t b);
+uint8_t gf_inv(uint8_t a);
+
+// dst[i] ^= c * src[i] for all i < size (vectorized when the CPU supports it)
+void gf_mul_region_xor(uint8_t* dst, const uint8_t* src, uint8_t c, size_t size);
+
+//
+// REED-SOLOMON CODEC
+//
+
+// ErasureCoder: systematic Reed-Solomon code over GF(2^8)
+// a stripe of k equally sized data fragments is extended with m parity fragments
+// (using a Cauchy matrix) such that any k of the k + m fragments recover the stripe
+class ErasureCoder {
+private:
+  unsigned int k;
+  unsigned int m;
+
+  // (k + m) x k encoding matrix (identity rows followed by Cauchy rows)
+  std::vector<uint8_t> matrix;
+
+  bool invert_matrix(std::vector<uint8_t>& square, std::vector<uint8_t>& inverse_buffer);
+
+public:
+  ErasureCoder(unsigned int k, unsigned int m);
+
+  // compute the m parity fragments for the k data fragments
+  // (all data fragments must have the same size)
+  void encode(std::vector<std::vector<char>*>& data_fragments, std::vector<std::vector<char>*>& parity_buffer);
+
+  // recover missing data fragments in place
+  // fragments holds k + m entries (data then parity) with NULL for missing fragments
+  // returns false if fewer than k fragments are present
+  bool decode(std::vector<std::vector<char>*>& fragments);
+};
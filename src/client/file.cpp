@@ -1,45 +1,81 @@
 #include "file.h"
+#include "erasure.h"
+#include "manifest.h"
 
 #include "src/utils/utils.h"
+#include "src/utils/metrics.h"
+
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// file layer metrics: manifest entries (chunks or stripes) are counted as stored once they were written to the
+// session, as failed if the session did not store them, and as skipped if they were already replicated (or
+// journaled), and loaded bytes once they were written out
+static Counter* stored_entries_counter(std::string mode) {
+  return metrics()->counter("distft_file_entries_stored_total", "mode=\"" + mode + "\"", "Chunks/stripes written to the session by stores");
+}
+
+static Counter* failed_entries_counter(std::string mode) {
+  return metrics()->counter("distft_file_entries_failed_total", "mode=\"" + mode + "\"", "Chunks/stripes of stores that the session failed to store");
+}
+
+static Counter* skipped_entries_counter(std::string mode) {
+  return metrics()->counter("distft_file_entries_skipped_total", "mode=\"" + mode + "\"", "Chunks/stripes of stores that were already replicated or journaled");
+}
+
+static Counter* stored_bytes_counter(std::string mode) {
+  return metrics()->counter("distft_file_bytes_stored_total", "mode=\"" + mode + "\"", "File bytes written to the session by stores");
+}
+
+static Counter* loaded_bytes_counter() {
+  return metrics()->counter("distft_file_bytes_loaded_total", "", "File bytes read from the session by loads");
+}
 
 //
 // INDEX FILE ACCESS/MUTATION
 //
+// the index is a hash trie of index pages: the page at path P (a string of hex digits) is stored under
+// the key for "index/P" and is either a leaf holding the names whose name hash starts with P, or a split
+// page whose names were moved to the 16 child pages at paths P0 ... Pf
+// page layout: type | version (u64) | names (each followed by a NUL byte)
+// pages are written as compare-and-sets on their version, so updates from concurrent writers (in any process) are
+// merged and retried instead of overwriting each other, and a split page never turns back into a leaf
 
-// index file key
-Key index_key = key_from_string(std::string("index"));
+// index page types
+const char index_leaf_page = 'L';
+const char index_split_page = 'S';
 
-// initialize the index file in the session
-bool init_index_file(Session* s) {
-  std::vector<char>* dummy_data = new std::vector<char>;
-  s->set(index_key, dummy_data, true);
-  return true;
+// size of an index page's header
+const size_t index_page_header_size = 9;
+
+// index page key
+static Key index_page_key(std::string path) {
+  return key_from_string(std::string("index/") + path);
 }
 
-// add the files to the index file chunk
-bool add_files_to_index_file(Session* s, std::vector<std::string> files) {
-  std::vector<char>* data_buffer;
-  if (!s->get(index_key, &data_buffer)) {
-    return false;
-  }
-  for (std::string file : files) {
-    data_buffer->insert(data_buffer->end(), file.begin(), file.end());
-    data_buffer->push_back('\0');
-  }
-  s->set(index_key, data_buffer, true);
-  return true;
+// hex digit of the name hash used to select the child page at the given depth
+static char index_digit(std::string file, size_t depth) {
+  char hash[KEYBYTES];
+  key_to_bytes(key_from_string(file), hash);
+  unsigned char byte = static_cast<unsigned char>(hash[(depth / 2) % KEYBYTES]);
+  unsigned char nibble = depth % 2 == 0 ? byte >> 4 : byte & 0x0f;
+  return "0123456789abcdef"[nibble];
 }
 
-// list all files in the index file (i.e., read the contents of the index file)
-bool get_index_files(Session* s, std::vector<std::string>& files_buffer) {
-  std::vector<char>* data_buffer;
-  if (!s->get(index_key, &data_buffer)) {
+// parse an index page into its type, version, and names
+static bool parse_index_page(std::vector<char>* data, char& type_buffer, uint64_t& version_buffer, std::vector<std::string>& files_buffer) {
+  if (data->size() < index_page_header_size || (data->at(0) != index_leaf_page && data->at(0) != index_split_page)) {
     return false;
   }
-
+  type_buffer = data->at(0);
+  version_buffer = get_uint(data->data() + 1, 8);
   std::string curr_file;
-  for (int i = 0; i < data_buffer->size(); i++) {
-    const char c = data_buffer->at(i);
+  for (size_t i = index_page_header_size; i < data->size(); i++) {
+    const char c = data->at(i);
     if (c == '\0') {
       if (curr_file.length() > 0) {
         files_buffer.push_back(curr_file);
@@ -52,134 +88,1571 @@ bool get_index_files(Session* s, std::vector<std::string>& files_buffer) {
   return true;
 }
 
-// return true if file already exists in session
-bool file_exists(Session* s, std::string dht_filename) {
+// read an index page into its type and names (and version, if given)
+static bool get_index_page_data(Session* s, std::string path, char& type_buffer, std::vector<std::string>& files_buffer, uint64_t* version_buffer = NULL) {
   std::vector<char>* data_buffer;
-  if (!s->get(index_key, &data_buffer)) {
+  if (!s->get(index_page_key(path), &data_buffer)) {
     return false;
   }
+  uint64_t version;
+  bool parsed = parse_index_page(data_buffer, type_buffer, version, files_buffer);
+  delete data_buffer;
+  if (!parsed) {
+    LOG_ERROR("{} MALFORMED INDEX PAGE: PATH={}", key_hex(s->self_key()), path);
+    return false;
+  }
+  if (version_buffer != NULL) {
+    *version_buffer = version;
+  }
+  return true;
+}
 
-  std::string curr_file;
-  for (int i = 0; i < data_buffer->size(); i++) {
-    const char c = data_buffer->at(i);
-    if (c == '\0') {
-      if (curr_file == dht_filename) {
+// write a version of an index page, unless a replica already holds that (or a newer) version
+// the pages held by the replicas that rejected it are added to newer_buffer (and written pages are written through
+// to the cache)
+static bool set_index_page_data(Session* s, std::string path, char type, uint64_t version, std::vector<std::string>& files,
+                                IndexCache* cache, std::vector<std::vector<char>*>& newer_buffer) {
+  std::vector<char>* data = new std::vector<char>;
+  data->push_back(type);
+  put_uint(data, version, 8);
+  for (std::string& file : files) {
+    data->insert(data->end(), file.begin(), file.end());
+    data->push_back('\0');
+  }
+  if (!s->set_versioned(index_page_key(path), data, version, newer_buffer)) {
+    return false;
+  }
+  if (cache != NULL) {
+    cache->update(path, type, files);
+  }
+  return true;
+}
+
+// find the leaf page that holds (or would hold) the file and read its names and version
+static bool find_index_leaf(Session* s, std::string file, std::string& path_buffer, std::vector<std::string>& files_buffer, uint64_t& version_buffer) {
+  path_buffer.clear();
+  while (path_buffer.length() < 2 * KEYBYTES) {
+    char type;
+    files_buffer.clear();
+    if (!get_index_page_data(s, path_buffer, type, files_buffer, &version_buffer)) {
+      return false;
+    }
+    if (type == index_leaf_page) {
+      return true;
+    }
+    path_buffer.push_back(index_digit(file, path_buffer.length()));
+  }
+  return false;
+}
+
+// initialize the index file in the session
+bool init_index_file(Session* s) {
+  std::vector<std::string> no_files;
+  std::vector<std::vector<char>*> newer;
+  bool stored = set_index_page_data(s, "", index_leaf_page, 1, no_files, NULL, newer);
+  for (std::vector<char>* page : newer) {
+    delete page;
+  }
+  // (an index that already exists is kept)
+  return stored || !newer.empty();
+}
+
+// add the files to the leaf page at the path, given the version and names it was last read with (0 and none for
+// pages that were not read)
+// on conflicts, the newer versions of the page are merged (or, if the page was split in the meantime, the files
+// are added to its children) and the update is retried with a higher version
+// a leaf that grows too large is split: its names are added to the child pages before it is marked as split
+static bool add_to_index_leaf(Session* s, std::string path, uint64_t version, std::vector<std::string> leaf,
+                              std::vector<std::string>& files, IndexCache* cache) {
+  std::mt19937 gen(std::random_device{}());
+  std::uniform_real_distribution<double> jitter(0.0, 1.0);
+  std::chrono::milliseconds backoff(INDEX_UPDATE_BACKOFF_MS);
+  for (int attempt = 0; attempt < INDEX_UPDATE_RETRIES; attempt++) {
+    for (std::string& file : files) {
+      if (std::find(leaf.begin(), leaf.end(), file) == leaf.end()) {
+        leaf.push_back(file);
+      }
+    }
+    bool split = leaf.size() > INDEX_PAGE_MAX_FILES && path.length() < 2 * KEYBYTES;
+    if (split) {
+      // (the children may already exist if the page was split concurrently, in which case they are merged)
+      std::unordered_map<char, std::vector<std::string>> children;
+      for (std::string& file : leaf) {
+        children[index_digit(file, path.length())].push_back(file);
+      }
+      for (char digit : std::string("0123456789abcdef")) {
+        if (!add_to_index_leaf(s, path + digit, 0, std::vector<std::string>(), children[digit], cache)) {
+          return false;
+        }
+      }
+    }
+    std::vector<std::string> no_files;
+    std::vector<std::vector<char>*> newer;
+    if (set_index_page_data(s, path, split ? index_split_page : index_leaf_page, version + 1, split ? no_files : leaf, cache, newer)) {
+      return true;
+    }
+
+    // merge the newer versions of the page (some replicas may have taken this version, so the next one is higher)
+    bool split_concurrently = false;
+    version++;
+    for (std::vector<char>* page : newer) {
+      char type;
+      uint64_t newer_version;
+      std::vector<std::string> newer_files;
+      if (parse_index_page(page, type, newer_version, newer_files)) {
+        version = std::max(version, newer_version);
+        split_concurrently = split_concurrently || type == index_split_page;
+        for (std::string& file : newer_files) {
+          if (std::find(leaf.begin(), leaf.end(), file) == leaf.end()) {
+            leaf.push_back(file);
+          }
+        }
+      }
+      delete page;
+    }
+    if (split_concurrently) {
+      if (split) {
+        // (the children already hold every name of the page)
         return true;
       }
-      curr_file.clear();
-    } else {
-      curr_file.push_back(c);
+      std::unordered_map<char, std::vector<std::string>> children;
+      for (std::string& file : files) {
+        children[index_digit(file, path.length())].push_back(file);
+      }
+      for (auto& pair : children) {
+        if (!add_to_index_leaf(s, path + pair.first, 0, std::vector<std::string>(), pair.second, cache)) {
+          return false;
+        }
+      }
+      return true;
     }
+    LOG_DEBUG("{} INDEX PAGE CONFLICT: PATH={} ATTEMPT={} VERSION={}", key_hex(s->self_key()), path, attempt, version);
+    std::this_thread::sleep_for(std::chrono::duration_cast<std::chrono::milliseconds>(backoff * jitter(gen)));
+    backoff = std::min(backoff * 2, std::chrono::milliseconds(INDEX_UPDATE_BACKOFF_MAX_MS));
   }
+  LOG_ERROR("{} FAILED TO UPDATE INDEX PAGE: PATH={} ATTEMPTS={}", key_hex(s->self_key()), path, INDEX_UPDATE_RETRIES);
   return false;
 }
 
+// add the files to the index file
+// only the leaf pages that hold the new files are rewritten (leaves that grow too large are split)
+// the rewritten pages are written through to the cache (if one is given)
+bool add_files_to_index_file(Session* s, std::vector<std::string> files, IndexCache* cache) {
+  // group the files by the leaf page they belong to
+  std::unordered_map<std::string, std::pair<uint64_t, std::vector<std::string>>> leaf_files;
+  std::unordered_map<std::string, std::vector<std::string>> leaf_new_files;
+  for (std::string file : files) {
+    bool found_leaf = false;
+    for (auto& pair : leaf_files) {
+      std::string path = pair.first;
+      bool in_leaf = true;
+      for (size_t depth = 0; depth < path.length() && in_leaf; depth++) {
+        in_leaf = index_digit(file, depth) == path[depth];
+      }
+      if (in_leaf) {
+        leaf_new_files[path].push_back(file);
+        found_leaf = true;
+        break;
+      }
+    }
+    if (found_leaf) {
+      continue;
+    }
+    std::string path;
+    std::vector<std::string> existing_files;
+    uint64_t version;
+    if (!find_index_leaf(s, file, path, existing_files, version)) {
+      return false;
+    }
+    leaf_files[path] = {version, existing_files};
+    leaf_new_files[path].push_back(file);
+  }
+
+  // update each touched leaf
+  for (auto& pair : leaf_new_files) {
+    std::pair<uint64_t, std::vector<std::string>>& leaf = leaf_files[pair.first];
+    if (!add_to_index_leaf(s, pair.first, leaf.first, leaf.second, pair.second, cache)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// list the files in a single leaf page of the index file
+// cursor is the path of the page to start from ("" for the first page) and next_cursor_buffer
+// is set to the path of the following page ("" once all pages have been read)
+bool get_index_page(Session* s, std::string cursor, std::vector<std::string>& files_buffer, std::string& next_cursor_buffer) {
+  // descend to the first leaf under the cursor
+  std::string path = cursor;
+  while (true) {
+    char type;
+    std::vector<std::string> page_files;
+    if (!get_index_page_data(s, path, type, page_files)) {
+      return false;
+    }
+    if (type == index_leaf_page) {
+      files_buffer.insert(files_buffer.end(), page_files.begin(), page_files.end());
+      break;
+    }
+    path.push_back('0');
+  }
+
+  // the next page is the following sibling of the deepest non-last ancestor
+  while (!path.empty() && path.back() == 'f') {
+    path.pop_back();
+  }
+  if (!path.empty()) {
+    char digit = path.back();
+    path.back() = digit == '9' ? 'a' : digit + 1;
+  }
+  next_cursor_buffer = path;
+  return true;
+}
+
+// list all files in the index file (i.e., read the contents of all index pages)
+bool get_index_files(Session* s, std::vector<std::string>& files_buffer) {
+  std::string cursor;
+  do {
+    if (!get_index_page(s, cursor, files_buffer, cursor)) {
+      return false;
+    }
+  } while (!cursor.empty());
+  return true;
+}
+
+// fetch an index page (from the cache if possible)
+static bool fetch_index_page(Session* s, std::string path, char& type_buffer, std::unordered_set<std::string>& files_buffer, IndexCache* cache) {
+  if (cache != NULL && cache->lookup(path, type_buffer, files_buffer)) {
+    return true;
+  }
+  std::vector<std::string> files;
+  if (!get_index_page_data(s, path, type_buffer, files)) {
+    return false;
+  }
+  files_buffer.insert(files.begin(), files.end());
+  if (cache != NULL) {
+    cache->update(path, type_buffer, files);
+  }
+  return true;
+}
+
+// add all of the files that already exist in session to the existing buffer
+// the index trie is walked one level at a time and each page on the files' paths is fetched
+// (concurrently) at most once, or not at all if it is held in the cache
+bool files_exist(Session* s, std::vector<std::string> dht_filenames, std::unordered_set<std::string>& existing_buffer, IndexCache* cache) {
+  std::unordered_map<std::string, std::vector<std::string>> pending_files;
+  pending_files[""] = dht_filenames;
+  while (!pending_files.empty()) {
+    std::vector<std::string> paths;
+    for (auto& pair : pending_files) {
+      paths.push_back(pair.first);
+    }
+    std::vector<char> types(paths.size());
+    std::vector<std::unordered_set<std::string>> pages(paths.size());
+    std::vector<char> page_success(paths.size(), false);
+    TaskGroup fetches;
+    for (size_t i = 0; i < paths.size(); i++) {
+      fetches.run([s, cache, &paths, &types, &pages, &page_success, i]() {
+        page_success[i] = fetch_index_page(s, paths[i], types[i], pages[i], cache);
+      });
+    }
+    fetches.wait();
+
+    // check leaves for the files and move on to the children of split pages
+    std::unordered_map<std::string, std::vector<std::string>> next_pending_files;
+    for (size_t i = 0; i < paths.size(); i++) {
+      if (!page_success[i]) {
+        return false;
+      }
+      for (std::string& file : pending_files[paths[i]]) {
+        if (types[i] == index_leaf_page) {
+          if (pages[i].count(file) > 0) {
+            existing_buffer.insert(file);
+          }
+        } else if (paths[i].length() < 2 * KEYBYTES) {
+          next_pending_files[paths[i] + index_digit(file, paths[i].length())].push_back(file);
+        }
+      }
+    }
+    pending_files = next_pending_files;
+  }
+  return true;
+}
+
+// return true if file already exists in session
+bool file_exists(Session* s, std::string dht_filename) {
+  std::unordered_set<std::string> existing;
+  if (!files_exist(s, std::vector<std::string>{dht_filename}, existing, NULL)) {
+    return false;
+  }
+  return existing.count(dht_filename) > 0;
+}
+
+//
+// INDEX CACHE
+//
+
+IndexCache::IndexCache(std::chrono::seconds ttl) {
+  this->ttl = ttl;
+  this->hit_count = 0;
+  this->miss_count = 0;
+}
+
+bool IndexCache::lookup(std::string path, char& type_buffer, std::unordered_set<std::string>& files_buffer) {
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  auto it = this->pages.find(path);
+  if (it == this->pages.end() || std::chrono::system_clock::now() - it->second.fetched >= this->ttl) {
+    this->miss_count++;
+    return false;
+  }
+  this->hit_count++;
+  type_buffer = it->second.type;
+  files_buffer.insert(it->second.files.begin(), it->second.files.end());
+  return true;
+}
+
+void IndexCache::update(std::string path, char type, std::vector<std::string>& files) {
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  cached_page& page = this->pages[path];
+  page.type = type;
+  page.files = std::unordered_set<std::string>(files.begin(), files.end());
+  page.fetched = std::chrono::system_clock::now();
+}
+
+void IndexCache::invalidate() {
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  this->pages.clear();
+}
+
+unsigned long IndexCache::hits() {
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  return this->hit_count;
+}
+
+unsigned long IndexCache::misses() {
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  return this->miss_count;
+}
+
 //
 // GENERAL FILE ACCESS/MUTATION
 //
 
 const unsigned int max_chunk_size = 1048576;
 
-// write the file from local file system to session
-bool write_from_file(Session* s, std::string file, std::string dht_filename) {
-  std::ifstream file_stream(file, std::ios::binary);
-  if (!file_stream) {
+// header identifying the version of a local file that a store journal was written for
+static std::string file_journal_header(struct stat& file_stat) {
+  uint64_t modified = file_stat.st_mtim.tv_sec * 1000000000ull + file_stat.st_mtim.tv_nsec;
+  return std::to_string(file_stat.st_size) + ":" + std::to_string(modified);
+}
+
+// read up to size bytes at the offset (fewer only at the end of the file)
+static ssize_t read_at(int fd, char* data, uint64_t size, uint64_t offset) {
+  uint64_t total = 0;
+  while (total < size) {
+    ssize_t bytes_read = pread(fd, data + total, size - total, offset + total);
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read < 0) {
+      return -1;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    total += bytes_read;
+  }
+  return total;
+}
+
+// write the whole buffer to the (possibly non-seekable) file descriptor
+bool write_fd(int fd, const char* data, uint64_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
       return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+// write the (regular) file open at the file descriptor to session
+static bool write_from_fd(Session* s, int fd, std::string dht_filename, Journal* journal, Transfer* transfer) {
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+    return false;
+  }
+  uint64_t file_size = file_stat.st_size;
+  if (journal != NULL && !journal->open(file_journal_header(file_stat), true)) {
+    LOG_ERROR("{} FAILED TO OPEN JOURNAL: FILE={}", key_hex(s->self_key()), dht_filename);
+    journal = NULL;
+  }
+
+  if (transfer != NULL) {
+    transfer->expect((file_size + max_chunk_size - 1) / max_chunk_size, file_size);
   }
 
   // (concurrently) write all data in file to the DHT
-  std::vector<Key> chunks;
+  Manifest manifest;
+  manifest.mode = REPLICATED;
+  manifest.level = 0;
+  manifest.erasure_k = 0;
+  manifest.erasure_m = 0;
+  uint64_t offset = 0;
   std::vector<char> buffer(max_chunk_size);
-  std::vector<std::thread> threads;
-  while (!file_stream.eof()) {
-    file_stream.read(buffer.data(), max_chunk_size);
-    std::size_t bytes_read = static_cast<std::size_t>(file_stream.gcount());
+  TaskGroup stores;
+
+  // chunks are probed in batches and only stored if they are not already replicated
+  static Counter* stored_entries = stored_entries_counter("replicated");
+  static Counter* skipped_entries = skipped_entries_counter("replicated");
+  static Counter* failed_entries = failed_entries_counter("replicated");
+  static Counter* stored_bytes = stored_bytes_counter("replicated");
+  std::vector<std::pair<ManifestEntry, std::vector<char>*>> pending;
+  std::atomic<unsigned int> failed_chunks(0);
+  auto store_pending = [s, journal, transfer, &pending, &stores, &failed_chunks]() {
+    std::vector<Key> keys;
+    for (auto& pair : pending) {
+      keys.push_back(pair.first.keys.at(0));
+    }
+    std::vector<char> replicated;
+    s->replicated(keys, KBUCKET_MAX, replicated);
+    for (size_t i = 0; i < pending.size(); i++) {
+      if (replicated[i]) {
+        delete pending[i].second;
+        skipped_entries->add(1);
+        if (journal != NULL) {
+          journal->record(pending[i].first);
+        }
+        if (transfer != NULL) {
+          transfer->complete(1, pending[i].first.length);
+        }
+        continue;
+      }
+      if (transfer != NULL && !transfer->begin_op()) {
+        delete pending[i].second;
+        continue;
+      }
+      ManifestEntry entry = pending[i].first;
+      std::vector<char>* data = pending[i].second;
+      stores.run([s, journal, transfer, entry, data, &failed_chunks]() mutable { 
+        // (only chunks that some peer confirmed are journaled, so resumed stores retry the others)
+        bool stored = s->set(entry.keys.at(0), data); 
+        if (!stored) {
+          LOG_ERROR("{} FAILED TO STORE CHUNK: OFFSET={}", key_hex(s->self_key()), entry.offset);
+          failed_entries->add(1);
+          failed_chunks++;
+        } else {
+          stored_entries->add(1);
+          stored_bytes->add(entry.length);
+          if (journal != NULL) {
+            journal->record(entry);
+          }
+        }
+        if (transfer != NULL) {
+          transfer->complete(1, entry.length);
+          transfer->end_op();
+        }
+      });
+    }
+    pending.clear();
+  };
+  while (transfer == NULL || !transfer->cancelled()) {
+    ManifestEntry entry;
+    uint64_t expected_size = std::min(static_cast<uint64_t>(max_chunk_size), file_size - std::min(offset, file_size));
+    if (journal != NULL && journal->completed(offset, entry) && entry.length == expected_size && expected_size > 0) {
+      manifest.entries.push_back(entry);
+      offset += entry.length;
+      skipped_entries->add(1);
+      if (transfer != NULL) {
+        transfer->complete(1, entry.length);
+      }
+      continue;
+    }
+    ssize_t bytes_read = read_at(fd, buffer.data(), max_chunk_size, offset);
+    if (bytes_read < 0) {
+      LOG_ERROR("{} FAILED TO READ FILE: FILE={} OFFSET={}", key_hex(s->self_key()), dht_filename, offset);
+      store_pending();
+      stores.wait();
+      return false;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
     std::vector<char>* data = new std::vector<char>(buffer.begin(), buffer.begin() + bytes_read);
     Key key = key_from_data(data->data(), data->size());
-    threads.push_back(std::thread(
-      [s](Key key, std::vector<char>* data) { 
-        s->set(key, data, false); 
-      }, key, data
-    ));
-    chunks.push_back(key);
+    entry = ManifestEntry{offset, static_cast<uint64_t>(bytes_read), {key}};
+    pending.push_back({entry, data});
+    if (pending.size() >= STORE_PROBE_BATCH) {
+      store_pending();
+    }
+    manifest.entries.push_back(entry);
+    offset += bytes_read;
   }
-  while (threads.size() > 0) {
-    threads.back().join();
-    threads.pop_back();
+  store_pending();
+  stores.wait();
+  if (transfer != NULL && transfer->cancelled()) {
+    return false;
+  }
+  if (failed_chunks > 0) {
+    // (the manifest is not published, so the journal keeps the stored chunks for a resumed store)
+    LOG_ERROR("{} FAILED TO STORE FILE: FILE={} CHUNKS={}", key_hex(s->self_key()), dht_filename, failed_chunks.load());
+    return false;
+  }
+
+  // write the chunk layout to the file's manifest
+  manifest.total_size = offset;
+  return publish_manifest(s, key_from_string(dht_filename), manifest, max_chunk_size);
+}
+
+// write the file from local file system (or the options' open file descriptor) to session
+// chunks recorded in the options' journal are skipped, and newly written chunks are recorded
+// every chunk store is an operation of the options' transfer, and a cancelled transfer does not publish the manifest
+// returns false (without publishing the manifest) if any chunk was not stored
+bool write_from_file(Session* s, std::string file, std::string dht_filename, transfer_options options) {
+  if (options.fd >= 0) {
+    return write_from_fd(s, options.fd, dht_filename, options.journal, options.transfer);
+  }
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool success = write_from_fd(s, fd, dht_filename, options.journal, options.transfer);
+  close(fd);
+  return success;
+}
+
+// write the (regular) file open at the file descriptor to session as erasure coded stripes
+// each stripe of (up to) k chunks is split into k data fragments and extended with m parity fragments,
+// and every fragment is stored under its own key on ERASURE_REPLICAS peers
+static bool write_from_fd_erasure(Session* s, int fd, std::string dht_filename, unsigned int k, unsigned int m, Journal* journal, Transfer* transfer) {
+  if (k == 0 || k + m > ERASURE_MAX_FRAGMENTS) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+    return false;
+  }
+  uint64_t file_size = file_stat.st_size;
+  if (journal != NULL && !journal->open(file_journal_header(file_stat), true)) {
+    LOG_ERROR("{} FAILED TO OPEN JOURNAL: FILE={}", key_hex(s->self_key()), dht_filename);
+    journal = NULL;
+  }
+
+  if (transfer != NULL) {
+    transfer->expect((file_size + k * max_chunk_size - 1) / (k * max_chunk_size), file_size);
+  }
+
+  // (concurrently) encode and write all stripes in file to the DHT
+  ErasureCoder coder(k, m);
+  Manifest manifest;
+  manifest.mode = ERASURE;
+  manifest.level = 0;
+  manifest.erasure_k = k;
+  manifest.erasure_m = m;
+  uint64_t offset = 0;
+  std::vector<char> buffer(k * max_chunk_size);
+  TaskGroup stores;
+
+  // stripes are probed in batches and only fragments that are not already replicated are stored
+  std::vector<std::pair<ManifestEntry, std::vector<std::vector<char>*>>> pending;
+  size_t pending_fragments = 0;
+  static Counter* stored_entries = stored_entries_counter("erasure");
+  static Counter* skipped_entries = skipped_entries_counter("erasure");
+  static Counter* failed_entries = failed_entries_counter("erasure");
+  static Counter* stored_bytes = stored_bytes_counter("erasure");
+  std::atomic<unsigned int> failed_stripes(0);
+  auto store_pending = [s, journal, transfer, &pending, &pending_fragments, &stores, &failed_stripes]() {
+    std::vector<Key> keys;
+    for (auto& pair : pending) {
+      keys.insert(keys.end(), pair.first.keys.begin(), pair.first.keys.end());
+    }
+    std::vector<char> replicated;
+    s->replicated(keys, ERASURE_REPLICAS, replicated);
+    size_t key_index = 0;
+    for (auto& pair : pending) {
+      std::vector<char> stripe_replicated(replicated.begin() + key_index, replicated.begin() + key_index + pair.first.keys.size());
+      key_index += pair.first.keys.size();
+      if (std::find(stripe_replicated.begin(), stripe_replicated.end(), false) == stripe_replicated.end()) {
+        for (std::vector<char>* fragment : pair.second) {
+          delete fragment;
+        }
+        skipped_entries->add(1);
+        if (journal != NULL) {
+          journal->record(pair.first);
+        }
+        if (transfer != NULL) {
+          transfer->complete(1, pair.first.length);
+        }
+        continue;
+      }
+      if (transfer != NULL && !transfer->begin_op()) {
+        for (std::vector<char>* fragment : pair.second) {
+          delete fragment;
+        }
+        continue;
+      }
+      ManifestEntry entry = pair.first;
+      std::vector<std::vector<char>*> fragments = pair.second;
+      stores.run([s, journal, transfer, entry, fragments, stripe_replicated, &failed_stripes]() mutable {
+        TaskGroup fragment_stores;
+        std::atomic<unsigned int> failed_fragments(0);
+        for (size_t i = 0; i < fragments.size(); i++) {
+          if (stripe_replicated[i]) {
+            delete fragments[i];
+            continue;
+          }
+          Key key = entry.keys[i];
+          std::vector<char>* data = fragments[i];
+          fragment_stores.run([s, key, data, &failed_fragments]() { 
+            if (!s->set(key, data, set_options{false, ERASURE_REPLICAS})) {
+              failed_fragments++;
+            }
+          });
+        }
+        fragment_stores.wait();
+        if (failed_fragments > 0) {
+          LOG_ERROR("{} FAILED TO STORE STRIPE: OFFSET={} FRAGMENTS={}", key_hex(s->self_key()), entry.offset, failed_fragments.load());
+          failed_entries->add(1);
+          failed_stripes++;
+        } else {
+          stored_entries->add(1);
+          stored_bytes->add(entry.length);
+          if (journal != NULL) {
+            journal->record(entry);
+          }
+        }
+        if (transfer != NULL) {
+          transfer->complete(1, entry.length);
+          transfer->end_op();
+        }
+      });
+    }
+    pending.clear();
+    pending_fragments = 0;
+  };
+  while (transfer == NULL || !transfer->cancelled()) {
+    ManifestEntry entry;
+    uint64_t expected_size = std::min(static_cast<uint64_t>(buffer.size()), file_size - std::min(offset, file_size));
+    if (journal != NULL && journal->completed(offset, entry) && entry.length == expected_size && expected_size > 0
+        && entry.keys.size() == k + m) {
+      manifest.entries.push_back(entry);
+      offset += entry.length;
+      skipped_entries->add(1);
+      if (transfer != NULL) {
+        transfer->complete(1, entry.length);
+      }
+      continue;
+    }
+    ssize_t read_size = read_at(fd, buffer.data(), buffer.size(), offset);
+    if (read_size < 0) {
+      LOG_ERROR("{} FAILED TO READ FILE: FILE={} OFFSET={}", key_hex(s->self_key()), dht_filename, offset);
+      store_pending();
+      stores.wait();
+      return false;
+    }
+    std::size_t bytes_read = read_size;
+    if (bytes_read == 0) {
+      break;
+    }
+
+    // split the stripe into k equally sized (zero-padded) data fragments and add parity
+    std::size_t fragment_size = (bytes_read + k - 1) / k;
+    std::vector<std::vector<char>*> fragments;
+    for (unsigned int i = 0; i < k; i++) {
+      std::vector<char>* fragment = new std::vector<char>(fragment_size, 0);
+      std::size_t start = std::min(i * fragment_size, bytes_read);
+      std::size_t end = std::min(start + fragment_size, bytes_read);
+      std::copy(buffer.begin() + start, buffer.begin() + end, fragment->begin());
+      fragments.push_back(fragment);
+    }
+    std::vector<std::vector<char>*> parity;
+    coder.encode(fragments, parity);
+    fragments.insert(fragments.end(), parity.begin(), parity.end());
+
+    entry = ManifestEntry{offset, bytes_read, {}};
+    for (std::vector<char>* fragment : fragments) {
+      entry.keys.push_back(key_from_data(fragment->data(), fragment->size()));
+    }
+    pending.push_back({entry, fragments});
+    pending_fragments += fragments.size();
+    if (pending_fragments >= STORE_PROBE_BATCH) {
+      store_pending();
+    }
+    manifest.entries.push_back(entry);
+    offset += bytes_read;
+  }
+  store_pending();
+  stores.wait();
+  if (transfer != NULL && transfer->cancelled()) {
+    return false;
+  }
+  if (failed_stripes > 0) {
+    LOG_ERROR("{} FAILED TO STORE FILE: FILE={} STRIPES={}", key_hex(s->self_key()), dht_filename, failed_stripes.load());
+    return false;
+  }
+
+  // write the stripe layout to the file's manifest
+  manifest.total_size = offset;
+  return publish_manifest(s, key_from_string(dht_filename), manifest, max_chunk_size);
+}
+
+// write the file from local file system (or the options' open file descriptor) to session as erasure coded stripes
+// stripes recorded in the options' journal are skipped, and newly written stripes are recorded
+// every stripe store is an operation of the options' transfer, and a cancelled transfer does not publish the manifest
+// returns false (without publishing the manifest) if any stripe was not fully stored
+bool write_from_file_erasure(Session* s, std::string file, std::string dht_filename, unsigned int k, unsigned int m, transfer_options options) {
+  if (options.fd >= 0) {
+    return write_from_fd_erasure(s, options.fd, dht_filename, k, m, options.journal, options.transfer);
+  }
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool success = write_from_fd_erasure(s, fd, dht_filename, k, m, options.journal, options.transfer);
+  close(fd);
+  return success;
+}
+
+// read in a single erasure coded stripe and write its (unpadded) data to the buffer
+// fetches the k data fragments first and only falls back to parity fragments for missing ones
+// (fallback fetches and retried fetches within a round, and the chunk cache lookups, are added to stats if given)
+static bool read_erasure_stripe(Session* s, ManifestEntry& entry, unsigned int k, unsigned int m, char* buffer, get_stats* stats) {
+  std::vector<std::vector<char>*> fragments(k + m, NULL);
+  unsigned int next_fragment = 0;
+  unsigned int needed = k;
+  while (needed > 0 && next_fragment < k + m) {
+    // request as many untried fragments as are still needed (striped across their replicas)
+    std::vector<Key> keys;
+    std::vector<unsigned int> indices;
+    for (; keys.size() < needed && next_fragment < k + m; next_fragment++) {
+      keys.push_back(entry.keys[next_fragment]);
+      indices.push_back(next_fragment);
+    }
+    if (stats != NULL && next_fragment > keys.size()) {
+      stats->retries += keys.size();
+    }
+    std::vector<std::vector<char>*> data;
+    s->get(keys, data, stats);
+    for (size_t i = 0; i < indices.size(); i++) {
+      fragments[indices[i]] = data[i];
+    }
+    needed = k;
+    for (std::vector<char>* fragment : fragments) {
+      if (fragment != NULL && needed > 0) {
+        needed--;
+      }
+    }
+  }
+
+  // reconstruct missing data fragments from any k fragments
+  ErasureCoder coder(k, m);
+  bool success = coder.decode(fragments);
+  if (success) {
+    uint64_t copied = 0;
+    for (unsigned int i = 0; i < k && copied < entry.length; i++) {
+      uint64_t copy_size = std::min(entry.length - copied, static_cast<uint64_t>(fragments[i]->size()));
+      std::copy(fragments[i]->begin(), fragments[i]->begin() + copy_size, buffer + copied);
+      copied += copy_size;
+    }
+    success = copied == entry.length;
   }
+  for (std::vector<char>* fragment : fragments) {
+    delete fragment;
+  }
+  return success;
+}
 
-  // write all file keys to the metadata chunk
-  Key metadata_key = key_from_string(dht_filename);
-  std::vector<char>* metadata = new std::vector<char>;
-  for (Key key : chunks) {
-    std::string key_str = key.to_string();
-    metadata->insert(metadata->end(), key_str.begin(), key_str.end());
-    metadata->push_back('\0');
+// read in the data of a single (leaf) manifest entry and write it to the buffer
+static bool read_manifest_entry(Session* s, Manifest& manifest, ManifestEntry& entry, char* buffer, get_stats* stats) {
+  if (manifest.mode == ERASURE) {
+    return read_erasure_stripe(s, entry, manifest.erasure_k, manifest.erasure_m, buffer, stats);
+  }
+  std::vector<Key> keys{entry.keys.at(0)};
+  std::vector<std::vector<char>*> chunks;
+  if (!s->get(keys, chunks, stats)) {
+    return false;
+  }
+  std::vector<char>* chunk = chunks[0];
+  bool success = chunk->size() == entry.length;
+  if (success) {
+    std::copy(chunk->begin(), chunk->end(), buffer);
+  } else {
+    LOG_ERROR("{} CHUNK HAS INCORRECT SIZE: CHUNK={} EXPECTED={} ACTUAL={}", key_hex(s->self_key()),
+                    key_hex(entry.keys.at(0)), entry.length, chunk->size());
+  }
+  delete chunk;
+  return success;
+}
+
+// read the given chunks of a replicated manifest in batches (each batch is striped across the chunks' replicas)
+// and hand the data of every chunk with the correct size to the sink
+// every batch is an operation of the transfer (if given)
+static bool read_replicated_entries(Session* s, std::vector<ManifestEntry*>& entries, const std::function<bool(ManifestEntry*, const char*)>& sink,
+                                    Transfer* transfer) {
+  bool success = true;
+  for (size_t start = 0; start < entries.size(); start += READ_BATCH_CHUNKS) {
+    size_t end = std::min(start + READ_BATCH_CHUNKS, entries.size());
+    std::vector<Key> keys;
+    for (size_t i = start; i < end; i++) {
+      keys.push_back(entries[i]->keys.at(0));
+    }
+    if (transfer != NULL && !transfer->begin_op()) {
+      return false;
+    }
+    std::vector<std::vector<char>*> chunks;
+    get_stats stats;
+    s->get(keys, chunks, &stats);
+    if (transfer != NULL) {
+      transfer->fetched(stats);
+      transfer->end_op();
+    }
+    for (size_t i = start; i < end; i++) {
+      std::vector<char>* chunk = chunks[i - start];
+      if (chunk == NULL) {
+        success = false;
+        continue;
+      }
+      if (chunk->size() != entries[i]->length) {
+        LOG_ERROR("{} CHUNK HAS INCORRECT SIZE: CHUNK={} EXPECTED={} ACTUAL={}", key_hex(s->self_key()),
+                        key_hex(entries[i]->keys.at(0)), entries[i]->length, chunk->size());
+        success = false;
+      } else if (!sink(entries[i], chunk->data())) {
+        success = false;
+      }
+      delete chunk;
+    }
+  }
+  return success;
+}
+
+// read all chunks/stripes of the manifest and write them into place in the buffer
+// (replicated chunks are read in striped batches and erasure coded stripes concurrently)
+static bool read_manifest_entries(Session* s, Manifest& manifest, char* buffer) {
+  if (manifest.mode != ERASURE) {
+    std::vector<ManifestEntry*> entries;
+    for (ManifestEntry& entry : manifest.entries) {
+      entries.push_back(&entry);
+    }
+    return read_replicated_entries(s, entries, [buffer](ManifestEntry* entry, const char* data) {
+      std::copy(data, data + entry->length, buffer + entry->offset);
+      return true;
+    }, NULL);
+  }
+  std::mutex success_lock;
+  bool success = true;
+  TaskGroup reads;
+  for (ManifestEntry& entry : manifest.entries) {
+    ManifestEntry* entry_ptr = &entry;
+    char* entry_buffer = buffer + entry.offset;
+    reads.run([s, &manifest, &success_lock, &success, entry_ptr, entry_buffer]() {
+      if (!read_manifest_entry(s, manifest, *entry_ptr, entry_buffer, NULL)) {
+        success_lock.lock();
+        success = false;
+        success_lock.unlock();
+      }
+    });
+  }
+  reads.wait();
+  return success;
+}
+
+// check that all (leaf) entries of the manifest lie within the file
+static bool manifest_in_range(Session* s, Manifest& manifest, std::string file) {
+  for (ManifestEntry& entry : manifest.entries) {
+    if (entry.offset + entry.length > manifest.total_size) {
+      LOG_ERROR("{} MALFORMED MANIFEST (ENTRY OUT OF RANGE): FILE={}", key_hex(s->self_key()), file);
+      return false;
+    }
   }
-  s->set(metadata_key, metadata, true);
   return true;
 }
 
 // read the file from session to local buffer
+// every file is read independently (its manifest and its chunks/stripes are all fetched concurrently)
 bool read_in_files(Session* s, std::vector<std::string> files, std::vector<char>** file_data_buffer) {
-  std::vector<Key> ordered_keys;
+  std::vector<std::vector<char>> file_data(files.size());
+  std::vector<char> file_success(files.size(), false);
+  TaskGroup reads;
+  for (unsigned int i = 0; i < files.size(); i++) {
+    reads.run([s, &files, &file_data, &file_success, i]() {
+      Manifest manifest;
+      if (!fetch_manifest(s, key_from_string(files[i]), manifest) || !manifest_in_range(s, manifest, files[i])) {
+        return;
+      }
+      file_data[i].resize(manifest.total_size);
+      file_success[i] = read_manifest_entries(s, manifest, file_data[i].data());
+    });
+  }
+  reads.wait();
+  for (char success : file_success) {
+    if (!success) {
+      return false;
+    }
+  }
 
-  // read in the keys for all files
-  for (std::string file : files) {
-    Key metadata_key = key_from_string(file);
-    std::vector<char>* metadata_chunk;
-    if (!s->get(metadata_key, &metadata_chunk)) {
+  // concatenate the files (without copying a single file)
+  *file_data_buffer = new std::vector<char>;
+  if (files.size() == 1) {
+    (*file_data_buffer)->swap(file_data[0]);
+    return true;
+  }
+  size_t total_size = 0;
+  for (std::vector<char>& data : file_data) {
+    total_size += data.size();
+  }
+  (*file_data_buffer)->reserve(total_size);
+  for (std::vector<char>& data : file_data) {
+    (*file_data_buffer)->insert((*file_data_buffer)->end(), data.begin(), data.end());
+  }
+  return true;
+}
+
+// write the whole buffer to the file descriptor at the offset
+static bool write_at(int fd, const char* data, uint64_t size, uint64_t offset) {
+  while (size > 0) {
+    ssize_t written = pwrite(fd, data, size, offset);
+    if (written <= 0) {
       return false;
     }
+    data += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
 
-    // read in the file keys in the metadata chunk
-    std::string curr_key;
-    for (int i = 0; i < metadata_chunk->size(); i++) {
-      const char c = metadata_chunk->at(i);
-      if (c == '\0') {
-        if (curr_key.length() != KEYBITS) {
-          spdlog::error("{} MALFORMED METADATA FILE (INCORRECTLY SIZED CHUNK KEY): CHUNK={}", hex_string(metadata_key), curr_key);
-        } else {
-          ordered_keys.push_back(Key(curr_key));
+// stream the files in order to a non-seekable file descriptor (e.g., a pipe or terminal)
+// every file's manifest is fetched concurrently, and the chunks/stripes of each file are fetched in batches
+// and written in order (the first missing chunk/stripe ends the stream)
+static bool stream_to_fd(Session* s, std::vector<std::string>& files, int fd, Transfer* transfer) {
+  std::vector<Manifest> manifests(files.size());
+  std::vector<char> fetched(files.size(), false);
+  TaskGroup fetches;
+  for (unsigned int i = 0; i < files.size(); i++) {
+    fetches.run([s, &files, &manifests, &fetched, i]() {
+      fetched[i] = fetch_manifest(s, key_from_string(files[i]), manifests[i]) && manifest_in_range(s, manifests[i], files[i]);
+    });
+  }
+  fetches.wait();
+  for (unsigned int i = 0; i < files.size(); i++) {
+    if (!fetched[i]) {
+      return false;
+    }
+    if (transfer != NULL) {
+      transfer->expect(manifests[i].entries.size(), manifests[i].total_size);
+    }
+  }
+
+  // data is written as long as every chunk/stripe directly follows the previous one
+  static Counter* loaded_bytes = loaded_bytes_counter();
+  uint64_t next_offset = 0;
+  auto write_entry = [fd, transfer, &next_offset](ManifestEntry* entry, const char* data) {
+    if (entry->offset != next_offset || !write_fd(fd, data, entry->length)) {
+      return false;
+    }
+    next_offset += entry->length;
+    loaded_bytes->add(entry->length);
+    if (transfer != NULL) {
+      transfer->complete(1, entry->length);
+    }
+    return true;
+  };
+  for (Manifest& manifest : manifests) {
+    next_offset = 0;
+    std::vector<ManifestEntry*> entries;
+    for (ManifestEntry& entry : manifest.entries) {
+      entries.push_back(&entry);
+    }
+    if (manifest.mode != ERASURE) {
+      if (!read_replicated_entries(s, entries, write_entry, transfer) || next_offset != manifest.total_size) {
+        return false;
+      }
+      continue;
+    }
+    for (size_t start = 0; start < entries.size(); start += READ_BATCH_CHUNKS) {
+      size_t end = std::min(start + READ_BATCH_CHUNKS, entries.size());
+      std::vector<std::vector<char>> buffers(end - start);
+      std::vector<char> read(end - start, false);
+      TaskGroup reads;
+      for (size_t i = start; i < end; i++) {
+        if (transfer != NULL && !transfer->begin_op()) {
+          break;
+        }
+        reads.run([s, transfer, &manifest, &entries, &buffers, &read, start, i]() {
+          get_stats stats;
+          buffers[i - start].resize(entries[i]->length);
+          read[i - start] = read_manifest_entry(s, manifest, *entries[i], buffers[i - start].data(), &stats);
+          if (transfer != NULL) {
+            transfer->fetched(stats);
+            transfer->end_op();
+          }
+        });
+      }
+      reads.wait();
+      for (size_t i = start; i < end; i++) {
+        if (!read[i - start] || !write_entry(entries[i], buffers[i - start].data())) {
+          return false;
         }
-        curr_key.clear();
-        continue;
       }
-      curr_key.push_back(c);
+    }
+    if (next_offset != manifest.total_size) {
+      return false;
     }
   }
+  return true;
+}
 
+// read the files from session into the file open at the file descriptor
+// regular files are written in place (and can be resumed with the journal), anything else is streamed in order
+// every file's manifest is fetched concurrently, and a file's chunks/stripes are fetched as soon as its position
+// in the output file is known (i.e., once the manifests of all files before it have arrived)
+static bool read_to_fd(Session* s, std::vector<std::string> files, int fd, Journal* journal, Transfer* transfer) {
+  struct stat output_stat;
+  if (fstat(fd, &output_stat) < 0) {
+    return false;
+  }
+  if (!S_ISREG(output_stat.st_mode)) {
+    return stream_to_fd(s, files, fd, transfer);
+  }
 
-  // (concurrently) read in all file chunks and store in buffer
-  std::vector<std::vector<char>*> ordered_chunks(ordered_keys.size(), NULL);
+  // records are matched by output offset, length, and (content-addressed) keys, so they stay valid
+  // for any file that did not change since the interrupted load (and only a non-empty output file can be resumed)
+  if (journal != NULL && !journal->open("load", output_stat.st_size > 0)) {
+    LOG_ERROR("{} FAILED TO OPEN JOURNAL: FD={}", key_hex(s->self_key()), fd);
+    journal = NULL;
+  }
+
+  // file sizes (or failures) are published as the manifests arrive
+  static Counter* loaded_bytes = loaded_bytes_counter();
+  std::mutex layout_lock;
+  std::condition_variable layout_cv;
+  std::vector<char> manifest_state(files.size(), 0);
+  std::vector<uint64_t> file_sizes(files.size(), 0);
+  std::mutex success_lock;
+  bool success = true;
+  auto fail = [&success_lock, &success]() {
+    success_lock.lock();
+    success = false;
+    success_lock.unlock();
+  };
+  // (every file runs on a thread of its own rather than on the executor, since it waits on the manifests of the
+  // files before it)
   std::vector<std::thread> threads;
-  for (unsigned int i = 0; i < ordered_keys.size(); i++) {
-    threads.push_back(std::thread(
-      [s](Key key, std::vector<char>** data) {
-        s->get(key, data);
-      }, ordered_keys[i], &ordered_chunks[i]
-    ));
+  for (unsigned int i = 0; i < files.size(); i++) {
+    threads.push_back(std::thread([&, i]() {
+      Manifest manifest;
+      bool fetched = fetch_manifest(s, key_from_string(files[i]), manifest) && manifest_in_range(s, manifest, files[i]);
+      std::unique_lock<std::mutex> uq_layout_lock(layout_lock);
+      manifest_state[i] = fetched ? 1 : 2;
+      file_sizes[i] = fetched ? manifest.total_size : 0;
+      layout_cv.notify_all();
+      if (fetched && transfer != NULL) {
+        transfer->expect(manifest.entries.size(), manifest.total_size);
+      }
+      if (!fetched) {
+        uq_layout_lock.unlock();
+        fail();
+        return;
+      }
+
+      // wait for the manifests of the files before this one
+      uint64_t file_offset = 0;
+      for (unsigned int j = 0; j < i; j++) {
+        while (manifest_state[j] == 0) {
+          layout_cv.wait(uq_layout_lock);
+        }
+        if (manifest_state[j] == 2) {
+          return;
+        }
+        file_offset += file_sizes[j];
+      }
+      uq_layout_lock.unlock();
+
+      // read all unfinished chunks/stripes and write them into place
+      std::vector<ManifestEntry*> pending;
+      for (ManifestEntry& entry : manifest.entries) {
+        ManifestEntry completed_entry;
+        if (journal != NULL && journal->completed(file_offset + entry.offset, completed_entry)
+            && completed_entry.length == entry.length && completed_entry.keys == entry.keys) {
+          if (transfer != NULL) {
+            transfer->complete(1, entry.length);
+          }
+          continue;
+        }
+        pending.push_back(&entry);
+      }
+      auto write_entry = [fd, journal, transfer, file_offset](ManifestEntry* entry, const char* data) {
+        ManifestEntry output_entry{file_offset + entry->offset, entry->length, entry->keys};
+        if (!write_at(fd, data, entry->length, output_entry.offset)) {
+          return false;
+        }
+        if (journal != NULL) {
+          journal->record(output_entry);
+        }
+        loaded_bytes->add(entry->length);
+        if (transfer != NULL) {
+          transfer->complete(1, entry->length);
+        }
+        return true;
+      };
+      if (manifest.mode != ERASURE) {
+        if (!read_replicated_entries(s, pending, write_entry, transfer)) {
+          fail();
+        }
+        return;
+      }
+      TaskGroup reads;
+      for (ManifestEntry* entry : pending) {
+        if (transfer != NULL && !transfer->begin_op()) {
+          fail();
+          break;
+        }
+        reads.run([s, transfer, &manifest, &fail, &write_entry, entry]() {
+          std::vector<char> buffer(entry->length);
+          get_stats stats;
+          if (!read_manifest_entry(s, manifest, *entry, buffer.data(), &stats) || !write_entry(entry, buffer.data())) {
+            fail();
+          }
+          if (transfer != NULL) {
+            transfer->fetched(stats);
+            transfer->end_op();
+          }
+        });
+      }
+      reads.wait();
+    }));
   }
   while (threads.size() > 0) {
     threads.back().join();
     threads.pop_back();
   }
-  
 
-  bool success = true;
-  *file_data_buffer = new std::vector<char>;
-  for (std::vector<char>* chunk : ordered_chunks) {
-    if (chunk == NULL) {
-      success = false;
-    } else {
-      if (success) {
-        (*file_data_buffer)->insert((*file_data_buffer)->end(), chunk->begin(), chunk->end());
+  // drop anything past the end of the (possibly shorter) files
+  uint64_t total_size = 0;
+  for (uint64_t size : file_sizes) {
+    total_size += size;
+  }
+  if (success && ftruncate(fd, total_size) < 0) {
+    success = false;
+  }
+  return success;
+}
+
+// read the files from session directly into place in the output file (or into the options' open file descriptor)
+// chunks/stripes recorded in the options' journal are already in the output file and are not fetched again
+// every read batch/stripe is an operation of the options' transfer, and a cancelled transfer fails the load
+bool read_to_file(Session* s, std::vector<std::string> files, std::string output_file, transfer_options options) {
+  if (options.fd >= 0) {
+    return read_to_fd(s, files, options.fd, options.journal, options.transfer);
+  }
+  int fd = open(output_file.c_str(), O_WRONLY | O_CREAT, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  bool success = read_to_fd(s, files, fd, options.journal, options.transfer);
+  close(fd);
+  return success;
+}
+
+//
+// OPERATION JOURNALS
+//
+// layout: magic | header length (u32) | header, followed by records of the finished entries:
+//         offset (u64) | length (u64) | key count (u16) | packed keys
+// (a record cut short by a crash is dropped when the journal is reopened)
+
+Journal::Journal(std::string path) {
+  this->path = path;
+}
+
+Journal::~Journal() {
+  if (this->stream.is_open()) {
+    this->stream.close();
+  }
+}
+
+bool Journal::open(std::string header, bool resume) {
+  std::lock_guard<std::mutex> guard(this->journal_lock);
+  this->entries.clear();
+  std::error_code ec;
+  std::filesystem::path journal_path(this->path);
+  if (journal_path.has_parent_path()) {
+    std::filesystem::create_directories(journal_path.parent_path(), ec);
+  }
+
+  // read back the records of a journal written for the same header
+  std::ifstream existing(this->path, std::ios::binary);
+  if (resume && existing) {
+    std::vector<char> data((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+    size_t header_end = 8 + header.size();
+    if (data.size() >= header_end && std::memcmp(data.data(), JOURNAL_MAGIC, 4) == 0
+        && get_uint(data.data() + 4, 4) == header.size() && std::string(data.data() + 8, header.size()) == header) {
+      size_t pos = header_end;
+      while (pos + 18 <= data.size()) {
+        size_t key_count = get_uint(data.data() + pos + 16, 2);
+        if (pos + 18 + key_count * KEYBYTES > data.size()) {
+          break;
+        }
+        ManifestEntry entry;
+        entry.offset = get_uint(data.data() + pos, 8);
+        entry.length = get_uint(data.data() + pos + 8, 8);
+        for (size_t i = 0; i < key_count; i++) {
+          entry.keys.push_back(key_from_bytes(data.data() + pos + 18 + i * KEYBYTES));
+        }
+        this->entries[entry.offset] = entry;
+        pos += 18 + key_count * KEYBYTES;
       }
-      delete chunk;
     }
   }
-  if (!success) {
-    delete (*file_data_buffer);
+  existing.close();
+
+  // rewrite the journal with the header and the (complete) records that were kept
+  std::vector<char> data(JOURNAL_MAGIC, JOURNAL_MAGIC + 4);
+  put_uint(&data, header.size(), 4);
+  data.insert(data.end(), header.begin(), header.end());
+  char key_bytes[KEYBYTES];
+  for (auto& pair : this->entries) {
+    put_uint(&data, pair.second.offset, 8);
+    put_uint(&data, pair.second.length, 8);
+    put_uint(&data, pair.second.keys.size(), 2);
+    for (Key& key : pair.second.keys) {
+      key_to_bytes(key, key_bytes);
+      data.insert(data.end(), key_bytes, key_bytes + KEYBYTES);
+    }
+  }
+  if (this->stream.is_open()) {
+    this->stream.close();
   }
-  return success;
+  this->stream.open(this->path, std::ios::binary | std::ios::trunc);
+  this->stream.write(data.data(), data.size());
+  this->stream.flush();
+  return this->stream.good();
+}
+
+bool Journal::completed(uint64_t offset, ManifestEntry& entry_buffer) {
+  std::lock_guard<std::mutex> guard(this->journal_lock);
+  auto it = this->entries.find(offset);
+  if (it == this->entries.end()) {
+    return false;
+  }
+  entry_buffer = it->second;
+  return true;
+}
+
+unsigned long Journal::num_completed() {
+  std::lock_guard<std::mutex> guard(this->journal_lock);
+  return this->entries.size();
+}
+
+void Journal::record(ManifestEntry& entry) {
+  std::lock_guard<std::mutex> guard(this->journal_lock);
+  if (!this->stream.is_open()) {
+    return;
+  }
+  std::vector<char> data;
+  put_uint(&data, entry.offset, 8);
+  put_uint(&data, entry.length, 8);
+  put_uint(&data, entry.keys.size(), 2);
+  char key_bytes[KEYBYTES];
+  for (Key& key : entry.keys) {
+    key_to_bytes(key, key_bytes);
+    data.insert(data.end(), key_bytes, key_bytes + KEYBYTES);
+  }
+  this->stream.write(data.data(), data.size());
+  this->stream.flush();
+  this->entries[entry.offset] = entry;
+}
+
+void Journal::finish() {
+  std::lock_guard<std::mutex> guard(this->journal_lock);
+  if (this->stream.is_open()) {
+    this->stream.close();
+  }
+  this->entries.clear();
+  std::error_code ec;
+  std::filesystem::remove(this->path, ec);
+}
+
+//
+// TRANSFERS
+//
+// a transfer's state is guarded by its share's lock (or its own lock without a share),
+// so that cancelling a transfer wakes up its operations waiting for a slot
+
+TransferShare::TransferShare(unsigned int capacity) {
+  this->capacity = std::max(capacity, 1u);
+  this->active = 0;
+  this->in_flight = 0;
+}
+
+Transfer::Transfer(TransferShare* share) {
+  this->share = share;
+  this->cancel_flag = false;
+  this->in_flight = 0;
+  this->chunks_done = 0;
+  this->chunks_total = 0;
+  this->bytes_done = 0;
+  this->bytes_total = 0;
+  this->retries = 0;
+  this->cache_hits = 0;
+  this->cache_misses = 0;
+  this->started = std::chrono::steady_clock::now();
+  if (share != NULL) {
+    std::lock_guard<std::mutex> guard(share->share_lock);
+    share->active++;
+    share->share_cv.notify_all();
+  }
+}
+
+Transfer::~Transfer() {
+  if (this->share != NULL) {
+    std::lock_guard<std::mutex> guard(this->share->share_lock);
+    this->share->active--;
+    this->share->share_cv.notify_all();
+  }
+}
+
+std::mutex& Transfer::state_lock() {
+  return this->share != NULL ? this->share->share_lock : this->transfer_lock;
+}
+
+void Transfer::cancel() {
+  std::lock_guard<std::mutex> guard(this->state_lock());
+  this->cancel_flag = true;
+  if (this->share != NULL) {
+    this->share->share_cv.notify_all();
+  }
+}
+
+bool Transfer::cancelled() {
+  std::lock_guard<std::mutex> guard(this->state_lock());
+  return this->cancel_flag;
+}
+
+bool Transfer::begin_op() {
+  if (this->share == NULL) {
+    std::lock_guard<std::mutex> guard(this->transfer_lock);
+    if (this->cancel_flag) {
+      return false;
+    }
+    this->in_flight++;
+    return true;
+  }
+  std::unique_lock<std::mutex> uq_share_lock(this->share->share_lock);
+  while (!this->cancel_flag && (this->in_flight >= std::max(this->share->capacity / this->share->active, 1u)
+                                || this->share->in_flight >= this->share->capacity)) {
+    this->share->share_cv.wait(uq_share_lock);
+  }
+  if (this->cancel_flag) {
+    return false;
+  }
+  this->in_flight++;
+  this->share->in_flight++;
+  return true;
+}
+
+void Transfer::end_op() {
+  if (this->share == NULL) {
+    std::lock_guard<std::mutex> guard(this->transfer_lock);
+    this->in_flight--;
+    return;
+  }
+  std::lock_guard<std::mutex> guard(this->share->share_lock);
+  this->in_flight--;
+  this->share->in_flight--;
+  this->share->share_cv.notify_all();
+}
+
+void Transfer::expect(uint64_t chunks, uint64_t bytes) {
+  std::lock_guard<std::mutex> guard(this->state_lock());
+  this->chunks_total += chunks;
+  this->bytes_total += bytes;
+}
+
+void Transfer::complete(uint64_t chunks, uint64_t bytes) {
+  std::lock_guard<std::mutex> guard(this->state_lock());
+  this->chunks_done += chunks;
+  this->bytes_done += bytes;
+}
+
+void Transfer::fetched(get_stats& stats) {
+  std::lock_guard<std::mutex> guard(this->state_lock());
+  this->retries += stats.retries;
+  this->cache_hits += stats.cache_hits;
+  this->cache_misses += stats.cache_misses;
+}
+
+void Transfer::cache_lookups(unsigned long& hits_buffer, unsigned long& misses_buffer) {
+  std::lock_guard<std::mutex> guard(this->state_lock());
+  hits_buffer = this->cache_hits;
+  misses_buffer = this->cache_misses;
+}
+
+void Transfer::progress(transfer_progress& progress_buffer) {
+  std::lock_guard<std::mutex> guard(this->state_lock());
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - this->started;
+  progress_buffer = transfer_progress{this->chunks_done, this->chunks_total, this->bytes_done, this->bytes_total,
+                                      this->in_flight, this->retries, elapsed.count()};
+}
+
+//
+// RANGED FILE ACCESS
+//
+
+FileReader::FileReader(Session* s, std::string dht_filename) {
+  this->s = s;
+  this->dht_filename = dht_filename;
+  this->manifest.total_size = 0;
+  this->fetches_in_flight = 0;
+  this->pinned_first = 1;
+  this->pinned_last = 0;
+  this->last_read_end = 0;
+}
+
+FileReader::~FileReader() {
+  std::unique_lock<std::mutex> uq_cache_lock(this->cache_lock);
+  while (this->fetches_in_flight > 0) {
+    this->cache_cv.wait(uq_cache_lock);
+  }
+  for (auto& pair : this->cache) {
+    delete pair.second.data;
+  }
+}
+
+bool FileReader::open() {
+  return fetch_manifest(this->s, key_from_string(this->dht_filename), this->manifest)
+          && manifest_in_range(this->s, this->manifest, this->dht_filename);
+}
+
+uint64_t FileReader::size() {
+  return this->manifest.total_size;
+}
+
+// index of the (leaf) manifest entry that holds the offset
+size_t FileReader::find_entry(uint64_t offset) {
+  auto it = std::upper_bound(this->manifest.entries.begin(), this->manifest.entries.end(), offset,
+    [](uint64_t offset, ManifestEntry& entry) {
+      return offset < entry.offset;
+    }
+  );
+  return it == this->manifest.entries.begin() ? 0 : it - this->manifest.entries.begin() - 1;
+}
+
+// start a background fetch of the entry unless it is already cached or in flight
+// (expects cache_lock to be held)
+void FileReader::request_entry(size_t i) {
+  if (i >= this->manifest.entries.size()) {
+    return;
+  }
+  auto it = this->cache.find(i);
+  if (it != this->cache.end() && !it->second.failed) {
+    return;
+  }
+  if (it != this->cache.end()) {
+    // retry entries that failed to prefetch
+    it->second.failed = false;
+    this->lru.splice(this->lru.begin(), this->lru, it->second.lru_it);
+  } else {
+    this->lru.push_front(i);
+    this->cache[i] = cached_entry{NULL, false, false, this->lru.begin()};
+  }
+  this->fetches_in_flight++;
+  this->fetches.run([this, i]() { this->fetch_entry(i); });
+}
+
+void FileReader::fetch_entry(size_t i) {
+  ManifestEntry& entry = this->manifest.entries[i];
+  std::vector<char>* data = new std::vector<char>(entry.length);
+  bool success = read_manifest_entry(this->s, this->manifest, entry, data->data(), NULL);
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  cached_entry& cached = this->cache[i];
+  cached.ready = success;
+  cached.failed = !success;
+  if (success) {
+    cached.data = data;
+  } else {
+    delete data;
+  }
+  this->fetches_in_flight--;
+  this->evict_entries();
+  this->cache_cv.notify_all();
+}
+
+// drop least recently used (fetched or failed) entries until the cache is within its capacity
+// entries of the range currently being read are pinned and never dropped
+// (expects cache_lock to be held)
+void FileReader::evict_entries() {
+  auto it = this->lru.end();
+  while (this->cache.size() > FILE_READER_CACHE_ENTRIES && it != this->lru.begin()) {
+    it--;
+    cached_entry& cached = this->cache[*it];
+    if ((!cached.ready && !cached.failed) || (*it >= this->pinned_first && *it <= this->pinned_last)) {
+      continue;
+    }
+    delete cached.data;
+    this->cache.erase(*it);
+    it = this->lru.erase(it);
+  }
+}
+
+bool FileReader::read(uint64_t offset, uint64_t length, std::vector<char>& buffer) {
+  buffer.clear();
+  if (offset >= this->manifest.total_size || length == 0) {
+    return true;
+  }
+  length = std::min(length, this->manifest.total_size - offset);
+  uint64_t end = offset + length;
+  size_t first = this->find_entry(offset);
+  size_t last = this->find_entry(end - 1);
+  buffer.resize(length);
+
+  std::unique_lock<std::mutex> uq_cache_lock(this->cache_lock);
+  bool sequential = offset == this->last_read_end && offset > 0;
+  this->last_read_end = end;
+  for (size_t i = first; i <= last; i++) {
+    // keep up to a cache's worth of the range's entries pinned and in flight
+    this->pinned_first = i;
+    this->pinned_last = std::min(last, i + FILE_READER_CACHE_ENTRIES - 1);
+    for (size_t j = this->pinned_first; j <= this->pinned_last; j++) {
+      this->request_entry(j);
+    }
+    while (!this->cache[i].ready && !this->cache[i].failed) {
+      this->cache_cv.wait(uq_cache_lock);
+    }
+    cached_entry& cached = this->cache[i];
+    if (cached.failed) {
+      this->lru.erase(cached.lru_it);
+      this->cache.erase(i);
+      this->pinned_first = 1;
+      this->pinned_last = 0;
+      buffer.clear();
+      return false;
+    }
+
+    // copy the overlap of the entry and the range, and mark the entry as recently used
+    ManifestEntry& entry = this->manifest.entries[i];
+    uint64_t copy_start = std::max(offset, entry.offset);
+    uint64_t copy_end = std::min(end, entry.offset + entry.length);
+    std::copy(cached.data->begin() + (copy_start - entry.offset), cached.data->begin() + (copy_end - entry.offset),
+                buffer.begin() + (copy_start - offset));
+    this->lru.splice(this->lru.begin(), this->lru, cached.lru_it);
+  }
+  this->pinned_first = 1;
+  this->pinned_last = 0;
+  this->evict_entries();
+  static Counter* loaded_bytes = loaded_bytes_counter();
+  loaded_bytes->add(length);
+
+  // read ahead of sequential readers
+  if (sequential) {
+    for (size_t i = last + 1; i <= last + FILE_READER_READ_AHEAD; i++) {
+      this->request_entry(i);
+    }
+  }
+  return true;
 }
@@ -1,12 +1,229 @@
 #include "src/dht/session.h"
+#include "src/client/manifest.h"
+#include "src/utils/executor.h"
 
 #include <vector>
+#include <list>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <fstream>
+
+// number of peers that store each erasure coded fragment
+#define ERASURE_REPLICAS 3
+
+// number of chunks (or fragments) whose replication is probed at once before they are stored
+#define STORE_PROBE_BATCH 64
+
+// number of (replicated) chunks fetched at once, striped across their replicas
+#define READ_BATCH_CHUNKS 64
+
+// max number of files in an index page before it is split
+#define INDEX_PAGE_MAX_FILES 1024
+
+// max attempts at an index page update that keeps conflicting with concurrent updates of other writers
+// (conflicting writers back off for a random time of up to INDEX_UPDATE_BACKOFF_MS, doubled on every attempt up to
+// INDEX_UPDATE_BACKOFF_MAX_MS, so that one of them gets to update every replica of the page)
+#define INDEX_UPDATE_RETRIES 16
+#define INDEX_UPDATE_BACKOFF_MS 10
+#define INDEX_UPDATE_BACKOFF_MAX_MS 1000
+
+// seconds before a cached index page must be re-fetched
+#define INDEX_CACHE_TTL 30
+
+// IndexCache: client-side copy of recently fetched index pages
+// pages are served from the cache until they are older than the TTL (or the cache is invalidated)
+class IndexCache {
+private:
+  struct cached_page {
+    char type;
+    std::unordered_set<std::string> files;
+    std::chrono::time_point<std::chrono::system_clock> fetched;
+  };
+
+  std::mutex cache_lock;
+  std::unordered_map<std::string, cached_page> pages;
+  std::chrono::seconds ttl;
+  unsigned long hit_count;
+  unsigned long miss_count;
+
+public:
+  IndexCache(std::chrono::seconds ttl);
+
+  // return false if the page is not cached (or has expired)
+  bool lookup(std::string path, char& type_buffer, std::unordered_set<std::string>& files_buffer);
+  void update(std::string path, char type, std::vector<std::string>& files);
+  void invalidate();
+  unsigned long hits();
+  unsigned long misses();
+};
+
+// max number of chunks/stripes held in a FileReader's cache
+#define FILE_READER_CACHE_ENTRIES 16
+
+// number of chunks/stripes prefetched past a read once sequential access is detected
+#define FILE_READER_READ_AHEAD 4
+
+// FileReader: random-access reads of byte ranges of a stored file
+// ranges are mapped to chunks/stripes through the file's manifest, recently fetched ones are kept in an LRU
+// cache, and the following chunks/stripes are prefetched when consecutive reads are sequential
+// (a single FileReader should only be read from one thread at a time)
+class FileReader {
+private:
+  struct cached_entry {
+    std::vector<char>* data;
+    bool ready;
+    bool failed;
+    std::list<size_t>::iterator lru_it;
+  };
+
+  Session* s;
+  std::string dht_filename;
+  Manifest manifest;
+  std::mutex cache_lock;
+  std::condition_variable cache_cv;
+  std::unordered_map<size_t, cached_entry> cache;
+  std::list<size_t> lru;
+  unsigned int fetches_in_flight;
+  size_t pinned_first;
+  size_t pinned_last;
+  uint64_t last_read_end;
+  TaskGroup fetches;
+
+  size_t find_entry(uint64_t offset);
+  void request_entry(size_t i);
+  void fetch_entry(size_t i);
+  void evict_entries();
+
+public:
+  FileReader(Session* s, std::string dht_filename);
+  ~FileReader();
+
+  // fetch the file's manifest (must succeed before reading)
+  bool open();
+  uint64_t size();
+
+  // read up to length bytes starting at offset (fewer if the range passes the end of the file)
+  bool read(uint64_t offset, uint64_t length, std::vector<char>& buffer);
+};
+
+#define JOURNAL_MAGIC "DFTJ"
+
+// Journal: local append-only record of the finished chunks/stripes of a (resumable) store or load
+// records are only reused when the journal is reopened for the same operation header (e.g., the same file
+// size and modification time), otherwise the journal is restarted
+class Journal {
+private:
+  std::string path;
+  std::mutex journal_lock;
+  std::ofstream stream;
+  std::unordered_map<uint64_t, ManifestEntry> entries;
+
+public:
+  Journal(std::string path);
+  ~Journal();
+
+  // open the journal for the operation (reusing existing records if resume is set and the header matches)
+  bool open(std::string header, bool resume);
+  bool completed(uint64_t offset, ManifestEntry& entry_buffer);
+  unsigned long num_completed();
+  void record(ManifestEntry& entry);
+
+  // remove the journal once the operation has finished
+  void finish();
+};
+
+// TransferShare: fair share of a fixed number of concurrent transfer operations (chunk stores, stripes, read batches)
+// every active transfer may have at most max(1, capacity / active transfers) operations in flight
+class TransferShare {
+private:
+  std::mutex share_lock;
+  std::condition_variable share_cv;
+  unsigned int capacity;
+  unsigned int active;
+  unsigned int in_flight;
+
+  friend class Transfer;
+
+public:
+  TransferShare(unsigned int capacity);
+};
+
+// progress of a transfer: chunks are the entries of the files' manifests (chunks or erasure coded stripes)
+struct transfer_progress {
+  uint64_t chunks_done;
+  uint64_t chunks_total;
+  uint64_t bytes_done;
+  uint64_t bytes_total;
+  unsigned int in_flight;
+  unsigned long retries;
+  double elapsed;
+};
+
+// Transfer: a single (cancellable) store or load, optionally limited by a transfer share
+// the store/load functions report the transfer's progress as they go
+class Transfer {
+private:
+  TransferShare* share;
+  std::mutex transfer_lock;
+  bool cancel_flag;
+  unsigned int in_flight;
+  uint64_t chunks_done;
+  uint64_t chunks_total;
+  uint64_t bytes_done;
+  uint64_t bytes_total;
+  unsigned long retries;
+  unsigned long cache_hits;
+  unsigned long cache_misses;
+  std::chrono::time_point<std::chrono::steady_clock> started;
+
+  std::mutex& state_lock();
+
+public:
+  Transfer(TransferShare* share);
+  ~Transfer();
+
+  // wake up all waiting operations, which then fail
+  void cancel();
+  bool cancelled();
+
+  // wait for a free operation slot (false if the transfer is cancelled)
+  bool begin_op();
+  void end_op();
+
+  // progress reporting
+  void expect(uint64_t chunks, uint64_t bytes);
+  void complete(uint64_t chunks, uint64_t bytes);
+  void fetched(get_stats& stats);
+  void progress(transfer_progress& progress_buffer);
+
+  // chunk cache hits and misses of the transfer's fetches
+  void cache_lookups(unsigned long& hits_buffer, unsigned long& misses_buffer);
+};
+
+// options of file stores and loads
+// journal: resume from (and record the progress in) the journal
+// transfer: run the operations as part of the transfer (for cancellation, fair sharing, and progress)
+// fd: store from (or load into) the open file descriptor instead of the file at the path
+struct transfer_options {
+  Journal* journal = NULL;
+  Transfer* transfer = NULL;
+  int fd = -1;
+};
 
 // FILES
 bool init_index_file(Session* s);
-bool add_files_to_index_file(Session* s, std::vector<std::string> files);
+bool add_files_to_index_file(Session* s, std::vector<std::string> files, IndexCache* cache);
 bool get_index_files(Session* s, std::vector<std::string>& files_buffer);
-bool write_from_file(Session* s, std::string file, std::string dht_filename);
+bool get_index_page(Session* s, std::string cursor, std::vector<std::string>& files_buffer, std::string& next_cursor_buffer);
+bool write_from_file(Session* s, std::string file, std::string dht_filename, transfer_options options = {});
+bool write_from_file_erasure(Session* s, std::string file, std::string dht_filename, unsigned int k, unsigned int m, transfer_options options = {});
 bool read_in_files(Session* s, std::vector<std::string> files, std::vector<char>** file_data_buffer);
+bool read_to_file(Session* s, std::vector<std::string> files, std::string output_file, transfer_options options = {});
+bool write_fd(int fd, const char* data, uint64_t size);
 bool file_exists(Session* s, std::string dht_filename);
+bool files_exist(Session* s, std::vector<std::string> dht_filenames, std::unordered_set<std::string>& existing_buffer, IndexCache* cache);
@@ -20,7 +20,7 @@ int run_founder_session_interactive() {
   }
   
   CommandControl ctrl = CommandControl();
-  if (!ctrl.bootstrap_cmd(endpoints) || !ctrl.start_background_strain_reliever_cmd()) {
+  if (!ctrl.bootstrap_cmd(endpoints)) {
     std::cout << "Error occurred while creating session. :(" << std::endl;
     std::cout << ctrl.get_cmd_err().c_str() << std::endl;
     return 0;
@@ -44,28 +44,71 @@ int run_founder_session_interactive() {
     } else if (tokens[0] == "help") {
       std::cout << interactive_commands().c_str() << std::endl;
     } else if (tokens[0] == "list") {
-      success = ctrl.list_cmd();
+      if (tokens.size() > 1 && tokens[1] == "--page") {
+        success = ctrl.list_page_cmd(tokens.size() > 2 ? tokens[2] : "");
+      } else {
+        success = ctrl.list_cmd();
+      }
     } else if (tokens[0] == "store") {
       if (tokens.size() < 2) {
         std::cout << "Please provide file(s) to add." << std::endl;
         continue;
       }
+      unsigned int erasure_k = 0;
+      unsigned int erasure_m = 0;
+      int first_file = 1;
+      if (tokens[1] == "--erasure") {
+        if (tokens.size() < 4 || !parse_erasure_arg(tokens[2], erasure_k, erasure_m)) {
+          std::cout << "Please provide erasure coding parameters <k>:<m> and file(s) to add." << std::endl;
+          continue;
+        }
+        first_file = 3;
+      }
       std::vector<std::string> files;
-      for (int i = 1; i < tokens.size(); i++) {
+      for (int i = first_file; i < tokens.size(); i++) {
         files.push_back(tokens[i]);
       }
-      success = ctrl.store_cmd(files);
+      success = ctrl.store_cmd(files, store_options{erasure_k, erasure_m});
     } else if (tokens[0] == "load") {
       if (tokens.size() < 3) {
         std::cout << "Please provide file to print/file to write to." << std::endl;
         continue;
       }
-      std::vector<std::string> files;
-      for (int i = 1; i < tokens.size() - 1; i++) {
-        files.push_back(tokens[i]);
+      if (tokens[1] == "--range") {
+        uint64_t offset;
+        uint64_t length;
+        if (tokens.size() != 5 || !parse_range_arg(tokens[2], offset, length)) {
+          std::cout << "Please provide a byte range <offset>:<length>, file to print, and file to write to." << std::endl;
+          continue;
+        }
+        success = ctrl.load_range_cmd(tokens[3], offset, length, tokens[4]);
+      } else if (tokens[1] == "--split") {
+        if (tokens.size() < 4) {
+          std::cout << "Please provide file(s) to print and directory to write to." << std::endl;
+          continue;
+        }
+        std::vector<std::string> files(tokens.begin() + 2, tokens.end() - 1);
+        success = ctrl.load_split_cmd(files, tokens.back());
+      } else {
+        std::vector<std::string> files;
+        for (int i = 1; i < tokens.size() - 1; i++) {
+          files.push_back(tokens[i]);
+        }
+        std::string output_file = tokens.back();
+        success = ctrl.load_cmd(files, output_file);
+      }
+    } else if (tokens[0] == "stats") {
+      success = ctrl.stats_cmd(tokens.size() > 1 && tokens[1] == "--prometheus");
+    } else if (tokens[0] == "trace") {
+      double sample_rate;
+      if (tokens.size() == 3 && tokens[1] == "--sample" && parse_sample_rate_arg(tokens[2], sample_rate)) {
+        success = ctrl.trace_cmd(sample_rate);
+      } else if (tokens.size() == 1) {
+        success = ctrl.trace_cmd();
+      } else {
+        std::cout << "Provide either no arguments or --sample <rate between 0 and 1>." << std::endl;
+        continue;
       }
-      std::string output_file = tokens.back();
-      success = ctrl.load_cmd(files, output_file);
     } else if (tokens[0] == "exit") {
       ctrl.exit_cmd();
       exit(0);
@@ -91,12 +134,18 @@ int run_transient_interactive() {
   std::string local_endpoint;
   std::getline(std::cin, local_endpoint);
 
-  std::cout << "Enter 1 remote endpoint: ";
+  std::cout << "Enter remote endpoint(s) (space separated): ";
+  std::string remote_line;
+  std::getline(std::cin, remote_line);
+  std::istringstream remote_stream(remote_line);
+  std::vector<std::string> remote_endpoints;
   std::string remote_endpoint;
-  std::getline(std::cin, remote_endpoint);
+  while (remote_stream >> remote_endpoint) {
+    remote_endpoints.push_back(remote_endpoint);
+  }
   
   CommandControl ctrl = CommandControl();
-  if (!ctrl.join_cmd(local_endpoint, remote_endpoint)) {
+  if (!ctrl.join_cmd(local_endpoint, remote_endpoints)) {
     std::cout << "Error occurred while joining session. :(" << std::endl;
     std::cout << ctrl.get_cmd_err().c_str() << std::endl;
     return 0;
@@ -120,18 +169,51 @@ int run_transient_interactive() {
     } else if (tokens[0] == "help") {
       std::cout << interactive_commands().c_str() << std::endl;
     } else if (tokens[0] == "list") {
-      success = ctrl.list_cmd();
+      if (tokens.size() > 1 && tokens[1] == "--page") {
+        success = ctrl.list_page_cmd(tokens.size() > 2 ? tokens[2] : "");
+      } else {
+        success = ctrl.list_cmd();
+      }
     } else if (tokens[0] == "load") {
       if (tokens.size() < 3) {
         std::cout << "Please provide file to print/file to write to." << std::endl;
         continue;
       }
-      std::vector<std::string> files;
-      for (int i = 1; i < tokens.size() - 1; i++) {
-        files.push_back(tokens[i]);
+      if (tokens[1] == "--range") {
+        uint64_t offset;
+        uint64_t length;
+        if (tokens.size() != 5 || !parse_range_arg(tokens[2], offset, length)) {
+          std::cout << "Please provide a byte range <offset>:<length>, file to print, and file to write to." << std::endl;
+          continue;
+        }
+        success = ctrl.load_range_cmd(tokens[3], offset, length, tokens[4]);
+      } else if (tokens[1] == "--split") {
+        if (tokens.size() < 4) {
+          std::cout << "Please provide file(s) to print and directory to write to." << std::endl;
+          continue;
+        }
+        std::vector<std::string> files(tokens.begin() + 2, tokens.end() - 1);
+        success = ctrl.load_split_cmd(files, tokens.back());
+      } else {
+        std::vector<std::string> files;
+        for (int i = 1; i < tokens.size() - 1; i++) {
+          files.push_back(tokens[i]);
+        }
+        std::string output_file = tokens.back();
+        success = ctrl.load_cmd(files, output_file);
+      }
+    } else if (tokens[0] == "stats") {
+      success = ctrl.stats_cmd(tokens.size() > 1 && tokens[1] == "--prometheus");
+    } else if (tokens[0] == "trace") {
+      double sample_rate;
+      if (tokens.size() == 3 && tokens[1] == "--sample" && parse_sample_rate_arg(tokens[2], sample_rate)) {
+        success = ctrl.trace_cmd(sample_rate);
+      } else if (tokens.size() == 1) {
+        success = ctrl.trace_cmd();
+      } else {
+        std::cout << "Provide either no arguments or --sample <rate between 0 and 1>." << std::endl;
+        continue;
       }
-      std::string output_file = tokens.back();
-      success = ctrl.load_cmd(files, output_file);
     } else if (tokens[0] == "exit") {
       ctrl.exit_cmd();
       exit(0);
@@ -155,9 +237,14 @@ int run_transient_interactive() {
 std::string interactive_commands() {
   return R"(
   help: print all commands
-  list: print all files
-  [RESTRICTED TO FOUNDERS] store <file path 1> ... <file path n>: add file(s) at local file path(s) to session
+  list [--page [cursor]]: print all files (or a single page of files starting at the cursor)
+  [RESTRICTED TO FOUNDERS] store [--erasure <k>:<m>] <file path 1> ... <file path n>: add file(s) at local file path(s) to session
+    (optionally erasure coded into k data + m parity fragments per stripe)
   load <file name 1> ... <file name n> <file path>: write the content of file name(s) to local file path
+  load --range <offset>:<length> <file name> <file path>: write a byte range of file name to local file path
+  load --split <file name 1> ... <file name n> <dir path>: write each file name to its own file in local dir path
+  stats [--prometheus]: print the process's metrics (or all of them in the Prometheus text format)
+  trace [--sample <rate>]: print the latest DHT lookup traces as Chrome trace JSON (or trace the given fraction of lookups)
   exit: exit the session
 )";
 }
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "src/client/jobs.h"
+#include "src/client/file.h"
+
+#include <algorithm>
+
+JobScheduler::JobScheduler(unsigned int num_workers, unsigned int share_capacity) {
+  this->stopping = false;
+  this->next_id = 1;
+  this->share = new TransferShare(share_capacity);
+  for (unsigned int i = 0; i < std::max(num_workers, 1u); i++) {
+    this->workers.push_back(new std::thread(&JobScheduler::work, this));
+  }
+}
+
+JobScheduler::~JobScheduler() {
+  this->shutdown();
+  for (auto& pair : this->jobs) {
+    delete pair.second;
+  }
+  delete this->share;
+}
+
+// run queued jobs until the scheduler stops
+void JobScheduler::work() {
+  std::unique_lock<std::mutex> uq_jobs_lock(this->jobs_lock);
+  while (true) {
+    while (!this->stopping && this->queue.empty()) {
+      this->queue_cv.wait(uq_jobs_lock);
+    }
+    if (this->stopping) {
+      return;
+    }
+    job* j = this->jobs[this->queue.front()];
+    this->queue.pop_front();
+    j->status.state = JOB_RUNNING;
+    j->transfer = new Transfer(this->share);
+    uq_jobs_lock.unlock();
+
+    std::string err;
+    std::string out;
+    bool success = j->fn(j->transfer, err, out);
+
+    uq_jobs_lock.lock();
+    j->status.err = err;
+    j->status.out = out;
+    JOB_STATE state = success ? JOB_DONE : (j->transfer->cancelled() ? JOB_CANCELLED : JOB_FAILED);
+    delete j->transfer;
+    j->transfer = NULL;
+    this->finish(j, state);
+  }
+}
+
+// move the job into the history (dropping the oldest finished jobs)
+// (expects jobs_lock to be held)
+void JobScheduler::finish(job* j, JOB_STATE state) {
+  j->status.state = state;
+  j->fn = NULL;
+  this->history.push_back(j->status.id);
+  while (this->history.size() > JOB_HISTORY) {
+    auto it = this->jobs.find(this->history.front());
+    delete it->second;
+    this->jobs.erase(it);
+    this->history.pop_front();
+  }
+  this->done_cv.notify_all();
+}
+
+uint32_t JobScheduler::submit(std::string description, job_fn fn) {
+  std::lock_guard<std::mutex> guard(this->jobs_lock);
+  job* j = new job{job_status{this->next_id++, description, JOB_QUEUED, "", ""}, fn, NULL};
+  this->jobs[j->status.id] = j;
+  if (this->stopping) {
+    j->status.err = "Job scheduler is shutting down";
+    this->finish(j, JOB_CANCELLED);
+    return j->status.id;
+  }
+  this->queue.push_back(j->status.id);
+  this->queue_cv.notify_one();
+  return j->status.id;
+}
+
+bool JobScheduler::wait(uint32_t id, job_status& status_buffer) {
+  return this->wait(id, status_buffer, std::chrono::milliseconds::max());
+}
+
+// stops waiting after the timeout (the copied status is then still queued or running)
+bool JobScheduler::wait(uint32_t id, job_status& status_buffer, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> uq_jobs_lock(this->jobs_lock);
+  auto deadline = timeout == std::chrono::milliseconds::max() ? std::chrono::steady_clock::time_point::max()
+                                                                : std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    auto it = this->jobs.find(id);
+    if (it == this->jobs.end()) {
+      return false;
+    }
+    status_buffer = it->second->status;
+    if (status_buffer.state != JOB_QUEUED && status_buffer.state != JOB_RUNNING) {
+      return true;
+    }
+    if (deadline == std::chrono::steady_clock::time_point::max()) {
+      this->done_cv.wait(uq_jobs_lock);
+    } else if (this->done_cv.wait_until(uq_jobs_lock, deadline) == std::cv_status::timeout) {
+      return true;
+    }
+  }
+}
+
+bool JobScheduler::status(uint32_t id, job_status& status_buffer) {
+  std::lock_guard<std::mutex> guard(this->jobs_lock);
+  auto it = this->jobs.find(id);
+  if (it == this->jobs.end()) {
+    return false;
+  }
+  status_buffer = it->second->status;
+  return true;
+}
+
+bool JobScheduler::progress(uint32_t id, transfer_progress& progress_buffer) {
+  std::lock_guard<std::mutex> guard(this->jobs_lock);
+  auto it = this->jobs.find(id);
+  if (it == this->jobs.end() || it->second->status.state != JOB_RUNNING) {
+    return false;
+  }
+  it->second->transfer->progress(progress_buffer);
+  return true;
+}
+
+// statuses of all known jobs (ordered by id)
+void JobScheduler::statuses(std::vector<job_status>& statuses_buffer) {
+  std::lock_guard<std::mutex> guard(this->jobs_lock);
+  for (auto& pair : this->jobs) {
+    statuses_buffer.push_back(pair.second->status);
+  }
+  std::sort(statuses_buffer.begin(), statuses_buffer.end(), [](job_status& a, job_status& b) {
+    return a.id < b.id;
+  });
+}
+
+// queued jobs are finished right away, running jobs stop at their next operation
+bool JobScheduler::cancel(uint32_t id) {
+  std::lock_guard<std::mutex> guard(this->jobs_lock);
+  auto it = this->jobs.find(id);
+  if (it == this->jobs.end()) {
+    return false;
+  }
+  job* j = it->second;
+  if (j->status.state == JOB_QUEUED) {
+    this->queue.erase(std::find(this->queue.begin(), this->queue.end(), id));
+    this->finish(j, JOB_CANCELLED);
+    return true;
+  }
+  if (j->status.state == JOB_RUNNING) {
+    j->transfer->cancel();
+    return true;
+  }
+  return false;
+}
+
+void JobScheduler::shutdown() {
+  std::unique_lock<std::mutex> uq_jobs_lock(this->jobs_lock);
+  this->stopping = true;
+  while (this->queue.size() > 0) {
+    job* j = this->jobs[this->queue.front()];
+    this->queue.pop_front();
+    this->finish(j, JOB_CANCELLED);
+  }
+  for (auto& pair : this->jobs) {
+    if (pair.second->status.state == JOB_RUNNING) {
+      pair.second->transfer->cancel();
+    }
+  }
+  this->queue_cv.notify_all();
+  uq_jobs_lock.unlock();
+  while (this->workers.size() > 0) {
+    this->workers.back()->join();
+    delete this->workers.back();
+    this->workers.pop_back();
+  }
+}
+
+std::string job_state_string(JOB_STATE state) {
+  switch (state) {
+    case JOB_QUEUED:
+      return "QUEUED";
+    case JOB_RUNNING:
+      return "RUNNING";
+    case JOB_DONE:
+      return "DONE";
+    case JOB_FAILED:
+      return "FAILED";
+    case JOB_CANCELLED:
+      return "CANCELLED";
+  }
+  return "UNKNOWN";
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <unordered_map>
+#include <functional>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <chrono>
+
+// number of jobs a daemon runs at once
+#define JOB_WORKERS 4
+
+// number of store/load operations (chunk stores, stripes, read batches) in flight across all running jobs
+#define TRANSFER_SHARE_CAPACITY 64
+
+// number of finished jobs whose results are kept
+#define JOB_HISTORY 256
+
+class Transfer;
+class TransferShare;
+struct transfer_progress;
+
+enum JOB_STATE {
+  JOB_QUEUED = 0,
+  JOB_RUNNING = 1,
+  JOB_DONE = 2,
+  JOB_FAILED = 3,
+  JOB_CANCELLED = 4,
+};
+
+struct job_status {
+  uint32_t id;
+  std::string description;
+  JOB_STATE state;
+  std::string err;
+  std::string out;
+};
+
+// a job runs as the given transfer and writes its result to the err/out buffers (returns false on failure)
+typedef std::function<bool(Transfer*, std::string&, std::string&)> job_fn;
+
+// JobScheduler: runs submitted jobs on a fixed number of worker threads (in submission order)
+// running jobs fairly share the operation slots of a single transfer share, and every job can be cancelled
+// while it is queued or running
+class JobScheduler {
+private:
+  struct job {
+    job_status status;
+    job_fn fn;
+    Transfer* transfer;
+  };
+
+  std::mutex jobs_lock;
+  std::condition_variable queue_cv;
+  std::condition_variable done_cv;
+  bool stopping;
+  uint32_t next_id;
+  std::deque<uint32_t> queue;
+  std::deque<uint32_t> history;
+  std::unordered_map<uint32_t, job*> jobs;
+  std::vector<std::thread*> workers;
+  TransferShare* share;
+
+  void work();
+  void finish(job* j, JOB_STATE state);
+
+public:
+  JobScheduler(unsigned int num_workers, unsigned int share_capacity);
+  ~JobScheduler();
+
+  uint32_t submit(std::string description, job_fn fn);
+
+  // copy the job's status (false if the job is unknown), optionally waiting for it to finish
+  bool wait(uint32_t id, job_status& status_buffer);
+  bool wait(uint32_t id, job_status& status_buffer, std::chrono::milliseconds timeout);
+  bool status(uint32_t id, job_status& status_buffer);
+  void statuses(std::vector<job_status>& statuses_buffer);
+
+  // copy the progress of a running job (false if the job is not running)
+  bool progress(uint32_t id, transfer_progress& progress_buffer);
+
+  // cancel a queued or running job (false if the job is unknown or already finished)
+  bool cancel(uint32_t id);
+
+  // cancel all jobs and stop the workers (called by the destructor)
+  void shutdown();
+};
+
+std::string job_state_string(JOB_STATE state);
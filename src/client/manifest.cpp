@@ -0,0 +1,206 @@
+#include "manifest.h"
+
+#include <cstring>
+#include <atomic>
+
+//
+// SERIALIZATION
+//
+
+// number of keys stored with each entry of the node
+unsigned int Manifest::keys_per_entry() {
+  if (this->level == 0 && this->mode == ERASURE) {
+    return this->erasure_k + this->erasure_m;
+  }
+  return 1;
+}
+
+// serialized size of each entry of the node
+size_t Manifest::entry_size() {
+  return 2 * sizeof(uint64_t) + this->keys_per_entry() * KEYBYTES;
+}
+
+// append little-endian integers to the buffer
+void put_uint(std::vector<char>* buffer, uint64_t value, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    buffer->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+// read little-endian integers from the buffer
+uint64_t get_uint(const char* data, size_t size) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; i++) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+  }
+  return value;
+}
+
+void serialize_manifest(Manifest& manifest, std::vector<char>* buffer) {
+  buffer->reserve(buffer->size() + MANIFEST_HEADER_SIZE + manifest.entries.size() * manifest.entry_size());
+  buffer->insert(buffer->end(), MANIFEST_MAGIC, MANIFEST_MAGIC + 4);
+  put_uint(buffer, MANIFEST_VERSION, 1);
+  put_uint(buffer, manifest.mode, 1);
+  put_uint(buffer, manifest.level, 1);
+  put_uint(buffer, manifest.erasure_k, 2);
+  put_uint(buffer, manifest.erasure_m, 2);
+  put_uint(buffer, manifest.total_size, 8);
+  put_uint(buffer, manifest.entries.size(), 4);
+  char key_bytes[KEYBYTES];
+  for (ManifestEntry& entry : manifest.entries) {
+    put_uint(buffer, entry.offset, 8);
+    put_uint(buffer, entry.length, 8);
+    for (Key& key : entry.keys) {
+      key_to_bytes(key, key_bytes);
+      buffer->insert(buffer->end(), key_bytes, key_bytes + KEYBYTES);
+    }
+  }
+}
+
+bool deserialize_manifest(std::vector<char>* buffer, Manifest& manifest_buffer) {
+  if (buffer->size() < MANIFEST_HEADER_SIZE || std::memcmp(buffer->data(), MANIFEST_MAGIC, 4) != 0) {
+    LOG_ERROR("MALFORMED MANIFEST (MISSING HEADER)");
+    return false;
+  }
+  const char* data = buffer->data();
+  if (get_uint(data + 4, 1) != MANIFEST_VERSION) {
+    LOG_ERROR("UNSUPPORTED MANIFEST VERSION: VERSION={}", get_uint(data + 4, 1));
+    return false;
+  }
+  manifest_buffer.mode = get_uint(data + 5, 1);
+  manifest_buffer.level = get_uint(data + 6, 1);
+  manifest_buffer.erasure_k = get_uint(data + 7, 2);
+  manifest_buffer.erasure_m = get_uint(data + 9, 2);
+  manifest_buffer.total_size = get_uint(data + 11, 8);
+  uint64_t entry_count = get_uint(data + 19, 4);
+  if (manifest_buffer.mode != REPLICATED && manifest_buffer.mode != ERASURE) {
+    LOG_ERROR("MALFORMED MANIFEST (UNKNOWN MODE): MODE={}", manifest_buffer.mode);
+    return false;
+  }
+  if (manifest_buffer.mode == ERASURE && manifest_buffer.erasure_k == 0) {
+    LOG_ERROR("MALFORMED MANIFEST (EMPTY ERASURE STRIPES)");
+    return false;
+  }
+  unsigned int keys_per_entry = manifest_buffer.keys_per_entry();
+  size_t entry_size = manifest_buffer.entry_size();
+  if (buffer->size() != MANIFEST_HEADER_SIZE + entry_count * entry_size) {
+    LOG_ERROR("MALFORMED MANIFEST (INCORRECTLY SIZED ENTRIES): ENTRIES={} SIZE={}", entry_count, buffer->size());
+    return false;
+  }
+
+  manifest_buffer.entries.clear();
+  manifest_buffer.entries.reserve(entry_count);
+  const char* entry_data = data + MANIFEST_HEADER_SIZE;
+  for (uint64_t i = 0; i < entry_count; i++, entry_data += entry_size) {
+    ManifestEntry entry;
+    entry.offset = get_uint(entry_data, 8);
+    entry.length = get_uint(entry_data + 8, 8);
+    for (unsigned int j = 0; j < keys_per_entry; j++) {
+      entry.keys.push_back(key_from_bytes(entry_data + 16 + j * KEYBYTES));
+    }
+    manifest_buffer.entries.push_back(entry);
+  }
+  return true;
+}
+
+//
+// MANIFEST TREE ACCESS/MUTATION
+//
+
+bool publish_manifest(Session* s, Key root_key, Manifest& leaf_manifest, size_t max_node_size) {
+  Manifest level_manifest = leaf_manifest;
+  level_manifest.level = 0;
+  while (MANIFEST_HEADER_SIZE + level_manifest.entries.size() * level_manifest.entry_size() > max_node_size) {
+    // split the level into content-addressed child nodes and reference them from the next level
+    size_t node_capacity = std::max(static_cast<size_t>(2), (max_node_size - MANIFEST_HEADER_SIZE) / level_manifest.entry_size());
+    // (nodes share the level's header, and every node only gets its own slice of the entries)
+    Manifest parent_manifest{level_manifest.mode, static_cast<uint8_t>(level_manifest.level + 1), level_manifest.erasure_k,
+                             level_manifest.erasure_m, level_manifest.total_size, {}};
+    TaskGroup stores;
+    std::atomic<bool> failed(false);
+    for (size_t start = 0; start < level_manifest.entries.size(); start += node_capacity) {
+      size_t end = std::min(start + node_capacity, level_manifest.entries.size());
+      Manifest child_manifest{level_manifest.mode, level_manifest.level, level_manifest.erasure_k, level_manifest.erasure_m,
+                              level_manifest.total_size,
+                              std::vector<ManifestEntry>(level_manifest.entries.begin() + start, level_manifest.entries.begin() + end)};
+      std::vector<char>* child = new std::vector<char>;
+      serialize_manifest(child_manifest, child);
+      Key child_key = key_from_data(child->data(), child->size());
+      stores.run([s, child_key, child, &failed]() {
+        if (!s->set(child_key, child)) {
+          failed = true;
+        }
+      });
+
+      ManifestEntry parent_entry;
+      parent_entry.offset = child_manifest.entries.front().offset;
+      parent_entry.length = child_manifest.entries.back().offset + child_manifest.entries.back().length - parent_entry.offset;
+      parent_entry.keys.push_back(child_key);
+      parent_manifest.entries.push_back(parent_entry);
+    }
+    stores.wait();
+    if (failed) {
+      // (a root referencing missing nodes would make the file unreadable)
+      return false;
+    }
+    level_manifest = std::move(parent_manifest);
+  }
+
+  // the root is stored under the (file name) root key and overwrites any older version
+  std::vector<char>* root = new std::vector<char>;
+  serialize_manifest(level_manifest, root);
+  return s->set(root_key, root, set_options{true});
+}
+
+bool fetch_manifest_node(Session* s, Key key, Manifest& manifest_buffer) {
+  std::vector<char>* data;
+  if (!s->get(key, &data)) {
+    return false;
+  }
+  bool success = deserialize_manifest(data, manifest_buffer);
+  delete data;
+  return success;
+}
+
+// fetch (and verify) content-addressed child nodes, striped across their replicas
+// sets success_buffer[i] if keys[i] was found and deserialized
+static void fetch_manifest_children(Session* s, std::vector<Key>& keys, std::vector<Manifest>& children_buffer, std::vector<char>& success_buffer) {
+  std::vector<std::vector<char>*> data;
+  s->get(keys, data);
+  children_buffer.assign(keys.size(), Manifest());
+  success_buffer.assign(keys.size(), false);
+  for (size_t i = 0; i < keys.size(); i++) {
+    success_buffer[i] = data[i] != NULL && deserialize_manifest(data[i], children_buffer[i]);
+    delete data[i];
+  }
+}
+
+bool fetch_manifest(Session* s, Key root_key, Manifest& manifest_buffer) {
+  if (!fetch_manifest_node(s, root_key, manifest_buffer)) {
+    return false;
+  }
+
+  // (concurrently) replace each level of the tree with its children until only leaf entries remain
+  while (manifest_buffer.level > 0) {
+    std::vector<Key> keys;
+    for (ManifestEntry& entry : manifest_buffer.entries) {
+      keys.push_back(entry.keys.at(0));
+    }
+    std::vector<Manifest> children;
+    std::vector<char> child_success;
+    fetch_manifest_children(s, keys, children, child_success);
+
+    std::vector<ManifestEntry> child_entries;
+    for (size_t i = 0; i < children.size(); i++) {
+      if (!child_success[i] || children[i].level != manifest_buffer.level - 1) {
+        LOG_ERROR("{} MISSING OR MALFORMED MANIFEST NODE: NODE={}", key_hex(root_key),
+                        key_hex(manifest_buffer.entries[i].keys.at(0)));
+        return false;
+      }
+      child_entries.insert(child_entries.end(), children[i].entries.begin(), children[i].entries.end());
+    }
+    manifest_buffer.entries = child_entries;
+    manifest_buffer.level--;
+  }
+  return true;
+}
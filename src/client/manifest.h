@@ -0,0 +1,61 @@
+#pragma once
+
+#include "src/dht/session.h"
+#include "src/utils/utils.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#define MANIFEST_MAGIC "DFTM"
+#define MANIFEST_VERSION 1
+#define MANIFEST_HEADER_SIZE 23
+
+// storage mode of the file described by a manifest
+enum MANIFEST_MODE {
+  REPLICATED = 0,
+  ERASURE = 1,
+};
+
+// ManifestEntry: a contiguous byte range of the file
+// level 0 entries reference the data itself (1 chunk key, or k + m fragment keys of an erasure stripe)
+// higher level entries reference a child manifest chunk covering the range
+struct ManifestEntry {
+  uint64_t offset;
+  uint64_t length;
+  std::vector<Key> keys;
+};
+
+// Manifest: a single (versioned, binary) node of a file's manifest tree
+// layout: magic | version | mode | level | erasure k (u16) | erasure m (u16) | total size (u64) | entry count (u32)
+//         followed by entries: offset (u64) | length (u64) | packed keys
+struct Manifest {
+  uint8_t mode;
+  uint8_t level;
+  uint16_t erasure_k;
+  uint16_t erasure_m;
+  uint64_t total_size;
+  std::vector<ManifestEntry> entries;
+
+  unsigned int keys_per_entry();
+  size_t entry_size();
+};
+
+// (de)serialize little-endian integers of the given size (in bytes)
+void put_uint(std::vector<char>* buffer, uint64_t value, size_t size);
+uint64_t get_uint(const char* data, size_t size);
+
+// (de)serialize a single manifest node
+void serialize_manifest(Manifest& manifest, std::vector<char>* buffer);
+bool deserialize_manifest(std::vector<char>* buffer, Manifest& manifest_buffer);
+
+// store the leaf manifest in the session under the root key
+// (leaf entries that do not fit in a single node of max_node_size bytes are split into a multi-level tree)
+// returns false if any node was not stored (in which case the root is not published)
+bool publish_manifest(Session* s, Key root_key, Manifest& leaf_manifest, size_t max_node_size);
+
+// fetch a single manifest node from the session
+bool fetch_manifest_node(Session* s, Key key, Manifest& manifest_buffer);
+
+// fetch the manifest tree at the root key and flatten it into its (ordered) leaf entries
+bool fetch_manifest(Session* s, Key root_key, Manifest& manifest_buffer);
@@ -1,6 +1,7 @@
 #include "src/client/client.h"
 
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <unistd.h>
 #include <regex>
@@ -18,14 +19,21 @@ void print_result(bool err, std::string err_msg, std::string succ_msg) {
   }
 }
 
+void print_result(client_flags flags, char err, std::string err_msg, std::string succ_msg) {
+  if (flags.json) {
+    print_json_result(err, err_msg, succ_msg);
+  } else {
+    print_result(static_cast<bool>(err), err_msg, succ_msg);
+  }
+}
+
 bool valid_endpoint(const std::string& ep) {
     std::regex pattern(R"((.*):(\d+))");
     std::smatch match;
     return std::regex_match(ep, match, pattern);
 }
 
-int handle_start(std::string remote_endpoint, std::string local_endpoint) {
-  pid_t client_id = getpid();
+int handle_start(std::vector<std::string> remote_endpoints, std::string local_endpoint) {
   pid_t session_id = fork();
   if (session_id < 0) {
     std::cout << "Failed to create new daemon. Aborting. :(" << std::endl;
@@ -33,14 +41,14 @@ int handle_start(std::string remote_endpoint, std::string local_endpoint) {
   }
   if (session_id == 0) {
     setup_daemon();
-    run_transient_session_daemon(client_id, remote_endpoint, local_endpoint);
+    run_transient_session_daemon(remote_endpoints, local_endpoint);
     return SUCCESS;
   }
   add_daemon_files(session_id);
   char err;
   std::string err_msg;
   std::string succ_msg;
-  if (!read_err(session_id, err, err_msg, succ_msg)) {
+  if (!send_cmd(session_id, START, std::vector<std::string>(), err, err_msg, succ_msg)) {
     std::cout << "Failed to receive result from daemon. :(" << std::endl;
     return INTERNAL_ERROR;
   }
@@ -50,7 +58,10 @@ int handle_start(std::string remote_endpoint, std::string local_endpoint) {
 }
 
 int handle_exit(int session_id) {
-  if (!write_cmd(session_id, EXIT, 0, std::vector<std::string>())) {
+  char err;
+  std::string err_msg;
+  std::string succ_msg;
+  if (!send_cmd(session_id, EXIT, std::vector<std::string>(), err, err_msg, succ_msg)) {
     std::cout << "Failed to send exit cmd to daemon. :(" << std::endl;
     return INTERNAL_ERROR;
   }
@@ -58,50 +69,152 @@ int handle_exit(int session_id) {
   return SUCCESS;
 }
 
-int handle_list(int session_id) {
-  if (!write_cmd(session_id, LIST, 0, std::vector<std::string>())) {
+int handle_list(int session_id, std::vector<std::string> list_args, client_flags flags) {
+  char err;
+  std::string err_msg;
+  std::string succ_msg;
+  if (!send_cmd(session_id, LIST, list_args, err, err_msg, succ_msg, send_options{flags})) {
     std::cout << "Failed to send list cmd to daemon. :(" << std::endl;
     return INTERNAL_ERROR;
   }
+  print_result(flags, err, err_msg, succ_msg);
+  return SUCCESS;
+}
+
+// the files are opened here and passed to the daemon
+int handle_store(int session_id, std::vector<std::string> files, client_flags flags) {
   char err;
   std::string err_msg;
   std::string succ_msg;
-  if (!read_err(session_id, err, err_msg, succ_msg)) {
-    std::cout << "Failed to receive result from daemon. :(" << std::endl;
+  std::vector<int> fds;
+  if (!open_cmd_files(STORE, files, fds, err_msg)) {
+    std::cout << err_msg << std::endl;
+    return USER_ERROR;
+  }
+  bool sent = send_cmd(session_id, STORE, files, err, err_msg, succ_msg, send_options{flags, fds});
+  for (int fd : fds) {
+    close(fd);
+  }
+  if (!sent) {
+    std::cout << "Failed to send store cmd to daemon. :(" << std::endl;
+    return INTERNAL_ERROR;
+  }
+  print_result(flags, err, err_msg, succ_msg);
+  return SUCCESS;
+}
+
+// the output file is opened here and passed to the daemon
+// (when loading to stdout, all other output goes to stderr)
+int handle_load(int session_id, std::vector<std::string> files, client_flags flags) {
+  char err;
+  std::string err_msg;
+  std::string succ_msg;
+  std::vector<int> fds;
+  if (files.back() == "-" && files[0] != "--split") {
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
+  if (!open_cmd_files(LOAD, files, fds, err_msg)) {
+    std::cout << err_msg << std::endl;
+    return USER_ERROR;
+  }
+  bool sent = send_cmd(session_id, LOAD, files, err, err_msg, succ_msg, send_options{flags, fds});
+  for (int fd : fds) {
+    close(fd);
+  }
+  if (!sent) {
+    std::cout << "Failed to send load cmd to daemon. :(" << std::endl;
+    return INTERNAL_ERROR;
+  }
+  print_result(flags, err, err_msg, succ_msg);
+  return SUCCESS;
+}
+
+int handle_jobs(int session_id) {
+  char err;
+  std::string err_msg;
+  std::string succ_msg;
+  if (!send_cmd(session_id, JOBS, std::vector<std::string>(), err, err_msg, succ_msg)) {
+    std::cout << "Failed to send jobs cmd to daemon. :(" << std::endl;
     return INTERNAL_ERROR;
   }
   print_result(static_cast<bool>(err), err_msg, succ_msg);
   return SUCCESS;
 }
 
-int handle_store(int session_id, int file_cnt, std::vector<std::string> files) {
-  if (!write_cmd(session_id, STORE, file_cnt, files)) {
-    std::cout << "Failed to send store cmd to daemon. :(" << std::endl;
+int handle_job(int session_id, std::vector<std::string> job_args, client_flags flags) {
+  char err;
+  std::string err_msg;
+  std::string succ_msg;
+  if (!send_cmd(session_id, JOB, job_args, err, err_msg, succ_msg, send_options{flags})) {
+    std::cout << "Failed to send job cmd to daemon. :(" << std::endl;
     return INTERNAL_ERROR;
   }
+  print_result(flags, err, err_msg, succ_msg);
+  return SUCCESS;
+}
+
+int handle_cancel(int session_id, std::string job_id) {
   char err;
   std::string err_msg;
   std::string succ_msg;
-  if (!read_err(session_id, err, err_msg, succ_msg)) {
-    std::cout << "Failed to receive result from daemon. :(" << std::endl;
+  if (!send_cmd(session_id, CANCEL, std::vector<std::string>{job_id}, err, err_msg, succ_msg)) {
+    std::cout << "Failed to send cancel cmd to daemon. :(" << std::endl;
     return INTERNAL_ERROR;
   }
   print_result(static_cast<bool>(err), err_msg, succ_msg);
   return SUCCESS;
 }
 
-int handle_load(int session_id, int file_cnt, std::vector<std::string> files) {
-  if (!write_cmd(session_id, LOAD, file_cnt, files)) {
-    std::cout << "Failed to send load cmd to daemon. :(" << std::endl;
+// --prometheus with a file path writes the metrics to the (local) file instead of printing them
+int handle_stats(int session_id, std::vector<std::string> stats_args) {
+  char err;
+  std::string err_msg;
+  std::string succ_msg;
+  std::string output_file;
+  if (stats_args.size() == 2 && stats_args[0] == "--prometheus") {
+    output_file = caller_path(stats_args[1]);
+    stats_args.pop_back();
+  } else if (stats_args.size() == 2 && stats_args[0] == "--listen") {
+    stats_args[1] = caller_path(stats_args[1]);
+  }
+  if (!send_cmd(session_id, STATS, stats_args, err, err_msg, succ_msg)) {
+    std::cout << "Failed to send stats cmd to daemon. :(" << std::endl;
     return INTERNAL_ERROR;
   }
+  if (!output_file.empty() && !err) {
+    std::ofstream file(output_file, std::ios::out | std::ios::binary);
+    if (!file.write(succ_msg.data(), succ_msg.size())) {
+      std::cout << "Failed to write metrics to " << output_file << std::endl;
+      return INTERNAL_ERROR;
+    }
+    succ_msg = "Wrote metrics to " + output_file;
+  }
+  print_result(static_cast<bool>(err), err_msg, succ_msg);
+  return SUCCESS;
+}
+
+// a file path writes the traces to the (local) file instead of printing them
+int handle_trace(int session_id, std::vector<std::string> trace_args) {
   char err;
   std::string err_msg;
   std::string succ_msg;
-  if (!read_err(session_id, err, err_msg, succ_msg)) {
-    std::cout << "Failed to receive result from daemon. :(" << std::endl;
+  std::string output_file;
+  if (trace_args.size() == 1) {
+    output_file = caller_path(trace_args[0]);
+    trace_args.pop_back();
+  }
+  if (!send_cmd(session_id, TRACE, trace_args, err, err_msg, succ_msg)) {
+    std::cout << "Failed to send trace cmd to daemon. :(" << std::endl;
     return INTERNAL_ERROR;
   }
+  if (!output_file.empty() && !err) {
+    std::ofstream file(output_file, std::ios::out | std::ios::binary);
+    if (!file.write(succ_msg.data(), succ_msg.size())) {
+      std::cout << "Failed to write traces to " << output_file << std::endl;
+      return INTERNAL_ERROR;
+    }
+    succ_msg = "Wrote traces to " + output_file;
+  }
   print_result(static_cast<bool>(err), err_msg, succ_msg);
   return SUCCESS;
 }
@@ -143,17 +256,21 @@ int main(int argc, char* argv[]) {
   char err;
   std::string msg;
   if (cmd == "start") {
-    if (argc != 4) {
-      std::cout << "Provide 1 remote and 1 local endpoint for the transient client." << std::endl;
+    if (argc < 4) {
+      std::cout << "Provide at least 1 remote and 1 local endpoint for the transient client." << std::endl;
       return USER_ERROR;
     }
-    std::string remote_endpoint(argv[2]);
-    std::string local_endpoint(argv[3]);
-    if (!valid_endpoint(remote_endpoint) || !valid_endpoint(local_endpoint)) {
+    std::vector<std::string> remote_endpoints(argv + 2, argv + argc - 1);
+    std::string local_endpoint(argv[argc - 1]);
+    bool valid = valid_endpoint(local_endpoint);
+    for (std::string& remote_endpoint : remote_endpoints) {
+      valid = valid && valid_endpoint(remote_endpoint);
+    }
+    if (!valid) {
         std::cout << "Endpoint invalid: must have the form <address>:<port>" << std::endl;
         return USER_ERROR;
     }
-    return handle_start(remote_endpoint, local_endpoint);
+    return handle_start(remote_endpoints, local_endpoint);
   } else if (cmd == "exit") {
     if (argc < 3) {
       std::cout << "Provide session id for a running founder client." << std::endl;
@@ -161,7 +278,7 @@ int main(int argc, char* argv[]) {
     }
     std::string session_id_arg = argv[2];
     if (!std::all_of(session_id_arg.begin(), session_id_arg.end(), [](unsigned char c){ return std::isdigit(c); })
-        || !std::filesystem::exists(CMD_FILE(std::stoi(session_id_arg)))) {
+        || !std::filesystem::exists(SOCKET_FILE(std::stoi(session_id_arg)))) {
       std::cout << "Session ID not found. :O" << std::endl;
       return USER_ERROR;
     }
@@ -174,12 +291,22 @@ int main(int argc, char* argv[]) {
     }
     std::string session_id_arg = argv[2];
     if (!std::all_of(session_id_arg.begin(), session_id_arg.end(), [](unsigned char c){ return std::isdigit(c); })
-        || !std::filesystem::exists(CMD_FILE(std::stoi(session_id_arg)))) {
+        || !std::filesystem::exists(SOCKET_FILE(std::stoi(session_id_arg)))) {
       std::cout << "Session ID not found. :O" << std::endl;
       return USER_ERROR;
     }
     int session_id = std::stoi(session_id_arg);
-    return handle_list(session_id);
+    std::vector<std::string> list_args;
+    for (int i = 3; i < argc; i++) {
+      list_args.push_back(std::string(argv[i]));
+    }
+    client_flags flags;
+    parse_client_flags(list_args, flags);
+    if (list_args.size() > 0 && list_args[0] != "--page") {
+      std::cout << "Provide an optional page cursor of the form --page [cursor]." << std::endl;
+      return USER_ERROR;
+    }
+    return handle_list(session_id, list_args, flags);
   } else if (cmd == "load") {
     if (argc < 5) {
       std::cout << "Provide session id for a running founder client, at least one file to download, and a file to write to." << std::endl;
@@ -187,17 +314,106 @@ int main(int argc, char* argv[]) {
     }
     std::string session_id_arg = argv[2];
     if (!std::all_of(session_id_arg.begin(), session_id_arg.end(), [](unsigned char c){ return std::isdigit(c); })
-        || !std::filesystem::exists(CMD_FILE(std::stoi(session_id_arg)))) {
+        || !std::filesystem::exists(SOCKET_FILE(std::stoi(session_id_arg)))) {
       std::cout << "Session ID not found. :O" << std::endl;
       return USER_ERROR;
     }
     int session_id = std::stoi(session_id_arg);
-    char file_cnt = static_cast<char>(argc - 3);
     std::vector<std::string> files;
     for (int i = 3; i < argc; i++) {
       files.push_back(std::string(argv[i]));
     }
-    return handle_load(session_id, file_cnt, files);
+    client_flags flags;
+    parse_client_flags(files, flags);
+    if (files.size() < 2) {
+      std::cout << "Provide at least one file to download and a file to write to." << std::endl;
+      return USER_ERROR;
+    }
+    if (files[0] == "--range") {
+      uint64_t offset;
+      uint64_t length;
+      if (files.size() != 4 || !parse_range_arg(files[1], offset, length)) {
+        std::cout << "Provide a byte range of the form <offset>:<length> (with length > 0), exactly one file to download, and a file to write to." << std::endl;
+        return USER_ERROR;
+      }
+    } else if (files[0] == "--split" && files.size() < 3) {
+      std::cout << "Provide at least one file to download and a directory to write to." << std::endl;
+      return USER_ERROR;
+    }
+    return handle_load(session_id, files, flags);
+  } else if (cmd == "jobs" || cmd == "job" || cmd == "cancel") {
+    if (argc < 3 || (cmd != "jobs" && argc < 4)) {
+      std::cout << "Provide session id for a running client (and a job id for job/cancel)." << std::endl;
+      return USER_ERROR;
+    }
+    std::string session_id_arg = argv[2];
+    if (!std::all_of(session_id_arg.begin(), session_id_arg.end(), [](unsigned char c){ return std::isdigit(c); })
+        || !std::filesystem::exists(SOCKET_FILE(std::stoi(session_id_arg)))) {
+      std::cout << "Session ID not found. :O" << std::endl;
+      return USER_ERROR;
+    }
+    int session_id = std::stoi(session_id_arg);
+    if (cmd == "jobs") {
+      return handle_jobs(session_id);
+    } else if (cmd == "cancel") {
+      return handle_cancel(session_id, std::string(argv[3]));
+    }
+    std::vector<std::string> job_args;
+    for (int i = 3; i < argc; i++) {
+      job_args.push_back(std::string(argv[i]));
+    }
+    client_flags flags;
+    parse_client_flags(job_args, flags);
+    if (job_args.empty()) {
+      std::cout << "Provide a job id." << std::endl;
+      return USER_ERROR;
+    }
+    return handle_job(session_id, job_args, flags);
+  } else if (cmd == "stats") {
+    if (argc < 3) {
+      std::cout << "Provide session id for a running client." << std::endl;
+      return USER_ERROR;
+    }
+    std::string session_id_arg = argv[2];
+    if (!std::all_of(session_id_arg.begin(), session_id_arg.end(), [](unsigned char c){ return std::isdigit(c); })
+        || !std::filesystem::exists(SOCKET_FILE(std::stoi(session_id_arg)))) {
+      std::cout << "Session ID not found. :O" << std::endl;
+      return USER_ERROR;
+    }
+    int session_id = std::stoi(session_id_arg);
+    std::vector<std::string> stats_args;
+    for (int i = 3; i < argc; i++) {
+      stats_args.push_back(std::string(argv[i]));
+    }
+    if (!(stats_args.empty() || (stats_args[0] == "--prometheus" && stats_args.size() <= 2)
+          || (stats_args[0] == "--listen" && stats_args.size() == 2))) {
+      std::cout << "Provide either --prometheus [file path] or --listen <socket path>." << std::endl;
+      return USER_ERROR;
+    }
+    return handle_stats(session_id, stats_args);
+  } else if (cmd == "trace") {
+    if (argc < 3) {
+      std::cout << "Provide session id for a running client." << std::endl;
+      return USER_ERROR;
+    }
+    std::string session_id_arg = argv[2];
+    if (!std::all_of(session_id_arg.begin(), session_id_arg.end(), [](unsigned char c){ return std::isdigit(c); })
+        || !std::filesystem::exists(SOCKET_FILE(std::stoi(session_id_arg)))) {
+      std::cout << "Session ID not found. :O" << std::endl;
+      return USER_ERROR;
+    }
+    int session_id = std::stoi(session_id_arg);
+    std::vector<std::string> trace_args;
+    for (int i = 3; i < argc; i++) {
+      trace_args.push_back(std::string(argv[i]));
+    }
+    double sample_rate;
+    if (!(trace_args.size() <= 1 && (trace_args.empty() || trace_args[0] != "--sample"))
+        && !(trace_args.size() == 2 && trace_args[0] == "--sample" && parse_sample_rate_arg(trace_args[1], sample_rate))) {
+      std::cout << "Provide either --sample <rate between 0 and 1> or an optional file path." << std::endl;
+      return USER_ERROR;
+    }
+    return handle_trace(session_id, trace_args);
   }
   std::cout << "Command not found. Enter `--help` for all commands." << std::endl;
   return SUCCESS;
@@ -0,0 +1,208 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <tuple>
+#include <cctype>
+
+ChunkCache::ChunkCache(std::string dir, uint64_t capacity) {
+  this->dir = std::filesystem::path(dir);
+  // (chunks are written in a subdirectory so that only completed chunks change the cache directory)
+  this->tmp_dir = this->dir / "tmp";
+  this->capacity = capacity;
+  this->total_size = 0;
+  this->hit_count = 0;
+  this->miss_count = 0;
+
+  std::error_code ec;
+  std::filesystem::create_directories(this->tmp_dir, ec);
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  this->scan_chunks();
+  this->evict_chunks();
+}
+
+std::filesystem::path ChunkCache::chunk_path(Key key) {
+  return this->dir / full_hex_string(key);
+}
+
+// re-derive the index from the chunks in the directory (including the ones other processes added), oldest first,
+// and remove partially written chunks that were abandoned (the ones still being written are left alone)
+// (expects cache_lock to be held)
+void ChunkCache::scan_chunks() {
+  std::error_code ec;
+  auto now = std::filesystem::file_time_type::clock::now();
+  for (auto& dir_entry : std::filesystem::directory_iterator(this->tmp_dir, ec)) {
+    std::filesystem::file_time_type mtime = dir_entry.last_write_time(ec);
+    if (!ec && now - mtime > std::chrono::seconds(CHUNK_CACHE_STALE_TMP)) {
+      std::filesystem::remove(dir_entry.path(), ec);
+    }
+  }
+
+  this->synced_time = std::filesystem::last_write_time(this->dir, ec);
+  std::vector<std::tuple<std::filesystem::file_time_type, Key, uint64_t>> files;
+  for (auto& dir_entry : std::filesystem::directory_iterator(this->dir, ec)) {
+    std::string name = dir_entry.path().filename().string();
+    std::filesystem::file_time_type mtime = dir_entry.last_write_time(ec);
+    if (ec || !dir_entry.is_regular_file(ec)) {
+      continue;
+    }
+    if (name.length() != 2 * KEYBYTES || !std::all_of(name.begin(), name.end(), ::isxdigit)) {
+      continue;
+    }
+    char bytes[KEYBYTES];
+    for (int i = 0; i < KEYBYTES; i++) {
+      bytes[i] = static_cast<char>(std::stoi(name.substr(2 * i, 2), nullptr, 16));
+    }
+    uint64_t size = dir_entry.file_size(ec);
+    if (!ec) {
+      files.push_back({mtime, key_from_bytes(bytes), size});
+    }
+  }
+  std::sort(files.begin(), files.end(), [](auto& a, auto& b) { return std::get<0>(a) < std::get<0>(b); });
+
+  this->chunks.clear();
+  this->lru.clear();
+  this->total_size = 0;
+  for (auto& file : files) {
+    Key key = std::get<1>(file);
+    this->lru.push_front(key);
+    this->chunks[key] = cached_chunk{std::get<2>(file), this->lru.begin()};
+    this->total_size += std::get<2>(file);
+  }
+}
+
+// rescan the directory if another process added or removed chunks since it was last indexed
+// (expects cache_lock to be held)
+void ChunkCache::sync_chunks() {
+  std::error_code ec;
+  if (std::filesystem::last_write_time(this->dir, ec) != this->synced_time) {
+    this->scan_chunks();
+  }
+}
+
+// remove least recently used chunks until the cache is within its capacity
+// (expects cache_lock to be held)
+void ChunkCache::evict_chunks() {
+  std::error_code ec;
+  bool rescanned = false;
+  while (this->total_size > this->capacity && !this->lru.empty()) {
+    Key key = this->lru.back();
+    bool removed = std::filesystem::remove(this->chunk_path(key), ec);
+    this->total_size -= this->chunks[key].size;
+    this->chunks.erase(key);
+    this->lru.pop_back();
+    if (!removed && !rescanned) {
+      // the chunk was already evicted by another process, so the index is out of sync with the directory
+      this->scan_chunks();
+      rescanned = true;
+    }
+  }
+  this->synced_time = std::filesystem::last_write_time(this->dir, ec);
+}
+
+bool ChunkCache::get(Key key, std::vector<char>** data_buffer) {
+  this->cache_lock.lock();
+  if (this->chunks.count(key) == 0) {
+    this->miss_count++;
+    this->cache_lock.unlock();
+    return false;
+  }
+  uint64_t size = this->chunks[key].size;
+  this->cache_lock.unlock();
+
+  // read (and verify) the chunk outside of the lock
+  std::ifstream file(this->chunk_path(key), std::ios::binary);
+  bool exists = file.is_open();
+  std::vector<char>* data = new std::vector<char>(size);
+  file.read(data->data(), size);
+  bool valid = file && static_cast<uint64_t>(file.gcount()) == size && key_from_data(data->data(), data->size()) == key;
+  std::error_code ec;
+  if (valid) {
+    // (the modification time orders the chunks for every process sharing the directory)
+    std::filesystem::last_write_time(this->chunk_path(key), std::filesystem::file_time_type::clock::now(), ec);
+  }
+
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  auto it = this->chunks.find(key);
+  if (!valid) {
+    // drop chunks that were evicted (or corrupted) while being read
+    delete data;
+    this->miss_count++;
+    if (it != this->chunks.end()) {
+      if (exists) {
+        LOG_ERROR("DROPPING INVALID CACHED CHUNK: CHUNK={}", key_hex(key));
+      }
+      std::filesystem::remove(this->chunk_path(key), ec);
+      this->total_size -= it->second.size;
+      this->lru.erase(it->second.lru_it);
+      this->chunks.erase(it);
+    }
+    return false;
+  }
+  if (it != this->chunks.end()) {
+    this->lru.splice(this->lru.begin(), this->lru, it->second.lru_it);
+  }
+  this->hit_count++;
+  *data_buffer = data;
+  return true;
+}
+
+void ChunkCache::put(Key key, std::vector<char>* data) {
+  if (data->size() > this->capacity || key_from_data(data->data(), data->size()) != key) {
+    return;
+  }
+  this->cache_lock.lock();
+  auto it = this->chunks.find(key);
+  if (it != this->chunks.end()) {
+    this->lru.splice(this->lru.begin(), this->lru, it->second.lru_it);
+    this->cache_lock.unlock();
+    std::error_code ec;
+    std::filesystem::last_write_time(this->chunk_path(key), std::filesystem::file_time_type::clock::now(), ec);
+    return;
+  }
+  this->cache_lock.unlock();
+
+  // write to a temporary file and move it into place so readers never see partial chunks
+  std::filesystem::path path = this->chunk_path(key);
+  std::filesystem::path tmp_path = this->tmp_dir / (full_hex_string(key) + "." + full_hex_string(random_key()).substr(0, 8));
+  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+  file.write(data->data(), data->size());
+  file.close();
+  std::error_code ec;
+  if (!file) {
+    std::filesystem::remove(tmp_path, ec);
+    return;
+  }
+
+  // pick up other processes' changes before this one so the directory stays in sync with the index
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  this->sync_chunks();
+  if (this->chunks.count(key) > 0) {
+    std::filesystem::remove(tmp_path, ec);
+    return;
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp_path, ec);
+    return;
+  }
+  this->lru.push_front(key);
+  this->chunks[key] = cached_chunk{data->size(), this->lru.begin()};
+  this->total_size += data->size();
+  this->evict_chunks();
+}
+
+unsigned long ChunkCache::hits() {
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  return this->hit_count;
+}
+
+unsigned long ChunkCache::misses() {
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  return this->miss_count;
+}
+
+uint64_t ChunkCache::size() {
+  std::lock_guard<std::mutex> guard(this->cache_lock);
+  return this->total_size;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "src/utils/utils.h"
+#include "src/utils/log.h"
+
+#include <spdlog/spdlog.h>
+
+#include <unordered_map>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <list>
+
+// default size of a client's chunk cache (in bytes)
+#define CHUNK_CACHE_CAPACITY 1073741824
+
+// age after which partially written chunks are removed (in seconds)
+#define CHUNK_CACHE_STALE_TMP 600
+
+// ChunkCache: local, size-bounded on-disk cache of content-addressed chunks
+// each chunk is stored in its own file (named by its key) and chunks are evicted in LRU order once the
+// total size passes the capacity
+// only chunks whose data hashes to their key are cached, so mutable keys (e.g., manifest roots and index
+// pages) are never served from the cache
+// the directory may be shared by several processes, so the index is re-derived from it (ordered by the files'
+// modification times, which hits refresh) whenever it was changed by someone else or turns out to be out of sync
+class ChunkCache {
+private:
+  struct cached_chunk {
+    uint64_t size;
+    std::list<Key>::iterator lru_it;
+  };
+
+  std::filesystem::path dir;
+  std::filesystem::path tmp_dir;
+  std::filesystem::file_time_type synced_time;
+  uint64_t capacity;
+  uint64_t total_size;
+  std::mutex cache_lock;
+  std::unordered_map<Key, cached_chunk> chunks;
+  std::list<Key> lru;
+  unsigned long hit_count;
+  unsigned long miss_count;
+
+  std::filesystem::path chunk_path(Key key);
+  void scan_chunks();
+  void sync_chunks();
+  void evict_chunks();
+
+public:
+  // open the cache directory (and index the chunks already stored in it)
+  ChunkCache(std::string dir, uint64_t capacity);
+
+  // returns false if the chunk is not cached
+  bool get(Key key, std::vector<char>** data_buffer);
+
+  // add the chunk (if it is content-addressed)
+  void put(Key key, std::vector<char>* data);
+
+  unsigned long hits();
+  unsigned long misses();
+  uint64_t size();
+};
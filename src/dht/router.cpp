@@ -45,8 +45,8 @@ bool Router::attempt_insert_peer(Key& peer_key, std::string endpoint, Peer** lru
 
     // insert into bucket if it has space
     if (tree->kbucket.size() < KBUCKET_MAX) {
-      spdlog::debug("{} INSERT: KEY={} ENDPOINT={}", hex_string(this->self_peer->key), 
-                hex_string(peer_key), endpoint);
+      LOG_DEBUG("{} INSERT: KEY={} ENDPOINT={}", key_hex(this->self_peer->key), 
+                key_hex(peer_key), endpoint);
       tree->latest_access = std::chrono::system_clock::now();
       Peer* peer = new Peer(peer_key, endpoint);
       tree->kbucket.push_front(peer);
@@ -75,9 +75,10 @@ bool Router::attempt_insert_peer(Key& peer_key, std::string endpoint, Peer** lru
 }
 
 // evict peer from its kbucket
-void Router::evict_peer(Key& evict_key) {
+// returns false if the router did not contain the peer
+bool Router::evict_peer(Key& evict_key) {
   if (evict_key == this->self_peer->key) {
-    return;
+    return false;
   }
   BinaryTree* tree = this->table;
   for (int i = KEYBITS - 1; i >= 0; i--) {
@@ -92,17 +93,18 @@ void Router::evict_peer(Key& evict_key) {
     // if peer is contained at this leaf, replace and refresh it
     for (int i = 0; i < tree->kbucket.size(); i++) {
       if (tree->kbucket.at(i)->key == evict_key) {
-        spdlog::debug("{} EVICT: KEY={}", hex_string(this->self_peer->key), 
-                hex_string(evict_key));
+        LOG_DEBUG("{} EVICT: KEY={}", key_hex(this->self_peer->key), 
+                key_hex(evict_key));
         tree->kbucket.erase(tree->kbucket.begin() + i);
         while (tree != NULL) {
           tree->key_count--;
           tree = tree->parent;
         }
-        return;
+        return true;
       }
     }
   }
+  return false;
 }
 
 
@@ -138,6 +140,10 @@ void Router::random_per_bucket_peers(std::deque<Peer*>& peer_buffer, std::chrono
   this->table->random_per_bucket_peers_helper(peer_buffer, unaccessed_time);
 }
 
+void Router::bucket_sizes(std::map<unsigned int, unsigned int>& sizes_buffer) {
+  this->table->tree_bucket_sizes(sizes_buffer);
+}
+
 //
 // BINARY TREE (HELPERS)
 //
@@ -189,23 +195,30 @@ void Router::BinaryTree::split() {
 
 // get the (potentially less than) n closest keys to the key
 void Router::BinaryTree::tree_closest_peers(Key& search_key, unsigned int n, std::deque<Peer*>& buffer) {
-  // add at most n keys from a leaf to the buffer
+  // add the (at most) n keys of a leaf closest to the search key to the buffer
+  // (the kbucket itself is kept in LRU order)
   if (this->leaf) {
     this->latest_access = std::chrono::system_clock::now();
-    for (int i = 0; i < n && i < this->kbucket.size(); i++) {
-      buffer.push_back(this->kbucket.at(i));
+    std::vector<Peer*> sorted_peers(this->kbucket.begin(), this->kbucket.end());
+    std::sort(sorted_peers.begin(), sorted_peers.end(), [&search_key](Peer* p1, Peer* p2) {
+      return Dist(search_key, p1->key) < Dist(search_key, p2->key);
+    });
+    for (int i = 0; i < n && i < sorted_peers.size(); i++) {
+      buffer.push_back(sorted_peers.at(i));
     }
     return;
   }
 
-  // try to add n keys from the matching tree
+  // try to add n keys from the matching tree (all closer than the keys of the mismatched tree)
   // add (potentially) remaining keys from the mismatched tree
   bool key_bit = search_key[this->split_bit_index];
   BinaryTree* preferred_tree = key_bit ? this->one_tree : this->zero_tree;
   BinaryTree* alternate_tree = key_bit ? this->zero_tree : this->one_tree;
+  size_t added_before = buffer.size();
   preferred_tree->tree_closest_peers(search_key, n, buffer);
-  if (n < preferred_tree->key_count) {
-    alternate_tree->tree_closest_peers(search_key, preferred_tree->key_count - n, buffer);
+  size_t added = buffer.size() - added_before;
+  if (added < n) {
+    alternate_tree->tree_closest_peers(search_key, n - added, buffer);
   }
 }
 
@@ -234,3 +247,12 @@ void Router::BinaryTree::random_per_bucket_peers_helper(std::deque<Peer*>& peer_
   this->zero_tree->random_per_bucket_peers_helper(peer_buffer, unaccessed_time);
   this->one_tree->random_per_bucket_peers_helper(peer_buffer, unaccessed_time);
 }
+
+void Router::BinaryTree::tree_bucket_sizes(std::map<unsigned int, unsigned int>& sizes_buffer) {
+  if (this->leaf) {
+    sizes_buffer[KEYBITS - 1 - this->split_bit_index] += this->kbucket.size();
+    return;
+  }
+  this->zero_tree->tree_bucket_sizes(sizes_buffer);
+  this->one_tree->tree_bucket_sizes(sizes_buffer);
+}
@@ -1,10 +1,12 @@
 #pragma once
 
 #include "src/utils/utils.h"
+#include "src/utils/log.h"
 
 #include <spdlog/spdlog.h>
 
 #include <deque>
+#include <map>
 #include <unordered_map>
 #include <chrono>
 #include <mutex>
@@ -45,6 +47,7 @@ private:
     void tree_closest_peers(Key& search_key, unsigned int n, std::deque<Peer*>& buffer);
     void tree_all_peers(std::deque<Peer*>& buffer);
     void random_per_bucket_peers_helper(std::deque<Peer*>& peer_buffer, std::chrono::seconds unaccessed_time);
+    void tree_bucket_sizes(std::map<unsigned int, unsigned int>& sizes_buffer);
     
   };
 
@@ -59,7 +62,7 @@ public:
 
   // mutating router state
   bool attempt_insert_peer(Key& peer_key, std::string endpoint, Peer** lru_peer_buffer);
-  void evict_peer(Key& evict_key);
+  bool evict_peer(Key& evict_key);
 
   // accessing peers
   Peer* get_peer(Key& key);
@@ -68,5 +71,8 @@ public:
   void all_peers(std::deque<Peer*>& buffer);
   void random_per_bucket_peers(std::deque<Peer*>& peer_buffer, std::chrono::seconds unaccessed_time);
 
+  // number of peers in the kbuckets at each depth of the tree (i.e., length of the prefix shared with self)
+  void bucket_sizes(std::map<unsigned int, unsigned int>& sizes_buffer);
+
 };
 
@@ -1,129 +1,580 @@
 #include "session.h"
 
+// metrics of the RPCs handled by this process (per handler) and of the RPCs it sends (per call)
+static Counter* rpc_handled_counter(std::string rpc) {
+  return metrics()->counter("distft_rpc_handled_total", "rpc=\"" + rpc + "\"", "RPCs handled by the process's sessions");
+}
+
+static Histogram* rpc_latency_histogram(std::string rpc) {
+  return metrics()->histogram("distft_rpc_latency_microseconds", "rpc=\"" + rpc + "\"", "Latency of RPCs sent by the process's sessions");
+}
+
+static Counter* rpc_failed_counter(std::string rpc) {
+  return metrics()->counter("distft_rpc_failed_total", "rpc=\"" + rpc + "\"", "RPCs sent by the process's sessions that failed");
+}
+
+// deadline of an RPC sent now that carries the given number of bytes of chunk data
+static std::chrono::system_clock::time_point rpc_deadline(size_t data_bytes) {
+  return std::chrono::system_clock::now() + std::chrono::milliseconds(RPC_TIMEOUT_MS + data_bytes / RPC_MIN_BYTES_PER_MS);
+}
+
 //
-// Session threads
+// Session maintenance
 //
 
-// start running the server RPC handler thread
+// start serving RPCs (on the server's own polling threads, so no thread has to wait on the server)
 void Session::init_server(std::string server_address, std::string port) {
   grpc::ServerBuilder builder;
   std::string serving_endpoint = "0.0.0.0:" + port;
   builder.AddListeningPort(serving_endpoint, grpc::InsecureServerCredentials());
   builder.RegisterService(this);
   this->server = builder.BuildAndStart();
-  this->server_thread = std::thread(&Session::handler_thread_fn, this);
 }
 
-void Session::handler_thread_fn() {
-  this->server->Wait();
-}
-
-// shutdown the RPC handler and wait for it to exit
+// shutdown the RPC handler (and wait for the running handlers to return)
 void Session::shutdown_server() {
   this->server->Shutdown();
-  this->server_thread.join();
 }
 
-// start running the RPC calling threads
-void Session::init_rpc_threads() {
-  std::thread* republish_thread = new std::thread(&Session::republish_chunks_thread_fn, this);
-  std::thread* expired_chunks_thread = new std::thread(&Session::cleanup_chunks_thread_fn, this);
-  std::thread* refresh_thread = new std::thread(&Session::refresh_peer_thread_fn, this);
-  this->rpc_threads.push_back(republish_thread);
-  this->rpc_threads.push_back(expired_chunks_thread);
-  this->rpc_threads.push_back(refresh_thread);
+// schedule the periodic maintenance tasks on the session's queue of the process's executor
+// (the session's tasks run one at a time, and the sessions of the process share the executor's workers)
+void Session::init_maintenance() {
+  std::chrono::milliseconds interval = std::chrono::seconds(MAINTENANCE_INTERVAL);
+  executor()->schedule_every(this->maintenance_queue, interval, [this]() { this->republish_chunks(); });
+  executor()->schedule_every(this->maintenance_queue, interval, [this]() { this->cleanup_chunks(); });
+  executor()->schedule_every(this->maintenance_queue, interval, [this]() { this->refresh_peers(); });
+  executor()->schedule_every(this->maintenance_queue, std::chrono::seconds(REPAIR_CHECK_INTERVAL), [this]() {
+    this->ping_neighbors();
+  });
+  executor()->schedule_every(this->maintenance_queue, std::chrono::seconds(ANTI_ENTROPY_INTERVAL), [this]() {
+    this->anti_entropy();
+  });
 }
 
-// wait for running RPC threads to exit
-void Session::shutdown_rpc_threads() {
-  while (this->rpc_threads.size() > 0) {
-    std::thread* rpc_thread = this->rpc_threads.front();
-    this->rpc_threads.pop_front();
-    rpc_thread->join();
-    delete rpc_thread;
-  }
+// cancel the maintenance tasks and wait for the running one to return
+void Session::shutdown_maintenance() {
+  this->repair_lock.lock();
+  task_queue* queue = this->maintenance_queue;
+  this->maintenance_queue = NULL;
+  this->repair_lock.unlock();
+  executor()->close_queue(queue);
 }
 
 // republish chunks that haven't been republished in a while by anyone
-void Session::republish_chunks_thread_fn() {
-  std::chrono::seconds sleep_time(10);
+// (the due chunks are taken out of the local map under the lock and published outside of it, since publishing
+// looks up and stores on other peers and may put the chunk back into the map)
+void Session::republish_chunks() {
   std::chrono::seconds unpublished_time(CHUNK_REPUBLISH_TIME);
-  while (true) {
-    std::this_thread::sleep_for(sleep_time);
+  if (this->dying) {
+    return;
+  }
+  std::vector<Chunk*> due_chunks;
+  auto now = std::chrono::system_clock::now();
+  this->chunks_lock.lock();
+  for (auto it = this->chunks.begin(); it != this->chunks.end();) {
+    std::chrono::seconds time_since_publish = std::chrono::duration_cast<std::chrono::seconds>(now - it->second->last_published);
+    if (time_since_publish >= unpublished_time) {
+      due_chunks.push_back(it->second);
+      it = this->chunks.erase(it);
+    } else {
+      it++;
+    }
+  }
+  this->chunks_lock.unlock();
+  for (Chunk* chunk : due_chunks) {
+    LOG_DEBUG("{} REPUBLISH: CHUNK={}", this->self_hex, key_hex(chunk->key));
+    chunk->last_published = now;
+    this->publish(chunk, false);
+  }
+}
+
+// remove expired chunks
+void Session::cleanup_chunks() {
+  std::chrono::seconds expire_time(CHUNK_EXPIRE_TIME);
+  if (this->dying) {
+    return;
+  }
+  this->chunks_lock.lock();
+  std::vector<Key> expired_keys;
+  for (auto& pair : this->chunks) {
+    Key chunk_key = pair.first;
+    Chunk* chunk = pair.second;
+    if (chunk->original_publish - std::chrono::system_clock::now() >= expire_time) {
+      expired_keys.push_back(chunk_key);
+    }
+  }
+  for (Key key : expired_keys) {
+    // remove chunk from local map and delete
+    delete this->chunks[key];
+    this->chunks.erase(key);
+    LOG_DEBUG("{} EXPIRED: CHUNK={}", this->self_hex, key_hex(key));
+  }
+  this->chunks_lock.unlock();
+}
+
+// store time since last lookup for each peer and perform random lookup on a peer
+// in each bucket
+void Session::refresh_peers() {
+  std::chrono::seconds unaccessed_time(3600);
+  if (this->dying) {
+    return;
+  }
+  std::deque<Peer*> refresh_peers;
+  this->router_lock.lock();
+  this->router->random_per_bucket_peers(refresh_peers, unaccessed_time);
+  this->router_lock.unlock();
+  std::deque<Peer> buffer;
+  for (Peer* peer : refresh_peers) {
+    this->node_lookup(peer->key, buffer);
+    buffer.clear();
+  }
+}
+
+// the peers closest to self share the most replica sets with it, so they are checked periodically
+// (failed pings evict them and schedule a repair)
+void Session::ping_neighbors() {
+  if (this->dying) {
+    return;
+  }
+
+  // forget peers that were evicted long ago
+  this->repair_lock.lock();
+  auto now = std::chrono::steady_clock::now();
+  for (auto it = this->recently_dead_peers.begin(); it != this->recently_dead_peers.end();) {
+    it = now - it->second >= std::chrono::seconds(DEAD_PEER_TTL) ? this->recently_dead_peers.erase(it) : std::next(it);
+  }
+  this->repair_lock.unlock();
+
+  Key self_key = this->self_key();
+  std::deque<Peer*> neighbor_ptrs;
+  this->router_lock.lock();
+  this->router->closest_peers(self_key, KBUCKET_MAX, neighbor_ptrs);
+  std::vector<Peer> neighbors;
+  for (Peer* peer : neighbor_ptrs) {
+    neighbors.push_back(*peer);
+  }
+  this->router_lock.unlock();
+
+  // (the pings are sent asynchronously on one completion queue, so dead neighbors hold this worker for at most one
+  // RPC deadline in total)
+  struct neighbor_ping {
+    Peer peer;
+    std::unique_ptr<dht::DHTService::Stub> stub;
+    grpc::ClientContext context;
+    dht::PingResponse response;
+    grpc::Status status;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<dht::PingResponse>> reader;
+  };
+  static Histogram* latency = rpc_latency_histogram("ping");
+  static Counter* failed = rpc_failed_counter("ping");
+  grpc::CompletionQueue cq;
+  std::vector<std::unique_ptr<neighbor_ping>> pings;
+  auto start = std::chrono::steady_clock::now();
+  for (Peer& neighbor : neighbors) {
+    std::unique_ptr<neighbor_ping> neighbor_rpc(new neighbor_ping);
+    neighbor_rpc->peer = neighbor;
+    neighbor_rpc->stub = rpc_stub(&neighbor_rpc->peer);
+    neighbor_rpc->context.set_deadline(rpc_deadline(0));
+    dht::PingRequest request;
+    dht::Peer* self_peer_rpc = new dht::Peer;
+    this->rpc_caller_prelims(self_peer_rpc);
+    request.set_allocated_sender(self_peer_rpc);
+    neighbor_rpc->reader = neighbor_rpc->stub->AsyncPing(&neighbor_rpc->context, request, &cq);
+    neighbor_rpc->reader->Finish(&neighbor_rpc->response, &neighbor_rpc->status, neighbor_rpc.get());
+    pings.push_back(std::move(neighbor_rpc));
+  }
+  for (size_t i = 0; i < pings.size(); i++) {
+    void* tag;
+    bool ok;
+    if (!cq.Next(&tag, &ok)) {
+      break;
+    }
+    neighbor_ping* neighbor_rpc = static_cast<neighbor_ping*>(tag);
+    latency->record(elapsed_micros(start));
+    if ((!ok || !neighbor_rpc->status.ok()) && !this->dying) {
+      failed->add(1);
+      this->evict_dead_peer(neighbor_rpc->peer.key);
+    }
+  }
+  cq.Shutdown();
+}
+
+// repair the chunks that lost replicas on the peers evicted since the repair was scheduled
+// (the first eviction schedules it REPAIR_COALESCE_MS ahead, so the evictions until then are coalesced)
+void Session::repair_evicted_peers() {
+  std::unordered_set<Key> dead_peers;
+  this->repair_lock.lock();
+  dead_peers.swap(this->repair_dead_peers);
+  this->repair_lock.unlock();
+  if (this->dying) {
+    return;
+  }
+  this->repair_chunks(dead_peers);
+}
+
+// re-replicate the local chunks whose replica set included one of the dead peers
+// (i) the chunks are found by comparing the dead peers' distances with the chunks' closest known peers,
+// (ii) their current replicas are counted by asking the closest known peers which chunks they hold,
+// (iii) chunks with the fewest live replicas are stored first on the members of their replica set (the closest
+// known peers, including self) that lack them
+// only the closest live holder of a chunk repairs it, so every lost replica is re-created once
+void Session::repair_chunks(std::unordered_set<Key>& dead_peers) {
+  // (i) find the chunks (grouped by their replica counts)
+  std::unordered_map<unsigned int, std::vector<Key>> replicas_keys;
+  this->chunks_lock.lock();
+  this->router_lock.lock();
+  for (auto& pair : this->chunks) {
+    Key chunk_key = pair.first;
+    unsigned int replicas = pair.second->replicas;
+    std::deque<Peer*> closest_peers;
+    this->router->closest_peers(chunk_key, replicas, closest_peers);
+    for (const Key& dead_key : dead_peers) {
+      if (closest_peers.size() < replicas || Dist(chunk_key, dead_key) < Dist(chunk_key, closest_peers.back()->key)) {
+        replicas_keys[replicas].push_back(chunk_key);
+        break;
+      }
+    }
+  }
+  this->router_lock.unlock();
+  this->chunks_lock.unlock();
+
+  // (ii) count the live replicas and collect the peers that lack the chunks this session should repair
+  std::vector<chunk_repair> repairs;
+  Key self_key = this->self_key();
+  for (auto& pair : replicas_keys) {
+    std::vector<std::vector<Peer>> holders;
+    std::vector<unsigned int> candidates;
+    this->locate_replicas(pair.second, pair.first, holders, candidates);
+    for (size_t i = 0; i < pair.second.size(); i++) {
+      Key& chunk_key = pair.second[i];
+      if (holders[i].size() >= candidates[i]) {
+        continue;
+      }
+      std::unordered_set<Key> holder_keys;
+      bool closest_holder = true;
+      for (Peer& holder : holders[i]) {
+        holder_keys.insert(holder.key);
+        closest_holder = closest_holder && Dist(chunk_key, self_key) < Dist(chunk_key, holder.key);
+      }
+      if (!closest_holder) {
+        continue;
+      }
+      std::deque<Peer*> replica_peers;
+      chunk_repair r = {chunk_key, holders[i].size(), {}};
+      this->router_lock.lock();
+      this->replica_set(chunk_key, pair.first, replica_peers);
+      for (Peer* peer : replica_peers) {
+        if (holder_keys.count(peer->key) == 0) {
+          r.targets.push_back(*peer);
+        }
+      }
+      this->router_lock.unlock();
+      if (!r.targets.empty()) {
+        repairs.push_back(r);
+      }
+    }
+  }
+  std::sort(repairs.begin(), repairs.end(), [](const chunk_repair& r1, const chunk_repair& r2) {
+    return r1.live_replicas < r2.live_replicas;
+  });
+  if (!repairs.empty()) {
+    LOG_DEBUG("{} REPAIR: DEAD_PEERS={} UNDER_REPLICATED={}", this->self_hex, dead_peers.size(), repairs.size());
+  }
+
+  // (iii) store the chunks at a limited rate
+  this->store_repairs(std::make_shared<std::vector<chunk_repair>>(std::move(repairs)), 0,
+                      std::chrono::steady_clock::now(), 0);
+}
+
+// store the repairs from the next one on (on copies, since the local chunks may expire or be republished meanwhile)
+// once the stores are ahead of the rate limit, the rest are scheduled on the maintenance queue for when they are
+// back below it (instead of holding the executor's worker)
+void Session::store_repairs(std::shared_ptr<std::vector<chunk_repair>> repairs, size_t next,
+                            std::chrono::steady_clock::time_point start, uint64_t sent_bytes) {
+  static Counter* repaired_chunks = metrics()->counter("distft_repair_chunks_total", "", "Under-replicated chunks repaired");
+  static Counter* repaired_replicas = metrics()->counter("distft_repair_replicas_total", "", "Replicas re-created by repairs");
+  static Counter* repaired_bytes = metrics()->counter("distft_repair_bytes_total", "", "Bytes stored by repairs");
+  for (size_t i = next; i < repairs->size(); i++) {
     if (this->dying) {
       return;
     }
+    chunk_repair& r = repairs->at(i);
     this->chunks_lock.lock();
-    std::vector<Key> republish_keys;
-    for (auto& pair : this->chunks) {
-      Key chunk_key = pair.first;
-      Chunk* chunk = pair.second;
-      std::chrono::seconds time_since_publish = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - chunk->last_published);
-      if (time_since_publish >= unpublished_time) {
-        republish_keys.push_back(chunk_key);
+    auto it = this->chunks.find(r.key);
+    if (it == this->chunks.end()) {
+      this->chunks_lock.unlock();
+      continue;
+    }
+    Chunk chunk = *it->second;
+    std::vector<char> data(*chunk.data);
+    chunk.data = &data;
+    this->chunks_lock.unlock();
+
+    unsigned int stored = 0;
+    for (Peer& target : r.targets) {
+      if (this->store(&target, &chunk, false)) {
+        stored++;
+        sent_bytes += data.size();
       }
     }
-    for (Key key : republish_keys) {
-    // remove chunk from local map and republish
-      spdlog::debug("{} REPUBLISH: CHUNK={}", hex_string(this->self_key()), hex_string(key));
-      Chunk* chunk = this->chunks[key];
-      this->chunks.erase(key);
-      this->publish(chunk, false);
+    repaired_chunks->add(1);
+    repaired_replicas->add(stored);
+    repaired_bytes->add(stored * data.size());
+
+    // continue once the repair stores are back below the rate limit
+    auto budget = std::chrono::microseconds(sent_bytes * 1000000 / REPAIR_BYTES_PER_SECOND);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    if (elapsed < budget && i + 1 < repairs->size() && this->maintenance_queue != NULL) {
+      auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(budget - elapsed + std::chrono::microseconds(999));
+      executor()->schedule(this->maintenance_queue, delay, [this, repairs, i, start, sent_bytes]() {
+        this->store_repairs(repairs, i + 1, start, sent_bytes);
+      });
+      return;
     }
-    this->chunks_lock.unlock();
   }
 }
 
-// remove expired chunks
-void Session::cleanup_chunks_thread_fn() {
-  std::chrono::seconds sleep_time(10);
-  std::chrono::seconds expire_time(CHUNK_EXPIRE_TIME);
-  while (true) {
-    std::this_thread::sleep_for(sleep_time);
+// reconcile the shared chunks with the neighbors (every ANTI_ENTROPY_INTERVAL seconds)
+unsigned int Session::anti_entropy() {
+  static Counter* rounds = metrics()->counter("distft_anti_entropy_rounds_total", "", "Anti-entropy rounds with the neighbors");
+  rounds->add(1);
+  std::unordered_map<Key, std::pair<Peer, std::vector<Key>>> shared;
+  this->shared_keys(shared);
+  unsigned int sent = 0;
+  for (auto& pair : shared) {
     if (this->dying) {
-      return;
+      break;
     }
-    this->chunks_lock.lock();
-    std::vector<Key> expired_keys;
-    for (auto& pair : this->chunks) {
-      Key chunk_key = pair.first;
-      Chunk* chunk = pair.second;
-      if (chunk->original_publish - std::chrono::system_clock::now() >= expire_time) {
-        expired_keys.push_back(chunk_key);
+    sent += this->sync_chunks(pair.second.first, pair.second.second);
+  }
+  return sent;
+}
+
+// digest (the xor of the keys) and number of the keys in the range of the prefix's first prefix_bits bits
+static uint64_t range_digest(std::vector<Key>& keys, Key& prefix, int prefix_bits, Key& digest_buffer) {
+  digest_buffer.reset();
+  uint64_t count = 0;
+  for (Key& key : keys) {
+    if (prefix_bits == 0 || ((key ^ prefix) >> (KEYBITS - prefix_bits)).none()) {
+      digest_buffer ^= key;
+      count++;
+    }
+  }
+  return count;
+}
+
+// store the chunks shared with the peer that it lacks
+// the ranges whose digests differ are split until the peer lists its keys in them, so ranges (and chunks) that
+// are in sync cost a single digest (the first round compares the digests of all shared keys)
+// chunks only the peer holds are sent by the peer's own anti-entropy rounds
+unsigned int Session::sync_chunks(Peer& peer, std::vector<Key>& shared_keys) {
+  static Counter* sync_rpcs = metrics()->counter("distft_anti_entropy_rpcs_total", "", "Key range digest exchanges of anti-entropy rounds");
+  static Counter* sent_chunks = metrics()->counter("distft_anti_entropy_chunks_total", "", "Chunks stored on neighbors that lacked them by anti-entropy");
+  static Counter* sent_bytes = metrics()->counter("distft_anti_entropy_bytes_total", "", "Bytes stored on neighbors by anti-entropy");
+
+  // (i) find the shared keys the peer lacks
+  std::vector<std::pair<Key, int>> frontier = {{Key(), 0}};
+  std::vector<Key> missing_keys;
+  while (!frontier.empty() && !this->dying) {
+    std::vector<dht::KeyRange> ranges;
+    for (auto& range : frontier) {
+      Key digest;
+      dht::KeyRange key_range;
+      key_range.set_prefix(range.first.to_string());
+      key_range.set_prefix_bits(range.second);
+      key_range.set_count(range_digest(shared_keys, range.first, range.second, digest));
+      key_range.set_digest(digest.to_string());
+      ranges.push_back(key_range);
+    }
+    std::vector<dht::KeyRange> peer_ranges;
+    sync_rpcs->add(1);
+    if (!this->sync_keys(&peer, ranges, peer_ranges)) {
+      return 0;
+    }
+
+    std::vector<std::pair<Key, int>> next_frontier;
+    for (size_t i = 0; i < frontier.size(); i++) {
+      Key& prefix = frontier[i].first;
+      int prefix_bits = frontier[i].second;
+      if (peer_ranges[i].digest() == ranges[i].digest() && peer_ranges[i].count() == ranges[i].count()) {
+        continue;
+      }
+      if (peer_ranges[i].listed()) {
+        std::unordered_set<Key> peer_keys;
+        for (const std::string& key : peer_ranges[i].keys()) {
+          peer_keys.insert(Key(key));
+        }
+        for (Key& key : shared_keys) {
+          if ((prefix_bits == 0 || ((key ^ prefix) >> (KEYBITS - prefix_bits)).none()) && peer_keys.count(key) == 0) {
+            missing_keys.push_back(key);
+          }
+        }
+        continue;
+      }
+
+      // split the range (skipping the sub-ranges without local keys, since only the peer could send them)
+      for (uint64_t child = 0; child < (1 << SYNC_RANGE_BITS); child++) {
+        int child_bits = prefix_bits + SYNC_RANGE_BITS;
+        Key child_prefix = prefix | (Key(child) << (KEYBITS - child_bits));
+        Key digest;
+        if (range_digest(shared_keys, child_prefix, child_bits, digest) > 0) {
+          next_frontier.push_back({child_prefix, child_bits});
+        }
       }
     }
-    for (Key key : expired_keys) {
-      // remove chunk from local map and delete
-      delete this->chunks[key];
-      this->chunks.erase(key);
-      spdlog::debug("{} EXPIRED: CHUNK={}", hex_string(this->self_key()), hex_string(key));
+    frontier.swap(next_frontier);
+  }
+  if (!missing_keys.empty()) {
+    LOG_DEBUG("{} ANTI ENTROPY: PEER={} SHARED={} MISSING={}", this->self_hex, key_hex(peer.key), shared_keys.size(), missing_keys.size());
+  }
+
+  // (ii) store the missing chunks (on a copy, since the local chunk may expire or be republished meanwhile)
+  unsigned int sent = 0;
+  for (Key& key : missing_keys) {
+    if (this->dying) {
+      break;
+    }
+    this->chunks_lock.lock();
+    auto it = this->chunks.find(key);
+    if (it == this->chunks.end()) {
+      this->chunks_lock.unlock();
+      continue;
     }
+    Chunk chunk = *it->second;
+    std::vector<char> data(*chunk.data);
+    chunk.data = &data;
     this->chunks_lock.unlock();
+    if (this->store(&peer, &chunk, false)) {
+      sent++;
+      sent_chunks->add(1);
+      sent_bytes->add(data.size());
+    }
   }
+  return sent;
 }
 
-// store time since last lookup for each peer and perform random lookup on a peer
-// in each bucket
-void Session::refresh_peer_thread_fn() {
-  std::chrono::seconds sleep_time(10);
-  std::chrono::seconds unaccessed_time(3600);
-  std::deque<Peer> buffer;
-  while (true) {
-    std::this_thread::sleep_for(sleep_time);
+// hand the local chunks off to the peers inserted since the handoff was scheduled
+// (the first arrival schedules it HANDOFF_COALESCE_MS ahead, so the arrivals until then are coalesced)
+void Session::handoff_new_peers() {
+  std::unordered_map<Key, Peer> new_peers;
+  this->repair_lock.lock();
+  new_peers.swap(this->handoff_peers);
+  this->repair_lock.unlock();
+  if (this->dying) {
+    return;
+  }
+  this->handoff_chunks(new_peers);
+}
+
+// store the local chunks whose replica sets the new peers joined on them
+// only the member of a replica set closest to the chunk (among the members that were already known) hands the
+// chunk off, the new peers are asked which of their chunks they already hold, and the rest are sent in batches
+void Session::handoff_chunks(std::unordered_map<Key, Peer>& new_peers) {
+  static Counter* handed_off = metrics()->counter("distft_handoff_chunks_total", "", "Chunks handed off to newly inserted peers");
+  static Counter* handed_off_bytes = metrics()->counter("distft_handoff_bytes_total", "", "Bytes handed off to newly inserted peers");
+
+  // (i) find the chunks of every new peer
+  std::unordered_map<Key, std::vector<Key>> peer_keys;
+  Key self_key = this->self_key();
+  this->chunks_lock.lock();
+  this->router_lock.lock();
+  for (auto& pair : this->chunks) {
+    Key chunk_key = pair.first;
+    std::deque<Peer*> replica_peers;
+    this->replica_set(chunk_key, pair.second->replicas, replica_peers);
+    std::vector<Key> targets;
+    bool closest_member = true;
+    for (Peer* peer : replica_peers) {
+      if (new_peers.count(peer->key) > 0) {
+        targets.push_back(peer->key);
+      } else if (Dist(chunk_key, peer->key) < Dist(chunk_key, self_key)) {
+        closest_member = false;
+        break;
+      }
+    }
+    if (!closest_member) {
+      continue;
+    }
+    for (Key& target : targets) {
+      peer_keys[target].push_back(chunk_key);
+    }
+  }
+  this->router_lock.unlock();
+  this->chunks_lock.unlock();
+
+  // (ii) send the chunks each new peer lacks in batches
+  for (auto& pair : peer_keys) {
     if (this->dying) {
       return;
     }
-    std::deque<Peer*> refresh_peers;
-    this->router_lock.lock();
-    this->router->random_per_bucket_peers(refresh_peers, unaccessed_time);
-    this->router_lock.unlock();
-    std::deque<Peer> buffer;
-    for (Peer* peer : refresh_peers) {
-      this->node_lookup(peer->key, buffer);
-      buffer.clear();
-    }
+    LOG_DEBUG("{} HANDOFF: PEER={} CHUNKS={}", this->self_hex, key_hex(pair.first), pair.second.size());
+    std::vector<char> held;
+    this->push_chunks(new_peers[pair.first], pair.second, std::chrono::steady_clock::time_point::max(),
+      [](size_t chunks, uint64_t bytes) {
+        handed_off->add(chunks);
+        handed_off_bytes->add(bytes);
+      }, held);
   }
+}
 
+// store the chunks of the keys that the peer lacks on it, in store batches of at most HANDOFF_BATCH_BYTES
+// (stops at the first failed RPC or once the deadline has passed)
+// on_stored is called with the number of chunks and bytes of every batch the peer stored,
+// and held_buffer[i] is set if the peer holds the chunk of keys[i] afterwards
+void Session::push_chunks(Peer& peer, std::vector<Key>& keys, std::chrono::steady_clock::time_point deadline,
+                          std::function<void(size_t, uint64_t)> on_stored, std::vector<char>& held_buffer) {
+  held_buffer.assign(keys.size(), false);
+  for (size_t start = 0; start < keys.size(); start += HAS_CHUNKS_BATCH) {
+    size_t end = std::min(start + HAS_CHUNKS_BATCH, keys.size());
+    std::vector<Key> batch_keys(keys.begin() + start, keys.begin() + end);
+    std::vector<char> has_chunk;
+    if (std::chrono::steady_clock::now() >= deadline || !this->has_chunks(&peer, batch_keys, has_chunk)) {
+      return;
+    }
+    size_t next = 0;
+    while (next < batch_keys.size()) {
+      // copy the next batch of chunks (the local chunks may expire or be republished meanwhile)
+      std::vector<Chunk> batch_chunks;
+      std::vector<std::vector<char>> batch_data;
+      std::vector<size_t> batch_indices;
+      size_t batch_bytes = 0;
+      this->chunks_lock.lock();
+      for (; next < batch_keys.size() && (batch_chunks.empty() || batch_bytes < HANDOFF_BATCH_BYTES); next++) {
+        held_buffer[start + next] = has_chunk[next];
+        auto it = this->chunks.find(batch_keys[next]);
+        if (has_chunk[next] || it == this->chunks.end()) {
+          continue;
+        }
+        batch_chunks.push_back(*it->second);
+        batch_data.push_back(*it->second->data);
+        batch_indices.push_back(start + next);
+        batch_bytes += it->second->data->size();
+      }
+      this->chunks_lock.unlock();
+      if (batch_chunks.empty()) {
+        break;
+      }
+      std::vector<Chunk*> batch;
+      for (size_t i = 0; i < batch_chunks.size(); i++) {
+        batch_chunks[i].data = &batch_data[i];
+        batch.push_back(&batch_chunks[i]);
+      }
+      std::vector<char> stored;
+      if (std::chrono::steady_clock::now() >= deadline || !this->store_batch(&peer, batch, stored)) {
+        return;
+      }
+      size_t stored_chunks = 0;
+      uint64_t stored_bytes = 0;
+      for (size_t i = 0; i < batch.size(); i++) {
+        if (stored[i]) {
+          held_buffer[batch_indices[i]] = true;
+          stored_chunks++;
+          stored_bytes += batch_data[i].size();
+        }
+      }
+      on_stored(stored_chunks, stored_bytes);
+    }
+  }
 }
 
 
@@ -135,6 +586,8 @@ void Session::refresh_peer_thread_fn() {
 grpc::Status Session::FindNode(grpc::ServerContext* context, 
                             const dht::FindNodeRequest* request,
                             dht::FindNodeResponse* response) {
+  static Counter* handled = rpc_handled_counter("find_node");
+  handled->add(1);
 
   // update sender and set receiver
   dht::Peer sender = request->sender();
@@ -144,8 +597,8 @@ grpc::Status Session::FindNode(grpc::ServerContext* context,
 
   // set closest keys
   Key search_key = Key(request->search_key());
-  spdlog::debug("{} FIND NODE RPC: SENDER={} SEARCH_KEY={}", hex_string(this->self_key()), 
-                hex_string(Key(sender.key())), hex_string(search_key));
+  LOG_DEBUG("{} FIND NODE RPC: SENDER={} SEARCH_KEY={}", this->self_hex, 
+                key_hex(Key(sender.key())), key_hex(search_key));
               
   std::deque<Peer*> closest_keys;
   this->router_lock.lock();
@@ -163,6 +616,8 @@ grpc::Status Session::FindNode(grpc::ServerContext* context,
 grpc::Status Session::FindValue(grpc::ServerContext* context, 
                         const dht::FindValueRequest* request,
                         dht::FindValueResponse* response) {
+  static Counter* handled = rpc_handled_counter("find_value");
+  handled->add(1);
 
   // update sender and set receiver
   dht::Peer sender = request->sender();
@@ -171,8 +626,8 @@ grpc::Status Session::FindValue(grpc::ServerContext* context,
   response->set_allocated_receiver(receiver);
 
   Key search_key = Key(request->search_key());
-  spdlog::debug("{} FIND VALUE RPC: SENDER={} SEARCH_KEY={}", hex_string(this->self_key()), 
-                hex_string(Key(sender.key())), hex_string(search_key));
+  LOG_DEBUG("{} FIND VALUE RPC: SENDER={} SEARCH_KEY={}", this->self_hex, 
+                key_hex(Key(sender.key())), key_hex(search_key));
 
   // found key -> send data
   this->chunks_lock.lock();
@@ -206,6 +661,8 @@ grpc::Status Session::FindValue(grpc::ServerContext* context,
 grpc::Status Session::StoreInit(grpc::ServerContext* context, 
                         const dht::StoreInitRequest* request,
                         dht::StoreInitResponse* response) {
+  static Counter* handled = rpc_handled_counter("store_init");
+  handled->add(1);
 
   // update sender and set receiver
   dht::Peer sender = request->sender();
@@ -215,8 +672,8 @@ grpc::Status Session::StoreInit(grpc::ServerContext* context,
 
   // continue store if data not stored locally
   Key chunk_key = Key(request->chunk_key());
-  spdlog::debug("{} STORE RPC: SENDER={} CHUNK_KEY={}", hex_string(this->self_key()), 
-                hex_string(Key(sender.key())), hex_string(chunk_key));
+  LOG_DEBUG("{} STORE RPC: SENDER={} CHUNK_KEY={}", this->self_hex, 
+                key_hex(Key(sender.key())), key_hex(chunk_key));
   this->chunks_lock.lock();
   response->set_continue_store(this->chunks.count(chunk_key) == 0);
   this->chunks_lock.unlock();
@@ -228,6 +685,8 @@ grpc::Status Session::StoreInit(grpc::ServerContext* context,
 grpc::Status Session::Store(grpc::ServerContext* context, 
                         const dht::StoreRequest* request,
                         dht::StoreResponse* response) {
+  static Counter* handled = rpc_handled_counter("store");
+  handled->add(1);
   // update sender and set receiver
   dht::Peer sender = request->sender();
   dht::Peer* receiver = new dht::Peer;
@@ -235,18 +694,28 @@ grpc::Status Session::Store(grpc::ServerContext* context,
   response->set_allocated_receiver(receiver);
 
   // store chunk locally
-  Key key = Key(request->chunk_key());
-  size_t size = request->size();
-  std::chrono::system_clock::time_point original_publish = 
-    std::chrono::time_point<std::chrono::system_clock>(std::chrono::seconds(request->original_publish()));
-  std::vector<char>* data = new std::vector<char>(request->data().data(), request->data().data() + size);
-  Chunk* chunk = new Chunk(key, data, false, original_publish);
-  this->chunks_lock.lock();
-  if (this->chunks.count(key) > 0) {
-    delete this->chunks[key];
+  Key sender_key = Key(sender.key());
+  return this->store_local(request, sender_key);
+}
+
+// store several key/bytes pairs locally (and tell the sender which of them were stored)
+grpc::Status Session::StoreBatch(grpc::ServerContext* context, 
+                        const dht::StoreBatchRequest* request,
+                        dht::StoreBatchResponse* response) {
+  static Counter* handled = rpc_handled_counter("store_batch");
+  handled->add(1);
+  // update sender and set receiver
+  dht::Peer sender = request->sender();
+  dht::Peer* receiver = new dht::Peer;
+  this->rpc_handler_prelims(&sender, receiver);
+  response->set_allocated_receiver(receiver);
+
+  Key sender_key = Key(sender.key());
+  LOG_DEBUG("{} STORE BATCH RPC: SENDER={} CHUNKS={}", this->self_hex, 
+                key_hex(sender_key), request->chunks_size());
+  for (const dht::StoreRequest& chunk : request->chunks()) {
+    response->add_stored(this->store_local(&chunk, sender_key).ok());
   }
-  this->chunks[chunk->key] = chunk;
-  this->chunks_lock.unlock();
   return grpc::Status::OK;
 }
 
@@ -254,13 +723,101 @@ grpc::Status Session::Store(grpc::ServerContext* context,
 grpc::Status Session::Ping(grpc::ServerContext* context, 
                         const dht::PingRequest* request,
                         dht::PingResponse* response) {
+  static Counter* handled = rpc_handled_counter("ping");
+  handled->add(1);
+  // update sender and set receiver
+  dht::Peer sender = request->sender();
+  dht::Peer* receiver = new dht::Peer;
+  this->rpc_handler_prelims(&sender, receiver);
+  response->set_allocated_receiver(receiver);
+
+  LOG_DEBUG("{} PING: SENDER={}", this->self_hex, key_hex(Key(sender.key())));
+  return grpc::Status::OK;
+}
+
+// tell sender which of the chunks are stored locally
+grpc::Status Session::HasChunks(grpc::ServerContext* context, 
+                        const dht::HasChunksRequest* request,
+                        dht::HasChunksResponse* response) {
+  static Counter* handled = rpc_handled_counter("has_chunks");
+  handled->add(1);
+  // update sender and set receiver
+  dht::Peer sender = request->sender();
+  dht::Peer* receiver = new dht::Peer;
+  this->rpc_handler_prelims(&sender, receiver);
+  response->set_allocated_receiver(receiver);
+
+  LOG_DEBUG("{} HAS CHUNKS RPC: SENDER={} KEYS={}", this->self_hex, 
+                key_hex(Key(sender.key())), request->chunk_keys_size());
+  this->chunks_lock.lock();
+  for (const std::string& chunk_key : request->chunk_keys()) {
+    response->add_has_chunk(this->chunks.count(Key(chunk_key)) > 0);
+  }
+  this->chunks_lock.unlock();
+  return grpc::Status::OK;
+}
+
+// compare the sender's digests of the keys both should hold with the local ones
+// (the keys of mismatched ranges are listed once both sides hold few enough keys in them)
+grpc::Status Session::SyncKeys(grpc::ServerContext* context, 
+                        const dht::SyncKeysRequest* request,
+                        dht::SyncKeysResponse* response) {
+  static Counter* handled = rpc_handled_counter("sync_keys");
+  handled->add(1);
   // update sender and set receiver
   dht::Peer sender = request->sender();
   dht::Peer* receiver = new dht::Peer;
   this->rpc_handler_prelims(&sender, receiver);
   response->set_allocated_receiver(receiver);
 
-  spdlog::debug("{} PING: SENDER={}", hex_string(this->self_key()), hex_string(Key(sender.key())));
+  Key sender_key = Key(sender.key());
+  LOG_DEBUG("{} SYNC KEYS RPC: SENDER={} RANGES={}", this->self_hex, 
+                key_hex(sender_key), request->ranges_size());
+
+  // the keys shared with the sender are computed once per reconciliation (which starts with the range of all keys)
+  bool starting = request->ranges_size() > 0 && request->ranges(0).prefix_bits() == 0;
+  auto now = std::chrono::steady_clock::now();
+  std::vector<Key> shared_keys;
+  this->sync_lock.lock();
+  for (auto it = this->sync_sessions.begin(); it != this->sync_sessions.end();) {
+    if (now - it->second.first >= std::chrono::seconds(SYNC_SESSION_TTL) || (starting && it->first == sender_key)) {
+      it = this->sync_sessions.erase(it);
+    } else {
+      it++;
+    }
+  }
+  auto session_it = this->sync_sessions.find(sender_key);
+  bool cached = session_it != this->sync_sessions.end();
+  if (cached) {
+    shared_keys = session_it->second.second;
+  }
+  this->sync_lock.unlock();
+  if (!cached) {
+    this->shared_keys(sender_key, shared_keys);
+    std::lock_guard<std::mutex> guard(this->sync_lock);
+    this->sync_sessions[sender_key] = {now, shared_keys};
+  }
+
+  for (const dht::KeyRange& range : request->ranges()) {
+    Key prefix = Key(range.prefix());
+    int prefix_bits = std::min(std::max(range.prefix_bits(), 0), KEYBITS);
+    Key digest;
+    uint64_t count = range_digest(shared_keys, prefix, prefix_bits, digest);
+    dht::KeyRange* local_range = response->add_ranges();
+    local_range->set_prefix(range.prefix());
+    local_range->set_prefix_bits(prefix_bits);
+    local_range->set_digest(digest.to_string());
+    local_range->set_count(count);
+    bool matched = local_range->digest() == range.digest() && count == range.count();
+    if (!matched && (prefix_bits == KEYBITS || (count <= SYNC_LEAF_KEYS && range.count() <= SYNC_LEAF_KEYS))) {
+      local_range->set_listed(true);
+      for (Key& key : shared_keys) {
+        if (prefix_bits == 0 || ((key ^ prefix) >> (KEYBITS - prefix_bits)).none()) {
+          local_range->add_keys(key.to_string());
+        }
+      }
+    }
+  }
   return grpc::Status::OK;
 }
 
@@ -274,6 +831,7 @@ bool Session::find_node(Peer* peer, Key& search_key, std::deque<Peer>& buffer) {
   dht::FindNodeRequest request;
   grpc::ClientContext context;
   dht::FindNodeResponse response;
+  context.set_deadline(rpc_deadline(0));
 
   // add sender and search key to request
   dht::Peer* self_peer_rpc = new dht::Peer;
@@ -281,9 +839,14 @@ bool Session::find_node(Peer* peer, Key& search_key, std::deque<Peer>& buffer) {
   request.set_allocated_sender(self_peer_rpc);
   request.set_search_key(search_key.to_string());
 
+  static Histogram* latency = rpc_latency_histogram("find_node");
+  static Counter* failed = rpc_failed_counter("find_node");
+  auto start = std::chrono::steady_clock::now();
   grpc::Status status = stub->FindNode(&context, request, &response);
+  latency->record(elapsed_micros(start));
   if (!status.ok()) {
-    this->router->evict_peer(peer->key);
+    failed->add(1);
+    this->evict_dead_peer(peer->key);
     return false;
   }
 
@@ -295,7 +858,8 @@ bool Session::find_node(Peer* peer, Key& search_key, std::deque<Peer>& buffer) {
   for (dht::Peer peer : response.closest_peers()) {
     Peer local_peer;
     this->rpc_peer_to_local(&peer, &local_peer);
-    if (local_peer.key ==  this->self_key() || local_peer.endpoint == this->self_endpoint()) {
+    if (local_peer.key ==  this->self_key() || local_peer.endpoint == this->self_endpoint()
+        || this->recently_dead(local_peer.key)) {
       continue;
     }
     this->update_peer(local_peer.key, local_peer.endpoint);
@@ -309,6 +873,7 @@ bool Session::find_value(Peer* peer, Key& search_key, bool* found_value_buffer,
   dht::FindValueRequest request;
   grpc::ClientContext context;
   dht::FindValueResponse response;
+  context.set_deadline(rpc_deadline(RPC_MAX_DATA_BYTES));
 
   // add sender and search key to request
   dht::Peer* self_peer_rpc = new dht::Peer;
@@ -316,9 +881,14 @@ bool Session::find_value(Peer* peer, Key& search_key, bool* found_value_buffer,
   request.set_allocated_sender(self_peer_rpc);
   request.set_search_key(search_key.to_string());
 
+  static Histogram* latency = rpc_latency_histogram("find_value");
+  static Counter* failed = rpc_failed_counter("find_value");
+  auto start = std::chrono::steady_clock::now();
   grpc::Status status = stub->FindValue(&context, request, &response);
+  latency->record(elapsed_micros(start));
   if (!status.ok()) {
-    this->router->evict_peer(peer->key);
+    failed->add(1);
+    this->evict_dead_peer(peer->key);
     return false;
   }
   
@@ -326,9 +896,13 @@ bool Session::find_value(Peer* peer, Key& search_key, bool* found_value_buffer,
   dht::Peer receiver_rpc = response.receiver();
   this->rpc_caller_epilogue(&receiver_rpc);
 
-  // copy data into data buffer if found
+  // copy data into data buffer if found (and not truncated)
   if (response.found_value()) {
     size_t size = response.size();
+    if (response.data().size() != size) {
+      LOG_ERROR("{} TRUNCATED VALUE: PEER={} CHUNK={}", this->self_hex, key_hex(peer->key), key_hex(search_key));
+      return false;
+    }
     *data_buffer = new std::vector<char>(response.data().data(), response.data().data() + size);
     *found_value_buffer = true;
     return true;
@@ -338,7 +912,8 @@ bool Session::find_value(Peer* peer, Key& search_key, bool* found_value_buffer,
   for (dht::Peer peer : response.closest_peers()) {
     Peer local_peer;
     this->rpc_peer_to_local(&peer, &local_peer);
-    if (local_peer.key ==  this->self_key() || local_peer.endpoint == this->self_endpoint()) {
+    if (local_peer.key ==  this->self_key() || local_peer.endpoint == this->self_endpoint()
+        || this->recently_dead(local_peer.key)) {
       continue;
     }
     this->update_peer(local_peer.key, local_peer.endpoint);
@@ -354,6 +929,7 @@ bool Session::store(Peer* peer, Chunk* chunk, bool force) {
   dht::StoreInitRequest init_request;
   grpc::ClientContext init_context;
   dht::StoreInitResponse init_response;
+  init_context.set_deadline(rpc_deadline(0));
 
   // add sender and chunk key to request
   dht::Peer* self_peer_init_rpc = new dht::Peer;
@@ -361,9 +937,13 @@ bool Session::store(Peer* peer, Chunk* chunk, bool force) {
   init_request.set_allocated_sender(self_peer_init_rpc);
   init_request.set_chunk_key(chunk->key.to_string());
 
+  static Histogram* latency = rpc_latency_histogram("store");
+  static Counter* failed = rpc_failed_counter("store");
+  auto start = std::chrono::steady_clock::now();
   grpc::Status status = stub->StoreInit(&init_context, init_request, &init_response);
   if (!status.ok()) {
-    this->router->evict_peer(peer->key);
+    failed->add(1);
+    this->evict_dead_peer(peer->key);
     return false;
   }
 
@@ -380,44 +960,203 @@ bool Session::store(Peer* peer, Chunk* chunk, bool force) {
   dht::StoreRequest request;
   grpc::ClientContext context;
   dht::StoreResponse response;
+  context.set_deadline(rpc_deadline(chunk->data->size()));
 
   // add sender and chunk key + data to request
   dht::Peer* self_peer_rpc = new dht::Peer;
   this->rpc_caller_prelims(self_peer_rpc);
   request.set_allocated_sender(self_peer_rpc);
-  request.set_chunk_key(chunk->key.to_string());
-  request.mutable_data()->assign(chunk->data->data(), chunk->data->size());
-  request.set_size(chunk->data->size());
-  request.set_original_publish(
-    std::chrono::time_point_cast<std::chrono::seconds>(chunk->original_publish).time_since_epoch().count()
-  );
+  this->chunk_to_rpc(chunk, &request);
 
   status = stub->Store(&context, request, &response);
+  latency->record(elapsed_micros(start));
+  if (!status.ok()) {
+    // (versioned stores are aborted by peers that hold a newer version)
+    if (status.error_code() != grpc::StatusCode::ABORTED) {
+      failed->add(1);
+    }
+    return false;
+  }
+
+  // update receiver
+  this->rpc_caller_epilogue(&receiver_rpc);
+  return true;
+}
+
+// store several chunks on a peer in a single RPC (sets stored_buffer[i] for chunks[i])
+bool Session::store_batch(Peer* peer, std::vector<Chunk*>& chunks, std::vector<char>& stored_buffer) {
+  std::unique_ptr<dht::DHTService::Stub> stub = rpc_stub(peer);
+  dht::StoreBatchRequest request;
+  grpc::ClientContext context;
+  dht::StoreBatchResponse response;
+
+  // add sender and chunks to request
+  dht::Peer* self_peer_rpc = new dht::Peer;
+  this->rpc_caller_prelims(self_peer_rpc);
+  request.set_allocated_sender(self_peer_rpc);
+  size_t data_bytes = 0;
+  for (Chunk* chunk : chunks) {
+    this->chunk_to_rpc(chunk, request.add_chunks());
+    data_bytes += chunk->data->size();
+  }
+  context.set_deadline(rpc_deadline(data_bytes));
+
+  static Histogram* latency = rpc_latency_histogram("store_batch");
+  static Counter* failed = rpc_failed_counter("store_batch");
+  auto start = std::chrono::steady_clock::now();
+  grpc::Status status = stub->StoreBatch(&context, request, &response);
+  latency->record(elapsed_micros(start));
+  if (!status.ok()) {
+    failed->add(1);
+    this->evict_dead_peer(peer->key);
+    return false;
+  }
+  if (response.stored_size() != chunks.size()) {
+    return false;
+  }
+
+  // update receiver
+  dht::Peer receiver_rpc = response.receiver();
+  this->rpc_caller_epilogue(&receiver_rpc);
+  stored_buffer.assign(response.stored().begin(), response.stored().end());
+  return true;
+}
+
+// ask a peer which of the chunks it stores
+bool Session::has_chunks(Peer* peer, std::vector<Key>& keys, std::vector<char>& has_chunk_buffer) {
+  std::unique_ptr<dht::DHTService::Stub> stub = rpc_stub(peer);
+  dht::HasChunksRequest request;
+  grpc::ClientContext context;
+  dht::HasChunksResponse response;
+  context.set_deadline(rpc_deadline(0));
+
+  // add sender and chunk keys to request
+  dht::Peer* self_peer_rpc = new dht::Peer;
+  this->rpc_caller_prelims(self_peer_rpc);
+  request.set_allocated_sender(self_peer_rpc);
+  for (Key& key : keys) {
+    request.add_chunk_keys(key.to_string());
+  }
+
+  static Histogram* latency = rpc_latency_histogram("has_chunks");
+  static Counter* failed = rpc_failed_counter("has_chunks");
+  auto start = std::chrono::steady_clock::now();
+  grpc::Status status = stub->HasChunks(&context, request, &response);
+  latency->record(elapsed_micros(start));
+  if (!status.ok()) {
+    failed->add(1);
+    this->evict_dead_peer(peer->key);
+    return false;
+  }
+  if (response.has_chunk_size() != keys.size()) {
+    return false;
+  }
+
+  // update receiver
+  dht::Peer receiver_rpc = response.receiver();
+  this->rpc_caller_epilogue(&receiver_rpc);
+  has_chunk_buffer.assign(response.has_chunk().begin(), response.has_chunk().end());
+  return true;
+}
+
+// fetch a chunk directly from a peer that is known to hold it
+// the call may be cancelled through the context (e.g., when another replica already sent the chunk),
+// in which case the peer is not evicted
+bool Session::fetch_value(Peer* peer, Key& search_key, grpc::ClientContext* context, std::vector<char>** data_buffer) {
+  std::unique_ptr<dht::DHTService::Stub> stub = rpc_stub(peer);
+  dht::FindValueRequest request;
+  dht::FindValueResponse response;
+  context->set_deadline(rpc_deadline(RPC_MAX_DATA_BYTES));
+
+  // add sender and search key to request
+  dht::Peer* self_peer_rpc = new dht::Peer;
+  this->rpc_caller_prelims(self_peer_rpc);
+  request.set_allocated_sender(self_peer_rpc);
+  request.set_search_key(search_key.to_string());
+
+  static Histogram* latency = rpc_latency_histogram("fetch_value");
+  static Counter* failed = rpc_failed_counter("fetch_value");
+  auto start = std::chrono::steady_clock::now();
+  grpc::Status status = stub->FindValue(context, request, &response);
+  latency->record(elapsed_micros(start));
   if (!status.ok()) {
+    if (status.error_code() != grpc::StatusCode::CANCELLED) {
+      failed->add(1);
+      this->evict_dead_peer(peer->key);
+    }
     return false;
   }
 
   // update receiver
+  dht::Peer receiver_rpc = response.receiver();
   this->rpc_caller_epilogue(&receiver_rpc);
+  if (!response.found_value() || response.data().size() != static_cast<size_t>(response.size())) {
+    return false;
+  }
+  size_t size = response.size();
+  *data_buffer = new std::vector<char>(response.data().data(), response.data().data() + size);
+  return true;
+}
+
+// exchange the digests of key ranges with a peer
+bool Session::sync_keys(Peer* peer, std::vector<dht::KeyRange>& ranges, std::vector<dht::KeyRange>& ranges_buffer) {
+  std::unique_ptr<dht::DHTService::Stub> stub = rpc_stub(peer);
+  dht::SyncKeysRequest request;
+  grpc::ClientContext context;
+  dht::SyncKeysResponse response;
+  context.set_deadline(rpc_deadline(0));
+
+  // add sender and ranges to request
+  dht::Peer* self_peer_rpc = new dht::Peer;
+  this->rpc_caller_prelims(self_peer_rpc);
+  request.set_allocated_sender(self_peer_rpc);
+  for (dht::KeyRange& range : ranges) {
+    *request.add_ranges() = range;
+  }
+
+  static Histogram* latency = rpc_latency_histogram("sync_keys");
+  static Counter* failed = rpc_failed_counter("sync_keys");
+  auto start = std::chrono::steady_clock::now();
+  grpc::Status status = stub->SyncKeys(&context, request, &response);
+  latency->record(elapsed_micros(start));
+  if (!status.ok()) {
+    failed->add(1);
+    this->evict_dead_peer(peer->key);
+    return false;
+  }
+  if (response.ranges_size() != ranges.size()) {
+    return false;
+  }
+
+  // update receiver
+  dht::Peer receiver_rpc = response.receiver();
+  this->rpc_caller_epilogue(&receiver_rpc);
+  ranges_buffer.assign(response.ranges().begin(), response.ranges().end());
   return true;
 }
 
 // send a ping to a peer
 // return false if the peer does not respond
-bool Session::ping(Peer* peer, Peer* receiver_peer_buffer) {
+bool Session::ping(Peer* peer, Peer* receiver_peer_buffer, std::chrono::milliseconds timeout) {
   std::unique_ptr<dht::DHTService::Stub> stub = rpc_stub(peer);
   dht::PingRequest request;
   grpc::ClientContext context;
   dht::PingResponse response;
+  context.set_deadline(std::chrono::system_clock::now() + timeout);
   
   // add sender to request
   dht::Peer* self_peer_rpc = new dht::Peer;
   this->rpc_caller_prelims(self_peer_rpc);
   request.set_allocated_sender(self_peer_rpc);
 
+  static Histogram* latency = rpc_latency_histogram("ping");
+  static Counter* failed = rpc_failed_counter("ping");
+  auto start = std::chrono::steady_clock::now();
   grpc::Status status = stub->Ping(&context, request, &response);
+  latency->record(elapsed_micros(start));
   if (!status.ok()) {
-    this->router->evict_peer(peer->key);
+    failed->add(1);
+    this->evict_dead_peer(peer->key);
     return false;
   }
 
@@ -428,6 +1167,52 @@ bool Session::ping(Peer* peer, Peer* receiver_peer_buffer) {
   return true;
 }
 
+// ping every seed endpoint on its own thread until one answers (or JOIN_TIMEOUT seconds have passed)
+// failed pings back off exponentially with jitter, so unreachable seeds cost a few pings per JOIN_BACKOFF_MAX_MS
+// returns false if no seed answered
+bool Session::ping_seeds(std::vector<std::string>& seed_endpoints, Peer& seed_peer_buffer) {
+  std::mutex seed_lock;
+  std::condition_variable seed_cv;
+  bool answered = false;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(JOIN_TIMEOUT);
+  std::vector<std::thread> threads;
+  for (std::string& endpoint : seed_endpoints) {
+    threads.push_back(std::thread([this, &seed_lock, &seed_cv, &answered, &seed_peer_buffer, deadline](std::string endpoint) {
+      std::mt19937 gen(std::random_device{}());
+      std::uniform_real_distribution<double> jitter(0.5, 1.0);
+      Peer seed_peer = {random_key(), endpoint};
+      std::chrono::milliseconds backoff(JOIN_BACKOFF_MIN_MS);
+      while (true) {
+        Peer receiver;
+        bool pinged = this->ping(&seed_peer, &receiver, std::chrono::milliseconds(JOIN_PING_TIMEOUT_MS));
+        std::unique_lock<std::mutex> uq_seed_lock(seed_lock);
+        if (pinged && !answered) {
+          LOG_DEBUG("{} SEED ANSWERED: KEY={} ENDPOINT={}", this->self_hex, key_hex(receiver.key), receiver.endpoint);
+          answered = true;
+          seed_peer_buffer = receiver;
+          seed_cv.notify_all();
+        }
+        if (answered || this->dying) {
+          return;
+        }
+
+        // wait out the backoff (unless another seed answers meanwhile)
+        auto wait_until = std::min(deadline, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::milliseconds>(backoff * jitter(gen)));
+        if (seed_cv.wait_until(uq_seed_lock, wait_until, [&answered]() { return answered; })
+            || std::chrono::steady_clock::now() >= deadline) {
+          return;
+        }
+        backoff = std::min(backoff * 2, std::chrono::milliseconds(JOIN_BACKOFF_MAX_MS));
+      }
+    }, endpoint));
+  }
+  while (threads.size() > 0) {
+    threads.back().join();
+    threads.pop_back();
+  }
+  return answered;
+}
+
 
 //
 // RPC helpers
@@ -480,12 +1265,23 @@ void Session::rpc_peer_to_local(dht::Peer* rpc_peer, Peer* peer_buffer) {
 void Session::update_peer(Key& peer_key, std::string endpoint) {
   
   // attempt to insert peer and evict lru peer if stale
+  // (newly inserted peers are handed the local chunks whose replica sets they joined)
   Peer* lru_peer;
   while(true) {
     this->router_lock.lock();
+    bool known = this->router->get_peer(peer_key) != NULL;
     bool inserted = this->router->attempt_insert_peer(peer_key, endpoint, &lru_peer);
     this->router_lock.unlock();
     if (inserted) {
+      if (!known && peer_key != this->self_key()) {
+        std::lock_guard<std::mutex> guard(this->repair_lock);
+        if (this->handoff_peers.empty() && this->maintenance_queue != NULL) {
+          executor()->schedule(this->maintenance_queue, std::chrono::milliseconds(HANDOFF_COALESCE_MS), [this]() {
+            this->handoff_new_peers();
+          });
+        }
+        this->handoff_peers[peer_key] = Peer(peer_key, endpoint);
+      }
       return;
     }
     Peer other_peer;
@@ -493,14 +1289,160 @@ void Session::update_peer(Key& peer_key, std::string endpoint) {
     if (lru_ping && lru_peer->key == other_peer.key) {
       return;
     } else {
-      this->router_lock.lock();
-      this->router->evict_peer(lru_peer->key);
-      this->router_lock.unlock();
+      // (a failed ping already evicted the peer)
+      this->evict_dead_peer(lru_peer->key);
+    }
+  }
+}
+
+// evict a peer that failed to answer (or was replaced at its endpoint) and schedule the repair of the chunks
+// that it may have held a replica of
+void Session::evict_dead_peer(Key peer_key) {
+  this->router_lock.lock();
+  bool evicted = this->router->evict_peer(peer_key);
+  this->router_lock.unlock();
+  this->repair_lock.lock();
+  this->recently_dead_peers[peer_key] = std::chrono::steady_clock::now();
+  this->repair_lock.unlock();
+  if (!evicted) {
+    return;
+  }
+
+  // record eviction of peer for system info
+  static Counter* dead_peers = metrics()->counter("distft_dead_peers_total", "", "Peers evicted after failing to answer an RPC");
+  dead_peers->add(1);
+  this->meta->meta_lock.lock();
+  this->meta->dead_peers++;
+  this->meta->meta_lock.unlock();
+
+  std::lock_guard<std::mutex> guard(this->repair_lock);
+  if (this->repair_dead_peers.empty() && this->maintenance_queue != NULL) {
+    executor()->schedule(this->maintenance_queue, std::chrono::milliseconds(REPAIR_COALESCE_MS), [this]() {
+      this->repair_evicted_peers();
+    });
+  }
+  this->repair_dead_peers.insert(peer_key);
+}
+
+// return true if the peer was evicted in the last DEAD_PEER_TTL seconds
+bool Session::recently_dead(Key& peer_key) {
+  std::lock_guard<std::mutex> guard(this->repair_lock);
+  auto it = this->recently_dead_peers.find(peer_key);
+  if (it == this->recently_dead_peers.end()) {
+    return false;
+  }
+  if (std::chrono::steady_clock::now() - it->second >= std::chrono::seconds(DEAD_PEER_TTL)) {
+    this->recently_dead_peers.erase(it);
+    return false;
+  }
+  return true;
+}
 
-      // record eviction of peer for system info
-      this->meta->meta_lock.lock();
-      this->meta->dead_peers++;
-      this->meta->meta_lock.unlock();
+// set peers_buffer to the other members of the key's replica set (its replicas closest known peers, including self)
+// and return true if self is a member (the router lock must be held)
+bool Session::replica_set(Key& key, unsigned int replicas, std::deque<Peer*>& peers_buffer) {
+  this->router->closest_peers(key, replicas, peers_buffer);
+  if (peers_buffer.size() < replicas) {
+    return true;
+  }
+  if (!peers_buffer.empty() && Dist(key, this->self_key()) < Dist(key, peers_buffer.back()->key)) {
+    peers_buffer.pop_back();
+    return true;
+  }
+  return false;
+}
+
+// group the keys of the local chunks whose replica sets include self by the other members of the sets
+void Session::shared_keys(std::unordered_map<Key, std::pair<Peer, std::vector<Key>>>& shared_buffer) {
+  this->chunks_lock.lock();
+  this->router_lock.lock();
+  for (auto& pair : this->chunks) {
+    Key chunk_key = pair.first;
+    std::deque<Peer*> replica_peers;
+    if (!this->replica_set(chunk_key, pair.second->replicas, replica_peers)) {
+      continue;
+    }
+    for (Peer* peer : replica_peers) {
+      auto& shared = shared_buffer[peer->key];
+      shared.first = *peer;
+      shared.second.push_back(chunk_key);
+    }
+  }
+  this->router_lock.unlock();
+  this->chunks_lock.unlock();
+}
+
+// the keys of the local chunks whose replica sets include both self and the peer
+void Session::shared_keys(Key& peer_key, std::vector<Key>& keys_buffer) {
+  this->chunks_lock.lock();
+  this->router_lock.lock();
+  for (auto& pair : this->chunks) {
+    Key chunk_key = pair.first;
+    std::deque<Peer*> replica_peers;
+    if (!this->replica_set(chunk_key, pair.second->replicas, replica_peers)) {
+      continue;
+    }
+    for (Peer* peer : replica_peers) {
+      if (peer->key == peer_key) {
+        keys_buffer.push_back(chunk_key);
+        break;
+      }
     }
   }
+  this->router_lock.unlock();
+  this->chunks_lock.unlock();
+}
+
+// store the chunk of a store request locally
+// fails (and stores nothing) with DATA_LOSS if the data is truncated or a content-addressed chunk does not match its key,
+// and with ABORTED if a newer version of a versioned chunk is held
+grpc::Status Session::store_local(const dht::StoreRequest* request, Key& sender_key) {
+  Key key = Key(request->chunk_key());
+  size_t size = request->size();
+  std::chrono::system_clock::time_point original_publish = 
+    std::chrono::time_point<std::chrono::system_clock>(std::chrono::seconds(request->original_publish()));
+  unsigned int replicas = request->replicas() > 0 ? std::min(request->replicas(), KBUCKET_MAX) : KBUCKET_MAX;
+  if (request->data().size() != size 
+      || (request->content_addressed() && key_from_data(request->data().data(), size) != key)) {
+    LOG_ERROR("{} REJECTED CORRUPTED STORE: SENDER={} CHUNK_KEY={}", this->self_hex, 
+                  key_hex(sender_key), key_hex(key));
+    return grpc::Status(grpc::StatusCode::DATA_LOSS, "chunk data does not match its key");
+  }
+  std::vector<char>* data = new std::vector<char>(request->data().data(), request->data().data() + size);
+  Chunk* chunk = new Chunk(key, data, false, original_publish, replicas);
+  chunk->content_addressed = request->content_addressed();
+  chunk->version = request->version();
+  this->chunks_lock.lock();
+  if (this->chunks.count(key) > 0) {
+    Chunk* held = this->chunks[key];
+    if (chunk->version > 0 && (held->version > chunk->version || (held->version == chunk->version && *held->data != *data))) {
+      // (the sender lost a race with a newer version and has to merge it, while copies of the held version are
+      // accepted, e.g., when it is republished or handed off)
+      this->chunks_lock.unlock();
+      LOG_DEBUG("{} REJECTED OUTDATED STORE: SENDER={} CHUNK_KEY={} VERSION={}", this->self_hex,
+                    key_hex(sender_key), key_hex(key), chunk->version);
+      delete data;
+      delete chunk;
+      return grpc::Status(grpc::StatusCode::ABORTED, "a newer version of the chunk is held");
+    }
+    delete this->chunks[key];
+  }
+  this->chunks[chunk->key] = chunk;
+  this->chunks_lock.unlock();
+  static Counter* stored_bytes = metrics()->counter("distft_chunk_store_bytes_total", "", "Chunk bytes stored by other peers on the process's sessions");
+  stored_bytes->add(size);
+  return grpc::Status::OK;
+}
+
+// fill in the chunk's key, data, and metadata of a store request
+void Session::chunk_to_rpc(Chunk* chunk, dht::StoreRequest* request_buffer) {
+  request_buffer->set_chunk_key(chunk->key.to_string());
+  request_buffer->mutable_data()->assign(chunk->data->data(), chunk->data->size());
+  request_buffer->set_size(chunk->data->size());
+  request_buffer->set_original_publish(
+    std::chrono::time_point_cast<std::chrono::seconds>(chunk->original_publish).time_since_epoch().count()
+  );
+  request_buffer->set_replicas(chunk->replicas);
+  request_buffer->set_content_addressed(chunk->content_addressed);
+  request_buffer->set_version(chunk->version);
 }
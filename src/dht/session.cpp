@@ -1,6 +1,8 @@
 #include "session.h"
 
 #include <regex>
+#include <limits>
+#include <condition_variable>
 
 //
 // SESSION API
@@ -14,72 +16,87 @@ std::string Session::self_endpoint() {
   return this->router->get_self_peer()->endpoint;
 }
 
-void Session::startup(session_metadata* parent_metadata, std::string self_endpoint, std::string init_endpoint) {
+bool Session::startup(session_metadata* parent_metadata, std::string self_endpoint, startup_options options) {
   this->dying = false;
   this->meta = parent_metadata;
+  this->cache = NULL;
+  Key self_key = options.self_key;
+  this->self_hex = key_hex(self_key);
+
+  // sessions whose peers' keys are all known up front seed the router without any pings or lookups
+  // (peers that do not fit into their full kbuckets are skipped)
+  if (!options.seed_peers.empty()) {
+    LOG_DEBUG("{} CREATING SEEDED SESSION: SEEDS={}", this->self_hex, options.seed_peers.size());
+    this->router_lock.lock();
+    this->router = new Router(self_key, self_endpoint, self_key, self_endpoint);
+    for (Peer& seed_peer : options.seed_peers) {
+      Peer* lru_peer;
+      this->router->attempt_insert_peer(seed_peer.key, seed_peer.endpoint, &lru_peer);
+    }
+    this->router_lock.unlock();
+    this->start_serving(self_endpoint);
+    return true;
+  }
 
-  // generate self's key and get the initial peer's key (temporarily create router)
-  Key self_key = random_key();
-  spdlog::debug("{} CREATING SESSION", hex_string(self_key));
-  Key temp_key = random_key();
-  Peer other_peer = {temp_key, init_endpoint};
+  // the router starts out empty
+  LOG_DEBUG("{} CREATING SESSION: SEEDS={}", this->self_hex, options.seed_endpoints.size());
   this->router_lock.lock();
-  this->router = new Router(self_key, self_endpoint, other_peer.key, other_peer.endpoint);
+  this->router = new Router(self_key, self_endpoint, self_key, self_endpoint);
   this->router_lock.unlock();
 
-  // start server RPC threads running in background
-  std::regex pattern(R"((.*):(\d+))");
-  std::smatch match;
-  std::regex_match(self_endpoint, match, pattern);
-  std::string port = match[2];
-  this->init_server(self_endpoint, port);
-  this->init_rpc_threads();
+  // start serving RPCs and running maintenance tasks in background
+  this->start_serving(self_endpoint);
 
-  // ping peer for correct key (and remove dummy peer from router)
-  while (!this->ping(&other_peer, &other_peer));
+  // ping the seeds for the key of the first one that answers
+  Peer seed_peer;
+  if (!this->ping_seeds(options.seed_endpoints, seed_peer)) {
+    LOG_ERROR("{} NO SEED ANSWERED: SEEDS={} TIMEOUT={}", this->self_hex, options.seed_endpoints.size(), JOIN_TIMEOUT);
+    return false;
+  }
   this->router_lock.lock();
-  Peer* dummy_peer;
-  this->router->attempt_insert_peer(other_peer.key, other_peer.endpoint, &dummy_peer);
-  this->router->evict_peer(temp_key);
+  Peer* lru_peer;
+  this->router->attempt_insert_peer(seed_peer.key, seed_peer.endpoint, &lru_peer);
   this->router_lock.unlock();
 
   // perform a node lookup on self
   this->self_lookup(self_key);
+  return true;
 }
 
-void Session::teardown(bool republish) {
+// start the RPC server and schedule the maintenance tasks
+void Session::start_serving(std::string self_endpoint) {
+  std::regex pattern(R"((.*):(\d+))");
+  std::smatch match;
+  std::regex_match(self_endpoint, match, pattern);
+  std::string port = match[2];
+  this->maintenance_queue = executor()->create_queue(1);
+  this->init_server(self_endpoint, port);
+  this->init_maintenance();
+  metrics()->add_collector(this, [this](std::vector<metric_sample>& samples_buffer) {
+    this->collect_metrics(samples_buffer);
+  });
+}
+
+void Session::teardown(bool republish, std::chrono::milliseconds deadline) {
   // set dying to true to invalidate all peer/chunk data for RPCs
   this->dying = true;
 
-  // stop all RPC threads
+  // stop serving RPCs and running maintenance tasks
+  metrics()->remove_collector(this);
   this->shutdown_server();
-  this->shutdown_rpc_threads();
+  this->shutdown_maintenance();
 
-  spdlog::debug("{} DELETING SESSION", hex_string(this->self_key()));
+  LOG_DEBUG("{} DELETING SESSION", this->self_hex);
 
-  // re-assign all chunks to other peers by republishing
-  this->chunks_lock.lock();
+  // re-assign all chunks to other peers by handing them off to the rest of their replica sets
   if (republish) {
-    for (auto& pair : this->chunks) {
-      Key chunk_key = pair.first;
-      Chunk* chunk = pair.second;
-      std::deque<Peer*> closest_peers;
-      this->router_lock.lock();
-      this->router->closest_peers(chunk_key, PEER_LOOKUP_ALPHA, closest_peers);
-      this->router_lock.unlock();
-      bool stored = false;
-      for (Peer* other_peer : closest_peers) {
-        stored = stored || this->store(other_peer, chunk, false);
-      }
-      if (!stored) {
-        spdlog::error("{} DROPPED CHUNK (NOT ENOUGH PEERS): CHUNK={}", hex_string(this->self_key()), hex_string(chunk_key));
-      }
-    }
+    this->teardown_handoff(deadline);
   } else {
-    spdlog::error("{} DROPPING ALL CHUNKS", hex_string(this->self_key()));
+    LOG_ERROR("{} DROPPING ALL CHUNKS", this->self_hex);
   }
 
   // memory cleanup: destroy all chunks and router
+  this->chunks_lock.lock();
   for (auto& pair : this->chunks) {
     Key key = pair.first;
     Chunk* chunk = pair.second;
@@ -90,57 +107,552 @@ void Session::teardown(bool republish) {
   delete this->router;
 }
 
+// hand the local chunks off to the other members of their replica sets before leaving
+// the chunks are grouped by destination peer, at most TEARDOWN_HANDOFF_WORKERS peers are served at once (peers with
+// the most chunks first), and a chunk is handed off once any of the peers holds it
+void Session::teardown_handoff(std::chrono::milliseconds deadline) {
+  static Counter* handed_off = metrics()->counter("distft_teardown_handoff_chunks_total", "", "Chunks handed off by sessions leaving the DHT");
+  static Counter* dropped_chunks = metrics()->counter("distft_teardown_dropped_chunks_total", "", "Chunks dropped by sessions leaving the DHT");
+  auto start = std::chrono::steady_clock::now();
+  auto deadline_at = start + deadline;
+
+  // (i) group the keys of the local chunks by the other members of their replica sets
+  std::unordered_map<Key, std::pair<Peer, std::vector<Key>>> peer_keys;
+  std::unordered_set<Key> pending;
+  this->chunks_lock.lock();
+  this->router_lock.lock();
+  for (auto& pair : this->chunks) {
+    Key chunk_key = pair.first;
+    std::deque<Peer*> replica_peers;
+    this->router->closest_peers(chunk_key, pair.second->replicas, replica_peers);
+    for (Peer* peer : replica_peers) {
+      auto& keys = peer_keys[peer->key];
+      keys.first = *peer;
+      keys.second.push_back(chunk_key);
+    }
+    pending.insert(chunk_key);
+  }
+  this->router_lock.unlock();
+  this->chunks_lock.unlock();
+  size_t num_chunks = pending.size();
+  if (num_chunks == 0) {
+    return;
+  }
+  std::vector<std::pair<Peer, std::vector<Key>>*> peers;
+  for (auto& pair : peer_keys) {
+    peers.push_back(&pair.second);
+  }
+  std::sort(peers.begin(), peers.end(), [](std::pair<Peer, std::vector<Key>>* p1, std::pair<Peer, std::vector<Key>>* p2) {
+    return p1->second.size() > p2->second.size();
+  });
+  LOG_INFO("{} TEARDOWN HANDOFF: CHUNKS={} PEERS={}", this->self_hex, num_chunks, peers.size());
+
+  // (ii) send the chunks every peer lacks with bounded parallelism (progress is reported by the tasks, since this
+  // thread runs the tasks no worker got to)
+  std::atomic<uint64_t> stored_chunks(0);
+  std::atomic<uint64_t> stored_bytes(0);
+  std::mutex pending_lock;
+  auto last_report = start;
+  TaskGroup handoffs(TEARDOWN_HANDOFF_WORKERS);
+  for (std::pair<Peer, std::vector<Key>>* peer_pair : peers) {
+    handoffs.run([&, peer_pair]() {
+      if (std::chrono::steady_clock::now() >= deadline_at) {
+        return;
+      }
+      Peer& peer = peer_pair->first;
+      std::vector<Key>& keys = peer_pair->second;
+      std::vector<char> held;
+      this->push_chunks(peer, keys, deadline_at, [&](size_t chunks, uint64_t bytes) {
+        stored_chunks += chunks;
+        stored_bytes += bytes;
+      }, held);
+      std::lock_guard<std::mutex> guard(pending_lock);
+      for (size_t k = 0; k < keys.size(); k++) {
+        if (held[k]) {
+          pending.erase(keys[k]);
+        }
+      }
+      auto now = std::chrono::steady_clock::now();
+      if (now - last_report >= std::chrono::milliseconds(TEARDOWN_PROGRESS_INTERVAL_MS)) {
+        last_report = now;
+        LOG_INFO("{} TEARDOWN HANDOFF PROGRESS: CHUNKS={}/{} STORED_CHUNKS={} STORED_BYTES={}", this->self_hex,
+                     num_chunks - pending.size(), num_chunks, stored_chunks.load(), stored_bytes.load());
+      }
+    });
+  }
+  handoffs.wait();
+
+  // (iii) drop the chunks that no peer holds
+  handed_off->add(num_chunks - pending.size());
+  dropped_chunks->add(pending.size());
+  for (const Key& chunk_key : pending) {
+    LOG_DEBUG("{} DROPPED CHUNK: CHUNK={}", this->self_hex, key_hex(chunk_key));
+  }
+  if (!pending.empty()) {
+    LOG_ERROR("{} DROPPED CHUNKS (NOT ENOUGH PEERS OR DEADLINE PASSED): CHUNKS={}", this->self_hex, pending.size());
+  }
+  LOG_INFO("{} TEARDOWN HANDOFF DONE: CHUNKS={}/{} STORED_CHUNKS={} STORED_BYTES={} MS={}", this->self_hex,
+               num_chunks - pending.size(), num_chunks, stored_chunks.load(), stored_bytes.load(),
+               std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
 // publish a new chunk of data to the DHT
-// force is set to force other peers to overwrite local copies of the key
-void Session::set(Key key, std::vector<char>* data, bool force) {
-  Chunk* chunk = new Chunk(key, data, true, std::chrono::system_clock::now());
-  this->publish(chunk, force);
+// (forced sets make other peers overwrite their local copies of the key)
+bool Session::set(Key key, std::vector<char>* data, set_options options) {
+  if (this->cache != NULL) {
+    this->cache->put(key, data);
+  }
+  Chunk* chunk = new Chunk(key, data, true, std::chrono::system_clock::now(), std::min(options.replicas, static_cast<unsigned int>(KBUCKET_MAX)));
+  chunk->content_addressed = key_from_data(data->data(), data->size()) == key;
+  return this->publish(chunk, options.force);
+}
+
+// publish a new version of a (mutable) chunk, as a compare-and-set on the version held by each replica
+// the replicas (including self if it is among the closest peers) are written closest first and the set stops at
+// the first replica that rejects it, so concurrent writers are ordered by the closest replica and the ones that
+// lose do not overwrite the replicas after it
+bool Session::set_versioned(Key key, std::vector<char>* data, uint64_t version, std::vector<std::vector<char>*>& newer_buffer) {
+  Chunk* chunk = new Chunk(key, data, true, std::chrono::system_clock::now(), KBUCKET_MAX);
+  chunk->version = version;
+  LOG_DEBUG("{} SET VERSIONED: CHUNK_KEY={} VERSION={}", this->self_hex, key_hex(key), version);
+  std::deque<Peer> buffer;
+  this->node_lookup(key, buffer);
+
+  Key self_key = this->self_key();
+  std::vector<Peer> replicas(buffer.begin(), buffer.begin() + std::min(buffer.size(), static_cast<size_t>(chunk->replicas)));
+  Dist max_dist;
+  max_dist.value.reset();
+  for (Peer& peer : replicas) {
+    max_dist = std::max(max_dist, Dist(key, peer.key));
+  }
+  if (buffer.size() <= chunk->replicas || max_dist >= Dist(key, self_key)) {
+    replicas.push_back(Peer(self_key, this->self_endpoint()));
+  }
+  std::sort(replicas.begin(), replicas.end(), StaticDistComparator(key));
+
+  bool stored = true;
+  for (Peer& peer : replicas) {
+    if (peer.key == self_key) {
+      // (the local replica gets its own copy, since other writers may replace it while this one is still sending)
+      std::lock_guard<std::mutex> guard(this->chunks_lock);
+      auto it = this->chunks.find(key);
+      if (it != this->chunks.end() && (it->second->version > version || (it->second->version == version && *it->second->data != *data))) {
+        newer_buffer.push_back(new std::vector<char>(*it->second->data));
+        stored = false;
+        break;
+      }
+      if (it != this->chunks.end()) {
+        delete it->second;
+      }
+      Chunk* local_chunk = new Chunk(key, new std::vector<char>(*data), true, chunk->original_publish, chunk->replicas);
+      local_chunk->version = version;
+      this->chunks[key] = local_chunk;
+      continue;
+    }
+    if (this->store(&peer, chunk, true)) {
+      continue;
+    }
+
+    // ask the replica for the value it holds instead
+    stored = false;
+    grpc::ClientContext context;
+    std::vector<char>* held;
+    if (this->fetch_value(&peer, key, &context, &held)) {
+      newer_buffer.push_back(held);
+    }
+    break;
+  }
+  delete chunk->data;
+  delete chunk;
+  return stored;
 }
 
 // publish a (new or old) chunk to the DHT
 // the chunk (and its data) may be deleted if it does not
 // need to be stored locally
-void Session::publish(Chunk* chunk, bool force) {
+// returns false if neither a peer nor self stored the chunk
+bool Session::publish(Chunk* chunk, bool force) {
   Key chunk_key = chunk->key;
-  spdlog::debug("{} PUBLISH: CHUNK_KEY={}", hex_string(this->self_key()), 
-                hex_string(chunk_key));
+  LOG_DEBUG("{} PUBLISH: CHUNK_KEY={}", this->self_hex, 
+                key_hex(chunk_key));
   std::deque<Peer> buffer;
   this->node_lookup(chunk_key, buffer);
 
-  // select the ALPHA closest keys to store the chunk
+  // select the (replica count) closest keys to store the chunk
   Dist max_dist;
   max_dist.value.reset();
-  for (int i = 0; i < KBUCKET_MAX && i < buffer.size(); i++) {
+  bool stored = false;
+  for (int i = 0; i < chunk->replicas && i < buffer.size(); i++) {
     Peer other_peer = buffer.at(i);
-    this->store(&other_peer, chunk, force);
+    stored = this->store(&other_peer, chunk, force) || stored;
     max_dist = std::max(max_dist, Dist(chunk->key, other_peer.key));
   }
 
   // figure out whether key should also be set locally
-  if (buffer.size() <= KBUCKET_MAX || max_dist >= Dist(chunk->key, this->self_key())) {
+  if (buffer.size() <= chunk->replicas || max_dist >= Dist(chunk->key, this->self_key())) {
     this->chunks_lock.lock();
+    auto it = this->chunks.find(chunk->key);
+    if (it != this->chunks.end() && it->second != chunk) {
+      delete it->second;
+    }
     this->chunks[chunk->key] = chunk;
     this->chunks_lock.unlock();
-  } else {
-    delete chunk;
+    return true;
   }
+  delete chunk;
+  return stored;
 }
 
 bool Session::get(Key search_key, std::vector<char>** data_buffer) {
   // check if the key is cached locally
   this->chunks_lock.lock();
   if (this->chunks.count(search_key) > 0) {
-    spdlog::debug("{} GET (LOCAL): CHUNK_KEY={}", hex_string(this->self_key()), 
-                hex_string(search_key));
+    LOG_DEBUG("{} GET (LOCAL): CHUNK_KEY={}", this->self_hex, 
+                key_hex(search_key));
     Chunk* found_chunk = this->chunks[search_key];
     *data_buffer = new std::vector<char>(found_chunk->data->begin(), found_chunk->data->end());
     this->chunks_lock.unlock();
     return true;
   }
   this->chunks_lock.unlock();
+
+  // (single keys are the mutable ones, e.g., manifest roots and index pages, so the chunk cache is not consulted)
   std::deque<Peer> buffer;
   return this->value_lookup(search_key, buffer, data_buffer);
-  
+}
+
+bool Session::get(std::vector<Key>& keys, std::vector<std::vector<char>*>& data_buffer, get_stats* stats_buffer) {
+  data_buffer.assign(keys.size(), NULL);
+
+  // serve what is possible from local chunks and the chunk cache
+  std::vector<Key> remote_keys;
+  std::vector<size_t> remote_indices;
+  unsigned long cache_hits = 0;
+  unsigned long cache_misses = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    this->chunks_lock.lock();
+    if (this->chunks.count(keys[i]) > 0) {
+      Chunk* found_chunk = this->chunks[keys[i]];
+      data_buffer[i] = new std::vector<char>(found_chunk->data->begin(), found_chunk->data->end());
+    }
+    this->chunks_lock.unlock();
+    if (data_buffer[i] != NULL && key_from_data(data_buffer[i]->data(), data_buffer[i]->size()) != keys[i]) {
+      LOG_ERROR("{} CORRUPTED LOCAL CHUNK: CHUNK={}", this->self_hex, key_hex(keys[i]));
+      delete data_buffer[i];
+      data_buffer[i] = NULL;
+    }
+    std::vector<char>* cached;
+    if (data_buffer[i] == NULL && this->cache != NULL) {
+      if (this->cache->get(keys[i], &cached)) {
+        data_buffer[i] = cached;
+        cache_hits++;
+      } else {
+        cache_misses++;
+      }
+    }
+    if (data_buffer[i] == NULL) {
+      remote_keys.push_back(keys[i]);
+      remote_indices.push_back(i);
+    }
+  }
+
+  // find which of the closest known peers hold each remaining chunk
+  std::vector<std::vector<Peer>> holders;
+  std::vector<unsigned int> candidates;
+  this->locate_replicas(remote_keys, KBUCKET_MAX, holders, candidates);
+
+  // give every chunk a preferred holder so that the expected finish times of the holders are balanced
+  std::unordered_map<Key, Peer> peers;
+  std::unordered_map<Key, std::vector<size_t>> peer_indices;
+  std::unordered_map<Key, double> throughputs;
+  std::unordered_map<Key, unsigned int> planned;
+  std::vector<Key> preferred(remote_keys.size());
+  for (size_t i = 0; i < remote_keys.size(); i++) {
+    double best_finish = std::numeric_limits<double>::max();
+    for (Peer& peer : holders[i]) {
+      if (peers.count(peer.key) == 0) {
+        peers[peer.key] = peer;
+        throughputs[peer.key] = this->estimated_throughput(peer.key);
+      }
+      peer_indices[peer.key].push_back(i);
+      double finish = (planned[peer.key] + 1) / throughputs[peer.key];
+      if (finish < best_finish) {
+        best_finish = finish;
+        preferred[i] = peer.key;
+      }
+    }
+    if (holders[i].size() > 0) {
+      planned[preferred[i]]++;
+    }
+  }
+
+  // every holder pulls its preferred chunks, then unclaimed chunks of other holders, and once idle
+  // duplicates fetches that take much longer than usual (the first copy to arrive wins, the other is cancelled)
+  struct fetch_state {
+    bool done;
+    std::unordered_set<Key> tried;
+    std::vector<grpc::ClientContext*> in_flight;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::duration<double> winner_elapsed;
+  };
+  std::vector<fetch_state> states(remote_keys.size(), fetch_state{false});
+  std::mutex fetch_lock;
+  std::condition_variable fetch_cv;
+  std::chrono::duration<double> total_elapsed(0);
+  unsigned int num_fetched = 0;
+  unsigned long retries = 0;
+  auto worker_fn = [&](Peer peer) {
+    std::vector<size_t>& indices = peer_indices.at(peer.key);
+    std::unique_lock<std::mutex> uq_fetch_lock(fetch_lock);
+    while (true) {
+      bool claimed = false;
+      size_t index = 0;
+      for (int pass = 0; pass < 2 && !claimed; pass++) {
+        for (size_t i : indices) {
+          fetch_state& state = states[i];
+          if (!state.done && state.tried.count(peer.key) == 0 && state.in_flight.empty()
+              && (pass == 1 || preferred[i] == peer.key)) {
+            claimed = true;
+            index = i;
+            break;
+          }
+        }
+      }
+
+      // nothing left to claim: duplicate a slow fetch (or wait until one becomes slow)
+      bool waiting = false;
+      auto now = std::chrono::steady_clock::now();
+      auto next_hedge = std::chrono::steady_clock::time_point::max();
+      for (size_t i : indices) {
+        fetch_state& state = states[i];
+        if (claimed || state.done || state.tried.count(peer.key) > 0 || state.in_flight.size() != 1) {
+          continue;
+        }
+        waiting = true;
+        if (num_fetched == 0) {
+          continue;
+        }
+        auto hedge_time = state.started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            STRIPED_GET_HEDGE_FACTOR * total_elapsed / num_fetched);
+        if (hedge_time <= now) {
+          claimed = true;
+          index = i;
+          break;
+        }
+        next_hedge = std::min(next_hedge, hedge_time);
+      }
+      if (!claimed) {
+        if (!waiting) {
+          return;
+        }
+        if (next_hedge == std::chrono::steady_clock::time_point::max()) {
+          fetch_cv.wait(uq_fetch_lock);
+        } else {
+          fetch_cv.wait_until(uq_fetch_lock, next_hedge);
+        }
+        continue;
+      }
+
+      // fetch the claimed chunk from this holder
+      grpc::ClientContext context;
+      if (states[index].in_flight.empty()) {
+        states[index].started = now;
+      }
+      if (!states[index].tried.empty()) {
+        retries++;
+      }
+      states[index].tried.insert(peer.key);
+      states[index].in_flight.push_back(&context);
+      uq_fetch_lock.unlock();
+      std::vector<char>* data = NULL;
+      auto start = std::chrono::steady_clock::now();
+      bool fetched = this->fetch_value(&peer, remote_keys[index], &context, &data);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+      // verify outside of the lock (a corrupted replica is treated like a failed one, so another holder is tried)
+      bool corrupted = false;
+      if (fetched && key_from_data(data->data(), data->size()) != remote_keys[index]) {
+        this->record_bad_replica(peer.key, remote_keys[index]);
+        delete data;
+        data = NULL;
+        fetched = false;
+        corrupted = true;
+      }
+      uq_fetch_lock.lock();
+
+      fetch_state& state = states[index];
+      state.in_flight.erase(std::find(state.in_flight.begin(), state.in_flight.end(), &context));
+      if (fetched && !state.done) {
+        state.done = true;
+        data_buffer[remote_indices[index]] = data;
+        total_elapsed += elapsed;
+        num_fetched++;
+        state.winner_elapsed = elapsed;
+        this->record_throughput(peer.key, data->size(), elapsed);
+        for (grpc::ClientContext* other_context : state.in_flight) {
+          other_context->TryCancel();
+        }
+      } else if (state.done) {
+        // lost the race against another holder (so it is at most as fast as the winner, even if it was the later
+        // duplicate and was cancelled sooner after it started)
+        delete data;
+        this->record_throughput(peer.key, data_buffer[remote_indices[index]]->size(), std::max(elapsed, state.winner_elapsed));
+      } else if (!corrupted) {
+        this->record_failed_fetch(peer.key);
+      }
+      fetch_cv.notify_all();
+    }
+  };
+  // (the workers run on the executor, and this thread runs the ones no worker got to)
+  TaskGroup workers(peers.size() * STRIPED_GET_WORKERS_PER_PEER);
+  for (auto& pair : peers) {
+    for (int i = 0; i < STRIPED_GET_WORKERS_PER_PEER; i++) {
+      Peer peer = pair.second;
+      workers.run([&worker_fn, peer]() { worker_fn(peer); });
+    }
+  }
+  workers.wait();
+
+  // fall back to regular lookups for chunks without (responsive) known holders
+  std::vector<size_t> missing;
+  for (size_t i = 0; i < remote_keys.size(); i++) {
+    if (states[i].done) {
+      continue;
+    }
+    if (!states[i].tried.empty()) {
+      retries++;
+    }
+    missing.push_back(i);
+  }
+  TaskGroup lookups(missing.size());
+  for (size_t i : missing) {
+    Key key = remote_keys[i];
+    std::vector<char>** data = &data_buffer[remote_indices[i]];
+    lookups.run([this, key, data]() {
+      std::deque<Peer> buffer;
+      if (!this->value_lookup(key, buffer, data)) {
+        *data = NULL;
+      } else if (key_from_data((*data)->data(), (*data)->size()) != key) {
+        LOG_ERROR("{} CORRUPTED LOOKUP VALUE: CHUNK={}", this->self_hex, key_hex(key));
+        delete *data;
+        *data = NULL;
+      }
+    });
+  }
+  lookups.wait();
+
+  static Counter* retried = metrics()->counter("distft_chunk_fetch_retries_total", "", "Chunk fetches that were duplicated, failed over, or looked up again");
+  retried->add(retries);
+  if (stats_buffer != NULL) {
+    stats_buffer->retries += retries;
+    stats_buffer->cache_hits += cache_hits;
+    stats_buffer->cache_misses += cache_misses;
+  }
+  bool found_all = true;
+  for (size_t i : remote_indices) {
+    if (data_buffer[i] == NULL) {
+      found_all = false;
+    } else if (this->cache != NULL) {
+      this->cache->put(keys[i], data_buffer[i]);
+    }
+  }
+  return found_all;
+}
+
+void Session::replicated(std::vector<Key>& keys, unsigned int replicas, std::vector<char>& replicated_buffer) {
+  std::vector<std::vector<Peer>> holders;
+  std::vector<unsigned int> candidates;
+  this->locate_replicas(keys, replicas, holders, candidates);
+  replicated_buffer.assign(keys.size(), false);
+  for (size_t i = 0; i < keys.size(); i++) {
+    replicated_buffer[i] = candidates[i] > 0 && holders[i].size() >= candidates[i];
+  }
+}
+
+void Session::set_cache(ChunkCache* cache) {
+  this->cache = cache;
+}
+
+void Session::peer_throughputs(std::unordered_map<Key, double>& throughputs_buffer) {
+  std::lock_guard<std::mutex> guard(this->peer_stats_lock);
+  throughputs_buffer = this->peer_throughput;
+}
+
+void Session::record_throughput(Key peer_key, size_t bytes, std::chrono::duration<double> elapsed) {
+  double sample = bytes / std::max(elapsed.count(), 1e-6);
+  std::lock_guard<std::mutex> guard(this->peer_stats_lock);
+  if (this->peer_throughput.count(peer_key) == 0) {
+    this->peer_throughput[peer_key] = sample;
+    return;
+  }
+  double& throughput = this->peer_throughput[peer_key];
+  throughput = PEER_THROUGHPUT_ALPHA * sample + (1 - PEER_THROUGHPUT_ALPHA) * throughput;
+}
+
+// corrupted values count against the peer and push its throughput estimate down
+void Session::record_bad_replica(Key peer_key, Key chunk_key) {
+  LOG_ERROR("{} CORRUPTED REPLICA: PEER={} CHUNK={}", this->self_hex, key_hex(peer_key), key_hex(chunk_key));
+  static Counter* corrupted = metrics()->counter("distft_corrupted_replicas_total", "", "Fetched chunks that did not match their key");
+  corrupted->add(1);
+  std::lock_guard<std::mutex> guard(this->peer_stats_lock);
+  this->peer_bad_replicas[peer_key]++;
+  if (this->peer_throughput.count(peer_key) > 0) {
+    this->peer_throughput[peer_key] *= 1 - PEER_THROUGHPUT_ALPHA;
+  }
+}
+
+// failed (or timed out) fetches push the peer's throughput estimate down as well, so a dead holder is not preferred
+// by the next batch
+void Session::record_failed_fetch(Key peer_key) {
+  std::lock_guard<std::mutex> guard(this->peer_stats_lock);
+  if (this->peer_throughput.count(peer_key) > 0) {
+    this->peer_throughput[peer_key] *= 1 - PEER_THROUGHPUT_ALPHA;
+  }
+}
+
+void Session::bad_replicas(std::unordered_map<Key, unsigned long>& bad_replicas_buffer) {
+  std::lock_guard<std::mutex> guard(this->peer_stats_lock);
+  bad_replicas_buffer = this->peer_bad_replicas;
+}
+
+// (called by the metrics registry while the metrics are read)
+void Session::collect_metrics(std::vector<metric_sample>& samples_buffer) {
+  std::string session = "session=\"" + hex_string(this->self_key()) + "\"";
+  uint64_t bytes = 0;
+  this->chunks_lock.lock();
+  size_t num_chunks = this->chunks.size();
+  for (auto& pair : this->chunks) {
+    bytes += pair.second->data->size();
+  }
+  this->chunks_lock.unlock();
+  samples_buffer.push_back({"distft_chunks", session, "Chunks stored by the session", static_cast<double>(num_chunks)});
+  samples_buffer.push_back({"distft_chunk_bytes", session, "Bytes of the chunks stored by the session", static_cast<double>(bytes)});
+
+  std::map<unsigned int, unsigned int> bucket_sizes;
+  this->router_lock.lock();
+  this->router->bucket_sizes(bucket_sizes);
+  this->router_lock.unlock();
+  for (auto& pair : bucket_sizes) {
+    samples_buffer.push_back({"distft_router_peers", session + ",bucket=\"" + std::to_string(pair.first) + "\"",
+                              "Peers in the session's kbuckets (by the length of the prefix they share with the session)",
+                              static_cast<double>(pair.second)});
+  }
+}
+
+// peers without measurements are assumed to be average (so that they are tried)
+double Session::estimated_throughput(Key peer_key) {
+  std::lock_guard<std::mutex> guard(this->peer_stats_lock);
+  if (this->peer_throughput.count(peer_key) > 0) {
+    return this->peer_throughput[peer_key];
+  }
+  if (this->peer_throughput.empty()) {
+    return 1;
+  }
+  double total = 0;
+  for (auto& pair : this->peer_throughput) {
+    total += pair.second;
+  }
+  return total / this->peer_throughput.size();
 }
 
 //
@@ -149,7 +661,7 @@ bool Session::get(Key search_key, std::vector<char>** data_buffer) {
 
 // lookup self (does not return a buffer; only populates the router)
 void Session::self_lookup(Key self_key) {
-  spdlog::debug("{} SELF LOOKUP", hex_string(self_key));
+  LOG_DEBUG("{} SELF LOOKUP", key_hex(self_key));
   std::deque<Peer> closest_peers;
   auto self_query_fn = [this, &self_key, &closest_peers]
                         (Peer& peer, std::mutex& ctr_lock, unsigned int& status_ctr) {
@@ -160,22 +672,35 @@ void Session::self_lookup(Key self_key) {
     }
     return false;
   };
-  this->lookup_helper(self_key, closest_peers, self_query_fn);
+  static Histogram* hops = metrics()->histogram("distft_lookup_hops", "lookup=\"self\"", "Iterations of the process's lookups");
+  LookupTrace* trace = tracer()->sample("self", self_key, self_key);
+  hops->record(this->lookup_helper(self_key, closest_peers, self_query_fn, trace));
+  if (trace != NULL) {
+    tracer()->record(trace);
+  }
 
-  // send refreshes to all peers
+  // send refreshes to all peers (one lookup per bucket, in parallel)
   std::deque<Peer*> peers;
+  std::vector<Key> refresh_keys;
   this->router_lock.lock();
   this->router->random_per_bucket_peers(peers, std::chrono::seconds(0));
-  this->router_lock.unlock();
   for (Peer* other_peer : peers) {
-    std::deque<Peer> dummy_buffer;
-    this->node_lookup(other_peer->key, dummy_buffer);
+    refresh_keys.push_back(other_peer->key);
+  }
+  this->router_lock.unlock();
+  TaskGroup refreshes(refresh_keys.size());
+  for (Key& refresh_key : refresh_keys) {
+    refreshes.run([this, refresh_key]() {
+      std::deque<Peer> dummy_buffer;
+      this->node_lookup(refresh_key, dummy_buffer);
+    });
   }
+  refreshes.wait();
 }
 
 // lookup a key in the DHT (populate buffer with K closest peers)
 void Session::node_lookup(Key node_key, std::deque<Peer>& buffer) {
-  spdlog::debug("{} NODE LOOKUP", hex_string(this->self_key()));
+  LOG_DEBUG("{} NODE LOOKUP", this->self_hex);
   std::deque<Peer> closest_peers;
   auto node_query_fn = [this, &node_key, &closest_peers]
                         (Peer& peer, std::mutex& ctr_lock, unsigned int& status_ctr) {
@@ -186,12 +711,19 @@ void Session::node_lookup(Key node_key, std::deque<Peer>& buffer) {
     }
     return false;
   };
-  this->lookup_helper(node_key, closest_peers, node_query_fn);
+  static Histogram* hops = metrics()->histogram("distft_lookup_hops", "lookup=\"node\"", "Iterations of the process's lookups");
+  LookupTrace* trace = tracer()->sample("node", this->self_key(), node_key);
+  hops->record(this->lookup_helper(node_key, closest_peers, node_query_fn, trace));
 
   // synchronously send final find node RPCs to the K closest nodes
   size_t lookup_count = closest_peers.size();
   for (int i = 0; i < lookup_count; i++) {
-    this->find_node(&closest_peers[i], node_key, closest_peers);
+    uint64_t rpc_start = trace != NULL ? LookupTrace::now() : 0;
+    size_t peers_before = closest_peers.size();
+    bool success = this->find_node(&closest_peers[i], node_key, closest_peers);
+    if (trace != NULL) {
+      trace->rpc(closest_peers[i], rpc_start, success, closest_peers.size() - peers_before, "final");
+    }
   }
 
   // sort and return the K closest (unique) peers
@@ -207,6 +739,10 @@ void Session::node_lookup(Key node_key, std::deque<Peer>& buffer) {
   if (buffer.size() > KBUCKET_MAX) {
     buffer.resize(KBUCKET_MAX);
   }
+  if (trace != NULL) {
+    trace->annotate("closest_peers", std::to_string(buffer.size()));
+    tracer()->record(trace);
+  }
 }
 
 
@@ -215,7 +751,7 @@ void Session::node_lookup(Key node_key, std::deque<Peer>& buffer) {
 // return true -> data_buffer is set as a pointer to the malloc'd value
 // return false -> peer buffer is populated with K closest peers
 bool Session::value_lookup(Key chunk_key, std::deque<Peer>& buffer, std::vector<char>** data_buffer) {
-  spdlog::debug("{} VALUE LOOKUP: CHUNK={}", hex_string(this->self_key()), hex_string(chunk_key));
+  LOG_DEBUG("{} VALUE LOOKUP: CHUNK={}", this->self_hex, key_hex(chunk_key));
   std::deque<Peer> closest_peers;
   bool found_value = false;
   auto value_query_fn = [this, &found_value, &chunk_key, &closest_peers, data_buffer]
@@ -227,17 +763,88 @@ bool Session::value_lookup(Key chunk_key, std::deque<Peer>& buffer, std::vector<
     }
     return found_value;
   };
-  this->lookup_helper(chunk_key, closest_peers, value_query_fn);
+  static Histogram* hops = metrics()->histogram("distft_lookup_hops", "lookup=\"value\"", "Iterations of the process's lookups");
+  static Counter* misses = metrics()->counter("distft_value_lookup_misses_total", "", "Value lookups that did not find the value");
+  LookupTrace* trace = tracer()->sample("value", this->self_key(), chunk_key);
+  hops->record(this->lookup_helper(chunk_key, closest_peers, value_query_fn, trace));
+  if (!found_value) {
+    misses->add(1);
+  }
+  if (trace != NULL) {
+    trace->annotate("found", found_value ? "true" : "false");
+    if (found_value) {
+      trace->annotate("value_bytes", std::to_string((*data_buffer)->size()));
+    }
+    tracer()->record(trace);
+  }
   return found_value;
 }
 
+// find which of the (at most replicas) closest known peers hold each key
+// sets holders_buffer[i] to the holders of keys[i] and candidates_buffer[i] to the number of peers asked
+void Session::locate_replicas(std::vector<Key>& keys, unsigned int replicas, std::vector<std::vector<Peer>>& holders_buffer, std::vector<unsigned int>& candidates_buffer) {
+  replicas = std::min(replicas, static_cast<unsigned int>(KBUCKET_MAX));
+  holders_buffer.assign(keys.size(), std::vector<Peer>());
+  candidates_buffer.assign(keys.size(), 0);
+
+  // group the keys by the (known) peers closest to them
+  std::unordered_map<Key, std::pair<Peer, std::vector<size_t>>> peer_keys;
+  this->router_lock.lock();
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::deque<Peer*> closest_peers;
+    this->router->closest_peers(keys[i], replicas, closest_peers);
+    for (Peer* peer : closest_peers) {
+      auto& pair = peer_keys[peer->key];
+      pair.first = *peer;
+      pair.second.push_back(i);
+    }
+    candidates_buffer[i] = closest_peers.size();
+  }
+  this->router_lock.unlock();
+
+  // (concurrently) ask each peer which of its keys it holds
+  std::mutex holders_lock;
+  TaskGroup probes(peer_keys.size());
+  for (auto& pair : peer_keys) {
+    Peer peer = pair.second.first;
+    std::vector<size_t>* indices = &pair.second.second;
+    probes.run([this, &keys, &holders_lock, &holders_buffer, peer, indices]() mutable {
+      for (size_t start = 0; start < indices->size(); start += HAS_CHUNKS_BATCH) {
+        size_t end = std::min(start + HAS_CHUNKS_BATCH, indices->size());
+        std::vector<Key> batch;
+        for (size_t j = start; j < end; j++) {
+          batch.push_back(keys[indices->at(j)]);
+        }
+        std::vector<char> has_chunk;
+        if (!this->has_chunks(&peer, batch, has_chunk)) {
+          return;
+        }
+        holders_lock.lock();
+        for (size_t j = start; j < end; j++) {
+          if (has_chunk[j - start]) {
+            holders_buffer[indices->at(j)].push_back(peer);
+          }
+        }
+        holders_lock.unlock();
+      }
+    });
+  }
+  probes.wait();
+}
+
 // perform a generic lookup on a search key
 // the query function is executed on each iteration of the lookup
 // and returns true if the lookup should halt
-void Session::lookup_helper(Key search_key, std::deque<Peer>& closest_peers, const std::function<bool(Peer&, std::mutex&, unsigned int&)>& query_fn) {
+// returns the number of iterations (hops) of the lookup
+// if the lookup is traced, its RPCs, router lock wait, iterations, and termination are added to the trace
+unsigned int Session::lookup_helper(Key search_key, std::deque<Peer>& closest_peers, const std::function<bool(Peer&, std::mutex&, unsigned int&)>& query_fn, LookupTrace* trace) {
   // get the current ALPHA closest keys in the router and record the min distance
   std::deque<Peer*> local_peers;
+  uint64_t lock_start = trace != NULL ? LookupTrace::now() : 0;
   this->router_lock.lock();
+  if (trace != NULL) {
+    trace->lock_wait(lock_start);
+  }
   this->router->closest_peers(search_key, KBUCKET_MAX, local_peers);
   this->router_lock.unlock();
 
@@ -252,10 +859,17 @@ void Session::lookup_helper(Key search_key, std::deque<Peer>& closest_peers, con
     closest_peers_min_dist = std::min(closest_peers_min_dist, curr_dist);
   }
   std::sort(closest_peers.begin(), closest_peers.end(), comparator);
+  if (closest_peers.empty()) {
+    if (trace != NULL) {
+      trace->terminate("no known peers");
+    }
+    return 0;
+  }
   for (int i = 0; i < MAX_LOOKUP_ITERS; i++) {
     // asynchronously send find node RPCs to the ALPHA closest nodes
     std::mutex ctr_lock;
     unsigned int lookup_ctr = 0;
+    unsigned int queried_ctr = 0;
     int lookup_count = std::min(PEER_LOOKUP_ALPHA, static_cast<int>(closest_peers.size()));
 
     for (int j = 0; j < closest_peers.size(); j++) {
@@ -271,9 +885,19 @@ void Session::lookup_helper(Key search_key, std::deque<Peer>& closest_peers, con
         continue;
       }
 
+      uint64_t rpc_start = trace != NULL ? LookupTrace::now() : 0;
+      size_t peers_before = closest_peers.size();
+      unsigned int responses_before = lookup_ctr;
       bool halt = query_fn(other_peer, ctr_lock, lookup_ctr);
+      queried_ctr++;
+      if (trace != NULL) {
+        trace->rpc(other_peer, rpc_start, lookup_ctr > responses_before, closest_peers.size() - peers_before, std::to_string(i));
+      }
       if (halt) {
-        return;
+        if (trace != NULL) {
+          trace->terminate("value found");
+        }
+        return i + 1;
       }
       queried.insert(other_peer.key);
     }
@@ -297,12 +921,23 @@ void Session::lookup_helper(Key search_key, std::deque<Peer>& closest_peers, con
     // halt once the distance has stopped improving and < kbucket peers were found
     size_t new_closest_peers_size = closest_peers.size();
     Dist new_closest_peers_min_dist = Dist(search_key, closest_peers.at(0).key);
-    if (new_closest_peers_size <= closest_peers_size && new_closest_peers_min_dist >= closest_peers_min_dist) {
-      spdlog::debug("{} TERMINATE LOOKUP (NO DIST IMPROVEMENT): SEARCH_KEY={}", 
-                      hex_string(this->self_key()), hex_string(search_key));
-      return;
+    bool improved = new_closest_peers_min_dist < closest_peers_min_dist;
+    if (trace != NULL) {
+      trace->iteration(i, queried_ctr, lookup_ctr, new_closest_peers_size, improved, closest_peers.at(0).key);
+    }
+    if (new_closest_peers_size <= closest_peers_size && !improved) {
+      LOG_DEBUG("{} TERMINATE LOOKUP (NO DIST IMPROVEMENT): SEARCH_KEY={}", 
+                      this->self_hex, key_hex(search_key));
+      if (trace != NULL) {
+        trace->terminate(queried_ctr == 0 ? "all peers queried" : "no distance improvement");
+      }
+      return i + 1;
     }
     closest_peers_size = new_closest_peers_size;
     closest_peers_min_dist = new_closest_peers_min_dist;
   }
+  if (trace != NULL) {
+    trace->terminate("max iterations");
+  }
+  return MAX_LOOKUP_ITERS;
 }
@@ -1,8 +1,13 @@
 #pragma once
 
 #include "router.h"
+#include "cache.h"
+#include "trace.h"
 
 #include "src/utils/utils.h"
+#include "src/utils/metrics.h"
+#include "src/utils/log.h"
+#include "src/utils/executor.h"
 
 #include "src/dht/dht.pb.h"
 #include "src/dht/dht.grpc.pb.h"
@@ -13,16 +18,106 @@
 #include <unordered_map>
 #include <string>
 #include <mutex>
+#include <condition_variable>
 #include <deque>
 #include <unordered_set>
 #include <thread>
 #include <iostream>
 #include <chrono>
+#include <functional>
+#include <memory>
 
 #define PEER_LOOKUP_ALPHA 3
 #define MAX_LOOKUP_ITERS KEYBITS
 #define CHUNK_EXPIRE_TIME 86400
 #define CHUNK_REPUBLISH_TIME 3600
+#define MAINTENANCE_INTERVAL 10
+#define HAS_CHUNKS_BATCH 4096
+#define STRIPED_GET_WORKERS_PER_PEER 2
+#define STRIPED_GET_HEDGE_FACTOR 2
+#define PEER_THROUGHPUT_ALPHA 0.3
+
+// repair of chunks that lost replicas on evicted peers: evictions are collected for REPAIR_COALESCE_MS before
+// the local chunks are scanned, and the repair stores are limited to REPAIR_BYTES_PER_SECOND
+// (without evictions, the closest peers are pinged every REPAIR_CHECK_INTERVAL seconds to find dead neighbors)
+#define REPAIR_COALESCE_MS 500
+#define REPAIR_CHECK_INTERVAL 10
+#define REPAIR_BYTES_PER_SECOND (16 << 20)
+
+// anti-entropy between neighbors that share replica sets: every ANTI_ENTROPY_INTERVAL seconds, the digests of the
+// keys both should hold are compared range by range (mismatched ranges are split by SYNC_RANGE_BITS more key bits
+// until both sides hold at most SYNC_LEAF_KEYS keys in them, at which point the keys are listed)
+// the receiver keeps the keys it shares with the sender for the later rounds of a reconciliation (for at most
+// SYNC_SESSION_TTL seconds)
+#define ANTI_ENTROPY_INTERVAL 60
+#define SYNC_RANGE_BITS 4
+#define SYNC_LEAF_KEYS 64
+#define SYNC_SESSION_TTL 60
+
+// joins ping all seed endpoints concurrently until the first one answers, each with exponential backoff (from
+// JOIN_BACKOFF_MIN_MS up to JOIN_BACKOFF_MAX_MS, with jitter) and a JOIN_PING_TIMEOUT_MS deadline per ping, and
+// give up after JOIN_TIMEOUT seconds
+#define JOIN_TIMEOUT 60
+#define JOIN_PING_TIMEOUT_MS 1000
+#define JOIN_BACKOFF_MIN_MS 50
+#define JOIN_BACKOFF_MAX_MS 5000
+
+// handoff of local chunks to newly inserted peers that joined their replica sets: arrivals are collected for
+// HANDOFF_COALESCE_MS, and the chunks are sent in store batches of at most HANDOFF_BATCH_BYTES
+#define HANDOFF_COALESCE_MS 500
+#define HANDOFF_BATCH_BYTES (2 << 20)
+
+// handoff of local chunks to the rest of their replica sets on teardown (with republishing): the chunks are sent
+// to at most TEARDOWN_HANDOFF_WORKERS destination peers at once, progress is logged at most every
+// TEARDOWN_PROGRESS_INTERVAL_MS, and the chunks not handed off within TEARDOWN_HANDOFF_DEADLINE seconds are dropped
+#define TEARDOWN_HANDOFF_WORKERS 8
+#define TEARDOWN_PROGRESS_INTERVAL_MS 1000
+#define TEARDOWN_HANDOFF_DEADLINE 60
+
+// deadlines of outgoing RPCs, so that peers that accept connections but never answer cannot hold the executor's
+// workers: RPC_TIMEOUT_MS, plus a millisecond per RPC_MIN_BYTES_PER_MS bytes of chunk data the RPC sends (or, for
+// RPCs answered with a chunk, at most RPC_MAX_DATA_BYTES)
+#define RPC_TIMEOUT_MS 5000
+#define RPC_MIN_BYTES_PER_MS 256
+#define RPC_MAX_DATA_BYTES (4 << 20)
+
+// seconds that evicted peers are not re-inserted from other peers' lookup responses (which may still list them)
+#define DEAD_PEER_TTL 60
+
+// options of session startups
+// seed_endpoints: join through the first of the endpoints that answers, followed by a self lookup
+// seed_peers: instead seed the router with the given peers, without any pings or lookups
+// (for sessions whose peers' keys are all known up front, e.g., the founder's)
+// self_key: key of the session (random by default)
+struct startup_options {
+  std::vector<std::string> seed_endpoints;
+  std::vector<Peer> seed_peers;
+  Key self_key = random_key();
+};
+
+// options of sets
+// force: overwrite other peers' copies of the key
+// replicas: store the chunk on (at most) this many closest peers
+struct set_options {
+  bool force = false;
+  unsigned int replicas = KBUCKET_MAX;
+};
+
+// counts of a multi-key get
+// retries: fetches that were duplicated, failed over, or looked up again
+// cache_hits/cache_misses: keys (not held by the session itself) that were found in/missing from the chunk cache
+struct get_stats {
+  unsigned long retries = 0;
+  unsigned long cache_hits = 0;
+  unsigned long cache_misses = 0;
+};
+
+// repair of an under-replicated chunk: its live replicas and the members of its replica set that lack it
+struct chunk_repair {
+  Key key;
+  size_t live_replicas;
+  std::vector<Peer> targets;
+};
 
 // Session: represents the local state of a peer that has joined a global session
 // with at least one other peer (set at initialization)
@@ -35,26 +130,46 @@ class Session : public dht::DHTService::Service {
 private:
 
   bool dying;
+  KeyHex self_hex;
   Router* router;
   std::mutex router_lock;
   std::unordered_map<Key, Chunk*> chunks;
   std::mutex chunks_lock;
   std::unique_ptr<grpc::Server> server;
-  std::thread server_thread;
-  std::deque<std::thread*> rpc_threads;
+  task_queue* maintenance_queue;
   session_metadata* meta;
+  ChunkCache* cache;
+  std::unordered_map<Key, double> peer_throughput;
+  std::unordered_map<Key, unsigned long> peer_bad_replicas;
+  std::mutex peer_stats_lock;
+  std::unordered_set<Key> repair_dead_peers;
+  std::unordered_map<Key, std::chrono::time_point<std::chrono::steady_clock>> recently_dead_peers;
+  std::unordered_map<Key, Peer> handoff_peers;
+  std::mutex repair_lock;
+  std::unordered_map<Key, std::pair<std::chrono::time_point<std::chrono::steady_clock>, std::vector<Key>>> sync_sessions;
+  std::mutex sync_lock;
   
   // node lookup algorithms
-  void publish(Chunk* chunk, bool force);
+  bool publish(Chunk* chunk, bool force);
   void self_lookup(Key self_key);
   void node_lookup(Key node_key, std::deque<Peer>& buffer);
   bool value_lookup(Key chunk_key, std::deque<Peer>& buffer, std::vector<char>** data_buffer);
-  void lookup_helper(Key search_key, std::deque<Peer>& closest_peers, const std::function<bool(Peer&, std::mutex&, unsigned int&)>& query_fn);
+  unsigned int lookup_helper(Key search_key, std::deque<Peer>& closest_peers, const std::function<bool(Peer&, std::mutex&, unsigned int&)>& query_fn, LookupTrace* trace);
+  void locate_replicas(std::vector<Key>& keys, unsigned int replicas, std::vector<std::vector<Peer>>& holders_buffer, std::vector<unsigned int>& candidates_buffer);
+
+  // per-peer download throughput (bytes/s, exponentially weighted), and replicas that failed verification or fetches
+  void record_throughput(Key peer_key, size_t bytes, std::chrono::duration<double> elapsed);
+  double estimated_throughput(Key peer_key);
+  void record_bad_replica(Key peer_key, Key chunk_key);
+  void record_failed_fetch(Key peer_key);
+
+  // add the session's chunk store and router occupancy to the metrics
+  void collect_metrics(std::vector<metric_sample>& samples_buffer);
 
   // RPC handlers
+  void start_serving(std::string self_endpoint);
   void init_server(std::string server_address, std::string port);
   void shutdown_server();
-  void handler_thread_fn();
   grpc::Status FindNode(grpc::ServerContext* context, 
                           const dht::FindNodeRequest* request,
                           dht::FindNodeResponse* response) override;
@@ -67,20 +182,45 @@ private:
   grpc::Status Store(grpc::ServerContext* context, 
                           const dht::StoreRequest* request,
                           dht::StoreResponse* response) override;
+  grpc::Status StoreBatch(grpc::ServerContext* context, 
+                          const dht::StoreBatchRequest* request,
+                          dht::StoreBatchResponse* response) override;
   grpc::Status Ping(grpc::ServerContext* context, 
                           const dht::PingRequest* request,
                           dht::PingResponse* response) override;
+  grpc::Status HasChunks(grpc::ServerContext* context, 
+                          const dht::HasChunksRequest* request,
+                          dht::HasChunksResponse* response) override;
+  grpc::Status SyncKeys(grpc::ServerContext* context, 
+                          const dht::SyncKeysRequest* request,
+                          dht::SyncKeysResponse* response) override;
   
-  // RPC caller threads: republish + expired chunks, refresh nodes
-  void init_rpc_threads();
-  void shutdown_rpc_threads();
-  void republish_chunks_thread_fn();
-  void cleanup_chunks_thread_fn();
-  void refresh_peer_thread_fn();
+  // maintenance tasks (on the executor): republish + expired chunks, refresh nodes, repairs, and handoffs
+  void init_maintenance();
+  void shutdown_maintenance();
+  void republish_chunks();
+  void cleanup_chunks();
+  void refresh_peers();
+  void ping_neighbors();
+  void repair_evicted_peers();
+  void repair_chunks(std::unordered_set<Key>& dead_peers);
+  void store_repairs(std::shared_ptr<std::vector<chunk_repair>> repairs, size_t next,
+                     std::chrono::steady_clock::time_point start, uint64_t sent_bytes);
+  void handoff_new_peers();
+  void handoff_chunks(std::unordered_map<Key, Peer>& new_peers);
+  void teardown_handoff(std::chrono::milliseconds deadline);
+  void push_chunks(Peer& peer, std::vector<Key>& keys, std::chrono::steady_clock::time_point deadline,
+                   std::function<void(size_t, uint64_t)> on_stored, std::vector<char>& held_buffer);
+  unsigned int sync_chunks(Peer& peer, std::vector<Key>& shared_keys);
   bool find_node(Peer* peer, Key& search_key, std::deque<Peer>& buffer);
   bool find_value(Peer* peer, Key& search_key, bool* found_value_buffer, std::deque<Peer>& buffer, std::vector<char>** data_buffer);
   bool store(Peer* peer, Chunk* chunk, bool force);
-  bool ping(Peer* peer, Peer* receiver_peer_buffer);
+  bool store_batch(Peer* peer, std::vector<Chunk*>& chunks, std::vector<char>& stored_buffer);
+  bool ping(Peer* peer, Peer* receiver_peer_buffer, std::chrono::milliseconds timeout = std::chrono::milliseconds(RPC_TIMEOUT_MS));
+  bool ping_seeds(std::vector<std::string>& seed_endpoints, Peer& seed_peer_buffer);
+  bool has_chunks(Peer* peer, std::vector<Key>& keys, std::vector<char>& has_chunk_buffer);
+  bool fetch_value(Peer* peer, Key& search_key, grpc::ClientContext* context, std::vector<char>** data_buffer);
+  bool sync_keys(Peer* peer, std::vector<dht::KeyRange>& ranges, std::vector<dht::KeyRange>& ranges_buffer);
 
   // helpers
   std::unique_ptr<dht::DHTService::Stub> rpc_stub(Peer* peer);
@@ -88,6 +228,13 @@ private:
   void rpc_caller_prelims(dht::Peer* sender);
   void rpc_caller_epilogue(dht::Peer* receiver_buffer);
   void update_peer(Key& peer_key, std::string endpoint);
+  void evict_dead_peer(Key peer_key);
+  bool recently_dead(Key& peer_key);
+  bool replica_set(Key& key, unsigned int replicas, std::deque<Peer*>& peers_buffer);
+  void shared_keys(std::unordered_map<Key, std::pair<Peer, std::vector<Key>>>& shared_buffer);
+  void shared_keys(Key& peer_key, std::vector<Key>& keys_buffer);
+  grpc::Status store_local(const dht::StoreRequest* request, Key& sender_key);
+  void chunk_to_rpc(Chunk* chunk, dht::StoreRequest* request_buffer);
   void local_to_rpc_peer(Peer* peer, dht::Peer* rpc_peer_buffer);
   void rpc_peer_to_local(dht::Peer* rpc_peer, Peer* peer_buffer);
 
@@ -100,17 +247,50 @@ public:
   // return session's endpoint
   std::string self_endpoint();
 
-  // startup session with self lookup
-  void startup(session_metadata* parent_metadata, std::string self_endpoint, std::string init_endpoint);
+  // startup session through its seed endpoints or seed peers (see startup_options)
+  // returns false if no seed endpoint answered within JOIN_TIMEOUT seconds (the session must still be torn down)
+  bool startup(session_metadata* parent_metadata, std::string self_endpoint, startup_options options);
 
   // teardown session (with option to forego republishing local chunks)
-  void teardown(bool republish);
+  // the local chunks that were not republished before the deadline are dropped
+  void teardown(bool republish, std::chrono::milliseconds deadline = std::chrono::seconds(TEARDOWN_HANDOFF_DEADLINE));
 
   // add chunk data to DHT
-  void set(Key key, std::vector<char>* data, bool force);
+  // returns false if no peer (including self) stored the chunk
+  bool set(Key key, std::vector<char>* data, set_options options = {});
+
+  // add a version of a mutable chunk to DHT, which replicas only accept if they hold an older version of the key
+  // (a compare-and-set for concurrent read-modify-write updates, e.g., of index pages)
+  // returns false if any replica (including self) did not store it, and adds the values held by the replicas that
+  // rejected it to newer_buffer (to be merged before retrying with a higher version)
+  bool set_versioned(Key key, std::vector<char>* data, uint64_t version, std::vector<std::vector<char>*>& newer_buffer);
 
-  // get value from DHT
+  // get value from DHT (meant for mutable keys, so the chunk cache is bypassed)
   // returns false if key was not found
   bool get(Key search_key, std::vector<char>** data_buffer);
+
+  // get content-addressed values from DHT, striping the fetches across the replicas of the chunks
+  // (replicas are weighted by their measured throughput, and idle replicas duplicate the slowest fetches)
+  // every value is verified against its key and replicas with corrupted values are skipped
+  // sets data_buffer[i] for keys[i] (NULL if not found) and returns false if any key was not found
+  // (the get's retried fetches and chunk cache lookups are added to stats_buffer if given)
+  bool get(std::vector<Key>& keys, std::vector<std::vector<char>*>& data_buffer, get_stats* stats_buffer = NULL);
+
+  // check which chunks are already stored on all of (at most replicas of) their closest known peers
+  // sets replicated_buffer[i] for keys[i]
+  void replicated(std::vector<Key>& keys, unsigned int replicas, std::vector<char>& replicated_buffer);
+
+  // reconcile the local chunks with the neighbors that share their replica sets (as done periodically)
+  // returns the number of chunks stored on neighbors that lacked them
+  unsigned int anti_entropy();
+
+  // consult (and fill) the local chunk cache on sets/gets (NULL to disable)
+  void set_cache(ChunkCache* cache);
+
+  // copy the measured per-peer download throughputs (bytes/s)
+  void peer_throughputs(std::unordered_map<Key, double>& throughputs_buffer);
+
+  // copy the number of corrupted values sent by each peer
+  void bad_replicas(std::unordered_map<Key, unsigned long>& bad_replicas_buffer);
 };
 
@@ -0,0 +1,179 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+
+// steady clock time that trace timestamps are relative to (the first use of the tracer)
+static std::chrono::steady_clock::time_point trace_epoch() {
+  static std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+  return epoch;
+}
+
+//
+// LOOKUP TRACES
+//
+
+LookupTrace::LookupTrace(uint64_t id, std::string kind, Key self_key, Key search_key) {
+  this->id = id;
+  this->kind = kind;
+  this->self_key = self_key;
+  this->search_key = search_key;
+  this->started = LookupTrace::now();
+  this->finished = this->started;
+}
+
+uint64_t LookupTrace::now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - trace_epoch()).count();
+}
+
+void LookupTrace::rpc(Peer& peer, uint64_t start, bool success, unsigned int peers_returned, std::string iteration) {
+  this->events.push_back({'X', this->kind == "value" ? "find_value" : "find_node", start, LookupTrace::now() - start, {
+    {"peer", hex_string(peer.key)},
+    {"endpoint", peer.endpoint},
+    {"iteration", iteration},
+    {"success", success ? "true" : "false"},
+    {"peers_returned", std::to_string(peers_returned)},
+  }});
+}
+
+void LookupTrace::lock_wait(uint64_t start) {
+  this->events.push_back({'X', "router_lock", start, LookupTrace::now() - start, {}});
+}
+
+void LookupTrace::iteration(unsigned int i, unsigned int queried, unsigned int responses, size_t shortlist_size, bool improved, Key closest_key) {
+  this->events.push_back({'i', "iteration " + std::to_string(i), LookupTrace::now(), 0, {
+    {"queried", std::to_string(queried)},
+    {"responses", std::to_string(responses)},
+    {"shortlist", std::to_string(shortlist_size)},
+    {"improved", improved ? "true" : "false"},
+    {"closest", hex_string(closest_key)},
+  }});
+}
+
+void LookupTrace::terminate(std::string reason) {
+  this->termination = reason;
+  this->finished = LookupTrace::now();
+}
+
+void LookupTrace::annotate(std::string name, std::string value) {
+  this->args.push_back({name, value});
+}
+
+//
+// TRACER
+//
+
+Tracer::Tracer() {
+  this->rate.store(0);
+  this->next_id.store(1);
+  this->ring.assign(TRACE_RING_SIZE, NULL);
+  this->ring_next = 0;
+  trace_epoch();
+}
+
+Tracer::~Tracer() {
+  this->clear();
+}
+
+void Tracer::set_sample_rate(double sample_rate) {
+  this->rate.store(std::min(1.0, std::max(0.0, sample_rate)));
+}
+
+double Tracer::sample_rate() {
+  return this->rate.load();
+}
+
+LookupTrace* Tracer::sample(std::string kind, Key self_key, Key search_key) {
+  double sample_rate = this->rate.load(std::memory_order_relaxed);
+  if (sample_rate <= 0) {
+    return NULL;
+  }
+  thread_local std::mt19937_64 gen(std::random_device{}());
+  if (sample_rate < 1 && std::uniform_real_distribution<double>(0, 1)(gen) >= sample_rate) {
+    return NULL;
+  }
+  return new LookupTrace(this->next_id++, kind, self_key, search_key);
+}
+
+// (overwrites the oldest trace once the ring is full)
+void Tracer::record(LookupTrace* trace) {
+  if (trace->termination.empty()) {
+    trace->terminate("unknown");
+  }
+  std::lock_guard<std::mutex> guard(this->ring_lock);
+  delete this->ring[this->ring_next];
+  this->ring[this->ring_next] = trace;
+  this->ring_next = (this->ring_next + 1) % TRACE_RING_SIZE;
+}
+
+size_t Tracer::size() {
+  std::lock_guard<std::mutex> guard(this->ring_lock);
+  return std::count_if(this->ring.begin(), this->ring.end(), [](LookupTrace* trace) { return trace != NULL; });
+}
+
+void Tracer::clear() {
+  std::lock_guard<std::mutex> guard(this->ring_lock);
+  for (LookupTrace*& trace : this->ring) {
+    delete trace;
+    trace = NULL;
+  }
+  this->ring_next = 0;
+}
+
+static std::string json_args(std::vector<std::pair<std::string, std::string>>& args) {
+  std::string json = "{";
+  for (size_t i = 0; i < args.size(); i++) {
+    json += (i > 0 ? "," : "") + json_string(args[i].first) + ":" + json_string(args[i].second);
+  }
+  return json + "}";
+}
+
+static std::string json_event(char phase, std::string name, uint64_t tid, uint64_t start, uint64_t duration, std::string args) {
+  std::string json = "{\"name\":" + json_string(name) + ",\"cat\":\"lookup\",\"ph\":\"" + phase + "\",\"pid\":1,\"tid\":"
+                     + std::to_string(tid) + ",\"ts\":" + std::to_string(start);
+  if (phase == 'X') {
+    json += ",\"dur\":" + std::to_string(duration);
+  } else if (phase == 'i') {
+    json += ",\"s\":\"t\"";
+  }
+  return json + ",\"args\":" + args + "}";
+}
+
+// traces are written from oldest to newest
+std::string Tracer::chrome_json() {
+  std::lock_guard<std::mutex> guard(this->ring_lock);
+  std::vector<std::string> events;
+  for (size_t i = 0; i < TRACE_RING_SIZE; i++) {
+    LookupTrace* trace = this->ring[(this->ring_next + i) % TRACE_RING_SIZE];
+    if (trace == NULL) {
+      continue;
+    }
+    std::vector<std::pair<std::string, std::string>> name_args = {
+      {"name", trace->kind + " lookup " + hex_string(trace->search_key) + " (" + std::to_string(trace->id) + ")"}
+    };
+    events.push_back(json_event('M', "thread_name", trace->id, trace->started, 0, json_args(name_args)));
+    std::vector<std::pair<std::string, std::string>> lookup_args = {
+      {"self", hex_string(trace->self_key)},
+      {"search_key", hex_string(trace->search_key)},
+      {"termination", trace->termination},
+    };
+    lookup_args.insert(lookup_args.end(), trace->args.begin(), trace->args.end());
+    events.push_back(json_event('X', trace->kind + "_lookup", trace->id, trace->started, trace->finished - trace->started,
+                                json_args(lookup_args)));
+    for (trace_event& event : trace->events) {
+      events.push_back(json_event(event.phase, event.name, trace->id, event.start, event.duration, json_args(event.args)));
+    }
+  }
+
+  std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (size_t i = 0; i < events.size(); i++) {
+    json += (i > 0 ? ",\n" : "\n") + events[i];
+  }
+  return json + "\n]}\n";
+}
+
+// never destroyed, so lookups can still finish on threads that outlive main
+Tracer* tracer() {
+  static Tracer* process_tracer = new Tracer();
+  return process_tracer;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "src/utils/utils.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <cstdint>
+
+// max number of finished lookup traces kept by the tracer (older traces are overwritten)
+#define TRACE_RING_SIZE 256
+
+// event of a lookup trace: a span ('X', e.g., an RPC to a peer) or an instant ('i', e.g., the end of an iteration)
+// times are in microseconds since the tracer's epoch
+struct trace_event {
+  char phase;
+  std::string name;
+  uint64_t start;
+  uint64_t duration;
+  std::vector<std::pair<std::string, std::string>> args;
+};
+
+// LookupTrace: hop-by-hop record of a single (sampled) lookup
+// the lookup adds its RPCs, router lock waits, and iterations as it goes, and the trace is handed to the tracer
+// once the lookup has terminated (a trace is only written by the lookup's thread)
+class LookupTrace {
+private:
+  uint64_t id;
+  std::string kind;
+  Key self_key;
+  Key search_key;
+  uint64_t started;
+  uint64_t finished;
+  std::string termination;
+  std::vector<trace_event> events;
+  std::vector<std::pair<std::string, std::string>> args;
+
+  friend class Tracer;
+
+public:
+  LookupTrace(uint64_t id, std::string kind, Key self_key, Key search_key);
+
+  // microseconds since the tracer's epoch (for the start of spans)
+  static uint64_t now();
+
+  // an RPC (find_value for value lookups, find_node otherwise) to a peer that started at start
+  // (peers_returned is the number of new peers in the response)
+  void rpc(Peer& peer, uint64_t start, bool success, unsigned int peers_returned, std::string iteration);
+
+  // a wait for the router lock that started at start
+  void lock_wait(uint64_t start);
+
+  // the end of an iteration of the lookup and the state of its shortlist
+  void iteration(unsigned int i, unsigned int queried, unsigned int responses, size_t shortlist_size, bool improved, Key closest_key);
+
+  // why the lookup terminated (e.g., "value found", "no distance improvement")
+  void terminate(std::string reason);
+
+  void annotate(std::string name, std::string value);
+};
+
+// Tracer: samples lookups for tracing and keeps the latest traces in a ring buffer
+// sampling is off (rate 0) by default, in which case lookups pay a single atomic load
+class Tracer {
+private:
+  std::atomic<double> rate;
+  std::atomic<uint64_t> next_id;
+  std::mutex ring_lock;
+  std::vector<LookupTrace*> ring;
+  size_t ring_next;
+
+public:
+  Tracer();
+  ~Tracer();
+
+  // fraction of lookups that are traced (0 disables tracing, 1 traces every lookup)
+  void set_sample_rate(double sample_rate);
+  double sample_rate();
+
+  // return a new trace if the lookup is sampled (NULL otherwise)
+  LookupTrace* sample(std::string kind, Key self_key, Key search_key);
+
+  // take ownership of a finished trace
+  void record(LookupTrace* trace);
+  size_t size();
+  void clear();
+
+  // all kept traces in the Chrome trace event format (chrome://tracing, Perfetto)
+  // every lookup is a thread of its own, with its RPCs and lock waits nested in the lookup's span
+  std::string chrome_json();
+};
+
+// tracer of the running process
+Tracer* tracer();
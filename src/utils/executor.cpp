@@ -0,0 +1,303 @@
+#include "executor.h"
+
+#include <algorithm>
+
+struct task_queue {
+  std::deque<std::function<void()>> tasks;
+  unsigned int max_running;
+  unsigned int running;
+  bool listed;
+  bool closed;
+  size_t home;
+  std::vector<executor_timer*> timers;
+};
+
+struct executor_timer {
+  task_queue* queue;
+  std::function<void()> task;
+  std::chrono::milliseconds interval;
+  bool periodic;
+  bool armed;
+  std::multimap<std::chrono::steady_clock::time_point, executor_timer*>::iterator it;
+};
+
+//
+// EXECUTOR
+//
+
+Executor::Executor(unsigned int num_threads) {
+  this->stopping = false;
+  this->next_home = 0;
+  this->ready.resize(std::max(num_threads, 1u));
+  for (size_t i = 0; i < this->ready.size(); i++) {
+    this->workers.push_back(std::thread(&Executor::work, this, i));
+  }
+  this->timer_thread = std::thread(&Executor::fire_timers, this);
+}
+
+Executor::~Executor() {
+  std::unique_lock<std::mutex> uq_executor_lock(this->executor_lock);
+  this->stopping = true;
+  this->work_cv.notify_all();
+  this->timer_cv.notify_all();
+  uq_executor_lock.unlock();
+  for (std::thread& worker : this->workers) {
+    worker.join();
+  }
+  this->timer_thread.join();
+}
+
+size_t Executor::num_threads() {
+  return this->workers.size();
+}
+
+// run the tasks of the ready queues until the executor stops
+void Executor::work(size_t worker) {
+  std::unique_lock<std::mutex> uq_executor_lock(this->executor_lock);
+  while (true) {
+    task_queue* queue;
+    std::function<void()> task;
+    while (!this->stopping && !this->next_task(worker, &queue, task)) {
+      this->work_cv.wait(uq_executor_lock);
+    }
+    if (this->stopping) {
+      return;
+    }
+    uq_executor_lock.unlock();
+    task();
+    task = nullptr;
+    this->finish_task(queue);
+    uq_executor_lock.lock();
+  }
+}
+
+// take the next task of the first ready queue homed on the worker, or steal one from the back of another worker's
+// queues (the queue goes to the back of its home's queues if it can run more of its tasks)
+// (expects executor_lock to be held)
+bool Executor::next_task(size_t worker, task_queue** queue_buffer, std::function<void()>& task_buffer) {
+  for (size_t i = 0; i < this->ready.size(); i++) {
+    std::deque<task_queue*>& ready = this->ready[(worker + i) % this->ready.size()];
+    while (!ready.empty()) {
+      task_queue* queue = i == 0 ? ready.front() : ready.back();
+      if (i == 0) {
+        ready.pop_front();
+      } else {
+        ready.pop_back();
+      }
+      queue->listed = false;
+      if (queue->tasks.empty() || queue->running >= queue->max_running) {
+        continue;
+      }
+      task_buffer = std::move(queue->tasks.front());
+      queue->tasks.pop_front();
+      queue->running++;
+      this->make_ready(queue);
+      *queue_buffer = queue;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Executor::finish_task(task_queue* queue) {
+  std::lock_guard<std::mutex> guard(this->executor_lock);
+  queue->running--;
+  this->make_ready(queue);
+  if (queue->closed && queue->running == 0) {
+    this->idle_cv.notify_all();
+  }
+}
+
+// list the queue on its home worker if it can run another task
+// (expects executor_lock to be held)
+void Executor::make_ready(task_queue* queue) {
+  if (queue->listed || queue->closed || queue->tasks.empty() || queue->running >= queue->max_running) {
+    return;
+  }
+  this->ready[queue->home].push_back(queue);
+  queue->listed = true;
+  this->work_cv.notify_one();
+}
+
+task_queue* Executor::create_queue(unsigned int max_running) {
+  std::lock_guard<std::mutex> guard(this->executor_lock);
+  task_queue* queue = new task_queue{{}, std::max(max_running, 1u), 0, false, false, this->next_home, {}};
+  this->next_home = (this->next_home + 1) % this->ready.size();
+  return queue;
+}
+
+void Executor::close_queue(task_queue* queue) {
+  std::unique_lock<std::mutex> uq_executor_lock(this->executor_lock);
+  queue->closed = true;
+  queue->tasks.clear();
+  for (executor_timer* timer : queue->timers) {
+    if (timer->armed) {
+      this->timers.erase(timer->it);
+      timer->armed = false;
+    }
+  }
+  if (queue->listed) {
+    std::deque<task_queue*>& ready = this->ready[queue->home];
+    ready.erase(std::find(ready.begin(), ready.end(), queue));
+    queue->listed = false;
+  }
+
+  // (the timers are deleted once the running tasks, e.g., the runs of periodic timers, finished)
+  this->idle_cv.wait(uq_executor_lock, [queue]() { return queue->running == 0; });
+  uq_executor_lock.unlock();
+  for (executor_timer* timer : queue->timers) {
+    delete timer;
+  }
+  delete queue;
+}
+
+bool Executor::submit(task_queue* queue, std::function<void()> task) {
+  std::lock_guard<std::mutex> guard(this->executor_lock);
+  if (queue->closed) {
+    return false;
+  }
+  queue->tasks.push_back(task);
+  this->make_ready(queue);
+  return true;
+}
+
+bool Executor::run_pending(task_queue* queue) {
+  std::unique_lock<std::mutex> uq_executor_lock(this->executor_lock);
+  if (queue->closed || queue->tasks.empty() || queue->running >= queue->max_running) {
+    return false;
+  }
+  std::function<void()> task = std::move(queue->tasks.front());
+  queue->tasks.pop_front();
+  queue->running++;
+  uq_executor_lock.unlock();
+  task();
+  task = nullptr;
+  this->finish_task(queue);
+  return true;
+}
+
+//
+// TIMERS
+//
+
+void Executor::schedule(task_queue* queue, std::chrono::milliseconds delay, std::function<void()> task) {
+  std::lock_guard<std::mutex> guard(this->executor_lock);
+  if (queue->closed) {
+    return;
+  }
+  executor_timer* timer = new executor_timer{queue, task, delay, false, false, {}};
+  queue->timers.push_back(timer);
+  this->arm(timer, std::chrono::steady_clock::now() + delay);
+}
+
+void Executor::schedule_every(task_queue* queue, std::chrono::milliseconds interval, std::function<void()> task) {
+  std::lock_guard<std::mutex> guard(this->executor_lock);
+  if (queue->closed) {
+    return;
+  }
+  executor_timer* timer = new executor_timer{queue, task, interval, true, false, {}};
+  queue->timers.push_back(timer);
+  this->arm(timer, std::chrono::steady_clock::now() + interval);
+}
+
+// (expects executor_lock to be held)
+void Executor::arm(executor_timer* timer, std::chrono::steady_clock::time_point deadline) {
+  timer->it = this->timers.insert({deadline, timer});
+  timer->armed = true;
+  this->timer_cv.notify_one();
+}
+
+// submit the tasks of the timers whose deadlines passed to their queues
+// one-shot timers are deleted once fired, and periodic timers are re-armed by their task once it ran
+void Executor::fire_timers() {
+  std::unique_lock<std::mutex> uq_executor_lock(this->executor_lock);
+  while (!this->stopping) {
+    if (this->timers.empty()) {
+      this->timer_cv.wait(uq_executor_lock);
+      continue;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (this->timers.begin()->first > now) {
+      this->timer_cv.wait_until(uq_executor_lock, this->timers.begin()->first);
+      continue;
+    }
+    executor_timer* timer = this->timers.begin()->second;
+    this->timers.erase(this->timers.begin());
+    timer->armed = false;
+    task_queue* queue = timer->queue;
+    if (timer->periodic) {
+      queue->tasks.push_back([this, timer]() {
+        timer->task();
+        std::lock_guard<std::mutex> guard(this->executor_lock);
+        if (!timer->queue->closed) {
+          this->arm(timer, std::chrono::steady_clock::now() + timer->interval);
+        }
+      });
+    } else {
+      queue->tasks.push_back(std::move(timer->task));
+      queue->timers.erase(std::find(queue->timers.begin(), queue->timers.end(), timer));
+      delete timer;
+    }
+    this->make_ready(queue);
+  }
+}
+
+//
+// TASK GROUPS
+//
+
+TaskGroup::TaskGroup(unsigned int max_running) {
+  this->queue = executor()->create_queue(max_running);
+  this->max_running = std::max(max_running, 1u);
+  this->pending = 0;
+  this->queued = 0;
+  this->running = 0;
+}
+
+TaskGroup::~TaskGroup() {
+  this->wait();
+  executor()->close_queue(this->queue);
+}
+
+void TaskGroup::run(std::function<void()> task) {
+  std::unique_lock<std::mutex> uq_group_lock(this->group_lock);
+  this->pending++;
+  this->queued++;
+  this->group_cv.notify_all();
+  uq_group_lock.unlock();
+  executor()->submit(this->queue, [this, task]() {
+    std::unique_lock<std::mutex> uq_group_lock(this->group_lock);
+    this->queued--;
+    this->running++;
+    uq_group_lock.unlock();
+    task();
+    // (notified with the lock held, since the group may be destroyed as soon as the waiter sees it done)
+    uq_group_lock.lock();
+    this->running--;
+    this->pending--;
+    this->group_cv.notify_all();
+  });
+}
+
+// (runs the group's queued tasks on the calling thread until the rest are running elsewhere, and otherwise waits
+// until a queued task may run)
+void TaskGroup::wait() {
+  while (true) {
+    if (executor()->run_pending(this->queue)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> uq_group_lock(this->group_lock);
+    this->group_cv.wait(uq_group_lock, [this]() {
+      return this->pending == 0 || (this->queued > 0 && this->running < this->max_running);
+    });
+    if (this->pending == 0) {
+      return;
+    }
+  }
+}
+
+// never destroyed, so tasks can still finish on threads that outlive main
+Executor* executor() {
+  static Executor* process_executor = new Executor(std::max(std::thread::hardware_concurrency(), static_cast<unsigned int>(EXECUTOR_MIN_THREADS)));
+  return process_executor;
+}
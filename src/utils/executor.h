@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <cstdint>
+
+// min number of worker threads of the process's executor (it runs one per core otherwise)
+#define EXECUTOR_MIN_THREADS 4
+
+// max number of tasks of a queue that run at once if unbounded
+#define EXECUTOR_UNBOUNDED ((unsigned int) -1)
+
+struct task_queue;
+struct executor_timer;
+
+// Executor: process-wide pool of worker threads and timer service that the sessions, file operations, and client
+// commands schedule their tasks onto (instead of running threads of their own)
+// tasks are submitted to queues (e.g., one per session) that run at most max_running of their tasks at once, and
+// workers take turns between the ready queues, so that every queue gets its share of the workers
+// every queue is homed on a worker, and idle workers steal ready queues homed on the other workers
+class Executor {
+private:
+  std::mutex executor_lock;
+  std::condition_variable work_cv;
+  std::condition_variable idle_cv;
+  std::condition_variable timer_cv;
+  bool stopping;
+  std::vector<std::deque<task_queue*>> ready;
+  std::vector<std::thread> workers;
+  size_t next_home;
+
+  // armed timers by their deadlines (fired by the timer thread, which submits their tasks to their queues)
+  std::multimap<std::chrono::steady_clock::time_point, executor_timer*> timers;
+  std::thread timer_thread;
+
+  void work(size_t worker);
+  void fire_timers();
+  bool next_task(size_t worker, task_queue** queue_buffer, std::function<void()>& task_buffer);
+  void finish_task(task_queue* queue);
+  void make_ready(task_queue* queue);
+  void arm(executor_timer* timer, std::chrono::steady_clock::time_point deadline);
+
+public:
+  Executor(unsigned int num_threads);
+  ~Executor();
+
+  size_t num_threads();
+
+  // create a queue that runs at most max_running of its tasks at once (1 runs its tasks in submission order)
+  task_queue* create_queue(unsigned int max_running);
+
+  // cancel the queue's timers, drop its pending tasks, and wait for its running tasks to finish before deleting it
+  // (must not be called by one of the queue's own tasks)
+  void close_queue(task_queue* queue);
+
+  // returns false if the queue is closed
+  bool submit(task_queue* queue, std::function<void()> task);
+
+  // run the task on the queue once the delay has passed
+  void schedule(task_queue* queue, std::chrono::milliseconds delay, std::function<void()> task);
+
+  // run the task on the queue every interval (measured from the end of its previous run) until the queue is closed
+  void schedule_every(task_queue* queue, std::chrono::milliseconds interval, std::function<void()> task);
+
+  // run the next pending task of the queue on the calling thread (false if no task of the queue is runnable)
+  bool run_pending(task_queue* queue);
+};
+
+// TaskGroup: tasks that run on the executor and can be waited on together
+// (a waiting thread runs the group's pending tasks itself, so waiting on groups in tasks never exhausts the workers)
+// groups that fan out blocking calls (e.g., RPCs to every holder of a batch) bound how many of their tasks run at once
+class TaskGroup {
+private:
+  task_queue* queue;
+  std::mutex group_lock;
+  std::condition_variable group_cv;
+  unsigned int max_running;
+  size_t pending;
+  size_t queued;
+  size_t running;
+
+public:
+  TaskGroup(unsigned int max_running = EXECUTOR_UNBOUNDED);
+  ~TaskGroup();
+
+  void run(std::function<void()> task);
+
+  // wait for all tasks of the group to finish
+  void wait();
+};
+
+// executor of the running process
+Executor* executor();
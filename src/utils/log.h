@@ -0,0 +1,30 @@
+#pragma once
+
+#include "utils.h"
+
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/fmt.h>
+
+// logging through the default logger that only evaluates its arguments (e.g., key formatting) if the logger's
+// level is enabled, so disabled log statements cost a single level check
+#define LOG_AT(level, ...) \
+  do { \
+    spdlog::logger* log_at_logger = spdlog::default_logger_raw(); \
+    if (log_at_logger->should_log(level)) { \
+      log_at_logger->log(level, __VA_ARGS__); \
+    } \
+  } while (0)
+#define LOG_TRACE(...) LOG_AT(spdlog::level::trace, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(spdlog::level::debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(spdlog::level::info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(spdlog::level::warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(spdlog::level::err, __VA_ARGS__)
+
+// format key prefixes (see key_hex) in place
+template <>
+struct fmt::formatter<KeyHex> : fmt::formatter<fmt::string_view> {
+  template <typename FormatContext>
+  auto format(const KeyHex& hex, FormatContext& ctx) const -> decltype(ctx.out()) {
+    return fmt::formatter<fmt::string_view>::format(fmt::string_view(hex.str), ctx);
+  }
+};
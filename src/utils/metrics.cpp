@@ -0,0 +1,316 @@
+#include "metrics.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+// shard of the calling thread (assigned round-robin on first use)
+static unsigned int thread_shard() {
+  static std::atomic<unsigned int> next_shard(0);
+  thread_local unsigned int shard = next_shard++ % METRICS_SHARDS;
+  return shard;
+}
+
+//
+// COUNTERS AND GAUGES
+//
+
+Counter::Counter() {
+  for (int i = 0; i < METRICS_SHARDS; i++) {
+    this->shards[i].value.store(0);
+  }
+}
+
+void Counter::add(uint64_t n) {
+  this->shards[thread_shard()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Counter::value() {
+  uint64_t total = 0;
+  for (int i = 0; i < METRICS_SHARDS; i++) {
+    total += this->shards[i].value.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+Gauge::Gauge() {
+  this->current.store(0);
+}
+
+void Gauge::set(int64_t value) {
+  this->current.store(value, std::memory_order_relaxed);
+}
+
+void Gauge::add(int64_t n) {
+  this->current.fetch_add(n, std::memory_order_relaxed);
+}
+
+int64_t Gauge::value() {
+  return this->current.load(std::memory_order_relaxed);
+}
+
+//
+// HISTOGRAMS
+//
+
+Histogram::Histogram() {
+  this->shards = new shard[METRICS_SHARDS];
+  for (int i = 0; i < METRICS_SHARDS; i++) {
+    for (int j = 0; j < HISTOGRAM_BUCKETS; j++) {
+      this->shards[i].counts[j].store(0);
+    }
+    this->shards[i].sum.store(0);
+  }
+}
+
+Histogram::~Histogram() {
+  delete[] this->shards;
+}
+
+// values below HISTOGRAM_SUB_BUCKETS get their own bucket, larger values are bucketed by their exponent and the
+// HISTOGRAM_SUB_BUCKET_BITS bits following their leading bit
+size_t Histogram::bucket_index(uint64_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  unsigned int exponent = 63 - __builtin_clzll(value);
+  if (exponent > HISTOGRAM_MAX_EXPONENT) {
+    return HISTOGRAM_BUCKETS - 1;
+  }
+  unsigned int shift = exponent - HISTOGRAM_SUB_BUCKET_BITS;
+  return (shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+// largest value that falls into the bucket
+uint64_t Histogram::bucket_upper_bound(size_t index) {
+  if (index < HISTOGRAM_SUB_BUCKETS) {
+    return index;
+  }
+  unsigned int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+  uint64_t lower = (HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << shift;
+  return lower + (1ull << shift) - 1;
+}
+
+void Histogram::record(uint64_t value) {
+  shard& s = this->shards[thread_shard()];
+  s.counts[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+  s.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+// (the snapshot is not atomic across buckets, so concurrent records may be partially included)
+void Histogram::snapshot(histogram_snapshot& snapshot_buffer) {
+  snapshot_buffer.counts.assign(HISTOGRAM_BUCKETS, 0);
+  snapshot_buffer.count = 0;
+  snapshot_buffer.sum = 0;
+  for (int i = 0; i < METRICS_SHARDS; i++) {
+    for (int j = 0; j < HISTOGRAM_BUCKETS; j++) {
+      uint64_t count = this->shards[i].counts[j].load(std::memory_order_relaxed);
+      snapshot_buffer.counts[j] += count;
+      snapshot_buffer.count += count;
+    }
+    snapshot_buffer.sum += this->shards[i].sum.load(std::memory_order_relaxed);
+  }
+}
+
+uint64_t histogram_snapshot::quantile(double q) {
+  uint64_t rank = std::max<uint64_t>(1, q * this->count + 0.5);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < this->counts.size(); i++) {
+    seen += this->counts[i];
+    if (seen >= rank) {
+      return Histogram::bucket_upper_bound(i);
+    }
+  }
+  return 0;
+}
+
+uint64_t histogram_snapshot::max() {
+  for (size_t i = this->counts.size(); i > 0; i--) {
+    if (this->counts[i - 1] > 0) {
+      return Histogram::bucket_upper_bound(i - 1);
+    }
+  }
+  return 0;
+}
+
+//
+// REGISTRY
+//
+
+MetricsRegistry::~MetricsRegistry() {
+  for (auto& name_pair : this->metrics) {
+    for (auto& labels_pair : name_pair.second) {
+      delete labels_pair.second.counter;
+      delete labels_pair.second.gauge;
+      delete labels_pair.second.histogram;
+    }
+  }
+}
+
+// (expects metrics_lock to be held)
+MetricsRegistry::metric_info& MetricsRegistry::find(std::string name, std::string labels, std::string help) {
+  metric_info& info = this->metrics[name][labels];
+  if (info.help.empty()) {
+    info.help = help;
+  }
+  return info;
+}
+
+Counter* MetricsRegistry::counter(std::string name, std::string labels, std::string help) {
+  std::lock_guard<std::mutex> guard(this->metrics_lock);
+  metric_info& info = this->find(name, labels, help);
+  if (info.counter == NULL) {
+    info.counter = new Counter();
+  }
+  return info.counter;
+}
+
+Gauge* MetricsRegistry::gauge(std::string name, std::string labels, std::string help) {
+  std::lock_guard<std::mutex> guard(this->metrics_lock);
+  metric_info& info = this->find(name, labels, help);
+  if (info.gauge == NULL) {
+    info.gauge = new Gauge();
+  }
+  return info.gauge;
+}
+
+Histogram* MetricsRegistry::histogram(std::string name, std::string labels, std::string help) {
+  std::lock_guard<std::mutex> guard(this->metrics_lock);
+  metric_info& info = this->find(name, labels, help);
+  if (info.histogram == NULL) {
+    info.histogram = new Histogram();
+  }
+  return info.histogram;
+}
+
+void MetricsRegistry::add_collector(void* owner, std::function<void(std::vector<metric_sample>&)> collector) {
+  std::lock_guard<std::mutex> guard(this->collectors_lock);
+  this->collectors.push_back({owner, collector});
+}
+
+// waits for running collections, so the owner's state is no longer read once this returns
+void MetricsRegistry::remove_collector(void* owner) {
+  std::lock_guard<std::mutex> guard(this->collectors_lock);
+  for (size_t i = 0; i < this->collectors.size(); i++) {
+    if (this->collectors[i].first == owner) {
+      this->collectors.erase(this->collectors.begin() + i);
+      i--;
+    }
+  }
+}
+
+void MetricsRegistry::collect(std::vector<metric_sample>& samples_buffer) {
+  std::lock_guard<std::mutex> guard(this->collectors_lock);
+  for (auto& pair : this->collectors) {
+    pair.second(samples_buffer);
+  }
+}
+
+static std::string format_name(std::string name, std::string labels) {
+  return labels.empty() ? name : name + "{" + labels + "}";
+}
+
+static std::string join_labels(std::string labels, std::string extra) {
+  return labels.empty() ? extra : labels + "," + extra;
+}
+
+static std::string format_value(double value) {
+  std::ostringstream stream;
+  stream << std::setprecision(15) << value;
+  return stream.str();
+}
+
+// histograms are exposed with cumulative buckets at every power of 4 (a fixed set of bounds across scrapes)
+std::string MetricsRegistry::prometheus_text() {
+  std::vector<metric_sample> samples;
+  this->collect(samples);
+  std::map<std::string, std::vector<metric_sample*>> collected;
+  for (metric_sample& sample : samples) {
+    collected[sample.name].push_back(&sample);
+  }
+
+  std::lock_guard<std::mutex> guard(this->metrics_lock);
+  std::string text;
+  for (auto& name_pair : this->metrics) {
+    const std::string& name = name_pair.first;
+    metric_info& first = name_pair.second.begin()->second;
+    std::string type = first.counter != NULL ? "counter" : (first.gauge != NULL ? "gauge" : "histogram");
+    text += "# HELP " + name + " " + first.help + "\n";
+    text += "# TYPE " + name + " " + type + "\n";
+    for (auto& labels_pair : name_pair.second) {
+      const std::string& labels = labels_pair.first;
+      metric_info& info = labels_pair.second;
+      if (info.counter != NULL) {
+        text += format_name(name, labels) + " " + std::to_string(info.counter->value()) + "\n";
+      } else if (info.gauge != NULL) {
+        text += format_name(name, labels) + " " + std::to_string(info.gauge->value()) + "\n";
+      } else if (info.histogram != NULL) {
+        histogram_snapshot snapshot;
+        info.histogram->snapshot(snapshot);
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        for (uint64_t bound = 1; bound <= (1ull << HISTOGRAM_MAX_EXPONENT); bound *= 4) {
+          for (; bucket < HISTOGRAM_BUCKETS && Histogram::bucket_upper_bound(bucket) <= bound; bucket++) {
+            cumulative += snapshot.counts[bucket];
+          }
+          text += format_name(name + "_bucket", join_labels(labels, "le=\"" + std::to_string(bound) + "\"")) + " "
+                  + std::to_string(cumulative) + "\n";
+        }
+        text += format_name(name + "_bucket", join_labels(labels, "le=\"+Inf\"")) + " " + std::to_string(snapshot.count) + "\n";
+        text += format_name(name + "_sum", labels) + " " + std::to_string(snapshot.sum) + "\n";
+        text += format_name(name + "_count", labels) + " " + std::to_string(snapshot.count) + "\n";
+      }
+    }
+  }
+  for (auto& pair : collected) {
+    text += "# HELP " + pair.first + " " + pair.second[0]->help + "\n";
+    text += "# TYPE " + pair.first + " gauge\n";
+    for (metric_sample* sample : pair.second) {
+      text += format_name(sample->name, sample->labels) + " " + format_value(sample->value) + "\n";
+    }
+  }
+  return text;
+}
+
+std::string MetricsRegistry::summary_text() {
+  std::vector<metric_sample> samples;
+  this->collect(samples);
+
+  std::lock_guard<std::mutex> guard(this->metrics_lock);
+  std::string text;
+  for (auto& name_pair : this->metrics) {
+    for (auto& labels_pair : name_pair.second) {
+      std::string name = format_name(name_pair.first, labels_pair.first);
+      metric_info& info = labels_pair.second;
+      if (info.counter != NULL) {
+        text += name + " " + std::to_string(info.counter->value()) + "\n";
+      } else if (info.gauge != NULL) {
+        text += name + " " + std::to_string(info.gauge->value()) + "\n";
+      } else if (info.histogram != NULL) {
+        histogram_snapshot snapshot;
+        info.histogram->snapshot(snapshot);
+        text += name + " count=" + std::to_string(snapshot.count);
+        if (snapshot.count > 0) {
+          text += " mean=" + format_value(static_cast<double>(snapshot.sum) / snapshot.count)
+                  + " p50=" + std::to_string(snapshot.quantile(0.5)) + " p90=" + std::to_string(snapshot.quantile(0.9))
+                  + " p99=" + std::to_string(snapshot.quantile(0.99)) + " max=" + std::to_string(snapshot.max());
+        }
+        text += "\n";
+      }
+    }
+  }
+  for (metric_sample& sample : samples) {
+    text += format_name(sample.name, sample.labels) + " " + format_value(sample.value) + "\n";
+  }
+  return text;
+}
+
+uint64_t elapsed_micros(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// never destroyed, so metrics can still be recorded by threads that outlive main
+MetricsRegistry* metrics() {
+  static MetricsRegistry* registry = new MetricsRegistry();
+  return registry;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdint>
+
+// number of per-thread shards of every counter/histogram (threads are spread round-robin across them)
+#define METRICS_SHARDS 8
+
+// histograms have 2^HISTOGRAM_SUB_BUCKET_BITS linear sub-buckets per power of two (<= 12.5% relative error)
+// and record values up to 2^HISTOGRAM_MAX_EXPONENT (larger values are clamped)
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_EXPONENT 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BUCKET_BITS + 2) * HISTOGRAM_SUB_BUCKETS)
+
+// Counter: monotonically increasing count, sharded per thread so that increments never contend
+class Counter {
+private:
+  struct alignas(64) shard {
+    std::atomic<uint64_t> value;
+  };
+  shard shards[METRICS_SHARDS];
+
+public:
+  Counter();
+  void add(uint64_t n);
+  uint64_t value();
+};
+
+// Gauge: value that can go up and down
+class Gauge {
+private:
+  std::atomic<int64_t> current;
+
+public:
+  Gauge();
+  void set(int64_t value);
+  void add(int64_t n);
+  int64_t value();
+};
+
+// merged counts of a histogram's shards
+struct histogram_snapshot {
+  std::vector<uint64_t> counts;
+  uint64_t count;
+  uint64_t sum;
+
+  // smallest bucket bound below which the given fraction of the values lie
+  uint64_t quantile(double q);
+  uint64_t max();
+};
+
+// Histogram: HDR-style distribution of (non-negative integer) values in log-linear buckets, sharded per thread
+class Histogram {
+private:
+  struct alignas(64) shard {
+    std::atomic<uint64_t> counts[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> sum;
+  };
+  shard* shards;
+
+public:
+  Histogram();
+  ~Histogram();
+  void record(uint64_t value);
+  void snapshot(histogram_snapshot& snapshot_buffer);
+
+  static size_t bucket_index(uint64_t value);
+  static uint64_t bucket_upper_bound(size_t index);
+};
+
+// value of a gauge computed by a collector when the metrics are read (e.g., router occupancy)
+struct metric_sample {
+  std::string name;
+  std::string labels;
+  std::string help;
+  double value;
+};
+
+// MetricsRegistry: named counters, gauges, and histograms of a process
+// metrics are identified by their name and (Prometheus-formatted) labels, e.g. rpc="find_node", and live as long
+// as the registry, so the returned pointers can be kept by the instrumented code
+// collectors add samples of state that is owned elsewhere, and are removed by their owner before it is destroyed
+class MetricsRegistry {
+private:
+  struct metric_info {
+    std::string help;
+    Counter* counter;
+    Gauge* gauge;
+    Histogram* histogram;
+  };
+
+  std::mutex metrics_lock;
+  std::map<std::string, std::map<std::string, metric_info>> metrics;
+  std::mutex collectors_lock;
+  std::vector<std::pair<void*, std::function<void(std::vector<metric_sample>&)>>> collectors;
+
+  metric_info& find(std::string name, std::string labels, std::string help);
+  void collect(std::vector<metric_sample>& samples_buffer);
+
+public:
+  ~MetricsRegistry();
+
+  Counter* counter(std::string name, std::string labels, std::string help);
+  Gauge* gauge(std::string name, std::string labels, std::string help);
+  Histogram* histogram(std::string name, std::string labels, std::string help);
+
+  void add_collector(void* owner, std::function<void(std::vector<metric_sample>&)> collector);
+  void remove_collector(void* owner);
+
+  // all metrics in the Prometheus text exposition format
+  std::string prometheus_text();
+
+  // all metrics with one line per metric (histograms are summarized by their count, mean, and quantiles)
+  std::string summary_text();
+};
+
+// registry of the running process
+MetricsRegistry* metrics();
+
+// microseconds since start (for latency histograms)
+uint64_t elapsed_micros(std::chrono::steady_clock::time_point start);
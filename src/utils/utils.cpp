@@ -1,5 +1,7 @@
 #include "utils.h"
 
+#include <cstdio>
+
 Key random_key() {
   std::random_device rd;
   std::mt19937 gen(rd());
@@ -11,38 +13,75 @@ Key random_key() {
   return key;
 }
 
+// hash through EVP so that OpenSSL can pick the fastest SHA-1 implementation for the CPU (e.g., SHA-NI)
 Key key_from_data(const char* data, size_t size) {
   unsigned char hash[SHA_DIGEST_LENGTH];
-  SHA1(reinterpret_cast<const unsigned char*>(data), size, hash);
+  EVP_Digest(data, size, hash, NULL, EVP_sha1(), NULL);
+  return key_from_bytes(reinterpret_cast<const char*>(hash));
+}
+
+Key key_from_string(std::string s) {
+  return key_from_data(s.c_str(), s.length());
+}
+
+// read a key from its packed (KEYBYTES long) representation
+Key key_from_bytes(const char* bytes) {
   Key key;
-  for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
-    unsigned char byte = hash[i];
+  for (int i = 0; i < KEYBYTES; i++) {
+    unsigned char byte = static_cast<unsigned char>(bytes[i]);
     for (int j = 0; j < 8; j++) {
-      if (byte >> j & 0x1) {
-        key.set(8 * i + j);
-      } else {
-        key.reset(8 * i + j);
-      }
+      key[8 * i + j] = byte >> j & 0x1;
     }
   }
   return key;
 }
 
-Key key_from_string(std::string s) {
-  return key_from_data(s.c_str(), s.length());
+// write the packed (KEYBYTES long) representation of the key to the buffer
+void key_to_bytes(Key k, char* buffer) {
+  for (int i = 0; i < KEYBYTES; i++) {
+    unsigned char byte = 0;
+    for (int j = 0; j < 8; j++) {
+      byte |= k[8 * i + j] << j;
+    }
+    buffer[i] = static_cast<char>(byte);
+  }
 }
 
 std::string hex_string(Key k) {
+  return std::string(key_hex(k).str);
+}
+
+// the (unpadded) hex digits of the key's bytes from its most significant bit on, cut at KEY_HEX_LENGTH
+KeyHex key_hex(Key k) {
+  KeyHex hex;
+  int length = 0;
+  for (int i = KEYBITS - 1; i >= 0 && length < KEY_HEX_LENGTH; i -= 8) {
+    unsigned int byte = 0;
+    for (int j = 0; j < 8; j++) {
+      byte = byte << 1 | k[i - j];
+    }
+    if (byte >= 0x10) {
+      hex.str[length++] = "0123456789abcdef"[byte >> 4];
+    }
+    if (length < KEY_HEX_LENGTH) {
+      hex.str[length++] = "0123456789abcdef"[byte & 0x0f];
+    }
+  }
+  hex.str[length] = '\0';
+  return hex;
+}
+
+// full (2 * KEYBYTES long) hex representation of the packed key
+std::string full_hex_string(Key k) {
+  char bytes[KEYBYTES];
+  key_to_bytes(k, bytes);
   std::string res;
-  std::string bits = k.to_string();
-  for (int i = 0; i < KEYBITS / 8; i++) {
-    std::string byte = bits.substr(8 * i, 8 * (i + 1));
-    std::bitset<8> byte_bitset(byte);
-    std::stringstream byte_hex;
-    byte_hex << std::hex << byte_bitset.to_ulong();
-    res.append(byte_hex.str());
+  for (int i = 0; i < KEYBYTES; i++) {
+    unsigned char byte = static_cast<unsigned char>(bytes[i]);
+    res.push_back("0123456789abcdef"[byte >> 4]);
+    res.push_back("0123456789abcdef"[byte & 0x0f]);
   }
-  return res.substr(0, 6);
+  return res;
 }
 
 const bool Dist::operator < (const Dist& d) const {
@@ -66,3 +105,22 @@ const bool Dist::operator >= (const Dist& d) const {
   }
   return true;
 }
+
+std::string json_string(const std::string& s) {
+  std::string escaped = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped + "\"";
+}
@@ -9,8 +9,10 @@
 #include <sstream>
 #include <fstream>
 #include <openssl/sha.h>
+#include <openssl/evp.h>
 
 #define KEYBITS 160
+#define KEYBYTES (KEYBITS / 8)
 
 //
 // Keys and Distances
@@ -21,7 +23,18 @@ typedef std::bitset<KEYBITS> Key;
 Key random_key();
 Key key_from_data(const char* data, size_t size);
 Key key_from_string(std::string);
+Key key_from_bytes(const char* bytes);
+void key_to_bytes(Key k, char* buffer);
 std::string hex_string(Key k);
+std::string full_hex_string(Key k);
+
+// short hex prefix of a key (as returned by hex_string) in a fixed size buffer, so formatting it does not allocate
+// (e.g., for log messages on hot paths)
+#define KEY_HEX_LENGTH 6
+struct KeyHex {
+  char str[KEY_HEX_LENGTH + 1];
+};
+KeyHex key_hex(Key k);
 
 // represents a distance between two keys
 struct Dist {
@@ -71,31 +84,43 @@ struct StaticDistComparator {
 //
 struct Chunk {
   Chunk(Key key, std::vector<char>* data, bool original_publisher, 
-        std::chrono::time_point<std::chrono::system_clock> original_publish) {
+        std::chrono::time_point<std::chrono::system_clock> original_publish, unsigned int replicas) {
     this->key = key;
     this->data = data;
     this->original_publisher = original_publisher;
     this->original_publish = original_publish;
     this->last_published = std::chrono::system_clock::now();
+    this->replicas = replicas;
+    this->content_addressed = false;
+    this->version = 0;
   }
 
   bool original_publisher;
+  bool content_addressed;
+  // (versioned chunks only replace older versions of the key, unversioned chunks have version 0)
+  uint64_t version;
   Key key;
   std::vector<char>* data;
+  unsigned int replicas;
   std::chrono::time_point<std::chrono::system_clock> last_published;
   std::chrono::time_point<std::chrono::system_clock> original_publish;
 };
 
 
 
+//
+// Strings
+//
+
+// quoted JSON string literal of the string (with quotes, backslashes, and control characters escaped)
+std::string json_string(const std::string& s);
+
 // 
 // Session strain management
 //
-// store metadata (i.e., session system info) to drive client behavior
-// depending on if the session is strained
+// store metadata (i.e., session system info) shared by the sessions of a client
+// (sessions repair the chunks that lost replicas on dead peers themselves)
 struct session_metadata {
   std::mutex meta_lock;
-  std::condition_variable dead_cv;
   unsigned int dead_peers;
-  unsigned int dead_peers_thresh;
 };
@@ -0,0 +1,450 @@
+#include "tests/tests.h"
+
+#include "src/client/client.h"
+#include "src/client/file.h"
+#include "src/client/jobs.h"
+#include "src/client/manifest.h"
+
+#include <spdlog/spdlog.h>
+#include <filesystem>
+#include <fstream>
+#include <atomic>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+std::function<bool()> daemon_ipc(unsigned int num_clients, unsigned int num_requests) {
+  auto fn = [num_clients, num_requests]() {
+    std::filesystem::path socket_path = std::filesystem::path("/tmp") / ("distft_ipc_" + std::to_string(getpid()) + ".sock");
+    int listen_fd = listen_daemon_socket(socket_path.string());
+    if (listen_fd < 0) {
+      spdlog::error("FAILED TO LISTEN ON SOCKET");
+      return false;
+    }
+
+    // echo server (with random delays so that results arrive out of order)
+    std::thread server([listen_fd]() {
+      serve_daemon_socket(listen_fd, [](daemon_request& request, daemon_result& result) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::rand() % 20));
+        result.err = request.cmd;
+        result.err_msg = std::to_string(request.args.size());
+        for (std::string& arg : request.args) {
+          result.succ_msg.append(arg + ",");
+        }
+        return true;
+      });
+    });
+
+    // every client pipelines all of its requests (with more than 255 args each) on a single connection
+    std::mutex correct_lock;
+    unsigned int num_correct = 0;
+    std::vector<std::thread*> threads;
+    for (unsigned int c = 0; c < num_clients; c++) {
+      threads.push_back(new std::thread([&, c]() {
+        int fd = connect_daemon_socket(socket_path.string(), 5);
+        if (fd < 0) {
+          spdlog::error("FAILED TO CONNECT: client={}", c);
+          return;
+        }
+        std::unordered_map<uint32_t, std::string> expected;
+        for (uint32_t id = 0; id < num_requests; id++) {
+          daemon_request request{id, static_cast<char>(id % 6), {}};
+          for (unsigned int i = 0; i < 300 + id; i++) {
+            request.args.push_back(std::to_string(c) + ":" + std::to_string(i));
+            expected[id].append(request.args.back() + ",");
+          }
+          if (!write_request(fd, request)) {
+            spdlog::error("FAILED TO WRITE REQUEST: client={} id={}", c, id);
+            close(fd);
+            return;
+          }
+        }
+        for (uint32_t i = 0; i < num_requests; i++) {
+          daemon_result result;
+          if (!read_result(fd, result)) {
+            spdlog::error("FAILED TO READ RESULT: client={}", c);
+            break;
+          }
+          if (expected.count(result.id) == 0 || result.err != static_cast<char>(result.id % 6)
+              || result.err_msg != std::to_string(300 + result.id) || result.succ_msg != expected[result.id]) {
+            spdlog::error("INCORRECT RESULT: client={} id={}", c, result.id);
+            continue;
+          }
+          expected.erase(result.id);
+          correct_lock.lock();
+          num_correct++;
+          correct_lock.unlock();
+        }
+        close(fd);
+      }));
+    }
+    wait_on_threads(threads);
+
+    // a malformed request (claiming an arg that is missing) is answered with an error instead of left hanging
+    bool malformed_answered = false;
+    int fd = connect_daemon_socket(socket_path.string(), 5);
+    if (fd >= 0) {
+      std::vector<char> frame;
+      put_uint(&frame, 5, 4);
+      put_uint(&frame, 7, 4);
+      frame.push_back(REQUEST_FRAME);
+      frame.push_back(0);
+      put_uint(&frame, 1, 4);
+      daemon_result result;
+      malformed_answered = write(fd, frame.data(), frame.size()) == static_cast<ssize_t>(frame.size())
+                           && read_result(fd, result) && result.id == 7 && result.err;
+      close(fd);
+    }
+    if (!malformed_answered) {
+      spdlog::error("MALFORMED REQUEST NOT ANSWERED WITH AN ERROR");
+    }
+
+    // stop the server
+    shutdown(listen_fd, SHUT_RDWR);
+    server.join();
+    close(listen_fd);
+    std::filesystem::remove(socket_path);
+    return num_correct == num_clients * num_requests && malformed_answered;
+  };
+  return fn;
+}
+
+std::function<bool()> daemon_jobs(unsigned int num_servers, unsigned int num_files, size_t file_size) {
+  auto fn = [num_servers, num_files, file_size]() {
+    bool correct = true;
+
+    // every transfer of a share gets an equal number of operation slots
+    TransferShare share(4);
+    Transfer* a = new Transfer(&share);
+    Transfer* b = new Transfer(&share);
+    a->begin_op();
+    a->begin_op();
+    b->begin_op();
+    b->begin_op();
+    std::atomic<bool> blocked_op_done = false;
+    std::thread blocked_op([a, &blocked_op_done]() {
+      a->begin_op();
+      blocked_op_done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (blocked_op_done) {
+      spdlog::error("TRANSFER EXCEEDED ITS SHARE");
+      correct = false;
+    }
+    a->end_op();
+    blocked_op.join();
+    b->cancel();
+    if (b->begin_op()) {
+      spdlog::error("CANCELLED TRANSFER STARTED OPERATION");
+      correct = false;
+    }
+    for (int i = 0; i < 2; i++) {
+      a->end_op();
+      b->end_op();
+    }
+    delete a;
+    delete b;
+
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // run a store job per file (fewer workers than jobs), plus a job that only stops once it is cancelled
+    JobScheduler scheduler(2, 8);
+    std::vector<uint32_t> ids;
+    std::vector<std::vector<char>> file_data(num_files, std::vector<char>(file_size));
+    for (unsigned int i = 0; i < num_files; i++) {
+      std::filesystem::path file_path = std::filesystem::path("/tmp") / ("job" + std::to_string(i));
+      random_file(file_path, file_size);
+      std::ifstream file(file_path, std::ios::binary);
+      file.read(file_data[i].data(), file_size);
+      Session* s = sessions[std::rand() % num_servers];
+      ids.push_back(scheduler.submit("store " + file_path.string(), [s, file_path, i](Transfer* transfer, std::string& err, std::string& out) {
+        return write_from_file(s, file_path, "job" + std::to_string(i), transfer_options{NULL, transfer});
+      }));
+    }
+    uint32_t endless_id = scheduler.submit("endless", [](Transfer* transfer, std::string& err, std::string& out) {
+      while (transfer->begin_op()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        transfer->end_op();
+      }
+      return false;
+    });
+    uint32_t queued_id = scheduler.submit("queued", [](Transfer* transfer, std::string& err, std::string& out) {
+      return true;
+    });
+    job_status status;
+    if (!scheduler.cancel(queued_id) || !scheduler.status(queued_id, status) || status.state != JOB_CANCELLED) {
+      spdlog::error("FAILED TO CANCEL QUEUED JOB");
+      correct = false;
+    }
+    while (scheduler.status(endless_id, status) && status.state != JOB_RUNNING) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (!scheduler.cancel(endless_id) || !scheduler.wait(endless_id, status) || status.state != JOB_CANCELLED) {
+      spdlog::error("FAILED TO CANCEL RUNNING JOB");
+      correct = false;
+    }
+
+    // all stores finish and their files can be read back
+    for (unsigned int i = 0; i < num_files; i++) {
+      if (!scheduler.wait(ids[i], status) || status.state != JOB_DONE) {
+        spdlog::error("STORE JOB FAILED: job={} state={}", ids[i], job_state_string(status.state));
+        correct = false;
+        continue;
+      }
+      std::vector<char>* data;
+      if (!read_in_files(sessions[std::rand() % num_servers], std::vector<std::string>{"job" + std::to_string(i)}, &data)) {
+        spdlog::error("FAILED TO READ STORED FILE: job={}", ids[i]);
+        correct = false;
+        continue;
+      }
+      if (*data != file_data[i]) {
+        spdlog::error("STORED FILE HAS INCORRECT DATA: job={}", ids[i]);
+        correct = false;
+      }
+      delete data;
+    }
+    std::vector<job_status> statuses;
+    scheduler.statuses(statuses);
+    if (statuses.size() != num_files + 2) {
+      spdlog::error("INCORRECT NUMBER OF JOBS: expected={} actual={}", num_files + 2, statuses.size());
+      correct = false;
+    }
+    scheduler.shutdown();
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    for (unsigned int i = 0; i < num_files; i++) {
+      std::filesystem::remove(std::filesystem::path("/tmp") / ("job" + std::to_string(i)));
+    }
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> daemon_progress_events(unsigned int num_servers, size_t file_size, unsigned int num_events) {
+  auto fn = [num_servers, file_size, num_events]() {
+    bool correct = true;
+
+    // progress events of a request arrive (in order) before its result
+    std::filesystem::path socket_path = std::filesystem::path("/tmp") / ("distft_progress_" + std::to_string(getpid()) + ".sock");
+    int listen_fd = listen_daemon_socket(socket_path.string());
+    if (listen_fd < 0) {
+      spdlog::error("FAILED TO LISTEN ON SOCKET");
+      return false;
+    }
+    std::thread server([listen_fd, num_events]() {
+      serve_daemon_socket(listen_fd, [num_events](daemon_request& request, daemon_result& result) {
+        for (unsigned int i = 1; i <= num_events; i++) {
+          daemon_progress progress{request.id, i, num_events, i * 1000ul, num_events * 1000ul, 1000, i % 4, i / 2};
+          request.progress(progress);
+        }
+        result.err = 0;
+        result.succ_msg = "done";
+        return true;
+      });
+    });
+    int fd = connect_daemon_socket(socket_path.string(), 5);
+    daemon_request request{7, LOAD, {}, NULL};
+    daemon_result result;
+    unsigned int num_received = 0;
+    bool read = fd >= 0 && write_request(fd, request) && read_result(fd, result, [&](daemon_progress& progress) {
+      num_received++;
+      if (progress.id != 7 || progress.chunks_done != num_received || progress.bytes_done != num_received * 1000ul
+          || progress.chunks_total != num_events || progress.in_flight != num_received % 4 || progress.retries != num_received / 2) {
+        spdlog::error("INCORRECT PROGRESS EVENT: event={} chunks={}", num_received, progress.chunks_done);
+        correct = false;
+      }
+    });
+    if (!read || result.id != 7 || result.succ_msg != "done" || num_received != num_events) {
+      spdlog::error("FAILED TO READ PROGRESS AND RESULT: received={}", num_received);
+      correct = false;
+    }
+    close(fd);
+    shutdown(listen_fd, SHUT_RDWR);
+    server.join();
+    close(listen_fd);
+    std::filesystem::remove(socket_path);
+
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // a finished store/load has completed all of the chunks and bytes it expected
+    std::filesystem::path file_path = std::filesystem::path("/tmp") / "progress";
+    std::filesystem::path output_path = std::filesystem::path("/tmp") / "progress_out";
+    random_file(file_path, file_size);
+    Transfer store_transfer(NULL);
+    Transfer load_transfer(NULL);
+    transfer_progress progress;
+    if (!write_from_file(sessions[std::rand() % num_servers], file_path, "progress", transfer_options{NULL, &store_transfer})) {
+      spdlog::error("FAILED TO STORE FILE");
+      correct = false;
+    }
+    store_transfer.progress(progress);
+    if (progress.bytes_done != file_size || progress.bytes_total != file_size || progress.chunks_done != progress.chunks_total
+        || progress.chunks_total == 0 || progress.in_flight != 0) {
+      spdlog::error("INCORRECT STORE PROGRESS: bytes={}/{} chunks={}/{}", progress.bytes_done, progress.bytes_total,
+                      progress.chunks_done, progress.chunks_total);
+      correct = false;
+    }
+    if (!read_to_file(sessions[std::rand() % num_servers], std::vector<std::string>{"progress"}, output_path, transfer_options{NULL, &load_transfer})) {
+      spdlog::error("FAILED TO LOAD FILE");
+      correct = false;
+    }
+    load_transfer.progress(progress);
+    if (progress.bytes_done != file_size || progress.bytes_total != file_size || progress.chunks_done != progress.chunks_total
+        || progress.chunks_total == 0 || progress.in_flight != 0) {
+      spdlog::error("INCORRECT LOAD PROGRESS: bytes={}/{} chunks={}/{}", progress.bytes_done, progress.bytes_total,
+                      progress.chunks_done, progress.chunks_total);
+      correct = false;
+    }
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    std::remove(file_path.c_str());
+    std::remove(output_path.c_str());
+    return correct;
+  };
+  return fn;
+}
+
+// read a pipe until all of its writers are closed
+static void read_pipe(int fd, std::vector<char>& data_buffer) {
+  char buffer[65536];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+    data_buffer.insert(data_buffer.end(), buffer, buffer + n);
+  }
+}
+
+std::function<bool()> daemon_fd_passing(unsigned int num_servers, size_t file_size) {
+  auto fn = [num_servers, file_size]() {
+    bool correct = true;
+    std::filesystem::path file_path = std::filesystem::path("/tmp") / "fd_passing";
+    random_file(file_path, file_size);
+    std::vector<char> file_data(file_size);
+    std::ifstream file(file_path, std::ios::binary);
+    file.read(file_data.data(), file_size);
+
+    // the daemon copies the passed file into the passed pipe, and closes both once the request is answered
+    std::filesystem::path socket_path = std::filesystem::path("/tmp") / ("distft_fds_" + std::to_string(getpid()) + ".sock");
+    int listen_fd = listen_daemon_socket(socket_path.string());
+    if (listen_fd < 0) {
+      spdlog::error("FAILED TO LISTEN ON SOCKET");
+      return false;
+    }
+    std::thread server([listen_fd]() {
+      serve_daemon_socket(listen_fd, [](daemon_request& request, daemon_result& result) {
+        char buffer[65536];
+        ssize_t n = 0;
+        while (request.fds.size() == 2 && (n = read(request.fds[0], buffer, sizeof(buffer))) > 0 && write_fd(request.fds[1], buffer, n)) {
+        }
+        result.err = static_cast<char>(n != 0);
+        return true;
+      });
+    });
+    int pipe_fds[2];
+    int fd = connect_daemon_socket(socket_path.string(), 5);
+    int file_fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0 || file_fd < 0 || pipe(pipe_fds) != 0) {
+      spdlog::error("FAILED TO OPEN FILES");
+      return false;
+    }
+    std::vector<char> piped_data;
+    std::thread reader(read_pipe, pipe_fds[0], std::ref(piped_data));
+    daemon_request request{3, LOAD, {}, NULL, {file_fd, pipe_fds[1]}};
+    daemon_result result;
+    bool read = write_request(fd, request) && read_result(fd, result);
+    close(file_fd);
+    close(pipe_fds[1]);
+    reader.join();
+    close(pipe_fds[0]);
+    if (!read || result.err != 0 || piped_data != file_data) {
+      spdlog::error("INCORRECT DATA THROUGH PASSED FILES: bytes={}", piped_data.size());
+      correct = false;
+    }
+    close(fd);
+    shutdown(listen_fd, SHUT_RDWR);
+    server.join();
+    close(listen_fd);
+    std::filesystem::remove(socket_path);
+
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // store from an open file and stream the (replicated and erasure coded) file into a pipe
+    for (unsigned int k : {0u, 4u}) {
+      std::string dht_filename = "fd_passing" + std::to_string(k);
+      file_fd = open(file_path.c_str(), O_RDONLY);
+      transfer_options file_options{NULL, NULL, file_fd};
+      bool stored = k > 0 ? write_from_file_erasure(sessions[std::rand() % num_servers], file_path, dht_filename, k, 2, file_options)
+                          : write_from_file(sessions[std::rand() % num_servers], file_path, dht_filename, file_options);
+      close(file_fd);
+      if (!stored) {
+        spdlog::error("FAILED TO STORE FROM FILE DESCRIPTOR: k={}", k);
+        correct = false;
+        continue;
+      }
+      if (pipe(pipe_fds) != 0) {
+        spdlog::error("FAILED TO OPEN PIPE");
+        correct = false;
+        continue;
+      }
+      piped_data.clear();
+      std::thread reader(read_pipe, pipe_fds[0], std::ref(piped_data));
+      bool loaded = read_to_file(sessions[std::rand() % num_servers], std::vector<std::string>{dht_filename, dht_filename}, "",
+                                 transfer_options{NULL, NULL, pipe_fds[1]});
+      close(pipe_fds[1]);
+      reader.join();
+      close(pipe_fds[0]);
+      std::vector<char> expected = file_data;
+      expected.insert(expected.end(), file_data.begin(), file_data.end());
+      if (!loaded || piped_data != expected) {
+        spdlog::error("INCORRECT DATA STREAMED TO PIPE: k={} bytes={}", k, piped_data.size());
+        correct = false;
+      }
+    }
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    std::remove(file_path.c_str());
+    return correct;
+  };
+  return fn;
+}
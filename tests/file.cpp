@@ -1,11 +1,14 @@
 #include "tests/tests.h"
 
+#include "src/client/erasure.h"
 #include "src/client/file.h"
+#include "src/client/manifest.h"
 #include "src/dht/session.h"
 
 #include <spdlog/spdlog.h>
 #include <fstream>
 #include <filesystem>
+#include <atomic>
 
 std::function<bool()> server_static_files(unsigned int num_servers, unsigned int num_files, size_t file_size, 
                                           unsigned int found_tol, unsigned int corr_tol) {
@@ -27,7 +30,7 @@ std::function<bool()> server_static_files(unsigned int num_servers, unsigned int
       test_files.push_back(std::to_string(i));
     }
     init_index_file(sessions[std::rand() % num_servers]);
-    add_files_to_index_file(sessions[std::rand() % num_servers], test_files);
+    add_files_to_index_file(sessions[std::rand() % num_servers], test_files, NULL);
     for (int i = 0; i < num_files; i++) {
       random_file(base_path / std::to_string(i), file_size);
       write_from_file(sessions[std::rand() % num_servers], base_path / std::to_string(i), std::to_string(i));
@@ -88,7 +91,7 @@ std::function<bool()> server_dynamic_files(unsigned int num_servers, unsigned in
       test_files.push_back(std::to_string(i));
     }
     init_index_file(sessions[std::rand() % num_servers]);
-    add_files_to_index_file(sessions[std::rand() % num_servers], test_files);
+    add_files_to_index_file(sessions[std::rand() % num_servers], test_files, NULL);
     for (int i = 0; i < num_files; i++) {
       threads.push_back(new std::thread([base_path, i, file_size, num_servers, &sessions]() {
         random_file(base_path / std::to_string(i), file_size);
@@ -138,4 +141,792 @@ std::function<bool()> server_dynamic_files(unsigned int num_servers, unsigned in
     return (num_found >= num_files - found_tol) && (num_correct >= num_found - corr_tol);
   };
   return fn;
-}
\ No newline at end of file
+}
+
+std::function<bool()> erasure_codec(unsigned int k, unsigned int m, size_t fragment_size) {
+  auto fn = [k, m, fragment_size]() {
+    // encode random data fragments
+    ErasureCoder coder(k, m);
+    std::vector<std::vector<char>*> data_fragments;
+    for (int i = 0; i < k; i++) {
+      data_fragments.push_back(random_chunk(fragment_size)->data);
+    }
+    std::vector<std::vector<char>*> fragments(data_fragments.begin(), data_fragments.end());
+    std::vector<std::vector<char>*> parity;
+    coder.encode(data_fragments, parity);
+    fragments.insert(fragments.end(), parity.begin(), parity.end());
+
+    // drop m random fragments and recover the data fragments
+    std::vector<std::vector<char>*> received(fragments.begin(), fragments.end());
+    for (int dropped = 0; dropped < m;) {
+      unsigned int i = std::rand() % (k + m);
+      if (received[i] != NULL) {
+        received[i] = NULL;
+        dropped++;
+      }
+    }
+    if (!coder.decode(received)) {
+      spdlog::error("FAILED TO DECODE STRIPE: k={} m={}", k, m);
+      return false;
+    }
+    bool correct = true;
+    for (int i = 0; i < k; i++) {
+      if (*received[i] != *data_fragments[i]) {
+        spdlog::error("INCORRECT FRAGMENT AFTER DECODE: fragment={}", i);
+        correct = false;
+      }
+      if (received[i] != fragments[i]) {
+        delete received[i];
+      }
+    }
+    for (std::vector<char>* fragment : fragments) {
+      delete fragment;
+    }
+
+    // fewer than k fragments cannot be decoded
+    std::vector<std::vector<char>*> too_few(k + m, NULL);
+    return correct && !coder.decode(too_few);
+  };
+  return fn;
+}
+
+std::function<bool()> server_erasure_files(unsigned int num_servers, unsigned int num_files, size_t file_size, 
+                                            unsigned int k, unsigned int m, unsigned int found_tol, unsigned int corr_tol) {
+  
+  auto fn = [num_servers, num_files, file_size, k, m, found_tol, corr_tol]() {
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // create random files and add erasure coded files to cluster
+    std::filesystem::path base_path("/tmp");
+    std::vector<std::string> test_files;
+    for (int i = 0; i < num_files; i++) {
+      test_files.push_back(std::to_string(i));
+    }
+    init_index_file(sessions[std::rand() % num_servers]);
+    add_files_to_index_file(sessions[std::rand() % num_servers], test_files, NULL);
+    for (int i = 0; i < num_files; i++) {
+      random_file(base_path / std::to_string(i), file_size);
+      write_from_file_erasure(sessions[std::rand() % num_servers], base_path / std::to_string(i), std::to_string(i), k, m);
+    }
+
+    // check cluster for files and compare to base file
+    std::vector<std::vector<char>*> buffs;
+    for (int i = 0; i < num_files; i++) {
+      std::ifstream file(base_path / std::to_string(i), std::ios::binary);
+      std::vector<char>* buff = new std::vector<char>(file_size);
+      file.read(buff->data(), file_size);
+      buffs.push_back(buff);
+    }
+    std::mutex data_lock;
+    unsigned int num_found = 0;
+    unsigned int num_correct = 0;
+    for (int i = 0; i < num_files; i++) {
+      threads.push_back(new std::thread(verify_file, sessions[std::rand() % num_servers], buffs[i], std::to_string(i),
+                        std::ref(data_lock), std::ref(num_found), std::ref(num_correct)));
+    }
+    wait_on_threads(threads);
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    for (int i = 0; i < num_files; i++) {
+      delete buffs[i];
+      std::remove((base_path / std::to_string(i)).c_str());
+    }
+
+    return (num_found >= num_files - found_tol) && (num_correct >= num_found - corr_tol);
+  };
+  return fn;
+}
+
+std::function<bool()> manifest_tree(unsigned int num_servers, unsigned int num_entries, size_t max_node_size) {
+  auto fn = [num_servers, num_entries, max_node_size]() {
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // publish a manifest with random chunk entries (split into a multi-level tree)
+    Manifest manifest;
+    manifest.mode = REPLICATED;
+    manifest.level = 0;
+    manifest.erasure_k = 0;
+    manifest.erasure_m = 0;
+    uint64_t offset = 0;
+    for (int i = 0; i < num_entries; i++) {
+      uint64_t length = std::rand() % 0xFFFF + 1;
+      manifest.entries.push_back(ManifestEntry{offset, length, {random_key()}});
+      offset += length;
+    }
+    manifest.total_size = offset;
+    Key root_key = key_from_string("manifest");
+    bool correct = true;
+    if (!publish_manifest(sessions[std::rand() % num_servers], root_key, manifest, max_node_size)) {
+      spdlog::error("MANIFEST NOT PUBLISHED");
+      correct = false;
+    }
+
+    // the root node must fit in a single node and the flattened tree must match the original entries
+    Manifest root;
+    if (!fetch_manifest_node(sessions[std::rand() % num_servers], root_key, root)) {
+      spdlog::error("MANIFEST ROOT NOT FOUND");
+      correct = false;
+    } else if (MANIFEST_HEADER_SIZE + root.entries.size() * root.entry_size() > max_node_size) {
+      spdlog::error("MANIFEST ROOT TOO LARGE: ENTRIES={}", root.entries.size());
+      correct = false;
+    }
+    Manifest fetched;
+    if (!fetch_manifest(sessions[std::rand() % num_servers], root_key, fetched)) {
+      spdlog::error("MANIFEST TREE NOT FOUND");
+      correct = false;
+    } else if (fetched.total_size != manifest.total_size || fetched.entries.size() != manifest.entries.size()) {
+      spdlog::error("MANIFEST HAS INCORRECT SIZE: expected={} actual={}", manifest.entries.size(), fetched.entries.size());
+      correct = false;
+    } else {
+      for (int i = 0; i < num_entries; i++) {
+        if (fetched.entries[i].offset != manifest.entries[i].offset || fetched.entries[i].length != manifest.entries[i].length
+            || fetched.entries[i].keys != manifest.entries[i].keys) {
+          spdlog::error("MANIFEST HAS INCORRECT ENTRY: entry={}", i);
+          correct = false;
+          break;
+        }
+      }
+    }
+
+    // nodes with an unknown storage mode are rejected
+    std::vector<char> corrupted_node;
+    serialize_manifest(manifest, &corrupted_node);
+    corrupted_node[5] = 7;
+    Manifest corrupted;
+    if (deserialize_manifest(&corrupted_node, corrupted)) {
+      spdlog::error("MANIFEST WITH UNKNOWN MODE DESERIALIZED");
+      correct = false;
+    }
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> index_pages(unsigned int num_servers, unsigned int num_files, unsigned int batch_size) {
+  auto fn = [num_servers, num_files, batch_size]() {
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // add files to the index in concurrent batches from different sessions, as separate clients would (the
+    // conflicting page updates are merged, and index pages are split once they are full)
+    init_index_file(sessions[std::rand() % num_servers]);
+    std::vector<std::string> test_files;
+    std::vector<char> batch_added((num_files + batch_size - 1) / batch_size, false);
+    for (int i = 0; i < num_files; i += batch_size) {
+      std::vector<std::string> batch;
+      for (int j = i; j < i + batch_size && j < num_files; j++) {
+        batch.push_back("file" + std::to_string(j));
+      }
+      test_files.insert(test_files.end(), batch.begin(), batch.end());
+      threads.push_back(new std::thread([&sessions, &batch_added, num_servers, batch](size_t idx) {
+        batch_added[idx] = add_files_to_index_file(sessions[idx % num_servers], batch, NULL);
+      }, i / batch_size));
+    }
+    wait_on_threads(threads);
+
+    // all files (and only those files) are found, listed, and listed exactly once across pages
+    bool correct = true;
+    if (std::find(batch_added.begin(), batch_added.end(), false) != batch_added.end()) {
+      spdlog::error("FAILED TO ADD FILES TO INDEX");
+      correct = false;
+    }
+    for (int i = 0; i < num_files; i += std::max(1u, num_files / 100)) {
+      if (!file_exists(sessions[std::rand() % num_servers], test_files[i])) {
+        spdlog::error("FILE NOT FOUND IN INDEX: file={}", test_files[i]);
+        correct = false;
+      }
+    }
+    if (file_exists(sessions[std::rand() % num_servers], "missing")) {
+      spdlog::error("MISSING FILE FOUND IN INDEX");
+      correct = false;
+    }
+    std::vector<std::string> listed_files;
+    if (!get_index_files(sessions[std::rand() % num_servers], listed_files)) {
+      spdlog::error("FAILED TO LIST INDEX");
+      correct = false;
+    }
+    std::sort(listed_files.begin(), listed_files.end());
+    std::sort(test_files.begin(), test_files.end());
+    if (listed_files != test_files) {
+      spdlog::error("INDEX HAS INCORRECT FILES: expected={} actual={}", test_files.size(), listed_files.size());
+      correct = false;
+    }
+    std::vector<std::string> paged_files;
+    std::string cursor;
+    unsigned int pages = 0;
+    do {
+      if (!get_index_page(sessions[std::rand() % num_servers], cursor, paged_files, cursor)) {
+        spdlog::error("FAILED TO LIST INDEX PAGE: page={}", pages);
+        correct = false;
+        break;
+      }
+      pages++;
+    } while (!cursor.empty());
+    std::sort(paged_files.begin(), paged_files.end());
+    if (paged_files != test_files || (num_files > INDEX_PAGE_MAX_FILES && pages == 1)) {
+      spdlog::error("INDEX PAGES HAVE INCORRECT FILES: expected={} actual={} pages={}", test_files.size(), paged_files.size(), pages);
+      correct = false;
+    }
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> index_cache(unsigned int num_servers, unsigned int num_files) {
+  auto fn = [num_servers, num_files]() {
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // add half of the files through the cache (writing the touched pages through)
+    IndexCache cache(std::chrono::seconds(INDEX_CACHE_TTL));
+    init_index_file(sessions[std::rand() % num_servers]);
+    std::vector<std::string> added_files;
+    std::vector<std::string> test_files;
+    for (int i = 0; i < num_files; i++) {
+      test_files.push_back("file" + std::to_string(i));
+      if (i % 2 == 0) {
+        added_files.push_back(test_files.back());
+      }
+    }
+    add_files_to_index_file(sessions[std::rand() % num_servers], added_files, &cache);
+
+    // batched checks find exactly the added files
+    bool correct = true;
+    for (int round = 0; round < 2; round++) {
+      std::unordered_set<std::string> existing_files;
+      unsigned long misses = cache.misses();
+      if (!files_exist(sessions[std::rand() % num_servers], test_files, existing_files, &cache)) {
+        spdlog::error("FAILED TO CHECK INDEX: round={}", round);
+        correct = false;
+        continue;
+      }
+      if (existing_files != std::unordered_set<std::string>(added_files.begin(), added_files.end())) {
+        spdlog::error("INDEX CHECK HAS INCORRECT FILES: round={} expected={} actual={}", round, added_files.size(), existing_files.size());
+        correct = false;
+      }
+      if (cache.misses() != misses) {
+        spdlog::error("INDEX CHECK MISSED CACHE: round={} misses={}", round, cache.misses() - misses);
+        correct = false;
+      }
+    }
+
+    // pages are re-fetched once the cache is invalidated
+    cache.invalidate();
+    std::unordered_set<std::string> existing_files;
+    if (!files_exist(sessions[std::rand() % num_servers], test_files, existing_files, &cache)
+        || existing_files.size() != added_files.size() || cache.misses() == 0) {
+      spdlog::error("INDEX CHECK FAILED AFTER INVALIDATION: actual={} misses={}", existing_files.size(), cache.misses());
+      correct = false;
+    }
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> file_reader_ranges(unsigned int num_servers, size_t file_size, unsigned int num_reads, unsigned int erasure_k) {
+  auto fn = [num_servers, file_size, num_reads, erasure_k]() {
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // create and store a random file
+    std::filesystem::path file_path = std::filesystem::path("/tmp") / "ranged";
+    random_file(file_path, file_size);
+    std::ifstream file(file_path, std::ios::binary);
+    std::vector<char> file_data(file_size);
+    file.read(file_data.data(), file_size);
+    if (erasure_k > 0) {
+      write_from_file_erasure(sessions[std::rand() % num_servers], file_path, "ranged", erasure_k, 2);
+    } else {
+      write_from_file(sessions[std::rand() % num_servers], file_path, "ranged");
+    }
+
+    // random ranges (including ranges past the end of the file) match the file
+    bool correct = true;
+    FileReader reader(sessions[std::rand() % num_servers], "ranged");
+    if (!reader.open() || reader.size() != file_size) {
+      spdlog::error("FAILED TO OPEN FILE READER: size={}", reader.size());
+      correct = false;
+    }
+    std::vector<char> buffer;
+    for (int i = 0; i < num_reads && correct; i++) {
+      uint64_t offset = std::rand() % (file_size + 10);
+      uint64_t length = 1 + std::rand() % (file_size / 4 + 1);
+      uint64_t expected_length = offset >= file_size ? 0 : std::min(length, file_size - offset);
+      if (!reader.read(offset, length, buffer) || buffer.size() != expected_length
+          || !std::equal(buffer.begin(), buffer.end(), file_data.begin() + std::min(offset, static_cast<uint64_t>(file_size)))) {
+        spdlog::error("RANGE HAS INCORRECT DATA: offset={} length={} actual={}", offset, length, buffer.size());
+        correct = false;
+      }
+    }
+
+    // a sequential scan in small blocks reassembles the file
+    std::vector<char> scanned;
+    for (uint64_t offset = 0; offset < file_size && correct; offset += 65536) {
+      if (!reader.read(offset, 65536, buffer)) {
+        spdlog::error("FAILED TO READ BLOCK: offset={}", offset);
+        correct = false;
+      }
+      scanned.insert(scanned.end(), buffer.begin(), buffer.end());
+    }
+    if (correct && scanned != file_data) {
+      spdlog::error("SEQUENTIAL SCAN HAS INCORRECT DATA: expected={} actual={}", file_size, scanned.size());
+      correct = false;
+    }
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    std::remove(file_path.c_str());
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> resumable_transfers(unsigned int num_servers, size_t file_size) {
+  auto fn = [num_servers, file_size]() {
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // store a random file with a journal, then repeat the store (which only reuses the journal)
+    std::filesystem::path base_path("/tmp");
+    std::filesystem::path file_path = base_path / "resumable";
+    std::filesystem::path output_path = base_path / "resumable_out";
+    std::filesystem::path store_journal_path = base_path / "journals" / "store";
+    std::filesystem::path load_journal_path = base_path / "journals" / "load";
+    random_file(file_path, file_size);
+    std::ifstream file(file_path, std::ios::binary);
+    std::vector<char> file_data(file_size);
+    file.read(file_data.data(), file_size);
+    bool correct = true;
+    Journal store_journal(store_journal_path);
+    write_from_file(sessions[std::rand() % num_servers], file_path, "resumable", transfer_options{&store_journal});
+    uintmax_t journal_size = std::filesystem::file_size(store_journal_path);
+    write_from_file(sessions[std::rand() % num_servers], file_path, "resumable", transfer_options{&store_journal});
+    if (std::filesystem::file_size(store_journal_path) != journal_size || store_journal.num_completed() == 0) {
+      spdlog::error("REPEATED STORE DID NOT RESUME: completed={}", store_journal.num_completed());
+      correct = false;
+    }
+    store_journal.finish();
+
+    // load the file with a journal and cut its last record short (as if the load was interrupted)
+    Journal load_journal(load_journal_path);
+    if (!read_to_file(sessions[std::rand() % num_servers], std::vector<std::string>{"resumable"}, output_path, transfer_options{&load_journal})) {
+      spdlog::error("FAILED TO LOAD FILE");
+      correct = false;
+    }
+    unsigned long num_entries = load_journal.num_completed();
+    std::filesystem::resize_file(load_journal_path, std::filesystem::file_size(load_journal_path) - 10);
+
+    // zero the output file: only the entry whose record was lost is fetched again
+    std::vector<char> zeros(file_size, 0);
+    {
+      std::fstream output(output_path, std::ios::in | std::ios::out | std::ios::binary);
+      output.write(zeros.data(), zeros.size());
+    }
+    if (!read_to_file(sessions[std::rand() % num_servers], std::vector<std::string>{"resumable"}, output_path, transfer_options{&load_journal})) {
+      spdlog::error("FAILED TO RESUME LOAD");
+      correct = false;
+    }
+    std::ifstream output(output_path, std::ios::binary);
+    std::vector<char> output_data(file_size);
+    output.read(output_data.data(), file_size);
+    uint64_t restored = 0;
+    for (size_t i = 0; i < file_size; i++) {
+      if (output_data[i] == file_data[i] && file_data[i] != 0) {
+        restored++;
+      }
+    }
+    if (load_journal.num_completed() != num_entries || restored == 0 || restored > 1048576) {
+      spdlog::error("RESUMED LOAD FETCHED INCORRECT ENTRIES: entries={} completed={} restored={}", num_entries,
+                      load_journal.num_completed(), restored);
+      correct = false;
+    }
+    load_journal.finish();
+
+    // a load without a journal record rewrites the whole file
+    Journal fresh_journal(load_journal_path);
+    if (!read_to_file(sessions[std::rand() % num_servers], std::vector<std::string>{"resumable"}, output_path, transfer_options{&fresh_journal})) {
+      spdlog::error("FAILED TO RELOAD FILE");
+      correct = false;
+    }
+    std::ifstream reloaded(output_path, std::ios::binary);
+    reloaded.read(output_data.data(), file_size);
+    if (output_data != file_data) {
+      spdlog::error("RELOADED FILE HAS INCORRECT DATA");
+      correct = false;
+    }
+    fresh_journal.finish();
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    std::remove(file_path.c_str());
+    std::remove(output_path.c_str());
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> chunk_cache(unsigned int num_servers, size_t file_size, uint64_t capacity) {
+  auto fn = [num_servers, file_size, capacity]() {
+    // setup cluster (with a chunk cache on the first session)
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+    std::filesystem::path cache_path = std::filesystem::path("/tmp") / "chunk_cache";
+    std::filesystem::remove_all(cache_path);
+    ChunkCache* cache = new ChunkCache(cache_path, capacity);
+    sessions[0]->set_cache(cache);
+
+    // store a random file from another session (erasure coded, so most fragments are not held by the first session)
+    std::filesystem::path file_path = std::filesystem::path("/tmp") / "cached";
+    random_file(file_path, file_size);
+    std::ifstream file(file_path, std::ios::binary);
+    std::vector<char>* file_data = new std::vector<char>(file_size);
+    file.read(file_data->data(), file_size);
+    write_from_file_erasure(sessions[1 + std::rand() % (num_servers - 1)], file_path, "cached", 4, 2);
+
+    // the first load fills the cache and repeated loads are served from it
+    bool correct = true;
+    for (int round = 0; round < 3; round++) {
+      unsigned long hits = cache->hits();
+      std::vector<char>* buff;
+      if (!read_in_files(sessions[0], std::vector<std::string>{"cached"}, &buff)) {
+        spdlog::error("FAILED TO LOAD FILE: round={}", round);
+        correct = false;
+        continue;
+      }
+      if (*buff != *file_data) {
+        spdlog::error("LOADED FILE HAS INCORRECT DATA: round={}", round);
+        correct = false;
+      }
+      delete buff;
+      if (round > 0 && cache->hits() == hits) {
+        spdlog::error("REPEATED LOAD MISSED CACHE: round={} hits={} misses={}", round, cache->hits(), cache->misses());
+        correct = false;
+      }
+    }
+    if (cache->size() > capacity) {
+      spdlog::error("CACHE EXCEEDED CAPACITY: size={} capacity={}", cache->size(), capacity);
+      correct = false;
+    }
+
+    // a reopened cache indexes the chunks already on disk
+    uint64_t cache_size = cache->size();
+    sessions[0]->set_cache(NULL);
+    delete cache;
+    cache = new ChunkCache(cache_path, capacity);
+    if (cache->size() != cache_size) {
+      spdlog::error("REOPENED CACHE HAS INCORRECT SIZE: expected={} actual={}", cache_size, cache->size());
+      correct = false;
+    }
+
+    // caches sharing the directory leave chunks still being written alone and only remove abandoned ones
+    std::filesystem::path writing_path = cache_path / "tmp" / (full_hex_string(random_key()) + ".0");
+    std::filesystem::path abandoned_path = cache_path / "tmp" / (full_hex_string(random_key()) + ".1");
+    std::ofstream(writing_path) << "writing";
+    std::ofstream(abandoned_path) << "abandoned";
+    std::filesystem::last_write_time(abandoned_path, std::filesystem::file_time_type::clock::now() - std::chrono::seconds(2 * CHUNK_CACHE_STALE_TMP));
+    ChunkCache* shared_cache = new ChunkCache(cache_path, capacity);
+    if (!std::filesystem::exists(writing_path) || std::filesystem::exists(abandoned_path)) {
+      spdlog::error("SHARED CACHE REMOVED INCORRECT TEMPORARY FILES");
+      correct = false;
+    }
+
+    // chunks put by one cache count towards the capacity of the others
+    std::vector<char>* extra = new std::vector<char>(capacity / 2 + 1);
+    std::generate(extra->begin(), extra->end(), std::rand);
+    shared_cache->put(key_from_data(extra->data(), extra->size()), extra);
+    delete extra;
+    extra = new std::vector<char>(capacity / 2 + 1);
+    std::generate(extra->begin(), extra->end(), std::rand);
+    cache->put(key_from_data(extra->data(), extra->size()), extra);
+    delete extra;
+    uint64_t dir_size = 0;
+    for (auto& dir_entry : std::filesystem::directory_iterator(cache_path)) {
+      if (dir_entry.is_regular_file()) {
+        dir_size += dir_entry.file_size();
+      }
+    }
+    if (dir_size > capacity) {
+      spdlog::error("SHARED CACHES EXCEEDED CAPACITY: size={} capacity={}", dir_size, capacity);
+      correct = false;
+    }
+    delete shared_cache;
+    delete cache;
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    delete file_data;
+    std::remove(file_path.c_str());
+    std::filesystem::remove_all(cache_path);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> multi_file_load(unsigned int num_servers, unsigned int num_files, size_t max_file_size) {
+  auto fn = [num_servers, num_files, max_file_size]() {
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // store random files of different sizes
+    std::filesystem::path base_path("/tmp");
+    std::vector<std::string> test_files;
+    std::vector<char> expected_data;
+    for (int i = 0; i < num_files; i++) {
+      std::string name = "multi" + std::to_string(i);
+      size_t file_size = 1 + std::rand() % max_file_size;
+      random_file(base_path / name, file_size);
+      std::ifstream file(base_path / name, std::ios::binary);
+      std::vector<char> file_data(file_size);
+      file.read(file_data.data(), file_size);
+      expected_data.insert(expected_data.end(), file_data.begin(), file_data.end());
+      write_from_file(sessions[std::rand() % num_servers], base_path / name, name);
+      test_files.push_back(name);
+    }
+
+    // concatenated loads (into memory and into an output file) match the files
+    bool correct = true;
+    std::vector<char>* buff;
+    if (!read_in_files(sessions[std::rand() % num_servers], test_files, &buff) || *buff != expected_data) {
+      spdlog::error("MULTI-FILE LOAD HAS INCORRECT DATA");
+      correct = false;
+    } else {
+      delete buff;
+    }
+    std::filesystem::path output_path = base_path / "multi_out";
+    Journal journal(base_path / "journals" / "multi");
+    std::ofstream { output_path } << std::string(max_file_size * num_files + 100, 'x');
+
+    // the fetches of the load run on the executor, so the process's threads grow with the files (each file runs on a
+    // thread of its own) and the cores, not with the holders of every fetched batch
+    unsigned int threads_before = process_threads();
+    std::atomic<bool> loading(true);
+    std::atomic<unsigned int> max_threads(threads_before);
+    std::thread sampler([&loading, &max_threads]() {
+      while (loading) {
+        max_threads = std::max(max_threads.load(), process_threads());
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    });
+    if (!read_to_file(sessions[std::rand() % num_servers], test_files, output_path, transfer_options{&journal})) {
+      spdlog::error("FAILED MULTI-FILE LOAD INTO FILE");
+      correct = false;
+    }
+    loading = false;
+    sampler.join();
+    journal.finish();
+    spdlog::info("PROCESS THREADS DURING LOAD: before={} max={} files={} executor={}", threads_before, max_threads.load(),
+                 num_files, executor()->num_threads());
+    if (max_threads > threads_before + 1 + num_files + 2 * executor()->num_threads() + 2 * num_servers) {
+      spdlog::error("TOO MANY THREADS DURING MULTI-FILE LOAD: before={} max={}", threads_before, max_threads.load());
+      correct = false;
+    }
+    std::ifstream output(output_path, std::ios::binary);
+    std::vector<char> output_data((std::istreambuf_iterator<char>(output)), std::istreambuf_iterator<char>());
+    if (output_data != expected_data) {
+      spdlog::error("MULTI-FILE LOAD INTO FILE HAS INCORRECT DATA: expected={} actual={}", expected_data.size(), output_data.size());
+      correct = false;
+    }
+
+    // loads with a missing file fail
+    std::vector<std::string> missing_files = test_files;
+    missing_files.insert(missing_files.begin() + num_files / 2, "missing");
+    if (read_to_file(sessions[std::rand() % num_servers], missing_files, output_path)) {
+      spdlog::error("MULTI-FILE LOAD WITH MISSING FILE SUCCEEDED");
+      correct = false;
+    }
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    for (std::string& name : test_files) {
+      std::remove((base_path / name).c_str());
+    }
+    std::remove(output_path.c_str());
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> has_chunks(unsigned int num_servers, size_t file_size) {
+  auto fn = [num_servers, file_size]() {
+    // setup cluster
+    Session* sessions[num_servers];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_servers; i++) {
+      std::thread* session_thread = new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_servers);
+      threads.push_back(session_thread);
+    }
+    wait_on_threads(threads);
+
+    // store a random file
+    std::filesystem::path file_path = std::filesystem::path("/tmp") / "probed";
+    random_file(file_path, file_size);
+    std::ifstream file(file_path, std::ios::binary);
+    std::vector<char>* file_data = new std::vector<char>(file_size);
+    file.read(file_data->data(), file_size);
+    bool correct = true;
+    if (!write_from_file(sessions[std::rand() % num_servers], file_path, "probed")) {
+      spdlog::error("FAILED TO STORE FILE");
+      correct = false;
+    }
+
+    // the stored chunks are reported as replicated and random keys are not
+    Manifest manifest;
+    if (!fetch_manifest(sessions[std::rand() % num_servers], key_from_string("probed"), manifest)) {
+      spdlog::error("FAILED TO FETCH MANIFEST");
+      correct = false;
+    }
+    std::vector<Key> keys;
+    for (ManifestEntry& entry : manifest.entries) {
+      keys.push_back(entry.keys.at(0));
+    }
+    unsigned int num_stored = keys.size();
+    for (int i = 0; i < num_stored; i++) {
+      keys.push_back(random_key());
+    }
+    std::vector<char> replicated;
+    sessions[std::rand() % num_servers]->replicated(keys, KBUCKET_MAX, replicated);
+    for (int i = 0; i < keys.size(); i++) {
+      if (replicated[i] != (i < num_stored)) {
+        spdlog::error("INCORRECT REPLICATION PROBE: i={} key={} expected={}", i, hex_string(keys[i]), i < num_stored);
+        correct = false;
+      }
+    }
+
+    // storing the file again skips the replicated chunks and the file is still readable
+    if (!write_from_file(sessions[std::rand() % num_servers], file_path, "probed")) {
+      spdlog::error("FAILED TO RESTORE FILE");
+      correct = false;
+    }
+    std::vector<char>* buff;
+    if (!read_in_files(sessions[std::rand() % num_servers], std::vector<std::string>{"probed"}, &buff)) {
+      spdlog::error("FAILED TO LOAD FILE");
+      correct = false;
+    } else {
+      if (*buff != *file_data) {
+        spdlog::error("LOADED FILE HAS INCORRECT DATA");
+        correct = false;
+      }
+      delete buff;
+    }
+
+    // teardown cluster
+    for (int i = 0; i < num_servers; i++) {
+      threads.push_back(new std::thread([](Session*& s){
+        s->teardown(false);
+        delete s;
+      }, std::ref(sessions[i])));
+    }
+    wait_on_threads(threads);
+    delete file_data;
+    std::remove(file_path.c_str());
+    return correct;
+  };
+  return fn;
+}
@@ -24,14 +24,48 @@ int main(int argc, char** argv) {
     {"churn-10-50-1", churn_chunks_fn(1, 10, 50, 10)},
     {"churn-5-50-5", churn_chunks_fn(5, 5, 50, 10)},
     {"churn-10-200-1", churn_chunks_fn(1, 10, 200, 10)},
+    {"striped-get-10-200-100000", striped_get_fn(200, 10, 100000, 5)},
+    {"corrupted-replicas-10-50-2", corrupted_replicas_fn(50, 10, 2)},
+    {"metrics-10-8-100000", metrics_fn(10, 8, 100000)},
+    {"lookup-tracing-10-300", lookup_tracing_fn(10, 300)},
+    {"repair-10-100-2", repair_fn(10, 100, 2, 3)},
+    {"anti-entropy-10-100", anti_entropy_fn(10, 100, 3)},
+    {"seeded-bootstrap-20-100", seeded_bootstrap_fn(20, 100, 3)},
+    {"multi-seed-join-10-2000", multi_seed_join_fn(10, 2000)},
+    {"handoff-10-100", handoff_fn(10, 100, 3)},
+    {"teardown-handoff-10-1000", teardown_handoff_fn(10, 1000, 3)},
+    {"executor-20-50-1000", executor_fn(20, 50, 1000)},
 
     // file tests
     {"server-only-static-10-10-100", server_static_files(10, 10, 100, 0, 0)},
     {"server-only-static-50-10-100", server_static_files(50, 10, 100, 0, 0)},
+    {"server-only-static-10-3-5000000", server_static_files(10, 3, 5000000, 0, 0)},
     {"server-only-dynamic-10-10-100", server_dynamic_files(10, 10, 100, 0, 0)},
     {"server-only-dynamic-50-10-100", server_dynamic_files(50, 10, 100, 0, 0)},
     {"server-only-dynamic-50-100-100", server_dynamic_files(50, 100, 100, 3, 3)},
     {"server-only-dynamic-100-100-100", server_dynamic_files(100, 100, 100, 3, 3)},
+    {"erasure-codec-8-4", erasure_codec(8, 4, 100003)},
+    {"erasure-codec-200-50", erasure_codec(200, 50, 1000)},
+    {"server-only-erasure-10-10-100", server_erasure_files(10, 10, 100, 4, 2, 0, 0)},
+    {"server-only-erasure-10-3-5000000", server_erasure_files(10, 3, 5000000, 4, 2, 0, 0)},
+    {"manifest-tree-10-1000-256", manifest_tree(10, 1000, 256)},
+    {"index-pages-10-100-10", index_pages(10, 100, 10)},
+    {"index-pages-10-5000-500", index_pages(10, 5000, 500)},
+    {"index-cache-10-100", index_cache(10, 100)},
+    {"index-cache-10-3000", index_cache(10, 3000)},
+    {"file-reader-10-20000000-50", file_reader_ranges(10, 20000000, 50, 0)},
+    {"file-reader-erasure-10-20000000-50", file_reader_ranges(10, 20000000, 50, 4)},
+    {"resumable-10-5000000", resumable_transfers(10, 5000000)},
+    {"chunk-cache-10-5000000-100000000", chunk_cache(10, 5000000, 100000000)},
+    {"chunk-cache-10-5000000-3000000", chunk_cache(10, 5000000, 3000000)},
+    {"multi-file-load-10-20-3000000", multi_file_load(10, 20, 3000000)},
+    {"has-chunks-10-10000000", has_chunks(10, 10000000)},
+
+    // daemon tests
+    {"daemon-ipc-20-50", daemon_ipc(20, 50)},
+    {"daemon-jobs-10-6-5000000", daemon_jobs(10, 6, 5000000)},
+    {"daemon-progress-10-10000000-100", daemon_progress_events(10, 10000000, 100)},
+    {"daemon-fds-10-5000000", daemon_fd_passing(10, 5000000)},
   };
 
   if (argc != 2 || tests.count(std::string(argv[1])) == 0) {
@@ -7,6 +7,12 @@
 #include <string>
 #include <random>
 #include <thread>
+#include <fstream>
+#include <atomic>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
 
 
 //
@@ -166,3 +172,845 @@ std::function<bool()> churn_chunks_fn(unsigned int num_chunks, unsigned int num_
   };
   return fn;
 }
+
+std::function<bool()> striped_get_fn(unsigned int num_chunks, unsigned int num_endpoints, size_t chunk_size, unsigned int replicas) {
+  auto fn = [num_chunks, num_endpoints, chunk_size, replicas]() {
+    // create sessions
+    Session* sessions[num_endpoints];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_endpoints));
+    }
+    wait_on_threads(threads);
+
+    // set (content-addressed) chunks on a few replicas each from another session
+    std::vector<Chunk*> chunks(num_chunks);
+    std::vector<Key> keys;
+    for (int i = 0; i < num_chunks; i++) {
+      chunks[i] = random_chunk(chunk_size);
+      chunks[i]->key = key_from_data(chunks[i]->data->data(), chunks[i]->data->size());
+      keys.push_back(chunks[i]->key);
+      threads.push_back(new std::thread([replicas](Session* s, Chunk* c) {
+        s->set(c->key, new std::vector<char>(c->data->begin(), c->data->end()), set_options{false, replicas});
+      }, sessions[1], chunks[i]));
+    }
+    wait_on_threads(threads);
+    keys.push_back(random_key());
+
+    // get all chunks at once (the missing key is reported without failing the others)
+    bool correct = true;
+    std::vector<std::vector<char>*> data;
+    if (sessions[0]->get(keys, data)) {
+      spdlog::error("MISSING CHUNK WAS FOUND");
+      correct = false;
+    }
+    for (int i = 0; i < num_chunks; i++) {
+      if (data[i] == NULL || *data[i] != *chunks[i]->data) {
+        spdlog::error("{} CHUNK NOT FOUND OR INCORRECT: CHUNK={}", hex_string(sessions[0]->self_key()), hex_string(keys[i]));
+        correct = false;
+      }
+      delete data[i];
+    }
+    if (data[num_chunks] != NULL) {
+      correct = false;
+      delete data[num_chunks];
+    }
+
+    // the chunks were fetched from (and measured on) several replicas
+    std::unordered_map<Key, double> throughputs;
+    sessions[0]->peer_throughputs(throughputs);
+    if (throughputs.size() < 2) {
+      spdlog::error("CHUNKS NOT STRIPED ACROSS REPLICAS: PEERS={}", throughputs.size());
+      correct = false;
+    }
+
+    // delete chunks and sessions
+    for (Chunk* c : chunks) {
+      delete c;
+    }
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, sessions[i]));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> corrupted_replicas_fn(unsigned int num_chunks, unsigned int num_endpoints, unsigned int good_replicas) {
+  auto fn = [num_chunks, num_endpoints, good_replicas]() {
+    // create sessions
+    Session* sessions[num_endpoints];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_endpoints));
+    }
+    wait_on_threads(threads);
+
+    // store corrupted copies of every (content-addressed) chunk everywhere, then overwrite only a few replicas with the real data
+    std::vector<Chunk*> chunks(num_chunks);
+    std::vector<Key> keys;
+    for (int i = 0; i < num_chunks; i++) {
+      chunks[i] = random_chunk(1000 + i);
+      chunks[i]->key = key_from_data(chunks[i]->data->data(), chunks[i]->data->size());
+      keys.push_back(chunks[i]->key);
+      threads.push_back(new std::thread([good_replicas](Session* s, Chunk* c) {
+        std::vector<char>* corrupted = new std::vector<char>(c->data->begin(), c->data->end());
+        corrupted->at(0) ^= 0x1;
+        s->set(c->key, corrupted);
+        s->set(c->key, new std::vector<char>(c->data->begin(), c->data->end()), set_options{true, good_replicas});
+      }, sessions[1], chunks[i]));
+    }
+    wait_on_threads(threads);
+
+    // every chunk is still loaded correctly and the corrupted replicas are recorded
+    bool correct = true;
+    std::vector<std::vector<char>*> data;
+    if (!sessions[0]->get(keys, data)) {
+      spdlog::error("CHUNKS NOT FOUND AFTER FAILOVER");
+      correct = false;
+    }
+    for (int i = 0; i < num_chunks; i++) {
+      if (data[i] != NULL && *data[i] != *chunks[i]->data) {
+        spdlog::error("{} CORRUPTED CHUNK LOADED: CHUNK={}", hex_string(sessions[0]->self_key()), hex_string(keys[i]));
+        correct = false;
+      }
+      delete data[i];
+    }
+    std::unordered_map<Key, unsigned long> bad_replicas;
+    sessions[0]->bad_replicas(bad_replicas);
+    if (bad_replicas.empty()) {
+      spdlog::error("NO CORRUPTED REPLICAS RECORDED");
+      correct = false;
+    }
+
+    // delete chunks and sessions
+    for (Chunk* c : chunks) {
+      delete c;
+    }
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, sessions[i]));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> metrics_fn(unsigned int num_endpoints, unsigned int num_threads, unsigned int num_records) {
+  auto fn = [num_endpoints, num_threads, num_records]() {
+    bool correct = true;
+
+    // values land in a bucket whose bounds are within 12.5% of them
+    for (uint64_t value : {0ull, 7ull, 8ull, 9ull, 1000ull, 123456789ull, (1ull << 40) - 1}) {
+      size_t bucket = Histogram::bucket_index(value);
+      uint64_t upper = Histogram::bucket_upper_bound(bucket);
+      if (upper < value || upper - value > value / 8 || (bucket > 0 && Histogram::bucket_upper_bound(bucket - 1) >= value)) {
+        spdlog::error("INCORRECT HISTOGRAM BUCKET: value={} bucket={} upper={}", value, bucket, upper);
+        correct = false;
+      }
+    }
+
+    // concurrent increments and records are not lost
+    Counter* counter = metrics()->counter("distft_test_total", "test=\"metrics\"", "Test counter");
+    Histogram* histogram = metrics()->histogram("distft_test_values", "test=\"metrics\"", "Test histogram");
+    std::vector<std::thread*> threads;
+    for (unsigned int t = 0; t < num_threads; t++) {
+      threads.push_back(new std::thread([counter, histogram, num_records]() {
+        for (unsigned int i = 1; i <= num_records; i++) {
+          counter->add(1);
+          histogram->record(i);
+        }
+      }));
+    }
+    wait_on_threads(threads);
+    histogram_snapshot snapshot;
+    histogram->snapshot(snapshot);
+    uint64_t expected_sum = static_cast<uint64_t>(num_threads) * num_records * (num_records + 1) / 2;
+    uint64_t median = snapshot.quantile(0.5);
+    if (counter->value() != num_threads * num_records || snapshot.count != num_threads * num_records
+        || snapshot.sum != expected_sum || median < num_records / 2 || median > num_records / 2 * 9 / 8 + 1) {
+      spdlog::error("INCORRECT CONCURRENT METRICS: counter={} count={} sum={} median={}", counter->value(), snapshot.count,
+                      snapshot.sum, median);
+      correct = false;
+    }
+    std::string text = metrics()->prometheus_text();
+    if (text.find("distft_test_total{test=\"metrics\"} " + std::to_string(num_threads * num_records) + "\n") == std::string::npos
+        || text.find("distft_test_values_count{test=\"metrics\"} " + std::to_string(num_threads * num_records) + "\n") == std::string::npos
+        || text.find("# TYPE distft_test_values histogram\n") == std::string::npos) {
+      spdlog::error("INCORRECT PROMETHEUS TEXT");
+      correct = false;
+    }
+
+    // sessions count their RPCs and expose their routers while they run
+    uint64_t handled_stores = metrics()->counter("distft_rpc_handled_total", "rpc=\"store\"", "")->value();
+    Session* sessions[num_endpoints];
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_endpoints));
+    }
+    wait_on_threads(threads);
+    Chunk* chunk = random_chunk(1000);
+    sessions[0]->set(chunk->key, new std::vector<char>(chunk->data->begin(), chunk->data->end()));
+    if (metrics()->counter("distft_rpc_handled_total", "rpc=\"store\"", "")->value() <= handled_stores) {
+      spdlog::error("STORE RPCS NOT COUNTED");
+      correct = false;
+    }
+    text = metrics()->prometheus_text();
+    for (int i = 0; i < num_endpoints; i++) {
+      if (text.find("distft_router_peers{session=\"" + hex_string(sessions[i]->self_key()) + "\"") == std::string::npos) {
+        spdlog::error("{} ROUTER OCCUPANCY MISSING", hex_string(sessions[i]->self_key()));
+        correct = false;
+      }
+    }
+    if (metrics()->summary_text().find("distft_lookup_hops{lookup=\"node\"} count=") == std::string::npos) {
+      spdlog::error("LOOKUP HOPS MISSING");
+      correct = false;
+    }
+
+    // torn down sessions are no longer collected
+    delete chunk;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, sessions[i]));
+    }
+    wait_on_threads(threads);
+    if (metrics()->prometheus_text().find("distft_router_peers{") != std::string::npos) {
+      spdlog::error("TORN DOWN SESSIONS STILL COLLECTED");
+      correct = false;
+    }
+    return correct;
+  };
+  return fn;
+}
+
+// returns a function that traces lookups while chunks are stored and fetched, and checks the exported traces
+std::function<bool()> lookup_tracing_fn(unsigned int num_endpoints, unsigned int num_chunks) {
+  auto fn = [num_endpoints, num_chunks]() {
+    bool correct = true;
+    tracer()->set_sample_rate(0);
+    tracer()->clear();
+    Session* sessions[num_endpoints];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_endpoints));
+    }
+    wait_on_threads(threads);
+    if (tracer()->size() != 0) {
+      spdlog::error("LOOKUPS TRACED WITHOUT SAMPLING: traces={}", tracer()->size());
+      correct = false;
+    }
+
+    // every lookup is traced (and only the latest ones are kept)
+    tracer()->set_sample_rate(1);
+    std::vector<Chunk*> chunks;
+    for (int i = 0; i < num_chunks; i++) {
+      chunks.push_back(random_chunk(100));
+      sessions[i % num_endpoints]->set(chunks[i]->key, new std::vector<char>(chunks[i]->data->begin(), chunks[i]->data->end()), set_options{false, 3});
+    }
+    for (int i = 0; i < num_chunks; i++) {
+      std::vector<char>* data = NULL;
+      if (!sessions[(i + 1) % num_endpoints]->get(chunks[i]->key, &data) || *data != *chunks[i]->data) {
+        spdlog::error("{} CHUNK NOT FOUND", hex_string(chunks[i]->key));
+        correct = false;
+      }
+      delete data;
+    }
+    size_t expected_traces = std::min(num_chunks, static_cast<unsigned int>(TRACE_RING_SIZE));
+    if (tracer()->size() < expected_traces) {
+      spdlog::error("LOOKUPS NOT TRACED: traces={} expected={}", tracer()->size(), expected_traces);
+      correct = false;
+    }
+    std::string json = tracer()->chrome_json();
+    if (json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") != 0 || json.find("\"name\":\"value_lookup\"") == std::string::npos
+        || json.find("\"name\":\"find_value\",\"cat\":\"lookup\",\"ph\":\"X\"") == std::string::npos
+        || json.find("\"termination\":\"value found\"") == std::string::npos || json.find("\"name\":\"router_lock\"") == std::string::npos
+        || json.find("\"name\":\"iteration 0\"") == std::string::npos) {
+      spdlog::error("INCORRECT CHROME TRACE JSON");
+      correct = false;
+    }
+
+    // event names and args are escaped with the shared JSON string escaper
+    std::string escaped = json_string(std::string("lookup \"a\\b\"\n\x01"));
+    if (escaped != "\"lookup \\\"a\\\\b\\\"\\n\\u0001\"") {
+      spdlog::error("INCORRECT JSON STRING ESCAPING: escaped={}", escaped);
+      correct = false;
+    }
+
+    // no more traces once sampling is disabled
+    tracer()->set_sample_rate(0);
+    tracer()->clear();
+    for (int i = 0; i < num_endpoints; i++) {
+      std::vector<char>* data = NULL;
+      sessions[i]->get(chunks[0]->key, &data);
+      delete data;
+    }
+    if (tracer()->size() != 0) {
+      spdlog::error("LOOKUPS TRACED AFTER SAMPLING WAS DISABLED: traces={}", tracer()->size());
+      correct = false;
+    }
+
+    for (Chunk* chunk : chunks) {
+      delete chunk;
+    }
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, sessions[i]));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+// returns a function that stores chunks, kills sessions, and checks that the survivors re-replicate the lost replicas
+std::function<bool()> repair_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int num_killed, unsigned int replicas) {
+  auto fn = [num_endpoints, num_chunks, num_killed, replicas]() {
+    Session* sessions[num_endpoints];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_endpoints));
+    }
+    wait_on_threads(threads);
+
+    // let the routers learn the whole network (through the lookups of a dummy chunk) before storing the chunks
+    for (int i = 0; i < num_endpoints; i++) {
+      sessions[i]->set(random_key(), new std::vector<char>(), set_options{false, 1});
+    }
+    std::vector<Chunk*> chunks;
+    for (int i = 0; i < num_chunks; i++) {
+      chunks.push_back(random_chunk(1000));
+      sessions[i % num_endpoints]->set(chunks[i]->key, new std::vector<char>(chunks[i]->data->begin(), chunks[i]->data->end()), set_options{false, replicas});
+    }
+
+    // kill sessions (dropping their chunks) and let the survivors notice through their lookups
+    Counter* repaired_replicas = metrics()->counter("distft_repair_replicas_total", "", "");
+    uint64_t repaired_before = repaired_replicas->value();
+    for (int i = 0; i < num_killed; i++) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, sessions[i]));
+    }
+    wait_on_threads(threads);
+    std::vector<Session*> survivors(sessions + num_killed, sessions + num_endpoints);
+    for (Session* s : survivors) {
+      s->set(random_key(), new std::vector<char>(), set_options{false, 1});
+    }
+
+    // every chunk is back on its closest surviving peers (as seen by the farthest survivor)
+    bool correct = false;
+    for (int attempt = 0; attempt < 30 && !correct; attempt++) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      unsigned int num_replicated = 0;
+      for (Chunk* chunk : chunks) {
+        Session* farthest = *std::max_element(survivors.begin(), survivors.end(), [chunk](Session* s1, Session* s2) {
+          return Dist(chunk->key, s1->self_key()) < Dist(chunk->key, s2->self_key());
+        });
+        std::vector<Key> keys = {chunk->key};
+        std::vector<char> replicated;
+        farthest->replicated(keys, replicas, replicated);
+        num_replicated += replicated[0];
+      }
+      correct = num_replicated == num_chunks;
+      if (!correct) {
+        spdlog::info("WAITING FOR REPAIRS: replicated={} chunks={}", num_replicated, num_chunks);
+      }
+    }
+    uint64_t repaired = repaired_replicas->value() - repaired_before;
+    if (repaired == 0 || repaired > num_chunks * num_killed) {
+      spdlog::error("UNEXPECTED NUMBER OF REPAIRED REPLICAS: repaired={} max={}", repaired, num_chunks * num_killed);
+      correct = false;
+    }
+
+    for (Chunk* chunk : chunks) {
+      delete chunk;
+    }
+    for (Session* s : survivors) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, s));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> anti_entropy_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int replicas) {
+  auto fn = [num_endpoints, num_chunks, replicas]() {
+    Session* sessions[num_endpoints + 1];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_endpoints));
+    }
+    wait_on_threads(threads);
+    for (int i = 0; i < num_endpoints; i++) {
+      sessions[i]->set(random_key(), new std::vector<char>(), set_options{false, 1});
+    }
+    std::vector<Chunk*> chunks;
+    for (int i = 0; i < num_chunks; i++) {
+      chunks.push_back(random_chunk(1000));
+      sessions[i % num_endpoints]->set(chunks[i]->key, new std::vector<char>(chunks[i]->data->begin(), chunks[i]->data->end()), set_options{false, replicas});
+    }
+
+    // a late session joins and becomes a member of some chunks' replica sets without holding them
+    create_session(sessions[num_endpoints], num_endpoints, 0);
+    std::vector<Session*> all_sessions(sessions, sessions + num_endpoints + 1);
+    for (Session* s : all_sessions) {
+      s->set(random_key(), new std::vector<char>(), set_options{false, 1});
+    }
+
+    // the first round sends the missing chunks
+    Counter* sync_rpcs = metrics()->counter("distft_anti_entropy_rpcs_total", "", "");
+    Counter* sent_bytes = metrics()->counter("distft_anti_entropy_bytes_total", "", "");
+    unsigned int sent = 0;
+    for (Session* s : all_sessions) {
+      sent += s->anti_entropy();
+    }
+    bool correct = true;
+    if (sent == 0) {
+      spdlog::error("NO CHUNKS SENT BY ANTI ENTROPY");
+      correct = false;
+    }
+    unsigned int num_replicated = 0;
+    for (Chunk* chunk : chunks) {
+      Session* farthest = *std::max_element(all_sessions.begin(), all_sessions.end(), [chunk](Session* s1, Session* s2) {
+        return Dist(chunk->key, s1->self_key()) < Dist(chunk->key, s2->self_key());
+      });
+      std::vector<Key> keys = {chunk->key};
+      std::vector<char> replicated;
+      farthest->replicated(keys, replicas, replicated);
+      num_replicated += replicated[0];
+    }
+    if (num_replicated != num_chunks) {
+      spdlog::error("CHUNKS NOT REPLICATED AFTER ANTI ENTROPY: replicated={} chunks={}", num_replicated, num_chunks);
+      correct = false;
+    }
+
+    // once in sync, a round sends no chunks and exchanges a single digest per neighbor
+    uint64_t rpcs_before = sync_rpcs->value();
+    uint64_t bytes_before = sent_bytes->value();
+    sent = 0;
+    for (Session* s : all_sessions) {
+      sent += s->anti_entropy();
+    }
+    uint64_t rpcs = sync_rpcs->value() - rpcs_before;
+    if (sent > 0 || sent_bytes->value() != bytes_before || rpcs > all_sessions.size() * (all_sessions.size() - 1)) {
+      spdlog::error("UNEXPECTED TRAFFIC IN SYNC: sent={} bytes={} rpcs={}", sent, sent_bytes->value() - bytes_before, rpcs);
+      correct = false;
+    }
+
+    for (Chunk* chunk : chunks) {
+      delete chunk;
+    }
+    for (Session* s : all_sessions) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, s));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> handoff_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int replicas) {
+  auto fn = [num_endpoints, num_chunks, replicas]() {
+    Session* sessions[num_endpoints + 1];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_endpoints));
+    }
+    wait_on_threads(threads);
+    for (int i = 0; i < num_endpoints; i++) {
+      sessions[i]->set(random_key(), new std::vector<char>(), set_options{false, 1});
+    }
+    std::vector<Chunk*> chunks;
+    for (int i = 0; i < num_chunks; i++) {
+      chunks.push_back(random_chunk(1000));
+      sessions[i % num_endpoints]->set(chunks[i]->key, new std::vector<char>(chunks[i]->data->begin(), chunks[i]->data->end()), set_options{false, replicas});
+    }
+
+    // a late session joins and is handed the chunks whose replica sets it joined (without any anti entropy rounds)
+    Counter* handed_off = metrics()->counter("distft_handoff_chunks_total", "", "");
+    uint64_t handed_off_before = handed_off->value();
+    create_session(sessions[num_endpoints], num_endpoints, 0);
+    std::vector<Session*> all_sessions(sessions, sessions + num_endpoints + 1);
+    bool correct = true;
+    unsigned int num_replicated = 0;
+    for (int i = 0; i < 100 && num_replicated != num_chunks; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      num_replicated = 0;
+      for (Chunk* chunk : chunks) {
+        Session* farthest = *std::max_element(all_sessions.begin(), all_sessions.end(), [chunk](Session* s1, Session* s2) {
+          return Dist(chunk->key, s1->self_key()) < Dist(chunk->key, s2->self_key());
+        });
+        std::vector<Key> keys = {chunk->key};
+        std::vector<char> replicated;
+        farthest->replicated(keys, replicas, replicated);
+        num_replicated += replicated[0];
+      }
+    }
+    if (num_replicated != num_chunks) {
+      spdlog::error("CHUNKS NOT REPLICATED AFTER HANDOFF: replicated={} chunks={}", num_replicated, num_chunks);
+      correct = false;
+    }
+    if (handed_off->value() == handed_off_before) {
+      spdlog::error("NO CHUNKS HANDED OFF");
+      correct = false;
+    }
+
+    for (Chunk* chunk : chunks) {
+      delete chunk;
+    }
+    for (Session* s : all_sessions) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, s));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> teardown_handoff_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int replicas) {
+  auto fn = [num_endpoints, num_chunks, replicas]() {
+    Session* sessions[num_endpoints];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_endpoints));
+    }
+    wait_on_threads(threads);
+    for (int i = 0; i < num_endpoints; i++) {
+      sessions[i]->set(random_key(), new std::vector<char>(), set_options{false, 1});
+    }
+    std::vector<Chunk*> chunks;
+    for (int i = 0; i < num_chunks; i++) {
+      chunks.push_back(random_chunk(1000));
+      sessions[i % num_endpoints]->set(chunks[i]->key, new std::vector<char>(chunks[i]->data->begin(), chunks[i]->data->end()), set_options{false, replicas});
+    }
+
+    // the first session leaves and hands its chunks off to the rest of their replica sets
+    Counter* handed_off = metrics()->counter("distft_teardown_handoff_chunks_total", "", "");
+    Counter* dropped = metrics()->counter("distft_teardown_dropped_chunks_total", "", "");
+    uint64_t handed_off_before = handed_off->value();
+    uint64_t dropped_before = dropped->value();
+    auto start = std::chrono::steady_clock::now();
+    sessions[0]->teardown(true);
+    delete sessions[0];
+    spdlog::info("SESSION LEFT: ms={}", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    bool correct = true;
+    if (handed_off->value() == handed_off_before || dropped->value() != dropped_before) {
+      spdlog::error("UNEXPECTED TEARDOWN HANDOFF: handed_off={} dropped={}", handed_off->value() - handed_off_before,
+                    dropped->value() - dropped_before);
+      correct = false;
+    }
+    std::vector<Session*> rest(sessions + 1, sessions + num_endpoints);
+    for (Session* s : rest) {
+      s->set(random_key(), new std::vector<char>(), set_options{false, 1});
+    }
+    unsigned int num_replicated = 0;
+    for (Chunk* chunk : chunks) {
+      Session* farthest = *std::max_element(rest.begin(), rest.end(), [chunk](Session* s1, Session* s2) {
+        return Dist(chunk->key, s1->self_key()) < Dist(chunk->key, s2->self_key());
+      });
+      std::vector<Key> keys = {chunk->key};
+      std::vector<char> replicated;
+      farthest->replicated(keys, replicas, replicated);
+      num_replicated += replicated[0];
+    }
+    if (num_replicated != num_chunks) {
+      spdlog::error("CHUNKS NOT REPLICATED AFTER TEARDOWN: replicated={} chunks={}", num_replicated, num_chunks);
+      correct = false;
+    }
+
+    // a session that leaves with a passed deadline drops its chunks
+    dropped_before = dropped->value();
+    rest[0]->teardown(true, std::chrono::milliseconds(0));
+    delete rest[0];
+    rest.erase(rest.begin());
+    if (dropped->value() == dropped_before) {
+      spdlog::error("NO CHUNKS DROPPED AFTER DEADLINE");
+      correct = false;
+    }
+
+    for (Chunk* chunk : chunks) {
+      delete chunk;
+    }
+    for (Session* s : rest) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, s));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> executor_fn(unsigned int num_endpoints, unsigned int num_queues, unsigned int num_tasks) {
+  auto fn = [num_endpoints, num_queues, num_tasks]() {
+    bool correct = true;
+
+    // tasks of a serial queue run one at a time and in submission order
+    std::vector<task_queue*> queues;
+    std::vector<std::vector<unsigned int>> runs(num_queues);
+    std::vector<std::atomic<unsigned int>> running(num_queues);
+    std::atomic<bool> overlapped(false);
+    for (unsigned int q = 0; q < num_queues; q++) {
+      queues.push_back(executor()->create_queue(1));
+    }
+    for (unsigned int i = 0; i < num_tasks; i++) {
+      for (unsigned int q = 0; q < num_queues; q++) {
+        executor()->submit(queues[q], [&runs, &running, &overlapped, q, i]() {
+          overlapped = overlapped || running[q]++ > 0;
+          runs[q].push_back(i);
+          running[q]--;
+        });
+      }
+    }
+    std::atomic<unsigned int> finished(0);
+    for (unsigned int q = 0; q < num_queues; q++) {
+      executor()->submit(queues[q], [&finished]() { finished++; });
+    }
+    while (finished < num_queues) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (unsigned int q = 0; q < num_queues; q++) {
+      bool ordered = runs[q].size() == num_tasks;
+      for (unsigned int i = 0; ordered && i < num_tasks; i++) {
+        ordered = runs[q][i] == i;
+      }
+      if (!ordered || overlapped) {
+        spdlog::error("SERIAL QUEUE OUT OF ORDER: queue={} runs={} overlapped={}", q, runs[q].size(), overlapped.load());
+        correct = false;
+      }
+      executor()->close_queue(queues[q]);
+    }
+
+    // groups waited on by more tasks than there are workers still finish (waiters run their groups' tasks)
+    std::atomic<unsigned int> inner_runs(0);
+    TaskGroup outer;
+    for (unsigned int i = 0; i < 4 * executor()->num_threads(); i++) {
+      outer.run([&inner_runs]() {
+        TaskGroup inner;
+        for (unsigned int j = 0; j < 10; j++) {
+          inner.run([&inner_runs]() { inner_runs++; });
+        }
+        inner.wait();
+      });
+    }
+    outer.wait();
+    if (inner_runs != 40 * executor()->num_threads()) {
+      spdlog::error("NESTED GROUP TASKS LOST: runs={}", inner_runs.load());
+      correct = false;
+    }
+
+    // periodic timers run until their queue is closed, and delayed tasks run once
+    std::atomic<unsigned int> ticks(0);
+    std::atomic<unsigned int> delayed(0);
+    task_queue* timer_queue = executor()->create_queue(1);
+    executor()->schedule_every(timer_queue, std::chrono::milliseconds(20), [&ticks]() { ticks++; });
+    executor()->schedule(timer_queue, std::chrono::milliseconds(50), [&delayed]() { delayed++; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    executor()->close_queue(timer_queue);
+    unsigned int closed_ticks = ticks;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (closed_ticks < 5 || closed_ticks > 25 || ticks != closed_ticks || delayed != 1) {
+      spdlog::error("INCORRECT TIMERS: ticks={} after_close={} delayed={}", closed_ticks, ticks.load(), delayed.load());
+      correct = false;
+    }
+
+    // sessions run their maintenance on the executor rather than on threads of their own
+    // (leaving about one polling thread of its gRPC server per session)
+    unsigned int threads_before = process_threads();
+    Session* sessions[num_endpoints];
+    create_seeded_sessions(sessions, num_endpoints);
+    unsigned int threads_after = process_threads();
+    spdlog::info("PROCESS THREADS: before={} after={} sessions={} executor={}", threads_before, threads_after,
+                 num_endpoints, executor()->num_threads());
+    if (threads_after > threads_before + 2 * num_endpoints) {
+      spdlog::error("TOO MANY THREADS PER SESSION: before={} after={}", threads_before, threads_after);
+      correct = false;
+    }
+
+    // RPCs to a peer that accepts connections but never answers give up at their deadlines (instead of holding the
+    // executor's workers), and the peer is evicted
+    int silent_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in silent_addr;
+    memset(&silent_addr, 0, sizeof(silent_addr));
+    silent_addr.sin_family = AF_INET;
+    silent_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    silent_addr.sin_port = htons(2000 + num_endpoints);
+    if (bind(silent_fd, reinterpret_cast<struct sockaddr*>(&silent_addr), sizeof(silent_addr)) < 0 || listen(silent_fd, 16) < 0) {
+      spdlog::error("FAILED TO LISTEN FOR SILENT PEER");
+      correct = false;
+    }
+    std::vector<Peer> probe_seeds = {Peer(sessions[0]->self_key(), sessions[0]->self_endpoint()),
+                                      Peer(random_key(), "localhost:" + std::to_string(2000 + num_endpoints))};
+    Session* probe = new Session;
+    startup_options probe_options;
+    probe_options.seed_peers = probe_seeds;
+    probe->startup(&dummy_meta, "localhost:" + std::to_string(2001 + num_endpoints), probe_options);
+    Chunk* chunk = random_chunk(1000);
+    chunk->key = key_from_data(chunk->data->data(), chunk->data->size());
+    auto start = std::chrono::steady_clock::now();
+    probe->set(chunk->key, new std::vector<char>(chunk->data->begin(), chunk->data->end()));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::vector<char>* found = NULL;
+    if (elapsed > std::chrono::milliseconds(4 * RPC_TIMEOUT_MS) || !sessions[num_endpoints - 1]->get(chunk->key, &found)
+        || *found != *chunk->data) {
+      spdlog::error("STORE WITH A SILENT PEER FAILED: ms={} found={}", 
+                    std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), found != NULL);
+      correct = false;
+    }
+    delete found;
+    delete chunk;
+    probe->teardown(false);
+    delete probe;
+    close(silent_fd);
+
+    TaskGroup teardowns;
+    for (Session* s : sessions) {
+      teardowns.run([s]() {
+        s->teardown(false);
+        delete s;
+      });
+    }
+    teardowns.wait();
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> seeded_bootstrap_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int replicas) {
+  auto fn = [num_endpoints, num_chunks, replicas]() {
+    Session* sessions[num_endpoints];
+    auto start = std::chrono::steady_clock::now();
+    create_seeded_sessions(sessions, num_endpoints);
+    spdlog::info("SEEDED SESSIONS STARTED: sessions={} ms={}", num_endpoints,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+    // without any lookups to converge, chunks are stored on (and found at) their closest peers right away
+    std::vector<Chunk*> chunks;
+    std::vector<Key> keys;
+    for (int i = 0; i < num_chunks; i++) {
+      chunks.push_back(random_chunk(1000));
+      chunks[i]->key = key_from_data(chunks[i]->data->data(), chunks[i]->data->size());
+      keys.push_back(chunks[i]->key);
+      sessions[i % num_endpoints]->set(chunks[i]->key, new std::vector<char>(chunks[i]->data->begin(), chunks[i]->data->end()), set_options{false, replicas});
+    }
+    bool correct = true;
+    unsigned int num_replicated = 0;
+    for (Chunk* chunk : chunks) {
+      Session* farthest = *std::max_element(sessions, sessions + num_endpoints, [chunk](Session* s1, Session* s2) {
+        return Dist(chunk->key, s1->self_key()) < Dist(chunk->key, s2->self_key());
+      });
+      std::vector<Key> chunk_keys = {chunk->key};
+      std::vector<char> replicated;
+      farthest->replicated(chunk_keys, replicas, replicated);
+      num_replicated += replicated[0];
+    }
+    if (num_replicated != num_chunks) {
+      spdlog::error("CHUNKS NOT ON THEIR CLOSEST PEERS: replicated={} chunks={}", num_replicated, num_chunks);
+      correct = false;
+    }
+    std::vector<std::vector<char>*> data;
+    if (!sessions[num_endpoints - 1]->get(keys, data)) {
+      spdlog::error("CHUNKS NOT FOUND IN SEEDED SESSIONS");
+      correct = false;
+    }
+    for (int i = 0; i < num_chunks; i++) {
+      if (data[i] == NULL || *data[i] != *chunks[i]->data) {
+        correct = false;
+      }
+      delete data[i];
+      delete chunks[i];
+    }
+
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, sessions[i]));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
+
+std::function<bool()> multi_seed_join_fn(unsigned int num_endpoints, unsigned int seed_delay_ms) {
+  auto fn = [num_endpoints, seed_delay_ms]() {
+    Session* sessions[num_endpoints];
+    std::vector<std::thread*> threads;
+    for (int i = 0; i < num_endpoints; i++) {
+      threads.push_back(new std::thread(create_session, std::ref(sessions[i]), i, (i + 1) % num_endpoints));
+    }
+    wait_on_threads(threads);
+    Chunk* chunk;
+    create_chunk(sessions[0], chunk, 1000);
+
+    // join through a seed that never answers and a seed that only comes up after a while
+    char joiner_addr[20];
+    char dead_addr[20];
+    char late_addr[20];
+    sprintf(joiner_addr, "localhost:%i", 2000 + num_endpoints);
+    sprintf(dead_addr, "localhost:%i", 2000 + num_endpoints + 1);
+    sprintf(late_addr, "localhost:%i", 2000 + num_endpoints + 2);
+    Session* joiner = new Session;
+    bool joined = false;
+    auto start = std::chrono::steady_clock::now();
+    std::thread join_thread([&]() {
+      joined = joiner->startup(&dummy_meta, std::string(joiner_addr), startup_options{{dead_addr, late_addr}});
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(seed_delay_ms));
+    Session* late;
+    create_session(late, num_endpoints + 2, 0);
+    join_thread.join();
+    auto join_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    // the join finishes within a backoff period of the late seed coming up and the joiner finds the chunk
+    bool correct = true;
+    if (!joined || join_ms > seed_delay_ms + JOIN_BACKOFF_MAX_MS + JOIN_PING_TIMEOUT_MS) {
+      spdlog::error("JOIN FAILED OR TOO SLOW: joined={} ms={}", joined, join_ms);
+      correct = false;
+    }
+    std::vector<char>* data = NULL;
+    if (joined && (!joiner->get(chunk->key, &data) || *data != *chunk->data)) {
+      spdlog::error("CHUNK NOT FOUND BY JOINED SESSION");
+      correct = false;
+    }
+    delete data;
+    delete chunk;
+
+    std::vector<Session*> all_sessions(sessions, sessions + num_endpoints);
+    all_sessions.push_back(joiner);
+    all_sessions.push_back(late);
+    for (Session* s : all_sessions) {
+      threads.push_back(new std::thread([](Session* s) {
+        s->teardown(false);
+        delete s;
+      }, s));
+    }
+    wait_on_threads(threads);
+    return correct;
+  };
+  return fn;
+}
@@ -8,18 +8,50 @@
 std::function<bool()> create_destroy_sessions(unsigned int num_endpoints);
 std::function<bool()> store_chunks_fn(unsigned int num_chunks, unsigned int num_endpoints);
 std::function<bool()> churn_chunks_fn(unsigned int num_chunks, unsigned int num_servers, unsigned int num_clients, unsigned int chunk_tol);
+std::function<bool()> striped_get_fn(unsigned int num_chunks, unsigned int num_endpoints, size_t chunk_size, unsigned int replicas);
+std::function<bool()> corrupted_replicas_fn(unsigned int num_chunks, unsigned int num_endpoints, unsigned int good_replicas);
+std::function<bool()> metrics_fn(unsigned int num_endpoints, unsigned int num_threads, unsigned int num_records);
+std::function<bool()> lookup_tracing_fn(unsigned int num_endpoints, unsigned int num_chunks);
+std::function<bool()> repair_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int num_killed, unsigned int replicas);
+std::function<bool()> anti_entropy_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int replicas);
+std::function<bool()> seeded_bootstrap_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int replicas);
+std::function<bool()> multi_seed_join_fn(unsigned int num_endpoints, unsigned int seed_delay_ms);
+std::function<bool()> handoff_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int replicas);
+std::function<bool()> teardown_handoff_fn(unsigned int num_endpoints, unsigned int num_chunks, unsigned int replicas);
+std::function<bool()> executor_fn(unsigned int num_endpoints, unsigned int num_queues, unsigned int num_tasks);
 
 // file integration tests
 std::function<bool()> server_static_files(unsigned int num_servers, unsigned int num_files, size_t file_size, 
                                           unsigned int found_tol, unsigned int corr_tol);
 std::function<bool()> server_dynamic_files(unsigned int num_servers, unsigned int num_files, size_t file_size, 
                                             unsigned int found_tol, unsigned int corr_tol);
+std::function<bool()> erasure_codec(unsigned int k, unsigned int m, size_t fragment_size);
+std::function<bool()> server_erasure_files(unsigned int num_servers, unsigned int num_files, size_t file_size, 
+                                            unsigned int k, unsigned int m, unsigned int found_tol, unsigned int corr_tol);
+std::function<bool()> manifest_tree(unsigned int num_servers, unsigned int num_entries, size_t max_node_size);
+std::function<bool()> index_pages(unsigned int num_servers, unsigned int num_files, unsigned int batch_size);
+std::function<bool()> index_cache(unsigned int num_servers, unsigned int num_files);
+std::function<bool()> file_reader_ranges(unsigned int num_servers, size_t file_size, unsigned int num_reads, unsigned int erasure_k);
+std::function<bool()> resumable_transfers(unsigned int num_servers, size_t file_size);
+std::function<bool()> chunk_cache(unsigned int num_servers, size_t file_size, uint64_t capacity);
+std::function<bool()> multi_file_load(unsigned int num_servers, unsigned int num_files, size_t max_file_size);
+std::function<bool()> has_chunks(unsigned int num_servers, size_t file_size);
+
+// daemon IPC tests
+std::function<bool()> daemon_ipc(unsigned int num_clients, unsigned int num_requests);
+std::function<bool()> daemon_jobs(unsigned int num_servers, unsigned int num_files, size_t file_size);
+std::function<bool()> daemon_progress_events(unsigned int num_servers, size_t file_size, unsigned int num_events);
+std::function<bool()> daemon_fd_passing(unsigned int num_servers, size_t file_size);
+
 // utils
+extern session_metadata dummy_meta;
 Chunk* random_chunk(size_t size);
 void random_file(std::filesystem::path path, size_t size);
 void create_session(Session*& session, unsigned int my_idx, unsigned int other_idx);
+void create_seeded_sessions(Session** sessions, unsigned int num_endpoints);
 void create_chunk(Session* session, Chunk*& chunk, size_t size);
 void verify_chunk(Session* s, Chunk* c, std::mutex& lock, unsigned int& ctr);
 void verify_file(Session* s, std::vector<char>* file_data, std::string dht_filename, 
                   std::mutex& lock, unsigned int& found_ctr, unsigned int& corr_ctr);
-void wait_on_threads(std::vector<std::thread*>& threads);
\ No newline at end of file
+void wait_on_threads(std::vector<std::thread*>& threads);
+unsigned int process_threads();
\ No newline at end of file
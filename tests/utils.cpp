@@ -12,7 +12,7 @@ Chunk* random_chunk(size_t size) {
   for (int i = 0; i < size; i++) {
     data->push_back(static_cast<char>(std::rand() % 0xFF));
   }
-  return new Chunk(key, data, true, std::chrono::system_clock::now());
+  return new Chunk(key, data, true, std::chrono::system_clock::now(), KBUCKET_MAX);
 }
 
 void random_file(std::filesystem::path path, size_t size) {
@@ -30,16 +30,50 @@ void create_session(Session*& session, unsigned int my_idx, unsigned int other_i
   sprintf(my_addr, "localhost:%i", 2000 + my_port);
   sprintf(other_addr, "localhost:%i", 2000 + other_port);
   session = new Session;
-  session->startup(&dummy_meta, std::string(my_addr), std::string(other_addr));
+  session->startup(&dummy_meta, std::string(my_addr), startup_options{{std::string(other_addr)}});
 };
 
+// start sessions (in parallel) that know each other up front, as the founder does
+void create_seeded_sessions(Session** sessions, unsigned int num_endpoints) {
+  std::vector<Peer> peers;
+  for (int i = 0; i < num_endpoints; i++) {
+    char addr[20];
+    sprintf(addr, "localhost:%i", 2000 + i);
+    peers.push_back(Peer(random_key(), std::string(addr)));
+  }
+  std::vector<std::thread*> threads;
+  for (int i = 0; i < num_endpoints; i++) {
+    sessions[i] = new Session;
+    threads.push_back(new std::thread([&peers](Session* session, unsigned int idx) {
+      startup_options options;
+      options.seed_peers = peers;
+      options.seed_peers.erase(options.seed_peers.begin() + idx);
+      options.self_key = peers[idx].key;
+      session->startup(&dummy_meta, peers[idx].endpoint, options);
+    }, sessions[i], i));
+  }
+  wait_on_threads(threads);
+}
+
 
 void create_chunk(Session* session, Chunk*& chunk, size_t size) {
   chunk = random_chunk(size);
   std::vector<char>* data = new std::vector<char>(chunk->data->begin(), chunk->data->end());
-  session->set(chunk->key, data, false);
+  session->set(chunk->key, data);
 };
 
+// number of threads of the process
+unsigned int process_threads() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("Threads:", 0) == 0) {
+      return std::stoul(line.substr(8));
+    }
+  }
+  return 0;
+}
+
 void wait_on_threads(std::vector<std::thread*>& threads) {
   while (threads.size() > 0) {
     threads.back()->join();